@@ -0,0 +1,53 @@
+/*!
+ * External dependencies
+ */
+
+var Binding = require('bindings')('pidaeus.node').GPIO;
+
+/*!
+ * Internal dependencies
+ */
+
+var suite = require('./harness').suite;
+
+/**
+ * Raw native binding: `NAN_METHOD` entry, threadpool
+ * queue and `Execute()` with no JavaScript wrapper.
+ *
+ * @param {Object} context
+ * @param {Function} callback
+ * @api public
+ */
+
+module.exports = function(ctx, cb) {
+  var handle = new Binding;
+  var value = 0;
+
+  function write(next) {
+    handle.write(ctx.pin, value ^= 1, next);
+  }
+
+  function read(next) {
+    handle.read(ctx.input, next);
+  }
+
+  function done(err) {
+    handle.teardown(function(terr) {
+      cb(err || terr);
+    });
+  }
+
+  handle.setup({ simulate: ctx.simulate }, function(err) {
+    if (err) return cb(err);
+    handle.claim(ctx.pin, { direction: 1 }, function(err) {
+      if (err) return done(err);
+      handle.claim(ctx.input, { direction: 0 }, function(err) {
+        if (err) return done(err);
+        suite(ctx, 'binding', [
+            [ 'binding_write', write ]
+          , [ 'binding_read', read ]
+        ], done);
+      });
+    });
+  });
+};
@@ -0,0 +1,72 @@
+/*!
+ * Internal dependencies
+ */
+
+var GPIO = require('..').GPIO;
+var suite = require('./harness').suite;
+
+/*!
+ * Native stand-in that completes synchronously, used
+ * to isolate the cost of the JavaScript wrapper.
+ */
+
+var stub = {
+    read: function(pin, cb) { cb(null, 0); }
+  , write: function(pin, value, cb) { cb(null); }
+};
+
+/**
+ * `GPIO` wrapper: state check, `wrap()`, closure
+ * allocation and argument handling, first over a
+ * synchronous stub then over the native binding.
+ *
+ * @param {Object} context
+ * @param {Function} callback
+ * @api public
+ */
+
+module.exports = function(ctx, cb) {
+  var gpio = new GPIO({ simulate: ctx.simulate });
+  var value = 0;
+
+  function write(next) {
+    gpio.write(ctx.pin, value ^= 1, next);
+  }
+
+  function read(next) {
+    gpio.read(ctx.input, next);
+  }
+
+  function native(err) {
+    gpio._handle = handle;
+    if (err) return done(err);
+    suite(ctx, 'gpio', [
+        [ 'gpio_write', write ]
+      , [ 'gpio_read', read ]
+    ], done);
+  }
+
+  function done(err) {
+    gpio.teardown(function(terr) {
+      cb(err || terr);
+    });
+  }
+
+  var handle;
+
+  gpio.setup(function(err) {
+    if (err) return cb(err);
+    gpio.claim(ctx.pin, { direction: 1 }, function(err) {
+      if (err) return done(err);
+      gpio.claim(ctx.input, { direction: 0 }, function(err) {
+        if (err) return done(err);
+        handle = gpio._handle;
+        gpio._handle = stub;
+        suite(ctx, 'gpio-stub', [
+            [ 'gpio_stub_write', write ]
+          , [ 'gpio_stub_read', read ]
+        ], native);
+      });
+    });
+  });
+};
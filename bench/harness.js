@@ -0,0 +1,192 @@
+/*!
+ * Number of operations used to sample heap growth.
+ */
+
+var HEAP_SAMPLE_OPS = 1000;
+
+/**
+ * ### measure(name, opts, op, cb)
+ *
+ * Run `op` sequentially `opts.iterations` times, timing
+ * each round trip, then run it again `HEAP_SAMPLE_OPS`
+ * times between forced collections to estimate bytes
+ * allocated per operation (requires `--expose-gc`).
+ *
+ * `op(next)` must invoke `next(err)` exactly once, either
+ * synchronously or asynchronously.
+ *
+ * @param {String} name
+ * @param {Object} options `{ iterations, layer }`
+ * @param {Function} op
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @cb {Object} result
+ * @api public
+ */
+
+exports.measure = function(name, opts, op, cb) {
+  var n = opts.iterations;
+  var samples = new Array(n);
+
+  for (var i = 0; i < n; i++) samples[i] = 0;
+
+  loop(op, n, function(i, ns) {
+    samples[i] = ns;
+  }, function(err, elapsed) {
+    if (err) return cb(err);
+    heap(op, function(err, bytes) {
+      if (err) return cb(err);
+      cb(null, result(name, opts.layer, samples, elapsed, bytes));
+    });
+  });
+};
+
+/*!
+ * Run `op` `n` times back to back without growing
+ * the stack when `op` completes synchronously.
+ *
+ * @param {Function} op
+ * @param {Number} count
+ * @param {Function} sample `(index, ns)`
+ * @param {Function} callback `(err, elapsed)`
+ * @api private
+ */
+
+function loop(op, n, sample, cb) {
+  var i = 0;
+  var sync = false;
+  var pending = false;
+  var start = process.hrtime();
+  var t;
+
+  function next(err) {
+    var d = process.hrtime(t);
+    if (err) return cb(err);
+    sample(i, d[0] * 1e9 + d[1]);
+    if (++i === n) return done();
+    if (sync) return pending = true;
+    run();
+  }
+
+  function run() {
+    do {
+      pending = false;
+      sync = true;
+      t = process.hrtime();
+      op(next);
+      sync = false;
+    } while (pending);
+  }
+
+  function done() {
+    var d = process.hrtime(start);
+    cb(null, d[0] * 1e9 + d[1]);
+  }
+
+  run();
+}
+
+/*!
+ * Estimate heap bytes allocated per operation.
+ *
+ * @param {Function} op
+ * @param {Function} callback `(err, bytes)`
+ * @api private
+ */
+
+function heap(op, cb) {
+  if ('function' !== typeof global.gc) return cb(null, null);
+
+  gc();
+  var before = process.memoryUsage().heapUsed;
+
+  loop(op, HEAP_SAMPLE_OPS, function() {}, function(err) {
+    if (err) return cb(err);
+    var after = process.memoryUsage().heapUsed;
+    cb(null, Math.max(0, Math.round((after - before) / HEAP_SAMPLE_OPS)));
+  });
+}
+
+/*!
+ * Build a result object from raw samples.
+ *
+ * @param {String} name
+ * @param {String} layer
+ * @param {Array} samples (ns)
+ * @param {Number} elapsed (ns)
+ * @param {Number|null} heap bytes per op
+ * @return {Object}
+ * @api private
+ */
+
+function result(name, layer, samples, elapsed, bytes) {
+  samples.sort(function(a, b) { return a - b; });
+
+  function pct(q) {
+    return Math.round(samples[Math.floor((samples.length - 1) * q)]);
+  }
+
+  return {
+      name: name
+    , layer: layer
+    , ops: samples.length
+    , elapsed_ns: Math.round(elapsed)
+    , ops_per_sec: Math.round(samples.length / (elapsed / 1e9))
+    , latency_ns: {
+          min: pct(0)
+        , p50: pct(0.5)
+        , p90: pct(0.9)
+        , p99: pct(0.99)
+        , max: pct(1)
+      }
+    , heap_bytes_per_op: bytes
+  };
+}
+
+/**
+ * ### suite(ctx, layer, benches, cb)
+ *
+ * Run each `[ name, op ]` pair in `benches` that
+ * matches `ctx.filter`, appending results to
+ * `ctx.results`.
+ *
+ * @param {Object} context
+ * @param {String} layer
+ * @param {Array} benches
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+exports.suite = function(ctx, layer, benches, cb) {
+  var opts = { iterations: ctx.iterations, layer: layer };
+  var i = 0;
+
+  function next(err, res) {
+    if (err) return cb(err);
+    if (res) ctx.results.push(res);
+    var bench = benches[i++];
+    if (!bench) return cb();
+    if (ctx.filter && 0 !== bench[0].indexOf(ctx.filter)) return next();
+    exports.measure(bench[0], opts, bench[1], next);
+  }
+
+  next();
+};
+
+/**
+ * ### baseline(ctx, cb)
+ *
+ * Cost of the harness itself (timing and sample
+ * storage); subtract from other results.
+ *
+ * @param {Object} context
+ * @param {Function} callback
+ * @api public
+ */
+
+exports.baseline = function(ctx, cb) {
+  exports.suite(ctx, 'harness', [
+    [ 'harness_noop', function(next) { next(); } ]
+  ], cb);
+};
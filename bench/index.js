@@ -0,0 +1,85 @@
+/*!
+ * Suites, in order of increasing abstraction.
+ */
+
+var suites = [
+    require('./harness').baseline
+  , require('./binding')
+  , require('./pin')
+  , require('./gpio')
+  , require('./streams')
+];
+
+/*!
+ * Usage
+ */
+
+var usage = [
+    'usage: node --expose-gc bench [options]'
+  , ''
+  , '  --hardware      use /dev/mem instead of simulated registers'
+  , '  -n <count>      iterations per benchmark (default: 10000)'
+  , '  -o <pin>        output pin (default: 18)'
+  , '  -i <pin>        input pin (default: 23)'
+  , '  -t <ms>         readable stream poll interval (default: 1)'
+  , '  -f <prefix>     only run benchmarks starting with prefix'
+].join('\n');
+
+/*!
+ * Parse arguments into a run context.
+ */
+
+function parse(argv) {
+  var ctx = {
+      simulate: true
+    , iterations: 10000
+    , pin: 18
+    , input: 23
+    , interval: 1
+    , filter: null
+    , results: []
+  };
+
+  for (var i = 0; i < argv.length; i++) {
+    switch (argv[i]) {
+      case '--hardware': ctx.simulate = false; break;
+      case '-n': ctx.iterations = parseInt(argv[++i], 10); break;
+      case '-o': ctx.pin = parseInt(argv[++i], 10); break;
+      case '-i': ctx.input = parseInt(argv[++i], 10); break;
+      case '-t': ctx.interval = parseInt(argv[++i], 10); break;
+      case '-f': ctx.filter = argv[++i]; break;
+      default:
+        console.error(usage);
+        process.exit('-h' === argv[i] ? 0 : 1);
+    }
+  }
+
+  return ctx;
+}
+
+/*!
+ * Run all suites then print a JSON report.
+ */
+
+var ctx = parse(process.argv.slice(2));
+var i = 0;
+
+function next(err) {
+  if (err) {
+    console.error(err.stack || err);
+    process.exit(1);
+  }
+
+  var suite = suites[i++];
+  if (suite) return suite(ctx, next);
+
+  console.log(JSON.stringify({
+      node: process.version
+    , backend: ctx.simulate ? 'sim' : 'mmap'
+    , iterations: ctx.iterations
+    , gc: 'function' === typeof global.gc
+    , results: ctx.results
+  }, null, 2));
+}
+
+next();
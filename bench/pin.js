@@ -0,0 +1,63 @@
+/*!
+ * Internal dependencies
+ */
+
+var GPIO = require('..').GPIO;
+var suite = require('./harness').suite;
+
+/**
+ * Bound `Pin` objects: the sync calls that skip the
+ * threadpool entirely, and the async calls that skip
+ * only the `GPIO` wrapper.
+ *
+ * @param {Object} context
+ * @param {Function} callback
+ * @api public
+ */
+
+module.exports = function(ctx, cb) {
+  var gpio = new GPIO({ simulate: ctx.simulate });
+  var out, input;
+
+  function writeSync(next) {
+    out.toggleSync();
+    next();
+  }
+
+  function readSync(next) {
+    input.readSync();
+    next();
+  }
+
+  function write(next) {
+    out.toggle(next);
+  }
+
+  function read(next) {
+    input.read(next);
+  }
+
+  function done(err) {
+    gpio.teardown(function(terr) {
+      cb(err || terr);
+    });
+  }
+
+  gpio.setup(function(err) {
+    if (err) return cb(err);
+    gpio.pin(ctx.pin, { direction: 1 }, function(err, pin) {
+      if (err) return done(err);
+      out = pin;
+      gpio.pin(ctx.input, { direction: 0 }, function(err, pin) {
+        if (err) return done(err);
+        input = pin;
+        suite(ctx, 'pin', [
+            [ 'pin_write_sync', writeSync ]
+          , [ 'pin_read_sync', readSync ]
+          , [ 'pin_write', write ]
+          , [ 'pin_read', read ]
+        ], done);
+      });
+    });
+  });
+};
@@ -0,0 +1,72 @@
+/*!
+ * Internal dependencies
+ */
+
+var GPIO = require('..').GPIO;
+var suite = require('./harness').suite;
+
+/**
+ * Readable and Writable streams on top of the
+ * `GPIO` wrapper. The readable stream is paced by its
+ * poll interval (`ctx.interval`), so its latency is
+ * mostly timer delay. `stream_write_buffer` writes a
+ * 64 value pattern per operation in one native call.
+ *
+ * @param {Object} context
+ * @param {Function} callback
+ * @api public
+ */
+
+module.exports = function(ctx, cb) {
+  var gpio = new GPIO({ simulate: ctx.simulate });
+  var value = 0;
+  var pattern = new Buffer(64);
+  var writable, readable, i;
+
+  for (i = 0; i < pattern.length; i++) pattern[i] = i & 1;
+
+  function write(next) {
+    writable.write(value ^= 1, next);
+  }
+
+  function writeBuffer(next) {
+    writable.write(pattern, next);
+  }
+
+  function read(next) {
+    readable.once('data', function() {
+      next();
+    });
+  }
+
+  function close(err) {
+    if (err) return done(err);
+    writable.once('release', function() {
+      readable.resume();
+      readable.close(done);
+    });
+    writable.end();
+  }
+
+  function done(err) {
+    gpio.teardown(function(terr) {
+      cb(err || terr);
+    });
+  }
+
+  gpio.setup(function(err) {
+    if (err) return cb(err);
+    writable = gpio.createWriteStream(ctx.pin);
+    readable = gpio.createReadStream(ctx.input, ctx.interval);
+    readable.once('claim', function() {
+      writable.write(0, function(err) {
+        if (err) return done(err);
+        suite(ctx, 'stream', [
+            [ 'stream_write', write ]
+          , [ 'stream_write_buffer', writeBuffer ]
+          , [ 'stream_read', read ]
+        ], close);
+      });
+    });
+  });
+};
@@ -5,7 +5,13 @@
       "sources" : [
         "src/pidaeus.cc", 
         "src/gpio.cc",
-        "src/gpio_async.cc"
+        "src/gpio_async.cc",
+        "src/gpio_client.cc",
+        "src/gpio_queue.cc",
+        "src/gpio_event_pump.cc",
+        "src/gpio_pin.cc",
+        "src/gpio_sampler.cc",
+        "src/gpio_stats.cc"
       ],
       "dependencies" : [
         "deps/libpi/libpi.gyp:pi"
@@ -0,0 +1,241 @@
+/*
+ * libpi - Benchmark harness
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Defaults
+ */
+
+#define BENCH_ITERATIONS 1000000
+#define BENCH_BATCH      64
+#define BENCH_PIN_OUT    18
+#define BENCH_PIN_IN     23
+
+/*
+ * Monotonic clock in nanoseconds.
+ */
+
+uint64_t
+bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Check a benchmark name against the `-f` prefix filter.
+ */
+
+int
+bench_enabled(bench_ctx_t *ctx, const char *name) {
+  if (ctx->filter == NULL) return 1;
+  return strncmp(ctx->filter, name, strlen(ctx->filter)) == 0;
+}
+
+/*
+ * Allocate a result with room for `cap` samples.
+ */
+
+bench_result_t*
+bench_result_new(const char *name, size_t cap, unsigned int batch) {
+  bench_result_t *res = calloc(1, sizeof(bench_result_t));
+  if (res == NULL) return NULL;
+  res->samples = malloc(sizeof(uint64_t) * (cap ? cap : 1));
+  if (res->samples == NULL) {
+    free(res);
+    return NULL;
+  }
+
+  res->name = name;
+  res->unit = "latency_ns";
+  res->cap = cap;
+  res->batch = batch ? batch : 1;
+  return res;
+}
+
+/*
+ * Record one sample, dropping it if the result is full.
+ */
+
+void
+bench_result_sample(bench_result_t *res, uint64_t ns) {
+  if (res->nsamples < res->cap) res->samples[res->nsamples++] = ns;
+}
+
+static int
+bench__cmp(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t
+bench__pct(bench_result_t *res, double q) {
+  if (res->nsamples == 0) return 0;
+  return res->samples[(size_t)((res->nsamples - 1) * q)];
+}
+
+static void
+bench__sep(bench_ctx_t *ctx) {
+  fprintf(ctx->out, "%s\n    ", ctx->emitted++ ? "," : "");
+}
+
+/*
+ * Write a result as a JSON object and free it.
+ */
+
+void
+bench_emit(bench_ctx_t *ctx, bench_result_t *res) {
+  double secs = res->elapsed_ns / 1e9;
+  double rate = secs > 0 ? res->ops / secs : 0;
+
+  qsort(res->samples, res->nsamples, sizeof(uint64_t), bench__cmp);
+
+  bench__sep(ctx);
+  fprintf(ctx->out,
+      "{ \"name\": \"%s\", \"ops\": %llu, \"batch\": %u"
+      ", \"elapsed_ns\": %llu, \"ops_per_sec\": %.1f"
+      ", \"%s\": { \"samples\": %lu, \"min\": %llu, \"p50\": %llu"
+      ", \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu } }"
+    , res->name
+    , (unsigned long long)res->ops
+    , res->batch
+    , (unsigned long long)res->elapsed_ns
+    , rate
+    , res->unit
+    , (unsigned long)res->nsamples
+    , (unsigned long long)bench__pct(res, 0.0)
+    , (unsigned long long)bench__pct(res, 0.5)
+    , (unsigned long long)bench__pct(res, 0.9)
+    , (unsigned long long)bench__pct(res, 0.99)
+    , (unsigned long long)bench__pct(res, 0.999)
+    , (unsigned long long)bench__pct(res, 1.0));
+
+  free(res->samples);
+  free(res);
+}
+
+/*
+ * Record a benchmark that could not run on this backend.
+ */
+
+void
+bench_skip(bench_ctx_t *ctx, const char *name, const char *reason) {
+  bench__sep(ctx);
+  fprintf(ctx->out, "{ \"name\": \"%s\", \"skipped\": \"%s\" }", name, reason);
+}
+
+static void
+usage(const char *prog) {
+  fprintf(stderr,
+      "usage: %s [options]\n"
+      "\n"
+      "  -s          use simulated registers (default when /dev/mem is unavailable)\n"
+      "  -m          require hardware registers via /dev/mem\n"
+      "  -n <count>  iterations per benchmark (default: %d)\n"
+      "  -b <count>  operations per latency sample (default: %d)\n"
+      "  -o <pin>    output pin (default: %d)\n"
+      "  -i <pin>    input pin (default: %d)\n"
+      "  -l          output pin is wired to input pin (enables edge suites)\n"
+      "  -c <cpu>    pin the benchmark to a cpu\n"
+      "  -r <prio>   run under SCHED_FIFO at prio\n"
+      "  -L          lock memory and prefault the stack\n"
+      "  -f <prefix> only run benchmarks starting with prefix\n"
+    , prog, BENCH_ITERATIONS, BENCH_BATCH, BENCH_PIN_OUT, BENCH_PIN_IN);
+}
+
+int
+main(int argc, char **argv) {
+  bench_ctx_t ctx;
+  pi_rt_config_t rt;
+  int mode = 0;
+  int opt;
+
+  memset(&ctx, 0, sizeof(ctx));
+  memset(&rt, 0, sizeof(rt));
+  ctx.iterations = BENCH_ITERATIONS;
+  ctx.batch = BENCH_BATCH;
+  ctx.pin_out = BENCH_PIN_OUT;
+  ctx.pin_in = BENCH_PIN_IN;
+  ctx.cpu = -1;
+  ctx.out = stdout;
+
+  while ((opt = getopt(argc, argv, "smn:b:o:i:lc:r:Lf:h")) != -1) {
+    switch (opt) {
+      case 's': mode = 's'; break;
+      case 'm': mode = 'm'; break;
+      case 'n': ctx.iterations = strtoul(optarg, NULL, 10); break;
+      case 'b': ctx.batch = strtoul(optarg, NULL, 10); break;
+      case 'o': ctx.pin_out = strtoul(optarg, NULL, 10); break;
+      case 'i': ctx.pin_in = strtoul(optarg, NULL, 10); break;
+      case 'l': ctx.loopback = 1; break;
+      case 'c': ctx.cpu = strtol(optarg, NULL, 10); break;
+      case 'r': rt.priority = strtol(optarg, NULL, 10); break;
+      case 'L': rt.lock_memory = 1; rt.prefault_stack = 64 * 1024; break;
+      case 'f': ctx.filter = optarg; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (ctx.batch == 0) ctx.batch = 1;
+  if (ctx.iterations < ctx.batch) ctx.iterations = ctx.batch;
+
+  if (ctx.cpu >= 0 && ctx.cpu < 32) rt.cpus = 1u << ctx.cpu;
+  ctx.realtime = pi_rt_apply(&rt);
+
+  if (ctx.realtime & PI_RT_AFFINITY_FAILED) {
+    fprintf(stderr, "warning: cannot pin to cpu %d\n", ctx.cpu);
+    ctx.cpu = -1;
+  }
+  if (ctx.realtime & PI_RT_SCHED_FAILED) {
+    fprintf(stderr, "warning: cannot use SCHED_FIFO priority %d\n", rt.priority);
+  }
+  if (ctx.realtime & PI_RT_MLOCK_FAILED) {
+    fprintf(stderr, "warning: cannot lock memory\n");
+  }
+
+  ctx.closure = pi_default_closure();
+
+  if (mode != 's' && pi_gpio_setup(ctx.closure) == 0) {
+    ctx.backend = "mmap";
+  } else if (mode != 'm' && pi_gpio_setup_sim(ctx.closure) == 0) {
+    ctx.backend = "sim";
+  } else {
+    fprintf(stderr, "error: gpio setup failed\n");
+    pi_closure_delete(ctx.closure);
+    return 1;
+  }
+
+  fprintf(ctx.out,
+      "{\n  \"backend\": \"%s\",\n  \"soc\": \"%s\",\n  \"revision\": %d,\n  \"cpu\": %d"
+      ",\n  \"priority\": %d,\n  \"realtime_status\": %d"
+      ",\n  \"iterations\": %lu,\n  \"batch\": %u,\n  \"results\": ["
+    , ctx.backend, pi_board()->soc_name, ctx.closure->revision, ctx.cpu
+    , (ctx.realtime & PI_RT_SCHED_FAILED) ? 0 : rt.priority, ctx.realtime
+    , ctx.iterations, ctx.batch);
+
+  bench_suite_gpio(&ctx);
+  bench_suite_event(&ctx);
+  bench_suite_timer(&ctx);
+  bench_suite_wave(&ctx);
+
+  fprintf(ctx.out, "\n  ]\n}\n");
+
+  pi_gpio_teardown(ctx.closure);
+  pi_closure_delete(ctx.closure);
+  return 0;
+}
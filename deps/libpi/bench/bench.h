@@ -0,0 +1,89 @@
+/*
+ * libpi - Benchmark harness
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#ifndef PI_BENCH_H
+#define PI_BENCH_H
+
+#include "pi.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Run context shared by all suites.
+ */
+
+typedef struct {
+  pi_closure_t *closure;
+  const char *backend;
+  unsigned long iterations;
+  unsigned int batch;
+  pi_gpio_pin_t pin_out;
+  pi_gpio_pin_t pin_in;
+  int loopback;
+  int cpu;
+  int realtime;
+  const char *filter;
+  FILE *out;
+  int emitted;
+} bench_ctx_t;
+
+/*
+ * Result of a single benchmark. Samples are latencies
+ * in nanoseconds, one per measured batch.
+ */
+
+typedef struct {
+  const char *name;
+  const char *unit;
+  uint64_t ops;
+  uint64_t elapsed_ns;
+  unsigned int batch;
+  uint64_t *samples;
+  size_t nsamples;
+  size_t cap;
+} bench_result_t;
+
+/*
+ * bench.c
+ */
+
+uint64_t
+bench_now(void);
+
+int
+bench_enabled(bench_ctx_t *ctx, const char *name);
+
+bench_result_t*
+bench_result_new(const char *name, size_t cap, unsigned int batch);
+
+void
+bench_result_sample(bench_result_t *res, uint64_t ns);
+
+void
+bench_emit(bench_ctx_t *ctx, bench_result_t *res);
+
+void
+bench_skip(bench_ctx_t *ctx, const char *name, const char *reason);
+
+/*
+ * Suites
+ */
+
+void
+bench_suite_gpio(bench_ctx_t *ctx);
+
+void
+bench_suite_event(bench_ctx_t *ctx);
+
+void
+bench_suite_timer(bench_ctx_t *ctx);
+
+void
+bench_suite_wave(bench_ctx_t *ctx);
+
+#endif /* PI_BENCH_H */
@@ -0,0 +1,308 @@
+/*
+ * libpi - Edge event benchmarks
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "bench.h"
+#include "common.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Give up on an edge after one second.
+ */
+
+#define EDGE_TIMEOUT_NS 1000000000ULL
+#define EDGE_MAX_SAMPLES 10000
+
+/*
+ * State shared between the injecting thread and the
+ * detecting thread.
+ */
+
+typedef struct {
+  bench_ctx_t *ctx;
+  pi_gpio_handle_t *in;
+  pi_gpio_handle_t *listener;
+  volatile int stop;
+  volatile int armed;
+  volatile unsigned long seq;
+  volatile uint64_t detected;
+} edge_state_t;
+
+static void*
+edge_poller(void *arg) {
+  edge_state_t *st = arg;
+  pi_gpio_value_t last = pi_gpio_read(st->in);
+
+  while (!st->stop) {
+    pi_gpio_value_t value = pi_gpio_read(st->in);
+    if (value == last) continue;
+    st->detected = bench_now();
+    last = value;
+    __sync_synchronize();
+    st->seq++;
+  }
+
+  return NULL;
+}
+
+static void*
+edge_listener(void *arg) {
+  edge_state_t *st = arg;
+
+  while (!st->stop) {
+    st->armed = 1;
+    int res = pi_gpio_listen(st->listener, PI_GPIO_EDGE_BOTH);
+    st->armed = 0;
+    if (res < 0) break;
+    st->detected = bench_now();
+    __sync_synchronize();
+    st->seq++;
+  }
+
+  return NULL;
+}
+
+/*
+ * Drive the input to `value` and return the time it was done.
+ */
+
+static uint64_t
+edge_inject(edge_state_t *st, pi_gpio_handle_t *out, pi_gpio_value_t value) {
+  uint64_t now = bench_now();
+  if (out == NULL) {
+    pi_gpio_sim_set_level(st->ctx->closure, st->ctx->pin_in, value);
+  } else {
+    pi_gpio_write(out, value);
+  }
+  return now;
+}
+
+/*
+ * Wait for the detecting thread to see edge `seq`.
+ */
+
+static int
+edge_wait(edge_state_t *st, unsigned long seq, uint64_t since) {
+  while (st->seq < seq) {
+    if (bench_now() - since > EDGE_TIMEOUT_NS) return -1;
+  }
+  __sync_synchronize();
+  return 0;
+}
+
+static unsigned long
+edge_count(bench_ctx_t *ctx) {
+  unsigned long n = ctx->iterations / 100;
+  if (n < 100) n = 100;
+  return n > EDGE_MAX_SAMPLES ? EDGE_MAX_SAMPLES : n;
+}
+
+/*
+ * Time from driving a level to a busy-polling reader
+ * observing it. On hardware this needs the output pin wired
+ * to the input pin.
+ */
+
+static void
+bench_edge_poll(bench_ctx_t *ctx) {
+  edge_state_t st = { 0 };
+  pi_gpio_handle_t *out = NULL;
+  pthread_t thread;
+  unsigned long count = edge_count(ctx);
+  unsigned long n;
+  uint64_t start;
+
+  if (!ctx->closure->simulated && !ctx->loopback) {
+    bench_skip(ctx, "edge_poll", "requires -l with output wired to input");
+    return;
+  }
+
+  st.ctx = ctx;
+  st.in = pi_gpio_claim_input(ctx->closure, ctx->pin_in, PI_GPIO_PULL_NONE);
+  if (!ctx->closure->simulated) {
+    out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  } else {
+    pi_gpio_sim_set_level(ctx->closure, ctx->pin_in, PI_GPIO_LOW);
+  }
+
+  pthread_create(&thread, NULL, edge_poller, &st);
+  pi_sleep_ms(10);
+
+  bench_result_t *res = bench_result_new("edge_poll", count, 1);
+  start = bench_now();
+
+  for (n = 0; n < count; n++) {
+    uint64_t at = edge_inject(&st, out, n & 1 ? PI_GPIO_LOW : PI_GPIO_HIGH);
+    if (edge_wait(&st, n + 1, at) < 0) break;
+    bench_result_sample(res, st.detected - at);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = n;
+  st.stop = 1;
+  pthread_join(thread, NULL);
+
+  if (out) {
+    pi_gpio_write(out, PI_GPIO_LOW);
+    pi_gpio_release(out);
+  }
+
+  pi_gpio_release(st.in);
+
+  if (n < count) {
+    free(res->samples);
+    free(res);
+    bench_skip(ctx, "edge_poll", "edge not observed; check wiring");
+    return;
+  }
+
+  bench_emit(ctx, res);
+}
+
+/*
+ * Time from driving a level to a blocking sysfs listener
+ * waking. Hardware and loopback wiring only.
+ */
+
+static void
+bench_edge_sysfs(bench_ctx_t *ctx) {
+  edge_state_t st = { 0 };
+  pthread_t thread;
+  unsigned long count = edge_count(ctx) / 10;
+  unsigned long n;
+  uint64_t start;
+
+  if (ctx->closure->simulated || !ctx->loopback) {
+    bench_skip(ctx, "edge_sysfs", "requires hardware and -l with output wired to input");
+    return;
+  }
+
+  st.ctx = ctx;
+  st.listener = pi_gpio_listener_claim(ctx->pin_in);
+  if (st.listener->error) {
+    pi_gpio_listener_release(st.listener);
+    bench_skip(ctx, "edge_sysfs", "cannot export input pin");
+    return;
+  }
+
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  pthread_create(&thread, NULL, edge_listener, &st);
+
+  bench_result_t *res = bench_result_new("edge_sysfs", count, 1);
+  start = bench_now();
+
+  for (n = 0; n < count; n++) {
+    while (!st.armed);
+    pi_sleep_ms(1);
+    uint64_t at = edge_inject(&st, out, n & 1 ? PI_GPIO_LOW : PI_GPIO_HIGH);
+    if (edge_wait(&st, n + 1, at) < 0) break;
+    bench_result_sample(res, st.detected - at);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = n;
+
+  // wake the listener one last time so it can exit
+  st.stop = 1;
+  uint64_t since = bench_now();
+  while (!st.armed && bench_now() - since < EDGE_TIMEOUT_NS);
+  if (st.armed) {
+    pi_sleep_ms(1);
+    pi_gpio_write(out, n & 1 ? PI_GPIO_LOW : PI_GPIO_HIGH);
+  }
+  pthread_join(thread, NULL);
+
+  pi_gpio_write(out, PI_GPIO_LOW);
+  pi_gpio_release(out);
+  pi_gpio_listener_release(st.listener);
+  bench_emit(ctx, res);
+}
+
+/*
+ * Time from driving a level to the sampler recording the
+ * change, polling at 20kHz. Latency is bounded below by
+ * the sample period.
+ */
+
+#define SAMPLER_RATE 20000
+
+static void
+bench_edge_sampler(bench_ctx_t *ctx) {
+  edge_state_t st = { 0 };
+  pi_gpio_handle_t *out = NULL;
+  pi_sampler_t *sampler;
+  pi_sample_t sample;
+  unsigned long count = edge_count(ctx);
+  unsigned long n;
+  uint64_t start;
+
+  if (!ctx->closure->simulated && !ctx->loopback) {
+    bench_skip(ctx, "edge_sampler", "requires -l with output wired to input");
+    return;
+  }
+
+  if (ctx->pin_in >= 32) {
+    bench_skip(ctx, "edge_sampler", "input pin must be in bank 0");
+    return;
+  }
+
+  st.ctx = ctx;
+  st.in = pi_gpio_claim_input(ctx->closure, ctx->pin_in, PI_GPIO_PULL_NONE);
+  if (!ctx->closure->simulated) {
+    out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  } else {
+    pi_gpio_sim_set_level(ctx->closure, ctx->pin_in, PI_GPIO_LOW);
+  }
+
+  sampler = pi_sampler_new(ctx->closure, SAMPLER_RATE, 64, NULL, NULL);
+  pi_sampler_start(sampler, 1 << ctx->pin_in);
+  pi_sleep_ms(10);
+
+  bench_result_t *res = bench_result_new("edge_sampler", count, 1);
+  start = bench_now();
+
+  for (n = 0; n < count; n++) {
+    uint64_t at = edge_inject(&st, out, n & 1 ? PI_GPIO_LOW : PI_GPIO_HIGH);
+    while (pi_sampler_read(sampler, &sample, 1) == 0) {
+      if (bench_now() - at > EDGE_TIMEOUT_NS) break;
+    }
+    if (bench_now() - at > EDGE_TIMEOUT_NS) break;
+    bench_result_sample(res, sample.time - at);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = n;
+  pi_sampler_delete(sampler);
+
+  if (out) {
+    pi_gpio_write(out, PI_GPIO_LOW);
+    pi_gpio_release(out);
+  }
+
+  pi_gpio_release(st.in);
+
+  if (n < count) {
+    free(res->samples);
+    free(res);
+    bench_skip(ctx, "edge_sampler", "edge not observed; check wiring");
+    return;
+  }
+
+  bench_emit(ctx, res);
+}
+
+/*
+ * Edge detection latency.
+ */
+
+void
+bench_suite_event(bench_ctx_t *ctx) {
+  if (bench_enabled(ctx, "edge_poll")) bench_edge_poll(ctx);
+  if (bench_enabled(ctx, "edge_sysfs")) bench_edge_sysfs(ctx);
+  if (bench_enabled(ctx, "edge_sampler")) bench_edge_sampler(ctx);
+}
@@ -0,0 +1,396 @@
+/*
+ * libpi - GPIO benchmarks
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "bench.h"
+#include "pi_fast.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Run `body` ctx->iterations times, timing it in batches of
+ * ctx->batch so clock reads do not dominate fast operations.
+ * Each sample is the mean latency of one batch.
+ */
+
+#define BENCH_BATCHED(ctx, res, i, body)                                      \
+  do {                                                                        \
+    unsigned long n__ = (ctx)->iterations / (ctx)->batch;                     \
+    unsigned long b__;                                                        \
+    unsigned int i;                                                           \
+    uint64_t start__ = bench_now();                                           \
+    for (b__ = 0; b__ < n__; b__++) {                                         \
+      uint64_t t__ = bench_now();                                             \
+      for (i = 0; i < (ctx)->batch; i++) { body; }                            \
+      bench_result_sample((res), (bench_now() - t__) / (ctx)->batch);         \
+    }                                                                         \
+    (res)->elapsed_ns = bench_now() - start__;                                \
+    (res)->ops = (uint64_t)n__ * (ctx)->batch;                                \
+  } while (0)
+
+/*
+ * Run `body` `count` times, timing every call.
+ */
+
+#define BENCH_EACH(res, count, body)                                          \
+  do {                                                                        \
+    unsigned long c__;                                                        \
+    uint64_t start__ = bench_now();                                           \
+    for (c__ = 0; c__ < (count); c__++) {                                     \
+      uint64_t t__ = bench_now();                                             \
+      body;                                                                   \
+      bench_result_sample((res), bench_now() - t__);                          \
+    }                                                                         \
+    (res)->elapsed_ns = bench_now() - start__;                                \
+    (res)->ops = (count);                                                     \
+  } while (0)
+
+/*
+ * Slow operations (sleeps, allocation) run fewer times.
+ */
+
+static unsigned long
+slow_count(bench_ctx_t *ctx) {
+  unsigned long n = ctx->iterations / 100;
+  return n < 100 ? 100 : n;
+}
+
+static void
+bench_write(bench_ctx_t *ctx) {
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  bench_result_t *res = bench_result_new("gpio_write", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, pi_gpio_write(out, i & 1 ? PI_GPIO_LOW : PI_GPIO_HIGH));
+  pi_gpio_write(out, PI_GPIO_LOW);
+  pi_gpio_release(out);
+  bench_emit(ctx, res);
+}
+
+/*
+ * pi_fast_write() with the map hoisted; the gap to
+ * gpio_write is the per-call handle and trace overhead.
+ */
+
+static void
+bench_write_fast(bench_ctx_t *ctx) {
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  volatile uint32_t *map = pi_fast_map(ctx->closure);
+  unsigned int pin = ctx->pin_out;
+  bench_result_t *res = bench_result_new("gpio_write_fast", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, pi_fast_write(map, pin, !(i & 1)));
+  pi_gpio_write(out, PI_GPIO_LOW);
+  pi_gpio_release(out);
+  bench_emit(ctx, res);
+}
+
+static void
+bench_read(bench_ctx_t *ctx) {
+  volatile pi_gpio_value_t sink;
+  pi_gpio_handle_t *in = pi_gpio_claim_input(ctx->closure, ctx->pin_in, PI_GPIO_PULL_NONE);
+  bench_result_t *res = bench_result_new("gpio_read", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, sink = pi_gpio_read(in));
+  (void)sink;
+  pi_gpio_release(in);
+  bench_emit(ctx, res);
+}
+
+static void
+bench_write_mask(bench_ctx_t *ctx) {
+  uint32_t mask = 1 << (ctx->pin_out % 32);
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  bench_result_t *res = bench_result_new("gpio_write_mask", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, pi_gpio_write_mask(ctx->closure, i & 1 ? 0 : mask, i & 1 ? mask : 0));
+  pi_gpio_write(out, PI_GPIO_LOW);
+  pi_gpio_release(out);
+  bench_emit(ctx, res);
+}
+
+/*
+ * One pi_gpio_write_sequence() call per batch, no period;
+ * samples are per-value latency like BENCH_BATCHED.
+ */
+
+static void
+bench_write_sequence(bench_ctx_t *ctx) {
+  unsigned long n = ctx->iterations / ctx->batch;
+  uint8_t *values = malloc(ctx->batch);
+  unsigned long b;
+  unsigned int i;
+  uint64_t start;
+
+  if (values == NULL) {
+    bench_skip(ctx, "gpio_write_sequence", "out of memory");
+    return;
+  }
+  for (i = 0; i < ctx->batch; i++) values[i] = !(i & 1);
+
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  bench_result_t *res = bench_result_new("gpio_write_sequence", n, ctx->batch);
+  start = bench_now();
+  for (b = 0; b < n; b++) {
+    uint64_t t = bench_now();
+    pi_gpio_write_sequence(out, values, ctx->batch, 0);
+    bench_result_sample(res, (bench_now() - t) / ctx->batch);
+  }
+  res->elapsed_ns = bench_now() - start;
+  res->ops = (uint64_t)n * ctx->batch;
+
+  pi_gpio_write(out, PI_GPIO_LOW);
+  pi_gpio_release(out);
+  free(values);
+  bench_emit(ctx, res);
+}
+
+static void
+bench_read_mask(bench_ctx_t *ctx) {
+  volatile uint32_t sink;
+  bench_result_t *res = bench_result_new("gpio_read_mask", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, sink = pi_gpio_read_mask(ctx->closure));
+  (void)sink;
+  bench_emit(ctx, res);
+}
+
+/*
+ * Read-and-clear of the event detect latches with an edge
+ * enabled on the input pin.
+ */
+
+static void
+bench_poll_events(bench_ctx_t *ctx) {
+  volatile uint32_t sink;
+  pi_gpio_handle_t *in = pi_gpio_claim_input(ctx->closure, ctx->pin_in, PI_GPIO_PULL_NONE);
+  pi_gpio_set_edge_detect(in, PI_GPIO_DETECT_RISING | PI_GPIO_DETECT_FALLING);
+  bench_result_t *res = bench_result_new("gpio_poll_events", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, sink = pi_gpio_poll_events(ctx->closure));
+  (void)sink;
+  pi_gpio_release(in);
+  bench_emit(ctx, res);
+}
+
+/*
+ * One rule table evaluation with an input change each
+ * time, so every call drives an output.
+ */
+
+static void
+bench_route_eval(bench_ctx_t *ctx) {
+  uint32_t in = 1 << (ctx->pin_in % 32);
+  pi_route_rule_t rule = { PI_ROUTE_COPY, in, 0, ctx->pin_out % 32, PI_GPIO_EDGE_NONE };
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  pi_route_t *route = pi_route_new(ctx->closure, &rule, 1);
+  bench_result_t *res = bench_result_new("route_eval", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, pi_route_eval(route, i & 1 ? in : 0));
+  pi_route_delete(route);
+  pi_gpio_write(out, PI_GPIO_LOW);
+  pi_gpio_release(out);
+  bench_emit(ctx, res);
+}
+
+/*
+ * A SET/CLR toggle loop run by the program runner; one
+ * run per batch, samples are per loop iteration.
+ */
+
+static void
+bench_program_loop(bench_ctx_t *ctx) {
+  uint32_t mask = 1 << (ctx->pin_out % 32);
+  pi_prog_insn_t code[] = {
+      { PI_PROG_LOAD, 0, 0, ctx->batch }
+    , { PI_PROG_SET, 0, 0, mask }
+    , { PI_PROG_CLR, 0, 0, mask }
+    , { PI_PROG_LOOP, 0, 0, 1 }
+  };
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  pi_program_t *program = pi_program_new(ctx->closure, code, 4, 0);
+  unsigned long n = ctx->iterations / ctx->batch;
+  bench_result_t *res = bench_result_new("program_loop", n, ctx->batch);
+  uint64_t start = bench_now();
+  unsigned long b;
+
+  for (b = 0; b < n; b++) {
+    uint64_t t = bench_now();
+    pi_program_run(program);
+    bench_result_sample(res, (bench_now() - t) / ctx->batch);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = (uint64_t) n * ctx->batch;
+  pi_program_delete(program);
+  pi_gpio_release(out);
+  bench_emit(ctx, res);
+}
+
+/*
+ * Queue a write somewhere in the next second and cancel
+ * it; covers placement on every wheel level.
+ */
+
+static void
+bench_sched_write(bench_ctx_t *ctx) {
+  pi_sched_t *sched = pi_sched_new(ctx->closure, 1, 0);
+  uint64_t base = pi_sched_now() + 1000000000ULL;
+  bench_result_t *res = bench_result_new("sched_write_cancel", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, pi_sched_cancel(sched
+    , pi_sched_write(sched, base + (i * 7919ULL) % 1000000000ULL, ctx->pin_out, i & 1)));
+  pi_sched_delete(sched);
+  bench_emit(ctx, res);
+}
+
+/*
+ * Client to daemon round trip through shared memory at
+ * the default scan rate; mostly the wait for the next
+ * scan.
+ */
+
+static void
+bench_daemon_ping(bench_ctx_t *ctx) {
+  unsigned long count = slow_count(ctx);
+  pi_daemon_cmd_t ping = { 0, PI_DAEMON_PING, 0, 0, 0, 0, 0 };
+  pi_daemon_t *daemon = pi_daemon_new(ctx->closure, "/libpi-bench", NULL);
+  pi_client_t *client;
+  bench_result_t *res;
+
+  if (daemon == NULL || pi_daemon_start(daemon) != 0) {
+    if (daemon != NULL) pi_daemon_delete(daemon);
+    bench_skip(ctx, "daemon_ping", "cannot create shared memory");
+    return;
+  }
+
+  client = pi_client_connect("/libpi-bench");
+  res = bench_result_new("daemon_ping", count, 1);
+  BENCH_EACH(res, count, pi_client_wait(client, (uint32_t) pi_client_submit(client, &ping), 0));
+  pi_client_disconnect(client);
+  pi_daemon_delete(daemon);
+  bench_emit(ctx, res);
+}
+
+/*
+ * gpio_write with a journal attached; the gap to
+ * gpio_write is the cost of recording.
+ */
+
+static void
+bench_write_journal(bench_ctx_t *ctx) {
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  pi_journal_t *journal = pi_journal_new(ctx->iterations);
+  bench_result_t *res = bench_result_new("gpio_write_journal", ctx->iterations / ctx->batch, ctx->batch);
+  pi_journal_attach(ctx->closure, journal);
+  BENCH_BATCHED(ctx, res, i, pi_gpio_write(out, i & 1 ? PI_GPIO_LOW : PI_GPIO_HIGH));
+  pi_journal_detach(ctx->closure);
+  pi_journal_delete(journal);
+  pi_gpio_write(out, PI_GPIO_LOW);
+  pi_gpio_release(out);
+  bench_emit(ctx, res);
+}
+
+/*
+ * Replay a journal of ctx->batch mask writes back to back;
+ * one replay per batch, samples are per op.
+ */
+
+static void
+bench_journal_replay(bench_ctx_t *ctx) {
+  uint32_t mask = 1 << (ctx->pin_out % 32);
+  pi_gpio_handle_t *out = pi_gpio_claim_output(ctx->closure, ctx->pin_out, PI_GPIO_LOW);
+  pi_journal_t *journal = pi_journal_new(ctx->batch);
+  unsigned long n = ctx->iterations / ctx->batch;
+  bench_result_t *res = bench_result_new("journal_replay", n, ctx->batch);
+  uint64_t start;
+  unsigned long b;
+  unsigned int i;
+
+  pi_journal_attach(ctx->closure, journal);
+  for (i = 0; i < ctx->batch; i++) {
+    pi_gpio_write_mask(ctx->closure, i & 1 ? 0 : mask, i & 1 ? mask : 0);
+  }
+  pi_journal_detach(ctx->closure);
+
+  start = bench_now();
+  for (b = 0; b < n; b++) {
+    uint64_t t = bench_now();
+    pi_journal_replay(ctx->closure, journal, 0, NULL);
+    bench_result_sample(res, (bench_now() - t) / ctx->batch);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = (uint64_t) n * ctx->batch;
+  pi_journal_delete(journal);
+  pi_gpio_write(out, PI_GPIO_LOW);
+  pi_gpio_release(out);
+  bench_emit(ctx, res);
+}
+
+/*
+ * Encode one transition per sample into a capture file,
+ * with gaps and pins varied so no repeat record forms.
+ */
+
+static void
+bench_capture_append(bench_ctx_t *ctx) {
+  const char *path = "/tmp/libpi-bench.pic";
+  pi_capture_t *capture = pi_capture_new(path, 0xff, 0, 0, NULL);
+  pi_sample_t sample = { 0, 0, 0 };
+  bench_result_t *res;
+
+  if (capture == NULL) {
+    bench_skip(ctx, "capture_append", "cannot create capture file");
+    return;
+  }
+
+  res = bench_result_new("capture_append", ctx->iterations / ctx->batch, ctx->batch);
+  BENCH_BATCHED(ctx, res, i, {
+    sample.time += 1000 + (i & 0x3ff);
+    sample.levels ^= 1u << (i & 7);
+    pi_capture_append(capture, &sample, 1);
+  });
+  pi_capture_close(capture);
+  unlink(path);
+  bench_emit(ctx, res);
+}
+
+static void
+bench_set_pull(bench_ctx_t *ctx) {
+  unsigned long count = slow_count(ctx);
+  pi_gpio_handle_t *in = pi_gpio_claim_input(ctx->closure, ctx->pin_in, PI_GPIO_PULL_NONE);
+  bench_result_t *res = bench_result_new("gpio_set_pull", count, 1);
+  BENCH_EACH(res, count, pi_gpio_set_pull(in, c__ & 1 ? PI_GPIO_PULL_DOWN : PI_GPIO_PULL_UP));
+  pi_gpio_set_pull(in, PI_GPIO_PULL_NONE);
+  pi_gpio_release(in);
+  bench_emit(ctx, res);
+}
+
+static void
+bench_claim_release(bench_ctx_t *ctx) {
+  unsigned long count = slow_count(ctx);
+  bench_result_t *res = bench_result_new("gpio_claim_release", count, 1);
+  BENCH_EACH(res, count, pi_gpio_release(pi_gpio_claim_with_args(ctx->closure
+    , ctx->pin_in, PI_GPIO_MODE_INPUT, PI_GPIO_PULL_NONE)));
+  bench_emit(ctx, res);
+}
+
+/*
+ * Register access and pin management.
+ */
+
+void
+bench_suite_gpio(bench_ctx_t *ctx) {
+  if (bench_enabled(ctx, "gpio_write")) bench_write(ctx);
+  if (bench_enabled(ctx, "gpio_write_fast")) bench_write_fast(ctx);
+  if (bench_enabled(ctx, "gpio_read")) bench_read(ctx);
+  if (bench_enabled(ctx, "gpio_write_mask")) bench_write_mask(ctx);
+  if (bench_enabled(ctx, "gpio_write_sequence")) bench_write_sequence(ctx);
+  if (bench_enabled(ctx, "gpio_read_mask")) bench_read_mask(ctx);
+  if (bench_enabled(ctx, "gpio_poll_events")) bench_poll_events(ctx);
+  if (bench_enabled(ctx, "gpio_set_pull")) bench_set_pull(ctx);
+  if (bench_enabled(ctx, "route_eval")) bench_route_eval(ctx);
+  if (bench_enabled(ctx, "program_loop")) bench_program_loop(ctx);
+  if (bench_enabled(ctx, "sched_write_cancel")) bench_sched_write(ctx);
+  if (bench_enabled(ctx, "daemon_ping")) bench_daemon_ping(ctx);
+  if (bench_enabled(ctx, "gpio_write_journal")) bench_write_journal(ctx);
+  if (bench_enabled(ctx, "journal_replay")) bench_journal_replay(ctx);
+  if (bench_enabled(ctx, "capture_append")) bench_capture_append(ctx);
+  if (bench_enabled(ctx, "gpio_claim_release")) bench_claim_release(ctx);
+}
@@ -0,0 +1,88 @@
+/*
+ * libpi - Timer benchmarks
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "bench.h"
+#include "common.h"
+
+#include <stdint.h>
+
+/*
+ * Requested durations for `pi_sleep_ns`.
+ */
+
+static const struct {
+  const char *name;
+  unsigned long ns;
+} sleeps[] = {
+    { "sleep_ns_150", 150 }
+  , { "sleep_ns_1000", 1000 }
+  , { "sleep_ns_10000", 10000 }
+  , { "sleep_ns_100000", 100000 }
+};
+
+/*
+ * Samples are the overshoot past the requested duration.
+ */
+
+static void
+bench_sleep_ns(bench_ctx_t *ctx, const char *name, unsigned long ns) {
+  unsigned long count = ctx->iterations / 1000;
+  unsigned long n;
+  if (count < 100) count = 100;
+
+  bench_result_t *res = bench_result_new(name, count, 1);
+  res->unit = "error_ns";
+  uint64_t start = bench_now();
+
+  for (n = 0; n < count; n++) {
+    uint64_t t = bench_now();
+    pi_sleep_ns(ns);
+    uint64_t took = bench_now() - t;
+    bench_result_sample(res, took > ns ? took - ns : 0);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = count;
+  bench_emit(ctx, res);
+}
+
+static void
+bench_sleep_ms(bench_ctx_t *ctx) {
+  unsigned long count = 100;
+  unsigned long n;
+
+  bench_result_t *res = bench_result_new("sleep_ms_1", count, 1);
+  res->unit = "error_ns";
+  uint64_t start = bench_now();
+
+  for (n = 0; n < count; n++) {
+    uint64_t t = bench_now();
+    pi_sleep_ms(1);
+    uint64_t took = bench_now() - t;
+    bench_result_sample(res, took > 1000000 ? took - 1000000 : 0);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = count;
+  bench_emit(ctx, res);
+}
+
+/*
+ * Accuracy of the timing functions.
+ */
+
+void
+bench_suite_timer(bench_ctx_t *ctx) {
+  unsigned int i;
+
+  for (i = 0; i < sizeof(sleeps) / sizeof(sleeps[0]); i++) {
+    if (bench_enabled(ctx, sleeps[i].name)) {
+      bench_sleep_ns(ctx, sleeps[i].name, sleeps[i].ns);
+    }
+  }
+
+  if (bench_enabled(ctx, "sleep_ms_1")) bench_sleep_ms(ctx);
+}
@@ -0,0 +1,116 @@
+/*
+ * libpi - DMA waveform benchmarks
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "bench.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Steps in the benchmark waveform: a square wave on the
+ * output pin with a varying half period.
+ */
+
+#define WAVE_STEPS 256
+
+static void
+wave_steps(bench_ctx_t *ctx, pi_wave_step_t *steps) {
+  unsigned int i;
+  for (i = 0; i < WAVE_STEPS; i++) {
+    steps[i].set = i & 1 ? 0 : 1 << ctx->pin_out;
+    steps[i].clr = i & 1 ? 1 << ctx->pin_out : 0;
+    steps[i].delay = 1 + (i % 16);
+  }
+}
+
+static unsigned long
+wave_count(bench_ctx_t *ctx) {
+  unsigned long n = ctx->iterations / 1000;
+  return n < 100 ? 100 : n;
+}
+
+/*
+ * Compiling includes allocating the DMA-able block.
+ */
+
+static void
+bench_wave_compile(bench_ctx_t *ctx) {
+  pi_wave_step_t steps[WAVE_STEPS];
+  unsigned long count = wave_count(ctx);
+  pi_wave_t *probe;
+
+  wave_steps(ctx, steps);
+  probe = pi_wave_new(ctx->closure, steps, WAVE_STEPS, 1000, 0);
+  if (probe == NULL) {
+    bench_skip(ctx, "wave_compile", "cannot allocate dma memory");
+    return;
+  }
+  pi_wave_delete(probe);
+
+  bench_result_t *res = bench_result_new("wave_compile", count, 1);
+  uint64_t start = bench_now();
+  unsigned long n;
+
+  for (n = 0; n < count; n++) {
+    uint64_t t = bench_now();
+    pi_wave_delete(pi_wave_new(ctx->closure, steps, WAVE_STEPS, 1000, 0));
+    bench_result_sample(res, bench_now() - t);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = count;
+  bench_emit(ctx, res);
+}
+
+/*
+ * Software interpretation of the whole chain; samples are
+ * per control block.
+ */
+
+static void
+bench_wave_interpret(bench_ctx_t *ctx) {
+  pi_wave_step_t steps[WAVE_STEPS];
+  pi_wave_event_t *events = malloc(WAVE_STEPS * sizeof(pi_wave_event_t));
+  unsigned long count = wave_count(ctx);
+  pi_wave_t *wave;
+  size_t ncbs;
+
+  wave_steps(ctx, steps);
+  wave = pi_wave_new(ctx->closure, steps, WAVE_STEPS, 1000, 0);
+  if (wave == NULL || events == NULL) {
+    bench_skip(ctx, "wave_interpret", "cannot allocate dma memory");
+    if (wave != NULL) pi_wave_delete(wave);
+    free(events);
+    return;
+  }
+
+  pi_wave_control_blocks(wave, &ncbs);
+  bench_result_t *res = bench_result_new("wave_interpret", count, ncbs);
+  uint64_t start = bench_now();
+  unsigned long n;
+
+  for (n = 0; n < count; n++) {
+    uint64_t t = bench_now();
+    pi_wave_interpret(wave, events, WAVE_STEPS, 0);
+    bench_result_sample(res, (bench_now() - t) / ncbs);
+  }
+
+  res->elapsed_ns = bench_now() - start;
+  res->ops = (uint64_t)count * ncbs;
+  pi_wave_delete(wave);
+  free(events);
+  bench_emit(ctx, res);
+}
+
+/*
+ * DMA waveform compilation and the software interpreter.
+ */
+
+void
+bench_suite_wave(bench_ctx_t *ctx) {
+  if (bench_enabled(ctx, "wave_compile")) bench_wave_compile(ctx);
+  if (bench_enabled(ctx, "wave_interpret")) bench_wave_interpret(ctx);
+}
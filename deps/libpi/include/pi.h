@@ -7,6 +7,7 @@
 #ifndef PI_H
 #define PI_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -24,13 +25,67 @@ extern "C" {
 #endif
 
 /*
- * Closure type
+ * Board information, detected once per process.
  */
 
+typedef enum {
+  PI_SOC_UNKNOWN = 0,
+  PI_SOC_BCM2835,
+  PI_SOC_BCM2836,
+  PI_SOC_BCM2837,
+  PI_SOC_BCM2711,
+  PI_SOC_BCM2712
+} pi_soc_t;
+
+typedef struct {
+  uint32_t revision_code;     /* raw board revision code */
+  int revision;               /* legacy header revision, 1 or 2 */
+  pi_soc_t soc;
+  const char *soc_name;
+  uint32_t peripheral_base;   /* 0 if registers cannot be mapped */
+} pi_board_t;
+
+/*
+ * Realtime configuration for threads owned by libpi.
+ * Zero fields leave that aspect of the thread unchanged.
+ */
+
+typedef struct {
+  int priority;           /* SCHED_FIFO priority (1-99) */
+  uint32_t cpus;          /* affinity mask, bit n = cpu n */
+  int lock_memory;        /* mlockall current and future pages */
+  size_t prefault_stack;  /* bytes of stack to fault in */
+} pi_rt_config_t;
+
+/*
+ * Realtime status bits; 0 means everything requested
+ * was applied.
+ */
+
+typedef enum {
+  PI_RT_OK              = 0x00,
+  PI_RT_SCHED_FAILED    = 0x01,
+  PI_RT_AFFINITY_FAILED = 0x02,
+  PI_RT_MLOCK_FAILED    = 0x04
+} pi_rt_status_t;
+
+/*
+ * Closure type. `journal`, when set, records the gpio
+ * operations made through the closure (journal.c).
+ */
+
+typedef struct pi_journal_s pi_journal_t;
+
 typedef struct {
   int revision;
+  int simulated;
   volatile uint32_t *gpio_map;
   volatile uint32_t *i2c_map;
+  volatile uint32_t *pwm_map;
+  volatile uint32_t *clk_map;
+  pi_rt_config_t rt;
+  volatile int rt_status;
+  pi_journal_t *volatile journal;
 } pi_closure_t;
 
 /*
@@ -50,7 +105,13 @@ typedef enum {
 
 typedef enum {
   PI_GPIO_MODE_INPUT  = 0x00,
-  PI_GPIO_MODE_OUTPUT = 0x01
+  PI_GPIO_MODE_OUTPUT = 0x01,
+  PI_GPIO_MODE_ALT0   = 0x04,
+  PI_GPIO_MODE_ALT1   = 0x05,
+  PI_GPIO_MODE_ALT2   = 0x06,
+  PI_GPIO_MODE_ALT3   = 0x07,
+  PI_GPIO_MODE_ALT4   = 0x03,
+  PI_GPIO_MODE_ALT5   = 0x02
 } pi_gpio_mode_t;
 
 typedef enum {
@@ -60,6 +121,23 @@ typedef enum {
   PI_GPIO_EDGE_BOTH    = 0x03
 } pi_gpio_edge_t;
 
+/*
+ * Conditions latched by the event detect registers, as a
+ * bit mask. RISING and FALLING match pi_gpio_edge_t; the
+ * synchronous edges filter glitches shorter than two
+ * clocks, the async ones do not.
+ */
+
+typedef enum {
+  PI_GPIO_DETECT_NONE          = 0x00,
+  PI_GPIO_DETECT_RISING        = 0x01,
+  PI_GPIO_DETECT_FALLING       = 0x02,
+  PI_GPIO_DETECT_HIGH          = 0x04,
+  PI_GPIO_DETECT_LOW           = 0x08,
+  PI_GPIO_DETECT_ASYNC_RISING  = 0x10,
+  PI_GPIO_DETECT_ASYNC_FALLING = 0x20
+} pi_gpio_detect_t;
+
 typedef enum {
   PI_GPIO_PULL_NONE  = 0x00,
   PI_GPIO_PULL_DOWN  = 0x01,
@@ -68,7 +146,9 @@ typedef enum {
 
 typedef enum {
   PI_GPIO_METHOD_MMAP,
-  PI_GPIO_METHOD_SYSFS
+  PI_GPIO_METHOD_SYSFS,
+  PI_GPIO_METHOD_CHARDEV,
+  PI_GPIO_METHOD_PWM
 } pi_gpio_method_t;
 
 typedef struct {
@@ -78,6 +158,476 @@ typedef struct {
   int error;
 } pi_gpio_handle_t;
 
+/*
+ * Hardware PWM. Both channels share one clock from the
+ * clock manager; each channel counts `range` ticks per
+ * period and drives the pin high for `data` of them.
+ */
+
+#define PI_PWM_CHANNELS 2
+
+typedef enum {
+  PI_PWM_MODE_BALANCED,       /* spread `data` pulses evenly */
+  PI_PWM_MODE_MARK_SPACE,     /* one pulse of `data` ticks */
+  PI_PWM_MODE_SERIALIZER      /* shift out `data` / fifo words */
+} pi_pwm_mode_t;
+
+/*
+ * DMA waveforms. Each step drives the pins in `set` high
+ * and those in `clr` low, then waits `delay` ticks. Steps
+ * compile to a chain of DMA control blocks that write the
+ * SET/CLR registers, with delays paced by the PWM FIFO.
+ */
+
+typedef struct {
+  uint32_t set;
+  uint32_t clr;
+  uint32_t delay;
+} pi_wave_step_t;
+
+/*
+ * DMA control block as read by the engine. Addresses are
+ * bus addresses; blocks are 32-byte aligned.
+ */
+
+typedef struct {
+  uint32_t ti;
+  uint32_t source_ad;
+  uint32_t dest_ad;
+  uint32_t txfr_len;
+  uint32_t stride;
+  uint32_t nextconbk;
+  uint32_t reserved[2];
+} pi_dma_cb_t;
+
+/*
+ * Register write produced by the software interpreter,
+ * `time` in ns from the start of the chain.
+ */
+
+typedef struct {
+  uint64_t time;
+  uint32_t set;
+  uint32_t clr;
+} pi_wave_event_t;
+
+typedef struct pi_wave_s pi_wave_t;
+
+/*
+ * Character device (gpiochip) line requests. Up to
+ * PI_GPIO_LINES_MAX lines of one chip share a request;
+ * values are bit masks where bit i is `pins[i]`.
+ */
+
+#define PI_GPIO_LINES_MAX 64
+
+typedef struct {
+  pi_gpio_mode_t mode;
+  pi_gpio_pull_t pull;
+  pi_gpio_edge_t edge;
+  uint64_t values;              /* initial output values */
+  uint32_t event_buffer_size;   /* kernel event queue, 0 for default */
+  const char *consumer;         /* label shown by gpioinfo */
+} pi_gpio_lines_config_t;
+
+typedef struct {
+  pi_gpio_method_t method;
+  int fd;
+  unsigned int count;
+  pi_gpio_pin_t pins[PI_GPIO_LINES_MAX];
+  uint64_t flags;               /* requested uAPI line flags */
+  uint64_t quiet;               /* lines with edge detection off */
+  int error;
+} pi_gpio_lines_t;
+
+/*
+ * Edge event with the kernel CLOCK_MONOTONIC timestamp,
+ * comparable with pi_sample_t and trace times.
+ */
+
+typedef struct {
+  uint64_t time;
+  pi_gpio_pin_t pin;
+  pi_gpio_edge_t edge;
+  uint32_t seqno;
+  uint32_t line_seqno;
+} pi_gpio_lines_event_t;
+
+/*
+ * Adaptive edge watcher. Each pin is waited on through
+ * interrupts until its edge rate reaches `poll_rate`, then
+ * busy-polled in bursts of `burst_us` until the rate falls
+ * below `irq_rate`. Rates are measured per `window_ms`.
+ */
+
+typedef struct {
+  uint32_t poll_rate;     /* edges/s to switch to polling */
+  uint32_t irq_rate;      /* edges/s to switch back, below poll_rate */
+  uint32_t window_ms;
+  uint32_t burst_us;
+  pi_gpio_edge_t edge;    /* edges reported while polling */
+} pi_gpio_watch_config_t;
+
+typedef struct {
+  uint64_t time;
+  pi_gpio_pin_t pin;
+  pi_gpio_edge_t edge;
+  int polled;             /* seen by polling, not an interrupt */
+} pi_gpio_watch_event_t;
+
+typedef struct {
+  uint32_t edges;
+  uint32_t rate;          /* edges/s over the last window */
+  uint32_t to_poll;       /* switches to polling */
+  uint32_t to_irq;        /* switches back to interrupts */
+  int polling;
+} pi_gpio_watch_stats_t;
+
+typedef struct pi_gpio_watcher_s pi_gpio_watcher_t;
+
+typedef void (*pi_gpio_watch_cb)(const pi_gpio_watch_event_t *events,
+    size_t count, void *data);
+
+/*
+ * Sampler change record: bank 0 levels at `time` and the
+ * watched pins that changed since the previous record.
+ */
+
+typedef struct {
+  uint64_t time;
+  uint32_t levels;
+  uint32_t changed;
+} pi_sample_t;
+
+typedef struct pi_sampler_s pi_sampler_t;
+
+typedef void (*pi_sampler_notify_cb)(void *data);
+
+/*
+ * Compressed capture. Only transitions of the watched
+ * bank 0 pins are stored, each as a varint time delta in
+ * ticks and the changed bits packed to the watched pins;
+ * runs of identical transitions (a clock) collapse into
+ * one repeat record. Files stream through a window of
+ * mapped pages and end with an index for seeking by time.
+ */
+
+#define PI_CAPTURE_MAGIC "PICAPT"
+#define PI_CAPTURE_VERSION 1
+
+/*
+ * A NULL config, or zero fields, mean 1ns ticks, a 1MB
+ * window and an index entry every 64KB.
+ */
+
+typedef struct {
+  uint32_t tick_ns;       /* time resolution */
+  uint32_t window;        /* bytes mapped at once */
+  uint32_t index_bytes;   /* data between index entries */
+} pi_capture_config_t;
+
+typedef struct {
+  uint64_t start;         /* pi_time_ns() of tick 0 */
+  uint64_t end;           /* time of the last transition */
+  uint32_t tick_ns;
+  uint32_t mask;          /* watched pins */
+  uint32_t levels;        /* at `start` */
+  uint64_t transitions;
+  uint64_t records;       /* encoded records, repeats counting once */
+  uint64_t bytes;         /* encoded data */
+  uint64_t index_count;
+  uint64_t dropped;       /* samples lost by the sampler */
+} pi_capture_info_t;
+
+typedef struct pi_capture_s pi_capture_t;
+typedef struct pi_capture_reader_s pi_capture_reader_t;
+
+/*
+ * Native routing. Each rule drives one bank 0 output from
+ * bank 0 inputs and is evaluated on every level snapshot:
+ * combinational ops follow their inputs, LATCH and TOGGLE
+ * act on `edge` of any input.
+ */
+
+typedef enum {
+  PI_ROUTE_COPY = 0,      /* single input */
+  PI_ROUTE_INVERT,        /* single input */
+  PI_ROUTE_AND,
+  PI_ROUTE_OR,
+  PI_ROUTE_NAND,
+  PI_ROUTE_NOR,
+  PI_ROUTE_XOR,           /* odd number of inputs high */
+  PI_ROUTE_LATCH,         /* set on edge, cleared while `reset` is high */
+  PI_ROUTE_TOGGLE,        /* flip on edge */
+  PI_ROUTE_OP_MAX
+} pi_route_op_t;
+
+typedef struct {
+  pi_route_op_t op;
+  uint32_t inputs;        /* bank 0 mask */
+  uint32_t reset;         /* LATCH only, bank 0 mask */
+  pi_gpio_pin_t output;
+  pi_gpio_edge_t edge;    /* LATCH and TOGGLE */
+} pi_route_rule_t;
+
+typedef struct {
+  uint64_t scans;         /* snapshots taken by the thread */
+  uint64_t changes;       /* snapshots where an input changed */
+  uint64_t writes;        /* output transitions driven */
+} pi_route_stats_t;
+
+typedef struct pi_route_s pi_route_t;
+
+/*
+ * Program runner. A program is an array of 8 byte
+ * instructions run on the calling thread against the gpio
+ * registers, with eight 32 bit registers, a timeout flag,
+ * a `mark` time and a buffer of recorded values. Jump
+ * targets are instruction indexes, up to the length;
+ * running off the end is END.
+ */
+
+typedef enum {
+  PI_PROG_END = 0,
+  PI_PROG_SET,            /* GPSET bank `b` = arg */
+  PI_PROG_CLR,            /* GPCLR bank `b` = arg */
+  PI_PROG_WRITE,          /* pin `a` = arg != 0 */
+  PI_PROG_READ,           /* r[a] = GPLEV bank `b` & arg */
+  PI_PROG_WAIT_EDGE,      /* edge `b` on pin `a`, timeout arg us (0 none) */
+  PI_PROG_WAIT_LEVEL,     /* pin `a` at level `b`, timeout arg us */
+  PI_PROG_DELAY,          /* arg ns from now */
+  PI_PROG_MARK,           /* mark = now, or the last event when `b` */
+  PI_PROG_DELAY_UNTIL,    /* mark + arg ns */
+  PI_PROG_RECORD,         /* push source `b` (pi_prog_source_t) */
+  PI_PROG_LOAD,           /* r[a] = arg */
+  PI_PROG_LOOP,           /* if (r[a] && --r[a]) jump arg */
+  PI_PROG_JUMP,           /* jump arg */
+  PI_PROG_JUMP_TIMEOUT,   /* jump arg if the last wait timed out */
+  PI_PROG_JUMP_HIGH,      /* jump arg if pin `a` is high */
+  PI_PROG_JUMP_LOW,       /* jump arg if pin `a` is low */
+  PI_PROG_OP_MAX
+} pi_prog_op_t;
+
+typedef enum {
+  PI_PROG_SOURCE_ELAPSED = 0,   /* ns since mark */
+  PI_PROG_SOURCE_EVENT,         /* ns from mark to the last event */
+  PI_PROG_SOURCE_REG,           /* r[a] */
+  PI_PROG_SOURCE_LEVELS,        /* GPLEV bank 0 */
+  PI_PROG_SOURCE_MAX
+} pi_prog_source_t;
+
+typedef struct {
+  uint8_t op;
+  uint8_t a;
+  uint16_t b;
+  uint32_t arg;
+} pi_prog_insn_t;
+
+typedef struct pi_program_s pi_program_t;
+
+/*
+ * Scheduled writes. Each entry drives a set and a clear
+ * mask of one bank at an absolute deadline on the
+ * pi_sched_now() clock (CLOCK_MONOTONIC ns). Entries due
+ * in the same tick are merged into one GPSET and one
+ * GPCLR store per bank; where they disagree on a pin the
+ * one queued last wins.
+ */
+
+typedef struct {
+  uint64_t deadline;
+  uint32_t set;
+  uint32_t clr;
+  uint8_t bank;
+} pi_sched_entry_t;
+
+typedef struct {
+  uint64_t queued;
+  uint64_t fired;         /* entries written */
+  uint64_t cancelled;
+  uint64_t stores;        /* register stores, after merging */
+  uint64_t max_late_ns;   /* worst deadline miss */
+  uint32_t pending;
+} pi_sched_stats_t;
+
+typedef struct pi_sched_s pi_sched_t;
+
+/*
+ * GPIO daemon. One process owns the registers and serves
+ * clients in other processes through POSIX shared memory:
+ * each client gets a lock-free command ring, and levels
+ * are published on a snapshot page, so clients make no
+ * syscalls after connecting. The daemon keeps pin
+ * ownership and does every mode and pull change, so
+ * clients never race on GPFSEL.
+ */
+
+#define PI_DAEMON_NAME "/libpi"
+
+typedef enum {
+  PI_DAEMON_PING = 0,     /* completes once earlier commands have */
+  PI_DAEMON_CLAIM,        /* `pin` in `mode`, pull `arg`, output level `set` */
+  PI_DAEMON_RELEASE,
+  PI_DAEMON_WRITE,        /* `pin` = `arg` */
+  PI_DAEMON_WRITE_MASK,   /* bank `pin`: `set` and `clr` masks */
+  PI_DAEMON_SET_PULL,     /* `pin` pull `arg` */
+  PI_DAEMON_OP_MAX
+} pi_daemon_op_t;
+
+typedef struct {
+  uint32_t seq;           /* filled in by the client library */
+  uint8_t op;
+  uint8_t pin;
+  uint8_t mode;
+  uint8_t arg;
+  uint32_t set;
+  uint32_t clr;
+} pi_daemon_cmd_t;
+
+/*
+ * A NULL config means 8 clients, 10000 scans per second
+ * and mode 0660; zero fields other than `rate` take
+ * those defaults.
+ */
+
+typedef struct {
+  unsigned int clients;   /* client slots (default 8) */
+  uint32_t rate;          /* ring scans per second, 0 to spin */
+  unsigned int mode;      /* shared memory permissions (default 0660) */
+} pi_daemon_config_t;
+
+typedef struct {
+  uint64_t scans;
+  uint64_t commands;
+  uint64_t rejected;      /* commands failed for ownership or arguments */
+  uint32_t clients;       /* connected now */
+  uint32_t reaped;        /* clients that exited without disconnecting */
+} pi_daemon_stats_t;
+
+typedef struct pi_daemon_s pi_daemon_t;
+typedef struct pi_client_s pi_client_t;
+
+/*
+ * Trace operations
+ */
+
+typedef enum {
+  PI_TRACE_NONE = 0,
+  PI_TRACE_GPIO_SETUP,
+  PI_TRACE_GPIO_TEARDOWN,
+  PI_TRACE_GPIO_CLAIM,
+  PI_TRACE_GPIO_RELEASE,
+  PI_TRACE_GPIO_SET_MODE,
+  PI_TRACE_GPIO_SET_PULL,
+  PI_TRACE_GPIO_READ,
+  PI_TRACE_GPIO_WRITE,
+  PI_TRACE_GPIO_READ_MASK,
+  PI_TRACE_GPIO_WRITE_MASK,
+  PI_TRACE_GPIO_LISTEN,
+  PI_TRACE_GPIO_WRITE_SEQUENCE,
+  PI_TRACE_GPIO_LINES_GET,
+  PI_TRACE_GPIO_LINES_SET,
+  PI_TRACE_GPIO_LINES_EVENTS,
+  PI_TRACE_PWM_CLOCK,
+  PI_TRACE_PWM_SET,
+  PI_TRACE_WAVE_START,
+  PI_TRACE_WAVE_STOP,
+  PI_TRACE_GPIO_SET_DETECT,
+  PI_TRACE_GPIO_POLL_EVENTS,
+  PI_TRACE_ROUTE_START,
+  PI_TRACE_ROUTE_STOP,
+  PI_TRACE_PROGRAM_RUN,
+  PI_TRACE_SCHED_FIRE,
+  PI_TRACE_DAEMON_CONNECT,
+  PI_TRACE_DAEMON_DISCONNECT,
+  PI_TRACE_OP_MAX
+} pi_trace_op_t;
+
+/*
+ * Fixed-size trace record. `value` and `extra` are op
+ * specific (eg. set and clear masks for mask writes).
+ */
+
+typedef struct {
+  uint64_t time;
+  uint32_t thread;
+  uint16_t op;
+  uint16_t pin;
+  uint32_t value;
+  uint32_t extra;
+} pi_trace_record_t;
+
+/*
+ * Trace dump file header.
+ */
+
+#define PI_TRACE_MAGIC "PITRACE"
+#define PI_TRACE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+} pi_trace_header_t;
+
+/*
+ * Operation journal. Unlike the trace rings, a journal
+ * keeps every record until full, so it can be replayed.
+ * `stamp` packs the time since the journal was created
+ * (48 bits of ns, about 78 hours), the op (a
+ * pi_trace_op_t) and the pin. Ops and operands:
+ *
+ *   GPIO_CLAIM        pin, mode, pull
+ *   GPIO_RELEASE      pin
+ *   GPIO_SET_MODE     pin, mode
+ *   GPIO_SET_PULL     pin, pull
+ *   GPIO_READ         pin, level read
+ *   GPIO_WRITE        pin, level written
+ *   GPIO_READ_MASK    bank 0 levels read
+ *   GPIO_WRITE_MASK   set mask, clear mask
+ */
+
+typedef struct {
+  uint64_t stamp;
+  uint32_t value;
+  uint32_t extra;
+} pi_journal_record_t;
+
+#define PI_JOURNAL_TIME(rec) ((rec)->stamp >> 16)
+#define PI_JOURNAL_OP(rec) (((rec)->stamp >> 8) & 0xff)
+#define PI_JOURNAL_PIN(rec) ((rec)->stamp & 0xff)
+
+#define PI_JOURNAL_MAGIC "PIJOURN"
+#define PI_JOURNAL_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t count;
+  uint64_t dropped;
+} pi_journal_header_t;
+
+/*
+ * Replay flags and results. Deviation is how late each
+ * op ran against its recorded offset from the first, in
+ * timed replays. Reads replayed on a simulated closure
+ * are fed the recorded levels first, so they match; on
+ * hardware, differing reads are counted as mismatches.
+ */
+
+#define PI_JOURNAL_REPLAY_TIMED 0x01
+
+typedef struct {
+  uint64_t records;       /* ops replayed */
+  uint64_t skipped;       /* ops on unclaimed pins or unknown */
+  uint64_t mismatches;    /* reads that differ from the journal */
+  uint64_t recorded_ns;   /* span of the journal */
+  uint64_t elapsed_ns;    /* span of the replay */
+  uint64_t max_late_ns;
+  uint64_t mean_late_ns;
+} pi_journal_replay_stats_t;
+
 /*
  * closure.c
  */
@@ -95,9 +645,70 @@ pi_closure_delete(pi_closure_t *closure);
  * cpuinfo.c
  */
 
+PI_EXTERN const pi_board_t*
+pi_board(void);
+
 PI_EXTERN int
 pi_revision(void);
 
+/*
+ * daemon.c
+ */
+
+PI_EXTERN pi_daemon_t*
+pi_daemon_new(pi_closure_t *closure, const char *name,
+    const pi_daemon_config_t *config);
+
+PI_EXTERN int
+pi_daemon_start(pi_daemon_t *daemon);
+
+PI_EXTERN void
+pi_daemon_stats(pi_daemon_t *daemon, pi_daemon_stats_t *stats);
+
+PI_EXTERN void
+pi_daemon_stop(pi_daemon_t *daemon);
+
+PI_EXTERN void
+pi_daemon_delete(pi_daemon_t *daemon);
+
+PI_EXTERN pi_client_t*
+pi_client_connect(const char *name);
+
+PI_EXTERN int64_t
+pi_client_submit(pi_client_t *client, const pi_daemon_cmd_t *cmd);
+
+PI_EXTERN int
+pi_client_wait(pi_client_t *client, uint32_t seq, uint64_t timeout_ns);
+
+PI_EXTERN int
+pi_client_claim(pi_client_t *client, pi_gpio_pin_t pin, pi_gpio_mode_t mode,
+    pi_gpio_pull_t pull, pi_gpio_value_t value);
+
+PI_EXTERN int
+pi_client_release(pi_client_t *client, pi_gpio_pin_t pin);
+
+PI_EXTERN int
+pi_client_write(pi_client_t *client, pi_gpio_pin_t pin, pi_gpio_value_t value);
+
+PI_EXTERN int
+pi_client_write_mask(pi_client_t *client, unsigned int bank, uint32_t set,
+    uint32_t clr);
+
+PI_EXTERN int
+pi_client_flush(pi_client_t *client, uint64_t timeout_ns);
+
+PI_EXTERN uint32_t
+pi_client_errors(pi_client_t *client, int *last_error);
+
+PI_EXTERN pi_gpio_value_t
+pi_client_read(pi_client_t *client, pi_gpio_pin_t pin);
+
+PI_EXTERN uint32_t
+pi_client_read_mask(pi_client_t *client, unsigned int bank);
+
+PI_EXTERN void
+pi_client_disconnect(pi_client_t *client);
+
 /*
  * gpio_mmap.c
  */
@@ -138,9 +749,39 @@ pi_gpio_read(pi_gpio_handle_t *handle);
 PI_EXTERN int
 pi_gpio_write(pi_gpio_handle_t *handle, pi_gpio_value_t value);
 
+PI_EXTERN int
+pi_gpio_write_sequence(pi_gpio_handle_t *handle, const uint8_t *values,
+    size_t len, uint64_t period_ns);
+
 PI_EXTERN int
 pi_gpio_release(pi_gpio_handle_t* handle);
 
+PI_EXTERN uint32_t
+pi_gpio_read_mask(pi_closure_t *closure);
+
+PI_EXTERN void
+pi_gpio_write_mask(pi_closure_t *closure, uint32_t set, uint32_t clr);
+
+PI_EXTERN void
+pi_gpio_set_edge_detect(pi_gpio_handle_t *handle, int detect);
+
+PI_EXTERN int
+pi_gpio_get_edge_detect(pi_gpio_handle_t *handle);
+
+PI_EXTERN uint32_t
+pi_gpio_poll_events(pi_closure_t *closure);
+
+/*
+ * gpio_sim.c
+ */
+
+PI_EXTERN int
+pi_gpio_setup_sim(pi_closure_t *closure);
+
+PI_EXTERN void
+pi_gpio_sim_set_level(pi_closure_t *closure, pi_gpio_pin_t pin,
+  pi_gpio_value_t value);
+
 /*
  * gpio_events.c
  */
@@ -154,6 +795,354 @@ pi_gpio_listen(pi_gpio_handle_t *listener, pi_gpio_edge_t edge);
 PI_EXTERN void
 pi_gpio_listener_release(pi_gpio_handle_t *listener);
 
+/*
+ * realtime.c
+ */
+
+PI_EXTERN void
+pi_closure_set_rt(pi_closure_t *closure, const pi_rt_config_t *config);
+
+PI_EXTERN int
+pi_rt_apply(const pi_rt_config_t *config);
+
+PI_EXTERN int
+pi_closure_rt_apply(pi_closure_t *closure);
+
+PI_EXTERN void
+pi_rt_prefault(void *buf, size_t len);
+
+/*
+ * gpio_chardev.c
+ */
+
+PI_EXTERN pi_gpio_lines_t*
+pi_gpio_lines_request(const char *chip, const pi_gpio_pin_t *pins,
+    unsigned int count, const pi_gpio_lines_config_t *config);
+
+PI_EXTERN int
+pi_gpio_lines_get(pi_gpio_lines_t *lines, uint64_t *values);
+
+PI_EXTERN int
+pi_gpio_lines_set(pi_gpio_lines_t *lines, uint64_t values, uint64_t mask);
+
+PI_EXTERN int
+pi_gpio_lines_read_events(pi_gpio_lines_t *lines, pi_gpio_lines_event_t *events,
+    size_t max, int timeout);
+
+PI_EXTERN int
+pi_gpio_lines_set_edge_enabled(pi_gpio_lines_t *lines, uint64_t mask,
+    int enabled);
+
+PI_EXTERN void
+pi_gpio_lines_release(pi_gpio_lines_t *lines);
+
+/*
+ * gpio_watch.c
+ */
+
+PI_EXTERN pi_gpio_watcher_t*
+pi_gpio_watcher_new(pi_closure_t *closure, pi_gpio_lines_t *lines,
+    const pi_gpio_pin_t *pins, unsigned int count,
+    const pi_gpio_watch_config_t *config, pi_gpio_watch_cb cb, void *data);
+
+PI_EXTERN int
+pi_gpio_watcher_start(pi_gpio_watcher_t *watcher);
+
+PI_EXTERN int
+pi_gpio_watcher_stats(pi_gpio_watcher_t *watcher, pi_gpio_pin_t pin,
+    pi_gpio_watch_stats_t *stats);
+
+PI_EXTERN void
+pi_gpio_watcher_stop(pi_gpio_watcher_t *watcher);
+
+PI_EXTERN void
+pi_gpio_watcher_delete(pi_gpio_watcher_t *watcher);
+
+/*
+ * sampler.c
+ */
+
+PI_EXTERN pi_sampler_t*
+pi_sampler_new(pi_closure_t *closure, uint32_t rate, size_t capacity,
+    pi_sampler_notify_cb notify, void *data);
+
+PI_EXTERN int
+pi_sampler_start(pi_sampler_t *sampler, uint32_t mask);
+
+PI_EXTERN void
+pi_sampler_set_mask(pi_sampler_t *sampler, uint32_t mask);
+
+PI_EXTERN size_t
+pi_sampler_read(pi_sampler_t *sampler, pi_sample_t *samples, size_t max);
+
+PI_EXTERN uint32_t
+pi_sampler_dropped(pi_sampler_t *sampler);
+
+PI_EXTERN void
+pi_sampler_stop(pi_sampler_t *sampler);
+
+PI_EXTERN void
+pi_sampler_delete(pi_sampler_t *sampler);
+
+/*
+ * capture.c
+ */
+
+PI_EXTERN pi_capture_t*
+pi_capture_new(const char *path, uint32_t mask, uint32_t levels, uint64_t start,
+    const pi_capture_config_t *config);
+
+PI_EXTERN int
+pi_capture_append(pi_capture_t *capture, const pi_sample_t *samples, size_t count);
+
+PI_EXTERN int
+pi_capture_start(pi_capture_t *capture, pi_closure_t *closure, uint32_t rate);
+
+PI_EXTERN void
+pi_capture_stop(pi_capture_t *capture);
+
+PI_EXTERN void
+pi_capture_info(pi_capture_t *capture, pi_capture_info_t *info);
+
+PI_EXTERN int
+pi_capture_close(pi_capture_t *capture);
+
+PI_EXTERN pi_capture_reader_t*
+pi_capture_open(const char *path);
+
+PI_EXTERN void
+pi_capture_reader_info(pi_capture_reader_t *reader, pi_capture_info_t *info);
+
+PI_EXTERN void
+pi_capture_seek(pi_capture_reader_t *reader, uint64_t time);
+
+PI_EXTERN int
+pi_capture_next(pi_capture_reader_t *reader, pi_sample_t *sample);
+
+PI_EXTERN uint32_t
+pi_capture_levels(pi_capture_reader_t *reader);
+
+PI_EXTERN void
+pi_capture_reader_close(pi_capture_reader_t *reader);
+
+/*
+ * program.c
+ */
+
+PI_EXTERN pi_program_t*
+pi_program_new(pi_closure_t *closure, const pi_prog_insn_t *code, size_t len,
+    size_t max_records);
+
+PI_EXTERN int
+pi_program_run(pi_program_t *program);
+
+PI_EXTERN const uint64_t*
+pi_program_records(pi_program_t *program, size_t *count);
+
+PI_EXTERN int
+pi_program_set_outputs(pi_program_t *program, uint8_t bank, uint32_t mask);
+
+PI_EXTERN void
+pi_program_stop(pi_program_t *program);
+
+PI_EXTERN void
+pi_program_delete(pi_program_t *program);
+
+/*
+ * route.c
+ */
+
+PI_EXTERN pi_route_t*
+pi_route_new(pi_closure_t *closure, const pi_route_rule_t *rules,
+    unsigned int count);
+
+PI_EXTERN uint32_t
+pi_route_eval(pi_route_t *route, uint32_t levels);
+
+PI_EXTERN uint32_t
+pi_route_step(pi_route_t *route);
+
+PI_EXTERN int
+pi_route_start(pi_route_t *route, uint32_t rate);
+
+PI_EXTERN void
+pi_route_stats(pi_route_t *route, pi_route_stats_t *stats);
+
+PI_EXTERN void
+pi_route_stop(pi_route_t *route);
+
+PI_EXTERN void
+pi_route_delete(pi_route_t *route);
+
+/*
+ * scheduler.c
+ */
+
+PI_EXTERN pi_sched_t*
+pi_sched_new(pi_closure_t *closure, size_t capacity, uint32_t tick_ns);
+
+PI_EXTERN uint64_t
+pi_sched_now(void);
+
+PI_EXTERN size_t
+pi_sched_add(pi_sched_t *sched, const pi_sched_entry_t *entries, size_t count,
+    uint64_t *ids);
+
+PI_EXTERN uint64_t
+pi_sched_write(pi_sched_t *sched, uint64_t deadline, pi_gpio_pin_t pin,
+    pi_gpio_value_t value);
+
+PI_EXTERN int
+pi_sched_cancel(pi_sched_t *sched, uint64_t id);
+
+PI_EXTERN int
+pi_sched_set_outputs(pi_sched_t *sched, uint8_t bank, uint32_t mask);
+
+PI_EXTERN size_t
+pi_sched_step(pi_sched_t *sched, uint64_t now);
+
+PI_EXTERN int
+pi_sched_start(pi_sched_t *sched);
+
+PI_EXTERN void
+pi_sched_stats(pi_sched_t *sched, pi_sched_stats_t *stats);
+
+PI_EXTERN void
+pi_sched_stop(pi_sched_t *sched);
+
+PI_EXTERN void
+pi_sched_delete(pi_sched_t *sched);
+
+/*
+ * pwm.c
+ */
+
+PI_EXTERN int
+pi_pwm_setup(pi_closure_t *closure);
+
+PI_EXTERN int
+pi_pwm_teardown(pi_closure_t *closure);
+
+PI_EXTERN int
+pi_pwm_channel(pi_gpio_pin_t pin);
+
+PI_EXTERN pi_gpio_handle_t*
+pi_pwm_claim(pi_closure_t *closure, pi_gpio_pin_t pin);
+
+PI_EXTERN int
+pi_pwm_set_clock(pi_closure_t *closure, uint32_t divi, uint32_t divf);
+
+PI_EXTERN int
+pi_pwm_set_mode(pi_closure_t *closure, unsigned int channel,
+    pi_pwm_mode_t mode, int use_fifo);
+
+PI_EXTERN int
+pi_pwm_set_range(pi_closure_t *closure, unsigned int channel, uint32_t range);
+
+PI_EXTERN int
+pi_pwm_set_data(pi_closure_t *closure, unsigned int channel, uint32_t data);
+
+PI_EXTERN int
+pi_pwm_enable(pi_closure_t *closure, unsigned int channel, int enabled);
+
+PI_EXTERN size_t
+pi_pwm_write_fifo(pi_closure_t *closure, const uint32_t *words, size_t len);
+
+PI_EXTERN int
+pi_pwm_set_frequency(pi_closure_t *closure, unsigned int channel,
+    double frequency, double duty);
+
+PI_EXTERN double
+pi_pwm_clock_hz(pi_closure_t *closure);
+
+PI_EXTERN int
+pi_pwm_set_dma(pi_closure_t *closure, int enabled);
+
+/*
+ * wave.c
+ */
+
+PI_EXTERN pi_wave_t*
+pi_wave_new(pi_closure_t *closure, const pi_wave_step_t *steps, size_t len,
+    uint32_t tick_ns, int loop);
+
+PI_EXTERN const pi_dma_cb_t*
+pi_wave_control_blocks(pi_wave_t *wave, size_t *count);
+
+PI_EXTERN int
+pi_wave_start(pi_wave_t *wave, unsigned int channel);
+
+PI_EXTERN int
+pi_wave_busy(pi_wave_t *wave);
+
+PI_EXTERN int
+pi_wave_stop(pi_wave_t *wave);
+
+PI_EXTERN void
+pi_wave_delete(pi_wave_t *wave);
+
+/*
+ * wave_sim.c
+ */
+
+PI_EXTERN int
+pi_wave_interpret(pi_wave_t *wave, pi_wave_event_t *events, size_t max,
+    uint64_t duration_ns);
+
+/*
+ * trace.c
+ */
+
+PI_EXTERN void
+pi_trace_enable(int enabled);
+
+PI_EXTERN int
+pi_trace_enabled(void);
+
+PI_EXTERN size_t
+pi_trace_read(pi_trace_record_t *records, size_t max);
+
+PI_EXTERN int
+pi_trace_dump(int fd);
+
+PI_EXTERN void
+pi_trace_clear(void);
+
+PI_EXTERN const char*
+pi_trace_op_name(uint16_t op);
+
+/*
+ * journal.c
+ */
+
+PI_EXTERN pi_journal_t*
+pi_journal_new(size_t capacity);
+
+PI_EXTERN void
+pi_journal_attach(pi_closure_t *closure, pi_journal_t *journal);
+
+PI_EXTERN void
+pi_journal_detach(pi_closure_t *closure);
+
+PI_EXTERN const pi_journal_record_t*
+pi_journal_records(pi_journal_t *journal, size_t *count, uint64_t *dropped);
+
+PI_EXTERN void
+pi_journal_clear(pi_journal_t *journal);
+
+PI_EXTERN int
+pi_journal_dump(pi_journal_t *journal, int fd);
+
+PI_EXTERN pi_journal_t*
+pi_journal_load(int fd);
+
+PI_EXTERN int
+pi_journal_replay(pi_closure_t *closure, pi_journal_t *journal, int flags,
+    pi_journal_replay_stats_t *stats);
+
+PI_EXTERN void
+pi_journal_delete(pi_journal_t *journal);
+
 /*
  * End
  */
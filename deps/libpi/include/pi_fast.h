@@ -0,0 +1,189 @@
+/*
+ * libpi - Inline register access
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#ifndef PI_FAST_H
+#define PI_FAST_H
+
+#include "pi.h"
+
+/*
+ * Header-only pin access for tight loops. Functions take
+ * the register block once (`pi_fast_map`) instead of a
+ * handle, so with a constant pin the bank and mask fold
+ * away and a write is a single store. Nothing here checks
+ * pin ownership or records trace or journal events; claim
+ * pins through pi.h first.
+ */
+
+/*
+ * Word offsets in the gpio block, as in src/common.h.
+ */
+
+#define PI_FAST_FSEL_OFFSET      0
+#define PI_FAST_SET_OFFSET       7
+#define PI_FAST_CLR_OFFSET       10
+#define PI_FAST_LEVEL_OFFSET     13
+
+#define PI_FAST_BANK(pin) ((pin) >> 5)
+#define PI_FAST_MASK(pin) (1u << ((pin) & 31))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline volatile uint32_t*
+pi_fast_map(const pi_closure_t *closure) {
+  return closure->gpio_map;
+}
+
+static inline void
+pi_fast_set(volatile uint32_t *map, unsigned int pin) {
+  map[PI_FAST_SET_OFFSET + PI_FAST_BANK(pin)] = PI_FAST_MASK(pin);
+}
+
+static inline void
+pi_fast_clr(volatile uint32_t *map, unsigned int pin) {
+  map[PI_FAST_CLR_OFFSET + PI_FAST_BANK(pin)] = PI_FAST_MASK(pin);
+}
+
+/*
+ * Non-zero `value` drives high. The register is picked
+ * arithmetically so a variable value does not branch.
+ */
+
+static inline void
+pi_fast_write(volatile uint32_t *map, unsigned int pin, int value) {
+  unsigned int offset = value ? PI_FAST_SET_OFFSET : PI_FAST_CLR_OFFSET;
+  map[offset + PI_FAST_BANK(pin)] = PI_FAST_MASK(pin);
+}
+
+static inline int
+pi_fast_read(volatile uint32_t *map, unsigned int pin) {
+  return (map[PI_FAST_LEVEL_OFFSET + PI_FAST_BANK(pin)] >> (pin & 31)) & 1;
+}
+
+/*
+ * Bank 0 masks, one store each.
+ */
+
+static inline void
+pi_fast_set_mask(volatile uint32_t *map, uint32_t mask) {
+  map[PI_FAST_SET_OFFSET] = mask;
+}
+
+static inline void
+pi_fast_clr_mask(volatile uint32_t *map, uint32_t mask) {
+  map[PI_FAST_CLR_OFFSET] = mask;
+}
+
+static inline uint32_t
+pi_fast_read_mask(volatile uint32_t *map) {
+  return map[PI_FAST_LEVEL_OFFSET];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * C++11 wrappers. `pi::Pin<N>` carries its register
+ * offsets and mask as constants; `pi::PinGroup<A, B, ...>`
+ * ORs the masks of pins sharing a bank so a whole group
+ * changes with one store per register.
+ */
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+
+namespace pi {
+
+template<unsigned int N>
+struct Pin {
+  static_assert(N < 54, "gpio pin out of range");
+
+  static constexpr unsigned int pin = N;
+  static constexpr unsigned int bank = PI_FAST_BANK(N);
+  static constexpr uint32_t mask = PI_FAST_MASK(N);
+  static constexpr unsigned int set_offset = PI_FAST_SET_OFFSET + bank;
+  static constexpr unsigned int clr_offset = PI_FAST_CLR_OFFSET + bank;
+  static constexpr unsigned int level_offset = PI_FAST_LEVEL_OFFSET + bank;
+
+  static inline void set(volatile uint32_t *map) { map[set_offset] = mask; }
+  static inline void clr(volatile uint32_t *map) { map[clr_offset] = mask; }
+
+  static inline void write(volatile uint32_t *map, bool value) {
+    map[value ? set_offset : clr_offset] = mask;
+  }
+
+  static inline bool read(volatile uint32_t *map) {
+    return (map[level_offset] & mask) != 0;
+  }
+};
+
+namespace detail {
+
+template<unsigned int... Ns>
+struct GroupMask;
+
+template<>
+struct GroupMask<> {
+  static constexpr uint32_t mask = 0;
+  static constexpr bool same_bank(unsigned int) { return true; }
+
+  // bit i of `bits` selects the i-th pin of the group
+  static constexpr uint32_t spread(uint32_t) { return 0; }
+};
+
+template<unsigned int N, unsigned int... Ns>
+struct GroupMask<N, Ns...> {
+  typedef GroupMask<Ns...> rest;
+
+  static constexpr uint32_t mask = Pin<N>::mask | rest::mask;
+
+  static constexpr bool same_bank(unsigned int bank) {
+    return Pin<N>::bank == bank && rest::same_bank(bank);
+  }
+
+  static constexpr uint32_t spread(uint32_t bits) {
+    return (bits & 1 ? Pin<N>::mask : 0) | rest::spread(bits >> 1);
+  }
+};
+
+} // namespace detail
+
+template<unsigned int First, unsigned int... Rest>
+struct PinGroup {
+  typedef detail::GroupMask<First, Rest...> group;
+
+  static_assert(group::same_bank(Pin<First>::bank), "pins in a group must share a bank");
+
+  static constexpr unsigned int bank = Pin<First>::bank;
+  static constexpr uint32_t mask = group::mask;
+  static constexpr unsigned int size = 1 + sizeof...(Rest);
+
+  static inline void set(volatile uint32_t *map) { map[Pin<First>::set_offset] = mask; }
+  static inline void clr(volatile uint32_t *map) { map[Pin<First>::clr_offset] = mask; }
+
+  /*
+   * Bit i of `bits` is the value of the i-th pin listed.
+   * Two stores; a constant `bits` folds to constant masks.
+   */
+
+  static inline void write(volatile uint32_t *map, uint32_t bits) {
+    uint32_t high = group::spread(bits);
+    if (high) map[Pin<First>::set_offset] = high;
+    if (mask & ~high) map[Pin<First>::clr_offset] = mask & ~high;
+  }
+
+  static inline uint32_t read(volatile uint32_t *map) {
+    return map[Pin<First>::level_offset] & mask;
+  }
+};
+
+} // namespace pi
+
+#endif
+
+#endif
@@ -19,12 +19,29 @@
       'type': 'static_library',
       'sources': [
         'include/pi.h',
+        'include/pi_fast.h',
         'src/common.h',
+        'src/capture.c',
         'src/closure.c',
         'src/cpuinfo.c',
+        'src/daemon.c',
         'src/gpio_mmap.c',
         'src/gpio_event.c',
-        'src/timer.c'
+        'src/gpio_chardev.c',
+        'src/gpio_sim.c',
+        'src/gpio_watch.c',
+        'src/journal.c',
+        'src/peripheral.c',
+        'src/program.c',
+        'src/pwm.c',
+        'src/realtime.c',
+        'src/route.c',
+        'src/sampler.c',
+        'src/scheduler.c',
+        'src/timer.c',
+        'src/trace.c',
+        'src/wave.c',
+        'src/wave_sim.c'
       ],
       'include_dirs': [
         'include',
@@ -34,6 +51,9 @@
         'include_dirs': [ 
           'include'
         ]
+      },
+      'link_settings': {
+        'libraries': [ '-lpthread', '-lrt' ]
       }
     },
 
@@ -41,10 +61,76 @@
       'target_name': 'test',
       'type': 'executable',
       'dependencies': [ 'pi' ],
+      'include_dirs': [
+        'src/'
+      ],
       'sources': [
         'test/test.c'
       ]
     },
 
+    {
+      'target_name': 'test-fast',
+      'type': 'executable',
+      'dependencies': [ 'pi' ],
+      'cflags_cc': [ '-std=c++11' ],
+      'sources': [
+        'test/test_fast.cc'
+      ]
+    },
+
+    {
+      'target_name': 'bench',
+      'type': 'executable',
+      'dependencies': [ 'pi' ],
+      'include_dirs': [
+        'src/'
+      ],
+      'sources': [
+        'bench/bench.h',
+        'bench/bench.c',
+        'bench/event.c',
+        'bench/gpio.c',
+        'bench/timer.c',
+        'bench/wave.c'
+      ]
+    },
+
+    {
+      'target_name': 'capture-vcd',
+      'type': 'executable',
+      'dependencies': [ 'pi' ],
+      'sources': [
+        'tools/capture_vcd.c'
+      ]
+    },
+
+    {
+      'target_name': 'pi-daemon',
+      'type': 'executable',
+      'dependencies': [ 'pi' ],
+      'sources': [
+        'tools/pi_daemon.c'
+      ]
+    },
+
+    {
+      'target_name': 'pi-replay',
+      'type': 'executable',
+      'dependencies': [ 'pi' ],
+      'sources': [
+        'tools/pi_replay.c'
+      ]
+    },
+
+    {
+      'target_name': 'trace-decode',
+      'type': 'executable',
+      'dependencies': [ 'pi' ],
+      'sources': [
+        'tools/trace_decode.c'
+      ]
+    },
+
   ]
 }
@@ -0,0 +1,723 @@
+/*
+ * libpi - Compressed transition capture
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "capture", ##args)
+
+/*
+ * Defaults for a NULL or zeroed config.
+ */
+
+#define DEFAULT_WINDOW       (1 << 20)
+#define DEFAULT_INDEX_BYTES  (1 << 16)
+
+/*
+ * Records start here; the header is rewritten in place.
+ */
+
+#define DATA_OFFSET 128
+
+/*
+ * Alignment of the index that follows the records.
+ */
+
+#define INDEX_ALIGN 8
+
+/*
+ * Sampler ring and the drain thread's batch and pause.
+ */
+
+#define SAMPLER_CAPACITY (1 << 16)
+#define DRAIN_BATCH 256
+#define DRAIN_NS 1000000
+
+/*
+ * File layout: header, records from DATA_OFFSET to
+ * `data_end`, then `index_count` index entries from the
+ * next multiple of INDEX_ALIGN. A record is a varint
+ * `head`: `delta << 1` followed by a varint of the
+ * changed bits packed to the watched pins, or
+ * `count << 1 | 1` to repeat the previous record `count`
+ * more times. `data_end` is also written each time the
+ * window moves, so a file that was never closed can still
+ * be read up to there.
+ */
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t tick_ns;
+  uint64_t start;
+  uint32_t mask;
+  uint32_t levels;
+  uint64_t end_ticks;
+  uint64_t transitions;
+  uint64_t records;
+  uint64_t data_end;
+  uint64_t index_offset;  /* 0 until closed */
+  uint64_t index_count;
+  uint64_t dropped;
+} capture_header_t;
+
+/*
+ * Decoding may start at `offset` with the time and levels
+ * of the transition before it; no repeat crosses it.
+ */
+
+typedef struct {
+  uint64_t ticks;
+  uint64_t offset;
+  uint32_t levels;
+  uint32_t pad;
+} capture_index_t;
+
+struct pi_capture_s {
+  int fd;
+  capture_header_t header;
+  uint32_t window;
+  uint32_t index_bytes;
+  int error;
+
+  uint8_t *map;
+  uint64_t map_off;
+  uint64_t pos;
+
+  capture_index_t *index;
+  size_t index_cap;
+  uint64_t next_index;
+
+  uint64_t ticks;         /* of the last transition */
+  uint32_t levels;
+  uint64_t prev_delta;
+  uint32_t prev_bits;
+  int repeatable;
+  uint64_t pending;       /* repeats not yet written */
+
+  pi_sampler_t *sampler;
+  volatile int running;
+  pthread_t thread;
+};
+
+/*
+ * Decoder position. Copied whole to look ahead.
+ */
+
+typedef struct {
+  uint64_t pos;
+  uint64_t ticks;
+  uint32_t levels;
+  uint64_t prev_delta;
+  uint32_t prev_bits;
+  uint64_t repeat;
+} capture_state_t;
+
+struct pi_capture_reader_s {
+  const uint8_t *map;
+  size_t size;
+  capture_header_t header;
+  const capture_index_t *index;
+  uint64_t index_count;
+  capture_state_t state;
+};
+
+/*
+ * LEB128 varints.
+ */
+
+static size_t
+varint_put(uint8_t *buf, uint64_t value) {
+  size_t n = 0;
+
+  while (value >= 0x80) {
+    buf[n++] = (uint8_t) value | 0x80;
+    value >>= 7;
+  }
+
+  buf[n++] = (uint8_t) value;
+  return n;
+}
+
+static int
+varint_get(const uint8_t *map, uint64_t end, uint64_t *pos, uint64_t *value) {
+  uint64_t v = 0;
+  unsigned int shift = 0;
+
+  while (*pos < end && shift < 64) {
+    uint8_t byte = map[(*pos)++];
+    v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = v;
+      return 0;
+    }
+    shift += 7;
+  }
+
+  return -1;
+}
+
+/*
+ * Move the bits of `mask` in `bits` down to the low bits,
+ * in pin order, and back.
+ */
+
+static uint32_t
+capture_pack(uint32_t bits, uint32_t mask) {
+  uint32_t packed = 0;
+  uint32_t bit = 1;
+
+  for (; mask; mask &= mask - 1, bit <<= 1) {
+    if (bits & mask & -mask) packed |= bit;
+  }
+
+  return packed;
+}
+
+static uint32_t
+capture_unpack(uint32_t packed, uint32_t mask) {
+  uint32_t bits = 0;
+
+  for (; mask && packed; mask &= mask - 1, packed >>= 1) {
+    if (packed & 1) bits |= mask & -mask;
+  }
+
+  return bits;
+}
+
+/*
+ * Map the window starting at `off`, growing the file to
+ * its end. The previous window's pages are left to
+ * writeback.
+ */
+
+static int
+capture_map(pi_capture_t *capture, uint64_t off) {
+  void *map;
+
+  if (capture->map != NULL) munmap(capture->map, capture->window);
+  capture->map = NULL;
+
+  if (ftruncate(capture->fd, off + capture->window) < 0) return -1;
+  map = mmap(NULL, capture->window, PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, off);
+  if (map == MAP_FAILED) return -1;
+
+  capture->map = map;
+  capture->map_off = off;
+  return 0;
+}
+
+static int
+capture_write_header(pi_capture_t *capture) {
+  capture->header.data_end = capture->pos;
+  capture->header.end_ticks = capture->ticks;
+  return pwrite(capture->fd, &capture->header, sizeof(capture_header_t), 0)
+    == sizeof(capture_header_t) ? 0 : -1;
+}
+
+static int
+capture_put(pi_capture_t *capture, const uint8_t *buf, size_t len) {
+  while (len) {
+    uint64_t end = capture->map_off + capture->window;
+    size_t room, n;
+
+    if (capture->pos == end) {
+      if (capture_write_header(capture) < 0 || capture_map(capture, end) < 0) {
+        capture->error = errno;
+        return -1;
+      }
+    }
+
+    room = capture->map_off + capture->window - capture->pos;
+    n = len < room ? len : room;
+    memcpy(capture->map + (capture->pos - capture->map_off), buf, n);
+    capture->pos += n;
+    buf += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static int
+capture_flush_repeat(pi_capture_t *capture) {
+  uint8_t buf[10];
+
+  if (capture->pending == 0) return 0;
+  if (capture_put(capture, buf, varint_put(buf, capture->pending << 1 | 1)) < 0) return -1;
+  capture->pending = 0;
+  capture->header.records++;
+  return 0;
+}
+
+static int
+capture_index_add(pi_capture_t *capture) {
+  capture_index_t *entry;
+
+  if (capture->header.index_count == capture->index_cap) {
+    size_t cap = capture->index_cap ? capture->index_cap * 2 : 64;
+    capture_index_t *index = realloc(capture->index, cap * sizeof(capture_index_t));
+    if (index == NULL) return -1;
+    capture->index = index;
+    capture->index_cap = cap;
+  }
+
+  entry = &capture->index[capture->header.index_count++];
+  entry->ticks = capture->ticks;
+  entry->offset = capture->pos;
+  entry->levels = capture->levels;
+  entry->pad = 0;
+  capture->next_index = capture->pos + capture->index_bytes;
+  return 0;
+}
+
+/*
+ * Store the transition to `levels` at `ticks`, if any
+ * watched pin changed.
+ */
+
+static int
+capture_encode(pi_capture_t *capture, uint64_t ticks, uint32_t levels) {
+  uint32_t bits = (levels ^ capture->levels) & capture->header.mask;
+  uint64_t delta;
+  uint8_t buf[20];
+  size_t n;
+
+  if (bits == 0) return 0;
+  if (ticks < capture->ticks) ticks = capture->ticks;
+  delta = ticks - capture->ticks;
+
+  if (capture->repeatable && delta == capture->prev_delta && bits == capture->prev_bits) {
+    capture->pending++;
+  } else {
+    if (capture_flush_repeat(capture) < 0) return -1;
+    if (capture->pos >= capture->next_index && capture_index_add(capture) < 0) return -1;
+
+    n = varint_put(buf, delta << 1);
+    n += varint_put(buf + n, capture_pack(bits, capture->header.mask));
+    if (capture_put(capture, buf, n) < 0) return -1;
+
+    capture->prev_delta = delta;
+    capture->prev_bits = bits;
+    capture->repeatable = 1;
+    capture->header.records++;
+  }
+
+  capture->ticks = ticks;
+  capture->levels ^= bits;
+  capture->header.transitions++;
+  return 0;
+}
+
+/*
+ * Create `path` for a capture of the bank 0 pins in
+ * `mask`, which were at `levels` at `start` (usually
+ * pi_gpio_read_mask() and pi_time_ns()).
+ */
+
+pi_capture_t*
+pi_capture_new(const char *path, uint32_t mask, uint32_t levels, uint64_t start,
+    const pi_capture_config_t *config) {
+  pi_capture_config_t defaults = { 0, 0, 0 };
+  uint32_t page = (uint32_t) sysconf(_SC_PAGESIZE);
+  pi_capture_t *capture;
+
+  if (config == NULL) config = &defaults;
+  if (mask == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  capture = calloc(1, sizeof(pi_capture_t));
+  if (capture == NULL) return NULL;
+
+  capture->window = config->window ? config->window : DEFAULT_WINDOW;
+  capture->window = (capture->window + page - 1) & ~(page - 1);
+  capture->index_bytes = config->index_bytes ? config->index_bytes : DEFAULT_INDEX_BYTES;
+
+  capture_header_t header = {
+      .magic = PI_CAPTURE_MAGIC
+    , .version = PI_CAPTURE_VERSION
+    , .tick_ns = config->tick_ns ? config->tick_ns : 1
+    , .start = start
+    , .mask = mask
+    , .levels = levels & mask
+  };
+  capture->header = header;
+  capture->levels = levels & mask;
+  capture->pos = DATA_OFFSET;
+  capture->next_index = DATA_OFFSET + capture->index_bytes;
+
+  capture->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (capture->fd < 0) {
+    free(capture);
+    return NULL;
+  }
+
+  if (capture_map(capture, 0) < 0 || capture_write_header(capture) < 0) {
+    int err = errno;
+    close(capture->fd);
+    unlink(path);
+    free(capture);
+    errno = err;
+    return NULL;
+  }
+
+  debug("%s mask 0x%08x", path, mask);
+  return capture;
+}
+
+/*
+ * Encode samples in time order. Samples that change no
+ * watched pin cost nothing. Returns -1 with errno set
+ * once the file cannot grow; the capture is then stuck.
+ */
+
+int
+pi_capture_append(pi_capture_t *capture, const pi_sample_t *samples, size_t count) {
+  uint64_t start = capture->header.start;
+  uint32_t tick = capture->header.tick_ns;
+  size_t i;
+
+  if (capture->error) {
+    errno = capture->error;
+    return -1;
+  }
+
+  for (i = 0; i < count; i++) {
+    uint64_t time = samples[i].time;
+    uint64_t ticks = time > start ? (time - start) / tick : 0;
+    if (capture_encode(capture, ticks, samples[i].levels) < 0) return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Drain thread: moves sampler records into the file so
+ * the sampling thread never waits on the file system.
+ */
+
+static void*
+capture_run(void *arg) {
+  pi_capture_t *capture = arg;
+  pi_sample_t samples[DRAIN_BATCH];
+
+  while (capture->running) {
+    size_t n = pi_sampler_read(capture->sampler, samples, DRAIN_BATCH);
+    if (n) pi_capture_append(capture, samples, n);
+    if (n < DRAIN_BATCH) pi_sleep_ns(DRAIN_NS);
+  }
+
+  return NULL;
+}
+
+/*
+ * Sample the watched pins `rate` times a second with a
+ * change-only sampler and stream the transitions to the
+ * file until stopped. A tick of 1e9 / `rate` ns lets
+ * periodic signals collapse into repeats.
+ */
+
+int
+pi_capture_start(pi_capture_t *capture, pi_closure_t *closure, uint32_t rate) {
+  if (capture->running) return 0;
+
+  capture->sampler = pi_sampler_new(closure, rate, SAMPLER_CAPACITY, NULL, NULL);
+  if (capture->sampler == NULL) return -1;
+
+  if (pi_sampler_start(capture->sampler, capture->header.mask) < 0) {
+    pi_sampler_delete(capture->sampler);
+    capture->sampler = NULL;
+    return -1;
+  }
+
+  capture->running = 1;
+  if (pthread_create(&capture->thread, NULL, capture_run, capture) != 0) {
+    debug("error: cannot start thread");
+    capture->running = 0;
+    pi_sampler_delete(capture->sampler);
+    capture->sampler = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Stop sampling and write out what the sampler still
+ * holds.
+ */
+
+void
+pi_capture_stop(pi_capture_t *capture) {
+  pi_sample_t samples[DRAIN_BATCH];
+  size_t n;
+
+  if (capture->sampler == NULL) return;
+
+  pi_sampler_stop(capture->sampler);
+  capture->running = 0;
+  pthread_join(capture->thread, NULL);
+
+  while ((n = pi_sampler_read(capture->sampler, samples, DRAIN_BATCH)) > 0) {
+    pi_capture_append(capture, samples, n);
+  }
+
+  capture->header.dropped += pi_sampler_dropped(capture->sampler);
+  pi_sampler_delete(capture->sampler);
+  capture->sampler = NULL;
+}
+
+/*
+ * Counters so far; transitions held in a pending repeat
+ * are counted though not yet written.
+ */
+
+void
+pi_capture_info(pi_capture_t *capture, pi_capture_info_t *info) {
+  const capture_header_t *header = &capture->header;
+
+  info->start = header->start;
+  info->end = header->start + capture->ticks * header->tick_ns;
+  info->tick_ns = header->tick_ns;
+  info->mask = header->mask;
+  info->levels = header->levels;
+  info->transitions = header->transitions;
+  info->records = header->records + (capture->pending != 0);
+  info->bytes = capture->pos - DATA_OFFSET;
+  info->index_count = header->index_count;
+  info->dropped = header->dropped
+    + (capture->sampler ? pi_sampler_dropped(capture->sampler) : 0);
+}
+
+/*
+ * Stop, write the index and header and trim the file.
+ * Returns -1 with errno set if anything was lost.
+ */
+
+int
+pi_capture_close(pi_capture_t *capture) {
+  size_t index_len;
+  int err;
+
+  pi_capture_stop(capture);
+  capture_flush_repeat(capture);
+  err = capture->error;
+
+  if (capture->map != NULL) munmap(capture->map, capture->window);
+
+  // the reader maps the index in place, so align it for its uint64_t fields
+  index_len = capture->header.index_count * sizeof(capture_index_t);
+  capture->header.index_offset = (capture->pos + INDEX_ALIGN - 1) & ~(uint64_t)(INDEX_ALIGN - 1);
+  if (index_len && pwrite(capture->fd, capture->index, index_len, capture->header.index_offset)
+      != (ssize_t) index_len) err = errno;
+  if (capture_write_header(capture) < 0) err = errno;
+  if (ftruncate(capture->fd, capture->header.index_offset + index_len) < 0) err = errno;
+
+  debug("%llu transitions in %llu bytes"
+    , (unsigned long long) capture->header.transitions
+    , (unsigned long long)(capture->pos - DATA_OFFSET));
+
+  close(capture->fd);
+  free(capture->index);
+  free(capture);
+
+  if (err) {
+    errno = err;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Reader. The file is mapped whole and read only.
+ */
+
+static void
+capture_rewind(pi_capture_reader_t *reader) {
+  memset(&reader->state, 0, sizeof(capture_state_t));
+  reader->state.pos = DATA_OFFSET;
+  reader->state.levels = reader->header.levels;
+}
+
+/*
+ * Open a capture for reading, positioned at its start.
+ * Returns NULL with errno EPROTO if `path` is not a
+ * capture of this version or its header is corrupt. Captures that were never
+ * closed read up to their last window and seek linearly.
+ */
+
+pi_capture_reader_t*
+pi_capture_open(const char *path) {
+  pi_capture_reader_t *reader;
+  capture_header_t *header;
+  struct stat st;
+  void *map;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  if (fstat(fd, &st) < 0 || (size_t) st.st_size < DATA_OFFSET) {
+    close(fd);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+
+  header = map;
+  if (memcmp(header->magic, PI_CAPTURE_MAGIC, sizeof(PI_CAPTURE_MAGIC)) != 0
+      || header->version != PI_CAPTURE_VERSION
+      || header->tick_ns == 0
+      || header->data_end < DATA_OFFSET || header->data_end > (uint64_t) st.st_size) {
+    munmap(map, st.st_size);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  reader = calloc(1, sizeof(pi_capture_reader_t));
+  if (reader == NULL) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  reader->map = map;
+  reader->size = st.st_size;
+  reader->header = *header;
+
+  if (header->index_offset && header->index_offset % INDEX_ALIGN == 0
+      && header->index_offset + header->index_count * sizeof(capture_index_t) <= reader->size) {
+    reader->index = (const capture_index_t*)(reader->map + header->index_offset);
+    reader->index_count = header->index_count;
+  }
+
+  capture_rewind(reader);
+  return reader;
+}
+
+void
+pi_capture_reader_info(pi_capture_reader_t *reader, pi_capture_info_t *info) {
+  const capture_header_t *header = &reader->header;
+
+  info->start = header->start;
+  info->end = header->start + header->end_ticks * header->tick_ns;
+  info->tick_ns = header->tick_ns;
+  info->mask = header->mask;
+  info->levels = header->levels;
+  info->transitions = header->transitions;
+  info->records = header->records;
+  info->bytes = header->data_end - DATA_OFFSET;
+  info->index_count = reader->index_count;
+  info->dropped = header->dropped;
+}
+
+/*
+ * Next transition: its time, the levels after it and the
+ * pins that changed. Returns 0 at the end.
+ */
+
+int
+pi_capture_next(pi_capture_reader_t *reader, pi_sample_t *sample) {
+  capture_state_t *st = &reader->state;
+  uint64_t end = reader->header.data_end;
+  uint64_t head, packed;
+
+  if (st->repeat == 0) {
+    if (varint_get(reader->map, end, &st->pos, &head) < 0) return 0;
+
+    if (head & 1) {
+      st->repeat = head >> 1;
+    } else {
+      if (varint_get(reader->map, end, &st->pos, &packed) < 0) return 0;
+      st->prev_delta = head >> 1;
+      st->prev_bits = capture_unpack((uint32_t) packed, reader->header.mask);
+      st->repeat = 1;
+    }
+  }
+
+  st->repeat--;
+  st->ticks += st->prev_delta;
+  st->levels ^= st->prev_bits;
+
+  sample->time = reader->header.start + st->ticks * reader->header.tick_ns;
+  sample->levels = st->levels;
+  sample->changed = st->prev_bits;
+  return 1;
+}
+
+/*
+ * Position before the first transition at or after
+ * `time`: jump to the last index entry before it, then
+ * decode forward.
+ */
+
+void
+pi_capture_seek(pi_capture_reader_t *reader, uint64_t time) {
+  const capture_header_t *header = &reader->header;
+  uint64_t target, lo = 0, hi = reader->index_count;
+  capture_state_t saved;
+  pi_sample_t sample;
+
+  capture_rewind(reader);
+  if (time <= header->start) return;
+  target = (time - header->start + header->tick_ns - 1) / header->tick_ns;
+
+  // first entry at or after target
+  while (lo < hi) {
+    uint64_t mid = (lo + hi) / 2;
+    if (reader->index[mid].ticks < target) lo = mid + 1;
+    else hi = mid;
+  }
+
+  if (lo > 0) {
+    const capture_index_t *entry = &reader->index[lo - 1];
+    reader->state.pos = entry->offset;
+    reader->state.ticks = entry->ticks;
+    reader->state.levels = entry->levels;
+  }
+
+  for (;;) {
+    saved = reader->state;
+    if (!pi_capture_next(reader, &sample)) break;
+    if (sample.time >= time) break;
+  }
+
+  reader->state = saved;
+}
+
+/*
+ * Levels before the next transition.
+ */
+
+uint32_t
+pi_capture_levels(pi_capture_reader_t *reader) {
+  return reader->state.levels;
+}
+
+void
+pi_capture_reader_close(pi_capture_reader_t *reader) {
+  munmap((void*) reader->map, reader->size);
+  free(reader);
+}
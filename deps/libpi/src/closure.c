@@ -23,9 +23,11 @@ static pi_closure_t* default_closure_inst;
 int
 pi__closure_init(pi_closure_t *closure) {
   memset(closure, 0, sizeof(*closure));
-  closure->revision = pi_revision();
   closure->gpio_map = NULL;
   closure->i2c_map = NULL;
+  closure->pwm_map = NULL;
+  closure->clk_map = NULL;
+  closure->journal = pi__journal_env;
   return 0;
 }
 
@@ -39,7 +41,7 @@ pi_default_closure(void) {
 
 pi_closure_t*
 pi_closure_new(void) {
-  pi_closure_t *closure = malloc(sizeof(closure));
+  pi_closure_t *closure = malloc(sizeof(pi_closure_t));
   if (closure == NULL) return NULL;
   pi__closure_init(closure);
   return closure;
@@ -47,7 +49,8 @@ pi_closure_new(void) {
 
 void
 pi_closure_delete(pi_closure_t *closure) {
-  // TODO: teardowns
+  if (closure->gpio_map != NULL) pi_gpio_teardown(closure);
+
   if (closure == default_closure_inst) {
     debug("default");
     default_closure_inst = NULL;
@@ -7,7 +7,9 @@
 #ifndef PI_COMMON_H
 #define PI_COMMON_H
 
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 /*
  * Get current DEBUG variable.
@@ -32,16 +34,182 @@
     }                                                                         \
   } while (0)
 
+/*
+ * Gpio register offsets (in words) and block size.
+ */
+
+#define FSEL_OFFSET          0
+#define SET_OFFSET           7
+#define CLR_OFFSET           10
+#define PINLEVEL_OFFSET      13
+#define PULLUPDN_OFFSET      37
+#define PULLUPDNCLK_OFFSET   38
+
+#define EVENT_DETECT_OFFSET          16
+#define RISING_DETECT_OFFSET         19
+#define FALLING_DETECT_OFFSET        22
+#define HIGH_DETECT_OFFSET           25
+#define LOW_DETECT_OFFSET            28
+#define ASYNC_RISING_DETECT_OFFSET   31
+#define ASYNC_FALLING_DETECT_OFFSET  34
+
+#define PAGE_SIZE    (4*1024)
+#define BLOCK_SIZE   (4*1024)
+
+/*
+ * Spinlocks for short register read-modify-write
+ * sequences. Waiters yield so a preempted holder on a
+ * single core is not starved.
+ */
+
+typedef volatile int pi__spinlock_t;
+
+#define PI_SPINLOCK_INIT 0
+
+void
+pi__spin_yield(void);
+
+static inline void
+pi__spin_lock(pi__spinlock_t *lock) {
+  while (__sync_lock_test_and_set(lock, 1)) {
+    while (*lock) pi__spin_yield();
+  }
+}
+
+static inline void
+pi__spin_unlock(pi__spinlock_t *lock) {
+  __sync_lock_release(lock);
+}
+
+/*
+ * Tracepoints. Always compiled in; a single predicted
+ * branch when tracing is off.
+ */
+
+extern volatile int pi__trace_on;
+
+void
+pi__trace_emit(uint16_t op, uint16_t pin, uint32_t value, uint32_t extra);
+
+#define pi__trace(op, pin, value, extra)                                      \
+  do {                                                                        \
+    if (__builtin_expect(pi__trace_on, 0)) {                                  \
+      pi__trace_emit((op), (pin), (value), (extra));                          \
+    }                                                                         \
+  } while (0)
+
+/*
+ * Journal points, beside the tracepoints of the ops a
+ * journal can replay. A load and a predicted branch when
+ * the closure has no journal.
+ */
+
+extern pi_journal_t *pi__journal_env;
+
+void
+pi__journal_emit(pi_journal_t *journal, uint8_t op, uint8_t pin, uint32_t value,
+    uint32_t extra);
+
+#define pi__journal(closure, op, pin, value, extra)                           \
+  do {                                                                        \
+    pi_journal_t *journal__ = (closure)->journal;                             \
+    if (__builtin_expect(journal__ != NULL, 0)) {                             \
+      pi__journal_emit(journal__, (op), (pin), (value), (extra));             \
+    }                                                                         \
+  } while (0)
+
+/*
+ * peripheral.c
+ */
+
+volatile uint32_t*
+pi__peripheral_map(const char *dev, off_t base, size_t size);
+
+void
+pi__peripheral_unmap(volatile uint32_t *map);
+
+/*
+ * Bus addresses of the registers DMA control blocks
+ * write. The engine sees peripherals at 0x7E000000
+ * whatever the ARM physical base.
+ */
+
+#define PI_BUS_GPSET0        0x7E20001C
+#define PI_BUS_GPCLR0        0x7E200028
+#define PI_BUS_PWM_FIF1      0x7E20C018
+
+/*
+ * DMA transfer information (control block `ti`) bits.
+ */
+
+#define PI_DMA_TI_TDMODE          (1 << 1)
+#define PI_DMA_TI_WAIT_RESP       (1 << 3)
+#define PI_DMA_TI_DEST_INC        (1 << 4)
+#define PI_DMA_TI_DEST_DREQ       (1 << 6)
+#define PI_DMA_TI_SRC_INC         (1 << 8)
+#define PI_DMA_TI_PERMAP(p)       ((p) << 16)
+#define PI_DMA_TI_PERMAP_MASK     (0x1f << 16)
+#define PI_DMA_TI_NO_WIDE_BURSTS  (1 << 26)
+
+#define PI_DMA_PERMAP_PWM         5
+
+/*
+ * Compiled waveform. Control blocks followed by their
+ * data words live in one DMA-able block of `size` bytes,
+ * seen by the engine at bus address `bus`.
+ */
+
+struct pi_wave_s {
+  pi_closure_t *closure;
+  void *mem;
+  uint32_t bus;
+  size_t size;
+  uint32_t mbox_handle;
+  pi_dma_cb_t *cbs;
+  size_t ncbs;
+  uint32_t tick_ns;
+  int loop;
+  volatile uint32_t *dma_map;
+  int channel;
+};
+
+/*
+ * pwm.c
+ */
+
+void
+pi__pwm_release(pi_closure_t *closure, pi_gpio_pin_t pin);
+
+/*
+ * gpio_watch.c
+ */
+
+int
+pi__watch_decide(int polling, uint32_t rate, uint32_t poll_rate, uint32_t irq_rate);
+
+/*
+ * gpio_sim.c
+ */
+
+void
+pi__gpio_sim_clear_events(pi_closure_t *closure, int bank, uint32_t mask);
+
 /*
  * timer.c
  */
 
+uint64_t
+pi_time_ns(void);
+
 void
 pi_sleep_ms(unsigned long ms);
 
 void
 pi_sleep_ns(unsigned long ns);
 
+void
+pi_sleep_until_ns(uint64_t deadline);
+
 /*
  * Stop
  */
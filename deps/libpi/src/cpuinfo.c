@@ -7,7 +7,7 @@
 #include "pi.h"
 #include "common.h"
 
-#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,50 +23,165 @@
 #define MAX_BUF 1024
 
 /*
- * Get the current board revision.
+ * Sources, in order of preference.
  */
 
-int
-pi_revision() {
-  debug("start");
-  FILE *fd;
+#define DT_REVISION "/proc/device-tree/system/linux,revision"
+#define DT_RANGES   "/proc/device-tree/soc/ranges"
+#define CPUINFO     "/proc/cpuinfo"
+
+/*
+ * New-style revision codes set this bit and carry the
+ * processor in bits 12-15.
+ */
+
+#define REVISION_NEW_STYLE  (1 << 23)
+#define REVISION_PROCESSOR(code) (((code) >> 12) & 0xf)
+
+/*
+ * Detected once, read-only afterwards.
+ */
+
+static pi_board_t board;
+static pthread_once_t board_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Read a big-endian 32 bit cell from a device-tree file.
+ * Returns 0 on success.
+ */
+
+static int
+pi__dt_cell(const char *path, long offset, uint32_t *value) {
+  unsigned char buf[4];
+  FILE *fd = fopen(path, "rb");
+  int res = -1;
+
+  if (fd == NULL) return -1;
+
+  if (fseek(fd, offset, SEEK_SET) == 0 && fread(buf, 1, 4, fd) == 4) {
+    *value = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+    res = 0;
+  }
+
+  fclose(fd);
+  return res;
+}
+
+/*
+ * Revision code from the device tree, falling back to
+ * the `Revision` line of /proc/cpuinfo.
+ */
+
+static uint32_t
+pi__revision_code(void) {
   char buf_file[MAX_BUF];
   char buf_key[MAX_BUF];
   char buf_val[MAX_BUF];
+  uint32_t code = 0;
+  FILE *fd;
 
-  fd = fopen("/proc/cpuinfo", "r");
+  if (pi__dt_cell(DT_REVISION, 0, &code) == 0 && code != 0) {
+    return code;
+  }
+
+  fd = fopen(CPUINFO, "r");
   if (fd == NULL) {
-    debug("error: cannot open /proc/cpuinfo");
-    return -1;
+    debug("error: cannot open " CPUINFO);
+    return 0;
   }
 
   while (fgets(buf_file, sizeof(buf_file), fd) != NULL) {
-    if (strlen(buf_file) == 1) continue;
-    sscanf(buf_file, "%[^\t:] : %[^\t\n]", buf_key, buf_val);
-    if (strncmp("Revision", buf_key, 8) == 0) break;
+    if (sscanf(buf_file, "%[^\t:] : %[^\t\n]", buf_key, buf_val) != 2) continue;
+    if (strncmp("Revision", buf_key, 8) == 0) {
+      code = strtoul(buf_val, NULL, 16);
+      break;
+    }
   }
 
   fclose(fd);
+  return code;
+}
 
-  long rev = strtol(buf_val, NULL, 16);
-  if (errno == ERANGE || rev == 0) {
-    debug("error: revision not found");
-    return -1;
+/*
+ * Peripheral base from the soc `ranges` property: the
+ * parent address follows the first child address cell
+ * and is two cells wide (high cell zero) on newer SoCs.
+ */
+
+static uint32_t
+pi__peripheral_base(void) {
+  uint32_t base = 0;
+
+  if (pi__dt_cell(DT_RANGES, 4, &base) == 0 && base == 0) {
+    pi__dt_cell(DT_RANGES, 8, &base);
   }
 
-  rev %= 0x10; // handle overclocked systems
+  return base;
+}
 
-  int res;
-  switch (rev) {
-    case 2:
-    case 3:
-      res = 1;
-      break;
-    default:
-      res = 2;
-      break;
+/*
+ * Fill `board` from the revision code and device tree.
+ */
+
+static void
+pi__board_detect(void) {
+  static const struct {
+    const char *name;
+    uint32_t base;
+  } socs[] = {
+      { "unknown", 0x20000000 }
+    , { "BCM2835", 0x20000000 }
+    , { "BCM2836", 0x3F000000 }
+    , { "BCM2837", 0x3F000000 }
+    , { "BCM2711", 0xFE000000 }
+    , { "BCM2712", 0 }
+  };
+
+  uint32_t code = pi__revision_code();
+  uint32_t base;
+
+  board.revision_code = code;
+
+  if (code & REVISION_NEW_STYLE) {
+    uint32_t processor = REVISION_PROCESSOR(code);
+    board.soc = processor <= 4 ? PI_SOC_BCM2835 + processor : PI_SOC_UNKNOWN;
+  } else {
+    board.soc = code ? PI_SOC_BCM2835 : PI_SOC_UNKNOWN;
   }
 
-  debug("revision: %i", res);
-  return res;
+  // only the first boards (old-style 2 and 3) had the rev 1 header
+  code &= (code & REVISION_NEW_STYLE) ? 0xffffff : 0xffff;
+  board.revision = (code == 2 || code == 3) ? 1 : 2;
+
+  board.soc_name = socs[board.soc].name;
+  board.peripheral_base = socs[board.soc].base;
+
+  // gpio lives on RP1 on BCM2712; the legacy block is not there
+  if (board.soc != PI_SOC_BCM2712) {
+    base = pi__peripheral_base();
+    if (base) board.peripheral_base = base;
+  }
+
+  debug("%s rev %x base %x", board.soc_name, board.revision_code
+    , board.peripheral_base);
+}
+
+/*
+ * Board information. Detection reads /proc on the first
+ * call only; later calls are free and thread safe.
+ */
+
+const pi_board_t*
+pi_board(void) {
+  pthread_once(&board_once, pi__board_detect);
+  return &board;
+}
+
+/*
+ * Get the current board revision.
+ */
+
+int
+pi_revision() {
+  return pi_board()->revision;
 }
@@ -0,0 +1,790 @@
+/*
+ * libpi - Shared memory GPIO daemon and client
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "daemon", ##args)
+
+/*
+ * Below this much time to the next scan the thread spins
+ * instead of sleeping, as in the sampler.
+ */
+
+#define SPIN_NS 50000
+
+#define DEFAULT_CLIENTS 8
+#define DEFAULT_RATE 10000
+#define DEFAULT_MODE 0660
+
+/*
+ * Layout limits. Owners are stored as slot + 1 in a byte.
+ */
+
+#define DAEMON_MAGIC 0x4c504944
+#define DAEMON_VERSION 1
+#define DAEMON_PINS 54
+#define MAX_CLIENTS 64
+#define RING_SIZE 256
+
+/*
+ * How often the daemon checks for clients that exited
+ * without disconnecting, and how long the blocking
+ * client calls wait.
+ */
+
+#define REAP_NS 100000000ULL
+#define CLIENT_TIMEOUT_NS 1000000000ULL
+
+enum {
+  SLOT_FREE = 0,          /* with pid 0, so the slot id is 0 */
+  SLOT_ATTACHING,         /* owned by a connecting client */
+  SLOT_ACTIVE,
+  SLOT_CLOSING            /* the daemon frees its pins */
+};
+
+/*
+ * Shared memory. The header is written by the daemon
+ * only; in a slot, `head` and the ring belong to the
+ * client, `tail`, `status` and the error fields to the
+ * daemon. Commands up to `tail` have run and left their
+ * result in `status` at the same ring index. Every client
+ * maps all of it writable, so `owner` and `tail` are only
+ * copies published for clients; the daemon decides from
+ * its own.
+ */
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+  uint32_t clients;
+  volatile int32_t pid;
+  volatile uint32_t running;
+
+  volatile uint32_t seq;          /* snapshot seqlock, odd while written */
+  volatile uint32_t levels[2];
+  volatile uint64_t time;
+  volatile uint8_t owner[64];
+} __attribute__((aligned(64))) shm_header_t;
+
+typedef union {
+  struct {
+    uint32_t state;
+    int32_t pid;
+  };
+  uint64_t word;                  /* both, swapped in one step */
+} slot_id_t;
+
+typedef struct {
+  union {
+    struct {
+      volatile uint32_t state;
+      volatile int32_t pid;
+    };
+    volatile uint64_t id;
+  };
+  volatile uint32_t head __attribute__((aligned(64)));
+  volatile uint32_t tail __attribute__((aligned(64)));
+  volatile uint32_t errors;
+  volatile int32_t last_error;
+  volatile int32_t status[RING_SIZE];
+  pi_daemon_cmd_t ring[RING_SIZE];
+} __attribute__((aligned(64))) shm_slot_t;
+
+struct pi_daemon_s {
+  pi_closure_t *closure;
+  char *name;
+  shm_header_t *shm;
+  shm_slot_t *slots;
+  size_t size;
+  unsigned int clients;
+  uint64_t period;
+
+  pi_gpio_handle_t *handles[DAEMON_PINS];
+  uint8_t owner[DAEMON_PINS];
+  uint32_t owned[MAX_CLIENTS][2];
+  uint32_t tails[MAX_CLIENTS];
+  pi_daemon_stats_t stats;
+
+  volatile int running;
+  pthread_t thread;
+};
+
+struct pi_client_s {
+  shm_header_t *shm;
+  shm_slot_t *slot;
+  size_t size;
+  uint32_t errors;
+};
+
+static size_t
+shm_size(unsigned int clients) {
+  return sizeof(shm_header_t) + clients * sizeof(shm_slot_t);
+}
+
+static int
+pid_alive(int32_t pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+/*
+ * Create the shared memory `name` (PI_DAEMON_NAME when
+ * NULL) for a closure with gpio set up. A segment left by
+ * a daemon that died is replaced; one held by a live
+ * daemon fails with errno EEXIST.
+ */
+
+pi_daemon_t*
+pi_daemon_new(pi_closure_t *closure, const char *name,
+    const pi_daemon_config_t *config) {
+  unsigned int clients = config && config->clients ? config->clients : DEFAULT_CLIENTS;
+  unsigned int mode = config && config->mode ? config->mode : DEFAULT_MODE;
+  uint32_t rate = config ? config->rate : DEFAULT_RATE;
+  pi_daemon_t *daemon;
+  size_t size = shm_size(clients);
+  void *mem;
+  int fd;
+
+  if (name == NULL) name = PI_DAEMON_NAME;
+
+  if (closure->gpio_map == NULL || clients > MAX_CLIENTS) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, mode);
+  if (fd < 0 && errno == EEXIST) {
+    int old = shm_open(name, O_RDONLY, 0);
+    int32_t pid = 0;
+
+    if (old >= 0) {
+      shm_header_t *header = mmap(NULL, sizeof(shm_header_t), PROT_READ, MAP_SHARED, old, 0);
+      if (header != MAP_FAILED) {
+        pid = header->pid;
+        munmap(header, sizeof(shm_header_t));
+      }
+      close(old);
+    }
+
+    if (pid_alive(pid)) {
+      debug("error: %s is served by pid %d", name, pid);
+      errno = EEXIST;
+      return NULL;
+    }
+
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, mode);
+  }
+
+  if (fd < 0) {
+    debug("error: cannot create %s", name);
+    return NULL;
+  }
+
+  // creation honours the umask; clients need `mode`
+  fchmod(fd, mode);
+  if (ftruncate(fd, size) < 0) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  daemon = calloc(1, sizeof(pi_daemon_t));
+  if (daemon == NULL || (daemon->name = strdup(name)) == NULL) {
+    free(daemon);
+    munmap(mem, size);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  daemon->closure = closure;
+  daemon->shm = mem;
+  daemon->slots = (shm_slot_t*) (daemon->shm + 1);
+  daemon->size = size;
+  daemon->clients = clients;
+  daemon->period = rate ? 1000000000ULL / rate : 0;
+
+  daemon->shm->version = DAEMON_VERSION;
+  daemon->shm->size = (uint32_t) size;
+  daemon->shm->clients = clients;
+  daemon->shm->pid = getpid();
+  __sync_synchronize();
+  daemon->shm->magic = DAEMON_MAGIC;
+  return daemon;
+}
+
+/*
+ * Run one command for client `c`. Returns 0 or a negative
+ * errno.
+ */
+
+static int
+daemon_exec(pi_daemon_t *daemon, unsigned int c, const pi_daemon_cmd_t *cmd) {
+  volatile uint32_t *gpio_map = daemon->closure->gpio_map;
+  uint8_t *owner = daemon->owner;
+  pi_gpio_pin_t pin = cmd->pin;
+  uint8_t me = c + 1;
+  uint32_t bit = 1u << (pin % 32);
+  pi_gpio_handle_t *handle;
+
+  if (cmd->op == PI_DAEMON_PING) return 0;
+
+  if (cmd->op == PI_DAEMON_WRITE_MASK) {
+    if (pin > 1) return -EINVAL;
+    if ((cmd->set | cmd->clr) & ~daemon->owned[c][pin]) return -EPERM;
+    if (cmd->set) *(gpio_map + SET_OFFSET + pin) = cmd->set;
+    if (cmd->clr) *(gpio_map + CLR_OFFSET + pin) = cmd->clr;
+    pi__trace(PI_TRACE_GPIO_WRITE_MASK, pin, cmd->set, cmd->clr);
+    return 0;
+  }
+
+  if (pin >= DAEMON_PINS) return -EINVAL;
+
+  if (cmd->op == PI_DAEMON_CLAIM) {
+    if (cmd->mode > 7) return -EINVAL;
+    if (owner[pin] != 0 && owner[pin] != me) return -EBUSY;
+
+    // a second claim by the owner reconfigures the pin
+    if (owner[pin] == me) {
+      handle = daemon->handles[pin];
+      pi_gpio_set_pull(handle, (pi_gpio_pull_t) cmd->arg);
+      if (cmd->mode == PI_GPIO_MODE_OUTPUT) {
+        pi_gpio_write(handle, cmd->set ? PI_GPIO_HIGH : PI_GPIO_LOW);
+      }
+      pi_gpio_set_mode(handle, (pi_gpio_mode_t) cmd->mode);
+      return 0;
+    }
+
+    handle = cmd->mode == PI_GPIO_MODE_OUTPUT
+      ? pi_gpio_claim_output(daemon->closure, pin, cmd->set ? PI_GPIO_HIGH : PI_GPIO_LOW)
+      : pi_gpio_claim_with_args(daemon->closure, pin, (pi_gpio_mode_t) cmd->mode
+          , (pi_gpio_pull_t) cmd->arg);
+    if (handle == NULL) return -ENOMEM;
+
+    daemon->handles[pin] = handle;
+    daemon->owned[c][pin / 32] |= bit;
+    owner[pin] = me;
+    daemon->shm->owner[pin] = me;
+    return 0;
+  }
+
+  if (owner[pin] != me) return -EPERM;
+  handle = daemon->handles[pin];
+
+  switch (cmd->op) {
+    case PI_DAEMON_RELEASE:
+      pi_gpio_release(handle);
+      daemon->handles[pin] = NULL;
+      daemon->owned[c][pin / 32] &= ~bit;
+      owner[pin] = 0;
+      daemon->shm->owner[pin] = 0;
+      return 0;
+    case PI_DAEMON_WRITE:
+      pi_gpio_write(handle, cmd->arg ? PI_GPIO_HIGH : PI_GPIO_LOW);
+      return 0;
+    case PI_DAEMON_SET_PULL:
+      pi_gpio_set_pull(handle, (pi_gpio_pull_t) cmd->arg);
+      return 0;
+    default:
+      return -EINVAL;
+  }
+}
+
+/*
+ * Run everything queued on a client ring, then publish
+ * the results with one store of `tail`. A `head` more
+ * than a ring ahead was not written by pi_client_submit();
+ * its commands are dropped and the ring starts over
+ * there.
+ */
+
+static void
+daemon_drain(pi_daemon_t *daemon, unsigned int c) {
+  shm_slot_t *slot = &daemon->slots[c];
+  uint32_t tail = daemon->tails[c];
+  uint32_t head = slot->head;
+
+  if (tail == head) return;
+  __sync_synchronize();
+
+  if (head - tail > RING_SIZE) {
+    debug("(%u) error: head %u is past tail %u", c, head, tail);
+    daemon->stats.rejected++;
+    slot->last_error = -EOVERFLOW;
+    slot->errors++;
+    tail = head;
+  }
+
+  while (tail != head) {
+    pi_daemon_cmd_t cmd = slot->ring[tail % RING_SIZE];
+    int res = daemon_exec(daemon, c, &cmd);
+
+    if (res < 0) {
+      daemon->stats.rejected++;
+      slot->last_error = res;
+      slot->errors++;
+    }
+
+    slot->status[tail % RING_SIZE] = res;
+    daemon->stats.commands++;
+    tail++;
+  }
+
+  __sync_synchronize();
+  daemon->tails[c] = tail;
+  slot->tail = tail;
+}
+
+/*
+ * Release every pin of a client and free its slot.
+ */
+
+static void
+daemon_detach(pi_daemon_t *daemon, unsigned int c) {
+  shm_slot_t *slot = &daemon->slots[c];
+  pi_gpio_pin_t pin;
+
+  for (pin = 0; pin < DAEMON_PINS; pin++) {
+    if (daemon->owner[pin] != c + 1) continue;
+    pi_gpio_release(daemon->handles[pin]);
+    daemon->handles[pin] = NULL;
+    daemon->owner[pin] = 0;
+    daemon->shm->owner[pin] = 0;
+  }
+
+  daemon->owned[c][0] = daemon->owned[c][1] = 0;
+  pi__trace(PI_TRACE_DAEMON_DISCONNECT, c, slot->pid, 0);
+  __sync_synchronize();
+  slot->id = 0;
+}
+
+static void
+daemon_snapshot(pi_daemon_t *daemon, uint64_t now) {
+  volatile uint32_t *level = daemon->closure->gpio_map + PINLEVEL_OFFSET;
+  shm_header_t *shm = daemon->shm;
+
+  shm->seq++;
+  __sync_synchronize();
+  shm->levels[0] = level[0];
+  shm->levels[1] = level[1];
+  shm->time = now;
+  __sync_synchronize();
+  shm->seq++;
+}
+
+/*
+ * Daemon thread: drain every ring, publish the levels,
+ * and now and then reap clients whose process is gone.
+ */
+
+static void*
+daemon_run(void *arg) {
+  pi_daemon_t *daemon = arg;
+  uint64_t deadline = pi_time_ns();
+  uint64_t reap = deadline + REAP_NS;
+  unsigned int c;
+
+  pi_closure_rt_apply(daemon->closure);
+
+  while (daemon->running) {
+    uint64_t now = pi_time_ns();
+    uint32_t connected = 0;
+
+    for (c = 0; c < daemon->clients; c++) {
+      shm_slot_t *slot = &daemon->slots[c];
+      uint32_t state = slot->state;
+
+      if (state == SLOT_ACTIVE || state == SLOT_CLOSING) daemon_drain(daemon, c);
+      if (state == SLOT_CLOSING) {
+        daemon_detach(daemon, c);
+        continue;
+      }
+
+      if (state == SLOT_FREE) continue;
+      if (now >= reap && slot->pid != 0 && !pid_alive(slot->pid)) {
+        debug("(%u) pid %d exited", c, slot->pid);
+        daemon->stats.reaped++;
+        daemon_detach(daemon, c);
+        continue;
+      }
+
+      connected++;
+    }
+
+    if (now >= reap) reap = now + REAP_NS;
+    daemon_snapshot(daemon, now);
+    daemon->stats.clients = connected;
+    daemon->stats.scans++;
+
+    if (daemon->period == 0) continue;
+
+    now = pi_time_ns();
+    deadline += daemon->period;
+
+    if (deadline <= now) {
+      deadline = now;
+    } else if (deadline - now > SPIN_NS) {
+      pi_sleep_until_ns(deadline - SPIN_NS);
+    }
+
+    while (pi_time_ns() < deadline);
+  }
+
+  return NULL;
+}
+
+/*
+ * Serve clients from a thread of its own.
+ */
+
+int
+pi_daemon_start(pi_daemon_t *daemon) {
+  if (daemon->running) return 0;
+
+  daemon->running = 1;
+  if (pthread_create(&daemon->thread, NULL, daemon_run, daemon) != 0) {
+    debug("error: cannot start thread");
+    daemon->running = 0;
+    return -1;
+  }
+
+  daemon->shm->running = 1;
+  return 0;
+}
+
+/*
+ * Snapshot of the counters; they may be a scan behind.
+ */
+
+void
+pi_daemon_stats(pi_daemon_t *daemon, pi_daemon_stats_t *stats) {
+  __sync_synchronize();
+  *stats = daemon->stats;
+}
+
+/*
+ * Stop serving. Clients stay connected and their commands
+ * queue until the daemon starts again.
+ */
+
+void
+pi_daemon_stop(pi_daemon_t *daemon) {
+  if (!daemon->running) return;
+  daemon->running = 0;
+  pthread_join(daemon->thread, NULL);
+  daemon->shm->running = 0;
+}
+
+/*
+ * Stop, release every client pin and remove the shared
+ * memory. Connected clients keep a dead mapping; their
+ * blocking calls time out.
+ */
+
+void
+pi_daemon_delete(pi_daemon_t *daemon) {
+  unsigned int c;
+
+  pi_daemon_stop(daemon);
+  for (c = 0; c < daemon->clients; c++) {
+    if (daemon->slots[c].state != SLOT_FREE) daemon_detach(daemon, c);
+  }
+
+  daemon->shm->pid = 0;
+  munmap(daemon->shm, daemon->size);
+  shm_unlink(daemon->name);
+  free(daemon->name);
+  free(daemon);
+}
+
+/*
+ * Attach to the daemon serving `name` (PI_DAEMON_NAME
+ * when NULL). Returns NULL with errno ENOENT when no
+ * daemon made it, EPROTO for another layout version,
+ * ECONNREFUSED when its daemon is gone and EBUSY when
+ * every client slot is taken.
+ */
+
+pi_client_t*
+pi_client_connect(const char *name) {
+  pi_client_t *client;
+  shm_header_t *shm;
+  struct stat st;
+  slot_id_t attach;
+  unsigned int c;
+  int fd;
+
+  if (name == NULL) name = PI_DAEMON_NAME;
+
+  fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) return NULL;
+
+  if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(shm_header_t)) {
+    close(fd);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  shm = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED) return NULL;
+
+  if (shm->magic != DAEMON_MAGIC || shm->version != DAEMON_VERSION
+      || shm_size(shm->clients) > (size_t) st.st_size) {
+    munmap(shm, st.st_size);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  if (!pid_alive(shm->pid)) {
+    munmap(shm, st.st_size);
+    errno = ECONNREFUSED;
+    return NULL;
+  }
+
+  client = calloc(1, sizeof(pi_client_t));
+  if (client == NULL) {
+    munmap(shm, st.st_size);
+    return NULL;
+  }
+
+  client->shm = shm;
+  client->size = st.st_size;
+
+  attach.state = SLOT_ATTACHING;
+  attach.pid = getpid();
+
+  for (c = 0; c < shm->clients; c++) {
+    shm_slot_t *slot = (shm_slot_t*) (shm + 1) + c;
+
+    // take a free slot and publish our pid in one step,
+    // so the daemon can reap it if we die attaching
+    if (!__sync_bool_compare_and_swap(&slot->id, 0, attach.word)) continue;
+
+    // start with an empty ring where the last client
+    // stopped
+    slot->head = slot->tail;
+    client->errors = slot->errors;
+    client->slot = slot;
+    __sync_synchronize();
+    slot->state = SLOT_ACTIVE;
+
+    pi__trace(PI_TRACE_DAEMON_CONNECT, c, slot->pid, 0);
+    return client;
+  }
+
+  free(client);
+  munmap(shm, st.st_size);
+  errno = EBUSY;
+  return NULL;
+}
+
+/*
+ * Queue a command without waiting. Returns its sequence
+ * number for pi_client_wait(), or -1 with errno EAGAIN
+ * when the ring is full.
+ */
+
+int64_t
+pi_client_submit(pi_client_t *client, const pi_daemon_cmd_t *cmd) {
+  shm_slot_t *slot = client->slot;
+  uint32_t head = slot->head;
+
+  if (head - slot->tail >= RING_SIZE) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  slot->ring[head % RING_SIZE] = *cmd;
+  slot->ring[head % RING_SIZE].seq = head;
+  __sync_synchronize();
+  slot->head = head + 1;
+  return head;
+}
+
+/*
+ * Wait for command `seq` to run, up to `timeout_ns` (0 for
+ * no limit). Returns its result, 0 or a negative errno,
+ * or -ETIMEDOUT. A result is kept until a ring's worth of
+ * later commands has run.
+ */
+
+int
+pi_client_wait(pi_client_t *client, uint32_t seq, uint64_t timeout_ns) {
+  shm_slot_t *slot = client->slot;
+  uint64_t start = 0;
+  unsigned int spins = 0;
+
+  while ((int32_t) (slot->tail - seq) <= 0) {
+    if (++spins < 1000) continue;
+    if (start == 0) start = pi_time_ns();
+    if (timeout_ns && pi_time_ns() - start >= timeout_ns) return -ETIMEDOUT;
+    pi__spin_yield();
+  }
+
+  __sync_synchronize();
+  return slot->status[seq % RING_SIZE];
+}
+
+static int
+client_call(pi_client_t *client, const pi_daemon_cmd_t *cmd) {
+  int64_t seq = pi_client_submit(client, cmd);
+  int res;
+
+  if (seq < 0) return -1;
+  res = pi_client_wait(client, (uint32_t) seq, CLIENT_TIMEOUT_NS);
+  if (res < 0) {
+    errno = -res;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Claim a pin through the daemon, waiting for the answer.
+ * Returns -1 with errno EBUSY if another client holds it.
+ */
+
+int
+pi_client_claim(pi_client_t *client, pi_gpio_pin_t pin, pi_gpio_mode_t mode,
+    pi_gpio_pull_t pull, pi_gpio_value_t value) {
+  pi_daemon_cmd_t cmd = { 0, PI_DAEMON_CLAIM, pin, mode, pull, value, 0 };
+  return client_call(client, &cmd);
+}
+
+int
+pi_client_release(pi_client_t *client, pi_gpio_pin_t pin) {
+  pi_daemon_cmd_t cmd = { 0, PI_DAEMON_RELEASE, pin, 0, 0, 0, 0 };
+  return client_call(client, &cmd);
+}
+
+/*
+ * Posted writes: these return once queued. Ownership
+ * failures show up at the next pi_client_flush().
+ */
+
+int
+pi_client_write(pi_client_t *client, pi_gpio_pin_t pin, pi_gpio_value_t value) {
+  pi_daemon_cmd_t cmd = { 0, PI_DAEMON_WRITE, pin, 0, value ? 1 : 0, 0, 0 };
+  return pi_client_submit(client, &cmd) < 0 ? -1 : 0;
+}
+
+int
+pi_client_write_mask(pi_client_t *client, unsigned int bank, uint32_t set,
+    uint32_t clr) {
+  pi_daemon_cmd_t cmd = { 0, PI_DAEMON_WRITE_MASK, bank, 0, 0, set, clr };
+  return pi_client_submit(client, &cmd) < 0 ? -1 : 0;
+}
+
+/*
+ * Wait for every queued command. Returns -1 with errno
+ * set to the last failure if any command failed since the
+ * previous flush.
+ */
+
+int
+pi_client_flush(pi_client_t *client, uint64_t timeout_ns) {
+  pi_daemon_cmd_t cmd = { 0, PI_DAEMON_PING, 0, 0, 0, 0, 0 };
+  int64_t seq = pi_client_submit(client, &cmd);
+  uint32_t errors;
+  int res;
+
+  if (seq < 0) return -1;
+  res = pi_client_wait(client, (uint32_t) seq, timeout_ns);
+  if (res < 0) {
+    errno = -res;
+    return -1;
+  }
+
+  errors = client->slot->errors;
+  if (errors != client->errors) {
+    client->errors = errors;
+    errno = -client->slot->last_error;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Commands the daemon has refused since the slot was
+ * made, and the negative errno of the last. Only reads
+ * the slot, so it is safe alongside the thread that
+ * submits.
+ */
+
+uint32_t
+pi_client_errors(pi_client_t *client, int *last_error) {
+  shm_slot_t *slot = client->slot;
+  uint32_t errors = slot->errors;
+
+  __sync_synchronize();
+  if (last_error != NULL) *last_error = slot->last_error;
+  return errors;
+}
+
+/*
+ * Levels from the daemon's last scan of a bank.
+ */
+
+uint32_t
+pi_client_read_mask(pi_client_t *client, unsigned int bank) {
+  shm_header_t *shm = client->shm;
+  uint32_t seq, levels;
+  int tries = 1000;
+
+  do {
+    seq = shm->seq;
+    __sync_synchronize();
+    levels = shm->levels[bank & 1];
+    __sync_synchronize();
+  } while ((seq & 1 || seq != shm->seq) && --tries);
+
+  return levels;
+}
+
+pi_gpio_value_t
+pi_client_read(pi_client_t *client, pi_gpio_pin_t pin) {
+  uint32_t levels = pi_client_read_mask(client, pin / 32);
+  return (levels >> (pin % 32)) & 1 ? PI_GPIO_HIGH : PI_GPIO_LOW;
+}
+
+/*
+ * Hand the slot back; the daemon runs what is queued,
+ * then releases the client's pins.
+ */
+
+void
+pi_client_disconnect(pi_client_t *client) {
+  __sync_synchronize();
+  client->slot->state = SLOT_CLOSING;
+  munmap(client->shm, client->size);
+  free(client);
+}
@@ -0,0 +1,291 @@
+/*
+ * libpi - GPIO character device (gpiochip v2 uAPI)
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "gpio_chardev", ##args)
+
+/*
+ * Events read from the kernel per read(2).
+ */
+
+#define EVENT_BATCH 64
+
+/*
+ * Mask covering every requested line.
+ */
+
+static uint64_t
+pi__lines_mask(pi_gpio_lines_t *lines) {
+  return lines->count == 64 ? ~0ULL : (1ULL << lines->count) - 1;
+}
+
+/*
+ * Translate a line config into uAPI flags.
+ */
+
+static uint64_t
+pi__lines_flags(const pi_gpio_lines_config_t *config) {
+  uint64_t flags;
+
+  if (config->mode == PI_GPIO_MODE_OUTPUT) {
+    flags = GPIO_V2_LINE_FLAG_OUTPUT;
+  } else {
+    flags = GPIO_V2_LINE_FLAG_INPUT;
+    if (config->edge & PI_GPIO_EDGE_RISING) flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    if (config->edge & PI_GPIO_EDGE_FALLING) flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+  }
+
+  switch (config->pull) {
+    case PI_GPIO_PULL_UP:
+      flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+      break;
+    case PI_GPIO_PULL_DOWN:
+      flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
+      break;
+    case PI_GPIO_PULL_NONE:
+    default:
+      flags |= GPIO_V2_LINE_FLAG_BIAS_DISABLED;
+      break;
+  }
+
+  return flags;
+}
+
+/*
+ * Request `count` lines of `chip` (e.g. "/dev/gpiochip0")
+ * as one handle. Works without root given access to the
+ * device node. Returns NULL on failure with errno set.
+ */
+
+pi_gpio_lines_t*
+pi_gpio_lines_request(const char *chip, const pi_gpio_pin_t *pins,
+    unsigned int count, const pi_gpio_lines_config_t *config) {
+  struct gpio_v2_line_request req;
+  pi_gpio_lines_t *lines;
+  unsigned int i;
+  int chip_fd, res;
+
+  if (count == 0 || count > PI_GPIO_LINES_MAX) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  lines = calloc(1, sizeof(pi_gpio_lines_t));
+  if (lines == NULL) return NULL;
+
+  lines->method = PI_GPIO_METHOD_CHARDEV;
+  lines->count = count;
+  lines->fd = -1;
+
+  memset(&req, 0, sizeof(req));
+  for (i = 0; i < count; i++) {
+    req.offsets[i] = pins[i];
+    lines->pins[i] = pins[i];
+  }
+
+  req.num_lines = count;
+  req.event_buffer_size = config->event_buffer_size;
+  strncpy(req.consumer, config->consumer ? config->consumer : "libpi"
+    , GPIO_MAX_NAME_SIZE - 1);
+  req.config.flags = pi__lines_flags(config);
+
+  if (config->mode == PI_GPIO_MODE_OUTPUT) {
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    req.config.attrs[0].attr.values = config->values;
+    req.config.attrs[0].mask = pi__lines_mask(lines);
+  }
+
+  chip_fd = open(chip, O_RDWR | O_CLOEXEC);
+  if (chip_fd < 0) {
+    debug("error: cannot open %s", chip);
+    free(lines);
+    return NULL;
+  }
+
+  res = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+  close(chip_fd);
+
+  if (res < 0) {
+    debug("error: line request on %s", chip);
+    free(lines);
+    return NULL;
+  }
+
+  lines->fd = req.fd;
+  lines->flags = req.config.flags;
+  debug("%s: %u lines, fd %d", chip, count, lines->fd);
+  return lines;
+}
+
+/*
+ * Read every requested line with one ioctl.
+ */
+
+int
+pi_gpio_lines_get(pi_gpio_lines_t *lines, uint64_t *values) {
+  struct gpio_v2_line_values req;
+
+  req.bits = 0;
+  req.mask = pi__lines_mask(lines);
+
+  if (ioctl(lines->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &req) < 0) {
+    lines->error = errno;
+    return -1;
+  }
+
+  *values = req.bits;
+  pi__trace(PI_TRACE_GPIO_LINES_GET, lines->pins[0], (uint32_t) req.bits, lines->count);
+  return 0;
+}
+
+/*
+ * Drive the lines in `mask` to their bit in `values`
+ * with one ioctl. Lines must be requested as outputs.
+ */
+
+int
+pi_gpio_lines_set(pi_gpio_lines_t *lines, uint64_t values, uint64_t mask) {
+  struct gpio_v2_line_values req;
+
+  req.bits = values;
+  req.mask = mask & pi__lines_mask(lines);
+  if (req.mask == 0) return 0;
+
+  if (ioctl(lines->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &req) < 0) {
+    lines->error = errno;
+    return -1;
+  }
+
+  pi__trace(PI_TRACE_GPIO_LINES_SET, lines->pins[0], (uint32_t) values, (uint32_t) req.mask);
+  return 0;
+}
+
+/*
+ * Read up to `max` queued edge events. Waits up to
+ * `timeout` ms for the first (-1 blocks, 0 polls).
+ * Returns the number of events, 0 on timeout or -1 on
+ * error.
+ */
+
+int
+pi_gpio_lines_read_events(pi_gpio_lines_t *lines, pi_gpio_lines_event_t *events,
+    size_t max, int timeout) {
+  struct gpio_v2_line_event buf[EVENT_BATCH];
+  struct pollfd pfd;
+  ssize_t bytes;
+  size_t n, i;
+  int res;
+
+  if (max == 0) return 0;
+  if (max > EVENT_BATCH) max = EVENT_BATCH;
+
+  pfd.fd = lines->fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  do {
+    res = poll(&pfd, 1, timeout);
+  } while (res < 0 && errno == EINTR);
+
+  if (res < 0) {
+    lines->error = errno;
+    return -1;
+  }
+
+  if (res == 0) return 0;
+
+  do {
+    bytes = read(lines->fd, buf, sizeof(buf[0]) * max);
+  } while (bytes < 0 && errno == EINTR);
+
+  if (bytes < 0) {
+    lines->error = errno;
+    return -1;
+  }
+
+  n = bytes / sizeof(buf[0]);
+  for (i = 0; i < n; i++) {
+    events[i].time = buf[i].timestamp_ns;
+    events[i].pin = buf[i].offset;
+    events[i].edge = buf[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE
+      ? PI_GPIO_EDGE_RISING
+      : PI_GPIO_EDGE_FALLING;
+    events[i].seqno = buf[i].seqno;
+    events[i].line_seqno = buf[i].line_seqno;
+  }
+
+  pi__trace(PI_TRACE_GPIO_LINES_EVENTS, lines->pins[0], n, lines->count);
+  return (int) n;
+}
+
+/*
+ * Turn kernel edge detection off (or back on) for the
+ * lines in `mask`, leaving their other flags as
+ * requested. Quiet lines queue no events and cost no
+ * interrupts.
+ */
+
+int
+pi_gpio_lines_set_edge_enabled(pi_gpio_lines_t *lines, uint64_t mask, int enabled) {
+  struct gpio_v2_line_config config;
+  uint64_t quiet = enabled ? lines->quiet & ~mask : lines->quiet | mask;
+
+  if (lines->flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+    lines->error = EINVAL;
+    return -1;
+  }
+
+  quiet &= pi__lines_mask(lines);
+  if (quiet == lines->quiet) return 0;
+
+  memset(&config, 0, sizeof(config));
+  config.flags = lines->flags;
+
+  if (quiet) {
+    config.num_attrs = 1;
+    config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    config.attrs[0].attr.flags = lines->flags
+      & ~(GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING);
+    config.attrs[0].mask = quiet;
+  }
+
+  if (ioctl(lines->fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+    lines->error = errno;
+    return -1;
+  }
+
+  debug("quiet 0x%llx", (unsigned long long) quiet);
+  lines->quiet = quiet;
+  return 0;
+}
+
+/*
+ * Release the lines and free the handle.
+ */
+
+void
+pi_gpio_lines_release(pi_gpio_lines_t *lines) {
+  debug("fd %d", lines->fd);
+  if (lines->fd >= 0) close(lines->fd);
+  free(lines);
+}
@@ -95,6 +95,9 @@ pi__gpio_set_mode(pi_gpio_handle_t *listener, pi_gpio_mode_t mode) {
       debug("(%i) out", (int)listener->pin);
       strcpy(str, "out");
       break;
+    default:
+      debug("(%i) unsupported mode", (int)listener->pin);
+      return -1;
   }
 
   snprintf(path, sizeof(path), "/gpio%d/mode", listener->pin);
@@ -211,6 +214,7 @@ pi_gpio_listen(pi_gpio_handle_t *listener, pi_gpio_edge_t edge) {
   }
 
   close(fd);
+  pi__trace(PI_TRACE_GPIO_LISTEN, listener->pin, res, edge);
   debug("(%i) return %i", (int)listener->pin, (int)res);
   return res;
 }
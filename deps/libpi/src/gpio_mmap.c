@@ -7,11 +7,10 @@
 #include "pi.h"
 #include "common.h"
 
-#include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/mman.h>
 
 /*
  * Debug macro
@@ -24,21 +23,61 @@
  * Gpio memory space
  */
 
-#define BCM2708_PERI_BASE   0x20000000
-#define GPIO_BASE           (BCM2708_PERI_BASE   +   0x200000)
+#define GPIO_OFFSET         0x200000
+#define GPIO_DEVICE         "/dev/mem"
 
-#define FSEL_OFFSET          0
-#define SET_OFFSET           7
-#define CLR_OFFSET           10
-#define PINLEVEL_OFFSET      13
-#define PULLUPDN_OFFSET      37
-#define PULLUPDNCLK_OFFSET   38
+/*
+ * Register locks. Each GPFSEL register holds the mode of
+ * 10 pins and is updated read-modify-write, so claims of
+ * neighbouring pins take that register's lock. The pull
+ * sequence drives the single GPPUD register for all pins
+ * and needs its own lock. SET, CLR and LEV accesses are
+ * single stores or loads and never lock. Locks are
+ * process-wide because every closure maps the same
+ * hardware.
+ */
+
+#define FSEL_REGISTERS 6
+
+static pi__spinlock_t fsel_locks[FSEL_REGISTERS];
+static pthread_mutex_t pull_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Mode and pull changes made on behalf of claim and
+ * release, which journal as the one op.
+ */
+
+static void
+gpio_set_mode(pi_gpio_handle_t *handle, pi_gpio_mode_t mode);
+
+static void
+gpio_set_pull(pi_gpio_handle_t *handle, pi_gpio_pull_t pull);
+
+/*
+ * Event detect enables, one register per condition in
+ * pi_gpio_detect_t bit order, each two banks wide. A
+ * bank's enables share one lock.
+ */
 
-#define PAGE_SIZE    (4*1024)
-#define BLOCK_SIZE   (4*1024)
+#define DETECT_BANKS 2
+
+static const int detect_offsets[] = {
+    RISING_DETECT_OFFSET
+  , FALLING_DETECT_OFFSET
+  , HIGH_DETECT_OFFSET
+  , LOW_DETECT_OFFSET
+  , ASYNC_RISING_DETECT_OFFSET
+  , ASYNC_FALLING_DETECT_OFFSET
+};
+
+#define DETECT_REGISTERS (sizeof(detect_offsets) / sizeof(detect_offsets[0]))
+
+static pi__spinlock_t detect_locks[DETECT_BANKS];
 
 /*
- * Open the memory space for read/write access.
+ * Map the gpio registers at the detected peripheral base.
+ * All closures share one process-wide mapping, so only
+ * the first setup opens /dev/mem.
  */
 
 int
@@ -48,53 +87,52 @@ pi_gpio_setup(pi_closure_t *closure) {
     return 0;
   }
 
-  int fd;
-  uint8_t *addr;
-  uint32_t *gpio_map_ctr;
-
-  fd = open("/dev/mem", O_RDWR | O_SYNC);
-  if (fd < 0) {
-    debug("error: cannot open /dev/mem");
-    return -1;
-  }
+  const pi_board_t *board = pi_board();
+  closure->revision = board->revision;
 
-  addr = malloc(BLOCK_SIZE + (PAGE_SIZE - 1));
-  if (addr == NULL) {
-    debug("error: cannot malloc address");
+  if (board->peripheral_base == 0) {
+    debug("error: no gpio registers on %s", board->soc_name);
     return -1;
   }
 
-  if ((uint32_t)addr % PAGE_SIZE) {
-    addr += PAGE_SIZE - ((uint32_t)addr % PAGE_SIZE);
-  }
-
-  gpio_map_ctr = mmap(
-    addr,
-    BLOCK_SIZE,
-    PROT_READ | PROT_WRITE,
-    MAP_SHARED | MAP_FIXED,
-    fd,
-    GPIO_BASE
-  );
-
-  if (gpio_map_ctr == MAP_FAILED) {
-    debug("error: mmap failed");
+  volatile uint32_t *map = pi__peripheral_map(GPIO_DEVICE
+    , (off_t) board->peripheral_base + GPIO_OFFSET, BLOCK_SIZE);
+  if (map == NULL) {
+    debug("error: cannot map gpio registers");
     return -1;
   }
 
-  closure->gpio_map = (volatile uint32_t*)gpio_map_ctr;
+  closure->gpio_map = map;
+  pi__trace(PI_TRACE_GPIO_SETUP, 0, 0, 0);
   debug("success");
   return 0;
 }
 
 /*
- * Unmap memory space.
+ * Release the register mapping; the last closure to
+ * tear down unmaps it.
  */
 
 int
 pi_gpio_teardown(pi_closure_t *closure) {
-  munmap((uint32_t*)closure->gpio_map, BLOCK_SIZE);
+  if (closure->gpio_map == NULL) {
+    debug("not setup");
+    return 0;
+  }
+
+  if (closure->pwm_map != NULL) {
+    pi_pwm_teardown(closure);
+  }
+
+  if (closure->simulated) {
+    free((uint32_t*)closure->gpio_map);
+    closure->simulated = 0;
+  } else {
+    pi__peripheral_unmap(closure->gpio_map);
+  }
+
   closure->gpio_map = NULL;
+  pi__trace(PI_TRACE_GPIO_TEARDOWN, 0, 0, 0);
   debug("success");
   return 0;
 }
@@ -124,7 +162,7 @@ pi_gpio_claim_input(pi_closure_t *closure, pi_gpio_pin_t pin, pi_gpio_pull_t pul
 pi_gpio_handle_t*
 pi_gpio_claim_output(pi_closure_t *closure, pi_gpio_pin_t pin, pi_gpio_value_t value) {
   pi_gpio_handle_t *handle = pi_gpio_claim_with_args(closure, pin, PI_GPIO_MODE_OUTPUT, PI_GPIO_PULL_NONE);
-  pi_gpio_write(handle, value);
+  if (handle != NULL) pi_gpio_write(handle, value);
   return handle;
 }
 
@@ -135,13 +173,17 @@ pi_gpio_claim_output(pi_closure_t *closure, pi_gpio_pin_t pin, pi_gpio_value_t v
 pi_gpio_handle_t*
 pi_gpio_claim_with_args(pi_closure_t *closure, pi_gpio_pin_t pin, pi_gpio_mode_t mode, pi_gpio_pull_t pull) {
   debug("(%i)", pin);
+  if (pin >= FSEL_REGISTERS * 10) return NULL;
   pi_gpio_handle_t *handle = malloc(sizeof(pi_gpio_handle_t));
+  if (handle == NULL) return NULL;
   handle->closure = closure;
   handle->method = PI_GPIO_METHOD_MMAP;
   handle->pin = pin;
   handle->error = 0;
-  pi_gpio_set_pull(handle, pull);
-  pi_gpio_set_mode(handle, mode);
+  pi__trace(PI_TRACE_GPIO_CLAIM, pin, mode, pull);
+  pi__journal(closure, PI_TRACE_GPIO_CLAIM, pin, mode, pull);
+  gpio_set_pull(handle, pull);
+  gpio_set_mode(handle, mode);
   return handle;
 }
 
@@ -149,18 +191,29 @@ pi_gpio_claim_with_args(pi_closure_t *closure, pi_gpio_pin_t pin, pi_gpio_mode_t
  * Set mode of a claimed pin. Usually invoked automatically.
  */
 
-void
-pi_gpio_set_mode(pi_gpio_handle_t *handle, pi_gpio_mode_t mode) {
+static void
+gpio_set_mode(pi_gpio_handle_t *handle, pi_gpio_mode_t mode) {
   volatile uint32_t *gpio_map = handle->closure->gpio_map;
   int pin = handle->pin;
   int offset = FSEL_OFFSET + (pin / 10);
   int shift = (pin % 10) * 3;
-  debug("(%i) %s", pin, mode == PI_GPIO_MODE_OUTPUT ? "out": "in");
+  debug("(%i) %s", pin, mode == PI_GPIO_MODE_OUTPUT ? "out"
+    : mode == PI_GPIO_MODE_INPUT ? "in" : "alt");
+  pi__trace(PI_TRACE_GPIO_SET_MODE, pin, mode, 0);
+  pi__spin_lock(&fsel_locks[pin / 10]);
   *(gpio_map + offset) = (*(gpio_map + offset) & ~(7 << shift)) | (mode << shift);
+  pi__spin_unlock(&fsel_locks[pin / 10]);
+}
+
+void
+pi_gpio_set_mode(pi_gpio_handle_t *handle, pi_gpio_mode_t mode) {
+  pi__journal(handle->closure, PI_TRACE_GPIO_SET_MODE, handle->pin, mode, 0);
+  gpio_set_mode(handle, mode);
 }
 
 /*
- * Get mode of a claimed pin.
+ * Get mode of a claimed pin; pins switched to a peripheral
+ * report their alternate function.
  */
 
 pi_gpio_mode_t
@@ -172,20 +225,23 @@ pi_gpio_get_mode(pi_gpio_handle_t *handle) {
   int value = *(gpio_map + offset);
   value >>= shift;
   value &= 7;
-  return value == 0 ? PI_GPIO_MODE_INPUT : PI_GPIO_MODE_OUTPUT;
+  return (pi_gpio_mode_t) value;
 }
 
 /*
  * Set software pull up/down value for input pins.
  */
 
-void
-pi_gpio_set_pull(pi_gpio_handle_t *handle, pi_gpio_pull_t pull) {
+static void
+gpio_set_pull(pi_gpio_handle_t *handle, pi_gpio_pull_t pull) {
   volatile uint32_t *gpio_map = handle->closure->gpio_map;
   int pin = handle->pin;
   int offset = PULLUPDNCLK_OFFSET + (pin / 32);
   int shift = (pin % 32);
 
+  pi__trace(PI_TRACE_GPIO_SET_PULL, pin, pull, 0);
+  pthread_mutex_lock(&pull_lock);
+
   switch (pull) {
     case PI_GPIO_PULL_DOWN:
     case PI_GPIO_PULL_UP:
@@ -203,6 +259,13 @@ pi_gpio_set_pull(pi_gpio_handle_t *handle, pi_gpio_pull_t pull) {
   pi_sleep_ns(150);
   *(gpio_map + PULLUPDN_OFFSET) &= ~3;
   *(gpio_map + offset) = 0;
+  pthread_mutex_unlock(&pull_lock);
+}
+
+void
+pi_gpio_set_pull(pi_gpio_handle_t *handle, pi_gpio_pull_t pull) {
+  pi__journal(handle->closure, PI_TRACE_GPIO_SET_PULL, handle->pin, pull, 0);
+  gpio_set_pull(handle, pull);
 }
 
 /*
@@ -216,6 +279,8 @@ pi_gpio_read(pi_gpio_handle_t *handle) {
   int offset = PINLEVEL_OFFSET + (pin / 32);
   int mask = (1 << pin % 32);
   int value = *(gpio_map + offset) & mask;
+  pi__trace(PI_TRACE_GPIO_READ, pin, value != 0, 0);
+  pi__journal(handle->closure, PI_TRACE_GPIO_READ, pin, value != 0, 0);
   return value == 0 ? PI_GPIO_LOW : PI_GPIO_HIGH;
 }
 
@@ -232,17 +297,50 @@ pi_gpio_write(pi_gpio_handle_t *handle, pi_gpio_value_t value) {
 
   switch (value) {
     case PI_GPIO_HIGH:
-      debug("(%i) PI_GPIO_HIGH", pin);
       offset = SET_OFFSET + (pin / 32);
       break;
     case PI_GPIO_LOW:
     default:
-      debug("(%i) PI_GPIO_LOW", pin);
       offset = CLR_OFFSET + (pin / 32);
       break;
   }
 
   *(gpio_map + offset) = 1 << shift;
+  pi__trace(PI_TRACE_GPIO_WRITE, pin, value == PI_GPIO_HIGH, 0);
+  pi__journal(handle->closure, PI_TRACE_GPIO_WRITE, pin, value == PI_GPIO_HIGH, 0);
+  return 0;
+}
+
+/*
+ * Write `len` values to a pin, non-zero meaning high, one
+ * every `period_ns` from the first. Deadlines are absolute
+ * so sleep overshoot does not accumulate; a late sample is
+ * written at once. A zero period writes back to back.
+ */
+
+int
+pi_gpio_write_sequence(pi_gpio_handle_t *handle, const uint8_t *values,
+    size_t len, uint64_t period_ns) {
+  volatile uint32_t *gpio_map = handle->closure->gpio_map;
+  int pin = handle->pin;
+  volatile uint32_t *set = gpio_map + SET_OFFSET + (pin / 32);
+  volatile uint32_t *clr = gpio_map + CLR_OFFSET + (pin / 32);
+  uint32_t mask = 1 << (pin % 32);
+  uint64_t start = period_ns ? pi_time_ns() : 0;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (period_ns && i) pi_sleep_until_ns(start + i * period_ns);
+    if (values[i]) {
+      *set = mask;
+    } else {
+      *clr = mask;
+    }
+    pi__journal(handle->closure, PI_TRACE_GPIO_WRITE, pin, values[i] != 0, 0);
+  }
+
+  pi__trace(PI_TRACE_GPIO_WRITE_SEQUENCE, pin, len,
+      period_ns > UINT32_MAX ? UINT32_MAX : period_ns);
   return 0;
 }
 
@@ -253,10 +351,20 @@ pi_gpio_write(pi_gpio_handle_t *handle, pi_gpio_value_t value) {
 int
 pi_gpio_release(pi_gpio_handle_t *handle) {
   debug("(%i)", handle->pin);
+  pi__trace(PI_TRACE_GPIO_RELEASE, handle->pin, 0, 0);
+  pi__journal(handle->closure, PI_TRACE_GPIO_RELEASE, handle->pin, 0, 0);
   pi_gpio_mode_t mode = pi_gpio_get_mode(handle);
 
-  if (mode == PI_GPIO_MODE_OUTPUT) {
-    pi_gpio_set_mode(handle, PI_GPIO_MODE_INPUT);
+  if (handle->method == PI_GPIO_METHOD_PWM) {
+    pi__pwm_release(handle->closure, handle->pin);
+  }
+
+  if (pi_gpio_get_edge_detect(handle) != PI_GPIO_DETECT_NONE) {
+    pi_gpio_set_edge_detect(handle, PI_GPIO_DETECT_NONE);
+  }
+
+  if (mode != PI_GPIO_MODE_INPUT) {
+    gpio_set_mode(handle, PI_GPIO_MODE_INPUT);
   }
 
   // jik ?
@@ -265,3 +373,102 @@ pi_gpio_release(pi_gpio_handle_t *handle) {
   return 0;
 }
 
+
+/*
+ * Read the levels of pins 0-31 in a single load.
+ */
+
+uint32_t
+pi_gpio_read_mask(pi_closure_t *closure) {
+  uint32_t levels = *(closure->gpio_map + PINLEVEL_OFFSET);
+  pi__trace(PI_TRACE_GPIO_READ_MASK, 0, levels, 0);
+  pi__journal(closure, PI_TRACE_GPIO_READ_MASK, 0, levels, 0);
+  return levels;
+}
+
+/*
+ * Drive pins 0-31 high in `set` and low in `clr` with one
+ * store per register. Empty masks are skipped.
+ */
+
+void
+pi_gpio_write_mask(pi_closure_t *closure, uint32_t set, uint32_t clr) {
+  volatile uint32_t *gpio_map = closure->gpio_map;
+  if (set) *(gpio_map + SET_OFFSET) = set;
+  if (clr) *(gpio_map + CLR_OFFSET) = clr;
+  pi__trace(PI_TRACE_GPIO_WRITE_MASK, 0, set, clr);
+  pi__journal(closure, PI_TRACE_GPIO_WRITE_MASK, 0, set, clr);
+}
+
+/*
+ * Clear latched events in `mask`. GPEDS is write-1-to-clear;
+ * simulated registers are plain memory and emulate it.
+ */
+
+static void
+clear_events(pi_closure_t *closure, int bank, uint32_t mask) {
+  if (closure->simulated) {
+    pi__gpio_sim_clear_events(closure, bank, mask);
+  } else {
+    *(closure->gpio_map + EVENT_DETECT_OFFSET + bank) = mask;
+  }
+}
+
+/*
+ * Choose which `pi_gpio_detect_t` conditions latch the
+ * pin's bit in the event detect register. Clears any
+ * event already latched for the pin.
+ */
+
+void
+pi_gpio_set_edge_detect(pi_gpio_handle_t *handle, int detect) {
+  volatile uint32_t *gpio_map = handle->closure->gpio_map;
+  int pin = handle->pin;
+  int bank = pin / 32;
+  uint32_t mask = 1 << (pin % 32);
+  unsigned int i;
+
+  debug("(%i) 0x%x", pin, detect);
+  pi__trace(PI_TRACE_GPIO_SET_DETECT, pin, detect, 0);
+  pi__spin_lock(&detect_locks[bank]);
+  for (i = 0; i < DETECT_REGISTERS; i++) {
+    volatile uint32_t *reg = gpio_map + detect_offsets[i] + bank;
+    *reg = detect & (1 << i) ? *reg | mask : *reg & ~mask;
+  }
+  pi__spin_unlock(&detect_locks[bank]);
+  clear_events(handle->closure, bank, mask);
+}
+
+/*
+ * Conditions currently enabled for the pin.
+ */
+
+int
+pi_gpio_get_edge_detect(pi_gpio_handle_t *handle) {
+  volatile uint32_t *gpio_map = handle->closure->gpio_map;
+  int bank = handle->pin / 32;
+  uint32_t mask = 1 << (handle->pin % 32);
+  int detect = 0;
+  unsigned int i;
+
+  for (i = 0; i < DETECT_REGISTERS; i++) {
+    if (*(gpio_map + detect_offsets[i] + bank) & mask) detect |= 1 << i;
+  }
+
+  return detect;
+}
+
+/*
+ * Read and clear the latched events of pins 0-31: one
+ * load and, if anything latched, one store. Pulses
+ * shorter than the polling interval are caught as long
+ * as their edge is enabled.
+ */
+
+uint32_t
+pi_gpio_poll_events(pi_closure_t *closure) {
+  uint32_t events = *(closure->gpio_map + EVENT_DETECT_OFFSET);
+  if (events) clear_events(closure, 0, events);
+  pi__trace(PI_TRACE_GPIO_POLL_EVENTS, 0, events, 0);
+  return events;
+}
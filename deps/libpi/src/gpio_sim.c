@@ -0,0 +1,104 @@
+/*
+ * libpi - Simulated GPIO registers
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "gpio_sim", ##args)
+
+/*
+ * Back a closure with a plain block of memory laid out
+ * like the gpio registers. All mmap handle operations work
+ * unchanged, which makes it possible to test and benchmark
+ * without hardware or root. Stores to SET/CLR are not
+ * reflected in the level register; use `pi_gpio_sim_set_level`
+ * to drive inputs.
+ */
+
+int
+pi_gpio_setup_sim(pi_closure_t *closure) {
+  if (closure->gpio_map != NULL) {
+    debug("already setup");
+    return 0;
+  }
+
+  void *addr;
+  if (posix_memalign(&addr, PAGE_SIZE, BLOCK_SIZE) != 0) {
+    debug("error: cannot allocate registers");
+    return -1;
+  }
+
+  memset(addr, 0, BLOCK_SIZE);
+  closure->revision = pi_revision();
+  closure->gpio_map = (volatile uint32_t*)addr;
+  closure->simulated = 1;
+  pi__trace(PI_TRACE_GPIO_SETUP, 0, 1, 0);
+  debug("success");
+  return 0;
+}
+
+/*
+ * Set the level an input pin reads as, latching an event
+ * if the pin's detect enables match the change.
+ */
+
+void
+pi_gpio_sim_set_level(pi_closure_t *closure, pi_gpio_pin_t pin, pi_gpio_value_t value) {
+  volatile uint32_t *gpio_map = closure->gpio_map;
+  int bank = pin / 32;
+  volatile uint32_t *level = gpio_map + PINLEVEL_OFFSET + bank;
+  uint32_t mask = 1 << (pin % 32);
+  int was = (*level & mask) != 0;
+  uint32_t enabled;
+
+  if (value == PI_GPIO_HIGH) {
+    *level |= mask;
+    enabled = *(gpio_map + HIGH_DETECT_OFFSET + bank);
+    if (!was) {
+      enabled |= *(gpio_map + RISING_DETECT_OFFSET + bank)
+        | *(gpio_map + ASYNC_RISING_DETECT_OFFSET + bank);
+    }
+  } else {
+    *level &= ~mask;
+    enabled = *(gpio_map + LOW_DETECT_OFFSET + bank);
+    if (was) {
+      enabled |= *(gpio_map + FALLING_DETECT_OFFSET + bank)
+        | *(gpio_map + ASYNC_FALLING_DETECT_OFFSET + bank);
+    }
+  }
+
+  if (enabled & mask) {
+    __sync_fetch_and_or(gpio_map + EVENT_DETECT_OFFSET + bank, mask);
+  }
+}
+
+/*
+ * Emulate the write-1-to-clear of the event register.
+ * Level-detected pins latch again at once while their
+ * level holds, as on hardware.
+ */
+
+void
+pi__gpio_sim_clear_events(pi_closure_t *closure, int bank, uint32_t mask) {
+  volatile uint32_t *gpio_map = closure->gpio_map;
+  uint32_t levels = *(gpio_map + PINLEVEL_OFFSET + bank);
+  uint32_t held = (*(gpio_map + HIGH_DETECT_OFFSET + bank) & levels)
+    | (*(gpio_map + LOW_DETECT_OFFSET + bank) & ~levels);
+
+  __sync_fetch_and_and(gpio_map + EVENT_DETECT_OFFSET + bank, ~mask);
+  if (held & mask) {
+    __sync_fetch_and_or(gpio_map + EVENT_DETECT_OFFSET + bank, held & mask);
+  }
+}
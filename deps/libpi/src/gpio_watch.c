@@ -0,0 +1,379 @@
+/*
+ * libpi - Adaptive interrupt/polling edge watcher
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "gpio_watch", ##args)
+
+/*
+ * Events handed to the callback at once, and kernel
+ * events read per call.
+ */
+
+#define WATCH_BATCH 64
+
+/*
+ * Defaults for a NULL config.
+ */
+
+#define DEFAULT_POLL_RATE   5000
+#define DEFAULT_IRQ_RATE    1000
+#define DEFAULT_WINDOW_MS   10
+#define DEFAULT_BURST_US    1000
+
+/*
+ * Per-pin rate and mode. Written by the watcher thread
+ * only.
+ */
+
+typedef struct {
+  pi_gpio_pin_t pin;
+  int pollable;
+  uint32_t window_edges;
+  pi_gpio_watch_stats_t stats;
+} watch_pin_t;
+
+struct pi_gpio_watcher_s {
+  pi_closure_t *closure;
+  pi_gpio_lines_t *lines;
+  pi_gpio_watch_config_t config;
+  pi_gpio_watch_cb cb;
+  void *data;
+
+  watch_pin_t pins[PI_GPIO_LINES_MAX];
+  unsigned int count;
+  uint32_t pollable;
+  uint32_t polled;
+
+  pi_gpio_watch_event_t batch[WATCH_BATCH];
+  size_t nbatch;
+
+  volatile int running;
+  pthread_t thread;
+};
+
+/*
+ * Mode for the next window given the rate over the last
+ * one. The gap between the thresholds is the hysteresis
+ * that keeps a pin near one threshold from flapping.
+ */
+
+int
+pi__watch_decide(int polling, uint32_t rate, uint32_t poll_rate, uint32_t irq_rate) {
+  if (!polling && rate >= poll_rate) return 1;
+  if (polling && rate < irq_rate) return 0;
+  return polling;
+}
+
+static watch_pin_t*
+watch_pin(pi_gpio_watcher_t *watcher, pi_gpio_pin_t pin) {
+  unsigned int i;
+  for (i = 0; i < watcher->count; i++) {
+    if (watcher->pins[i].pin == pin) return &watcher->pins[i];
+  }
+  return NULL;
+}
+
+static void
+watch_flush(pi_gpio_watcher_t *watcher) {
+  if (watcher->nbatch == 0) return;
+  watcher->cb(watcher->batch, watcher->nbatch, watcher->data);
+  watcher->nbatch = 0;
+}
+
+static void
+watch_emit(pi_gpio_watcher_t *watcher, watch_pin_t *p, uint64_t time,
+    pi_gpio_edge_t edge, int polled) {
+  pi_gpio_watch_event_t *event;
+
+  p->window_edges++;
+  p->stats.edges++;
+
+  if (watcher->nbatch == WATCH_BATCH) watch_flush(watcher);
+  event = &watcher->batch[watcher->nbatch++];
+  event->time = time;
+  event->pin = p->pin;
+  event->edge = edge;
+  event->polled = polled;
+}
+
+/*
+ * Report the bank 0 pins in `changed` whose new level
+ * matches a watched edge.
+ */
+
+static void
+watch_levels(pi_gpio_watcher_t *watcher, uint32_t levels, uint32_t changed) {
+  uint64_t now = pi_time_ns();
+  unsigned int i;
+
+  for (i = 0; i < watcher->count && changed; i++) {
+    watch_pin_t *p = &watcher->pins[i];
+    uint32_t bit = 1 << p->pin;
+    if (!p->pollable || !(changed & bit)) continue;
+    changed &= ~bit;
+
+    pi_gpio_edge_t edge = levels & bit ? PI_GPIO_EDGE_RISING : PI_GPIO_EDGE_FALLING;
+    if (watcher->config.edge & edge) watch_emit(watcher, p, now, edge, 1);
+  }
+}
+
+/*
+ * Take queued kernel events, waiting up to `timeout` ms.
+ * Events for pins already switched to polling were queued
+ * before the switch and are dropped; polling reports them.
+ */
+
+static void
+watch_kernel(pi_gpio_watcher_t *watcher, int timeout) {
+  pi_gpio_lines_event_t events[WATCH_BATCH];
+  int n, i;
+
+  n = pi_gpio_lines_read_events(watcher->lines, events, WATCH_BATCH, timeout);
+  for (i = 0; i < n; i++) {
+    watch_pin_t *p = watch_pin(watcher, events[i].pin);
+    if (p == NULL || p->stats.polling) continue;
+    watch_emit(watcher, p, events[i].time, events[i].edge, 0);
+  }
+}
+
+/*
+ * End of a window: recompute rates and switch pins whose
+ * rate crossed a threshold.
+ */
+
+static void
+watch_evaluate(pi_gpio_watcher_t *watcher, uint64_t elapsed) {
+  pi_gpio_watch_config_t *config = &watcher->config;
+  unsigned int i;
+
+  for (i = 0; i < watcher->count; i++) {
+    watch_pin_t *p = &watcher->pins[i];
+    p->stats.rate = (uint32_t) (p->window_edges * 1000000000ULL / elapsed);
+    p->window_edges = 0;
+
+    int polling = p->pollable && pi__watch_decide(p->stats.polling
+      , p->stats.rate, config->poll_rate, config->irq_rate);
+    if (polling == p->stats.polling) continue;
+
+    if (watcher->lines != NULL
+        && pi_gpio_lines_set_edge_enabled(watcher->lines, 1ULL << i, !polling) != 0) {
+      debug("error: (%i) cannot switch", p->pin);
+      continue;
+    }
+
+    debug("(%i) %u/s, %s", p->pin, p->stats.rate, polling ? "polling" : "interrupts");
+    p->stats.polling = polling;
+    if (polling) {
+      p->stats.to_poll++;
+      watcher->polled |= 1 << p->pin;
+    } else {
+      p->stats.to_irq++;
+      watcher->polled &= ~(1 << p->pin);
+    }
+  }
+}
+
+/*
+ * Watcher thread. With no pin polling it sleeps in the
+ * kernel until an edge or the end of the window. Once a
+ * pin polls, it spins on GPLEV in bounded bursts and
+ * drains interrupt pins' events between bursts. Without
+ * a lines handle the level register stands in for
+ * interrupts, checked once per window.
+ */
+
+static void*
+watch_run(void *arg) {
+  pi_gpio_watcher_t *watcher = arg;
+  volatile uint32_t *level = watcher->pollable
+    ? watcher->closure->gpio_map + PINLEVEL_OFFSET
+    : NULL;
+  uint64_t window = watcher->config.window_ms * 1000000ULL;
+  uint64_t burst = watcher->config.burst_us * 1000ULL;
+  uint64_t start = pi_time_ns();
+  uint32_t prev = level ? *level : 0;
+  uint32_t levels;
+
+  if (watcher->closure != NULL) pi_closure_rt_apply(watcher->closure);
+
+  while (watcher->running) {
+    uint64_t now = pi_time_ns();
+
+    if (watcher->polled != 0) {
+      uint32_t scan = watcher->lines ? watcher->polled : watcher->pollable;
+      uint64_t end = now + burst;
+      do {
+        levels = *level;
+        if ((levels ^ prev) & scan) watch_levels(watcher, levels, (levels ^ prev) & scan);
+        prev = levels;
+      } while (pi_time_ns() < end && watcher->running);
+
+      if (watcher->lines) watch_kernel(watcher, 0);
+    } else if (watcher->lines) {
+      uint64_t left = start + window > now ? start + window - now : 0;
+      watch_kernel(watcher, (int) ((left + 999999) / 1000000));
+    } else {
+      pi_sleep_until_ns(start + window);
+      if (level != NULL) {
+        levels = *level;
+        watch_levels(watcher, levels, (levels ^ prev) & watcher->pollable);
+        prev = levels;
+      }
+    }
+
+    watch_flush(watcher);
+
+    now = pi_time_ns();
+    if (now - start >= window) {
+      uint32_t polled = watcher->polled;
+      watch_evaluate(watcher, now - start);
+      start = now;
+
+      // newly polled pins start from their current level
+      if (level != NULL && (watcher->polled & ~polled)) {
+        levels = *level;
+        prev = (prev & ~(watcher->polled & ~polled)) | (levels & watcher->polled & ~polled);
+      }
+    }
+  }
+
+  watch_flush(watcher);
+  return NULL;
+}
+
+/*
+ * Watch `pins` (or every line of `lines` when given).
+ * `lines` must be requested as inputs with edge detection;
+ * without it, idle pins are checked once per window. Pins
+ * 0-31 can switch to polling when `closure` has gpio set
+ * up; others stay on interrupts. `cb` runs on the watcher
+ * thread with batches of events. Returns NULL with errno
+ * set on failure.
+ */
+
+pi_gpio_watcher_t*
+pi_gpio_watcher_new(pi_closure_t *closure, pi_gpio_lines_t *lines,
+    const pi_gpio_pin_t *pins, unsigned int count,
+    const pi_gpio_watch_config_t *config, pi_gpio_watch_cb cb, void *data) {
+  pi_gpio_watcher_t *watcher;
+  unsigned int i;
+
+  if (lines != NULL) {
+    pins = lines->pins;
+    count = lines->count;
+  }
+
+  if (cb == NULL || count == 0 || count > PI_GPIO_LINES_MAX) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  watcher = calloc(1, sizeof(pi_gpio_watcher_t));
+  if (watcher == NULL) return NULL;
+
+  if (config != NULL) {
+    watcher->config = *config;
+  } else {
+    watcher->config.poll_rate = DEFAULT_POLL_RATE;
+    watcher->config.irq_rate = DEFAULT_IRQ_RATE;
+    watcher->config.window_ms = DEFAULT_WINDOW_MS;
+    watcher->config.burst_us = DEFAULT_BURST_US;
+    watcher->config.edge = PI_GPIO_EDGE_BOTH;
+  }
+
+  if (watcher->config.window_ms == 0 || watcher->config.burst_us == 0
+      || watcher->config.irq_rate > watcher->config.poll_rate) {
+    free(watcher);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  watcher->closure = closure;
+  watcher->lines = lines;
+  watcher->cb = cb;
+  watcher->data = data;
+  watcher->count = count;
+
+  for (i = 0; i < count; i++) {
+    watch_pin_t *p = &watcher->pins[i];
+    p->pin = pins[i];
+    p->pollable = closure != NULL && closure->gpio_map != NULL && pins[i] < 32;
+    if (p->pollable) watcher->pollable |= 1 << pins[i];
+  }
+
+  return watcher;
+}
+
+int
+pi_gpio_watcher_start(pi_gpio_watcher_t *watcher) {
+  if (watcher->running) return 0;
+  watcher->running = 1;
+
+  if (pthread_create(&watcher->thread, NULL, watch_run, watcher) != 0) {
+    debug("error: cannot start thread");
+    watcher->running = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Snapshot of a pin's counters and mode. Returns -1 if
+ * the pin is not watched.
+ */
+
+int
+pi_gpio_watcher_stats(pi_gpio_watcher_t *watcher, pi_gpio_pin_t pin,
+    pi_gpio_watch_stats_t *stats) {
+  watch_pin_t *p = watch_pin(watcher, pin);
+  if (p == NULL) return -1;
+  __sync_synchronize();
+  *stats = p->stats;
+  return 0;
+}
+
+/*
+ * Stop the thread, waiting at most one window or burst.
+ * Pins switched to polling get their kernel edge
+ * detection back.
+ */
+
+void
+pi_gpio_watcher_stop(pi_gpio_watcher_t *watcher) {
+  unsigned int i;
+
+  if (!watcher->running) return;
+  watcher->running = 0;
+  pthread_join(watcher->thread, NULL);
+
+  for (i = 0; i < watcher->count; i++) {
+    watcher->pins[i].stats.polling = 0;
+  }
+
+  watcher->polled = 0;
+  if (watcher->lines != NULL) {
+    pi_gpio_lines_set_edge_enabled(watcher->lines, ~0ULL, 1);
+  }
+}
+
+void
+pi_gpio_watcher_delete(pi_gpio_watcher_t *watcher) {
+  pi_gpio_watcher_stop(watcher);
+  free(watcher);
+}
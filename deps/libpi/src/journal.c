@@ -0,0 +1,382 @@
+/*
+ * libpi - Operation journal and replay
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "journal", ##args)
+
+/*
+ * Below this much time to an op the timed replay spins
+ * instead of sleeping, as in the sampler.
+ */
+
+#define SPIN_NS 50000
+
+/*
+ * Records kept by the `PI_JOURNAL` journal unless
+ * `PI_JOURNAL_SIZE` says otherwise.
+ */
+
+#define ENV_CAPACITY (1 << 20)
+
+#define STAMP_TIME_MASK 0xffffffffffffULL
+
+/*
+ * Highest gpio pin, plus one.
+ */
+
+#define JOURNAL_PINS 54
+
+/*
+ * Records are claimed with one atomic add on `next`, so
+ * any number of threads can journal into one closure.
+ * Claims past `capacity` are counted, not stored.
+ */
+
+struct pi_journal_s {
+  pi_journal_record_t *records;
+  size_t capacity;
+  volatile uint64_t next;
+  uint64_t dropped;         /* carried over by pi_journal_load */
+  uint64_t start;
+};
+
+pi_journal_t *pi__journal_env = NULL;
+
+/*
+ * Allocate a journal for `capacity` records. Times are
+ * relative to now.
+ */
+
+pi_journal_t*
+pi_journal_new(size_t capacity) {
+  pi_journal_t *journal;
+
+  if (capacity == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  journal = calloc(1, sizeof(pi_journal_t));
+  if (journal == NULL) return NULL;
+
+  journal->records = malloc(capacity * sizeof(pi_journal_record_t));
+  if (journal->records == NULL) {
+    free(journal);
+    return NULL;
+  }
+
+  journal->capacity = capacity;
+  journal->start = pi_time_ns();
+  return journal;
+}
+
+/*
+ * Append a record. Called through pi__journal().
+ */
+
+void
+pi__journal_emit(pi_journal_t *journal, uint8_t op, uint8_t pin, uint32_t value,
+    uint32_t extra) {
+  uint64_t i = __sync_fetch_and_add(&journal->next, 1);
+  if (i >= journal->capacity) return;
+
+  pi_journal_record_t *rec = &journal->records[i];
+  rec->stamp = ((pi_time_ns() - journal->start) & STAMP_TIME_MASK) << 16
+    | (uint64_t) op << 8 | pin;
+  rec->value = value;
+  rec->extra = extra;
+}
+
+/*
+ * Record the gpio operations of `closure` into `journal`
+ * until detached. Several closures may share a journal.
+ */
+
+void
+pi_journal_attach(pi_closure_t *closure, pi_journal_t *journal) {
+  closure->journal = journal;
+  __sync_synchronize();
+}
+
+void
+pi_journal_detach(pi_closure_t *closure) {
+  closure->journal = NULL;
+  __sync_synchronize();
+}
+
+/*
+ * Records held, in the order they were claimed, and the
+ * count of ops that did not fit. Read once no thread is
+ * journaling into it.
+ */
+
+const pi_journal_record_t*
+pi_journal_records(pi_journal_t *journal, size_t *count, uint64_t *dropped) {
+  uint64_t next = journal->next;
+
+  *count = next < journal->capacity ? next : journal->capacity;
+  if (dropped != NULL) {
+    *dropped = journal->dropped + (next > journal->capacity ? next - journal->capacity : 0);
+  }
+
+  return journal->records;
+}
+
+void
+pi_journal_clear(pi_journal_t *journal) {
+  journal->next = 0;
+  journal->dropped = 0;
+  __sync_synchronize();
+}
+
+/*
+ * Write a header and the records to `fd`. Replay with
+ * `pi-replay` or pi_journal_load().
+ */
+
+int
+pi_journal_dump(pi_journal_t *journal, int fd) {
+  pi_journal_header_t header;
+  size_t count;
+  const pi_journal_record_t *records = pi_journal_records(journal, &count, &header.dropped);
+
+  memcpy(header.magic, PI_JOURNAL_MAGIC, sizeof(PI_JOURNAL_MAGIC));
+  header.version = PI_JOURNAL_VERSION;
+  header.record_size = sizeof(pi_journal_record_t);
+  header.count = count;
+
+  if (write(fd, &header, sizeof(header)) != sizeof(header)) return -1;
+  if (count && write(fd, records, count * sizeof(pi_journal_record_t))
+      != (ssize_t)(count * sizeof(pi_journal_record_t))) return -1;
+
+  debug("%lu records", (unsigned long) count);
+  return 0;
+}
+
+/*
+ * Read a dump into a new journal. Returns NULL with errno
+ * EPROTO for a file that is not a journal of this
+ * version, or EIO when it is cut short.
+ */
+
+pi_journal_t*
+pi_journal_load(int fd) {
+  pi_journal_header_t header;
+  pi_journal_t *journal;
+  size_t len;
+  size_t got = 0;
+
+  if (read(fd, &header, sizeof(header)) != sizeof(header)
+      || memcmp(header.magic, PI_JOURNAL_MAGIC, sizeof(PI_JOURNAL_MAGIC)) != 0
+      || header.version != PI_JOURNAL_VERSION
+      || header.record_size != sizeof(pi_journal_record_t)) {
+    errno = EPROTO;
+    return NULL;
+  }
+
+  journal = pi_journal_new(header.count ? header.count : 1);
+  if (journal == NULL) return NULL;
+
+  len = header.count * sizeof(pi_journal_record_t);
+  while (got < len) {
+    ssize_t n = read(fd, (char*) journal->records + got, len - got);
+    if (n <= 0) {
+      pi_journal_delete(journal);
+      errno = EIO;
+      return NULL;
+    }
+    got += n;
+  }
+
+  journal->next = header.count;
+  journal->dropped = header.dropped;
+  return journal;
+}
+
+/*
+ * Wait for `deadline`: sleep, then spin the last SPIN_NS.
+ */
+
+static void
+journal_wait_until(uint64_t deadline) {
+  uint64_t now = pi_time_ns();
+
+  if (deadline > now && deadline - now > SPIN_NS) {
+    pi_sleep_until_ns(deadline - SPIN_NS);
+  }
+
+  while (pi_time_ns() < deadline);
+}
+
+/*
+ * Run every record of `journal` against `closure`, which
+ * must be set up, on the calling thread: back to back, or
+ * with PI_JOURNAL_REPLAY_TIMED at the recorded offsets
+ * from the first record. Pins still claimed at the end
+ * are released. Fills `stats` if not NULL.
+ */
+
+int
+pi_journal_replay(pi_closure_t *closure, pi_journal_t *journal, int flags,
+    pi_journal_replay_stats_t *stats) {
+  pi_gpio_handle_t *handles[JOURNAL_PINS] = { NULL };
+  pi_journal_replay_stats_t s;
+  const pi_journal_record_t *records;
+  int timed = flags & PI_JOURNAL_REPLAY_TIMED;
+  uint64_t first, start, late_sum = 0;
+  size_t count, i;
+
+  if (closure->gpio_map == NULL) {
+    debug("error: gpio not setup");
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(&s, 0, sizeof(s));
+  records = pi_journal_records(journal, &count, NULL);
+  first = count ? PI_JOURNAL_TIME(&records[0]) : 0;
+  start = pi_time_ns();
+
+  for (i = 0; i < count; i++) {
+    const pi_journal_record_t *rec = &records[i];
+    unsigned int op = PI_JOURNAL_OP(rec);
+    unsigned int pin = PI_JOURNAL_PIN(rec);
+    pi_gpio_handle_t *handle = pin < JOURNAL_PINS ? handles[pin] : NULL;
+    uint64_t time = PI_JOURNAL_TIME(rec);
+    uint64_t offset = time > first ? time - first : 0;
+
+    // records from several threads may be a little out of order
+    if (offset > s.recorded_ns) s.recorded_ns = offset;
+
+    if (timed) {
+      uint64_t target = start + s.recorded_ns;
+      uint64_t now;
+
+      journal_wait_until(target);
+      now = pi_time_ns();
+      if (now - target > s.max_late_ns) s.max_late_ns = now - target;
+      late_sum += now - target;
+    }
+
+    switch (op) {
+      case PI_TRACE_GPIO_CLAIM:
+        if (pin >= JOURNAL_PINS) goto skip;
+        if (handle == NULL) {
+          handles[pin] = pi_gpio_claim_with_args(closure, pin
+            , (pi_gpio_mode_t) rec->value, (pi_gpio_pull_t) rec->extra);
+          if (handles[pin] == NULL) goto skip;
+        } else {
+          pi_gpio_set_pull(handle, (pi_gpio_pull_t) rec->extra);
+          pi_gpio_set_mode(handle, (pi_gpio_mode_t) rec->value);
+        }
+        break;
+
+      case PI_TRACE_GPIO_RELEASE:
+        if (handle == NULL) goto skip;
+        pi_gpio_release(handle);
+        handles[pin] = NULL;
+        break;
+
+      case PI_TRACE_GPIO_SET_MODE:
+        if (handle == NULL) goto skip;
+        pi_gpio_set_mode(handle, (pi_gpio_mode_t) rec->value);
+        break;
+
+      case PI_TRACE_GPIO_SET_PULL:
+        if (handle == NULL) goto skip;
+        pi_gpio_set_pull(handle, (pi_gpio_pull_t) rec->value);
+        break;
+
+      case PI_TRACE_GPIO_READ:
+        if (handle == NULL) goto skip;
+        if (closure->simulated) {
+          pi_gpio_sim_set_level(closure, pin, rec->value ? PI_GPIO_HIGH : PI_GPIO_LOW);
+        }
+        if ((pi_gpio_read(handle) == PI_GPIO_HIGH) != (rec->value != 0)) s.mismatches++;
+        break;
+
+      case PI_TRACE_GPIO_WRITE:
+        if (handle == NULL) goto skip;
+        pi_gpio_write(handle, rec->value ? PI_GPIO_HIGH : PI_GPIO_LOW);
+        break;
+
+      case PI_TRACE_GPIO_READ_MASK:
+        if (closure->simulated) *(closure->gpio_map + PINLEVEL_OFFSET) = rec->value;
+        if (pi_gpio_read_mask(closure) != rec->value) s.mismatches++;
+        break;
+
+      case PI_TRACE_GPIO_WRITE_MASK:
+        pi_gpio_write_mask(closure, rec->value, rec->extra);
+        break;
+
+      default:
+      skip:
+        s.skipped++;
+        continue;
+    }
+
+    s.records++;
+  }
+
+  s.elapsed_ns = pi_time_ns() - start;
+  if (timed && count) s.mean_late_ns = late_sum / count;
+
+  for (i = 0; i < JOURNAL_PINS; i++) {
+    if (handles[i] != NULL) pi_gpio_release(handles[i]);
+  }
+
+  debug("%lu ops in %lluns", (unsigned long) s.records, (unsigned long long) s.elapsed_ns);
+  if (stats != NULL) *stats = s;
+  return 0;
+}
+
+void
+pi_journal_delete(pi_journal_t *journal) {
+  free(journal->records);
+  free(journal);
+}
+
+/*
+ * `PI_JOURNAL=<path>` in the environment journals every
+ * closure created afterwards, `PI_JOURNAL_SIZE` records
+ * at most, and dumps to `path` at exit.
+ */
+
+static const char *dump_path = NULL;
+
+static void
+pi__journal_atexit(void) {
+  int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return;
+  pi_journal_dump(pi__journal_env, fd);
+  close(fd);
+}
+
+__attribute__((constructor)) static void
+pi__journal_init(void) {
+  const char *path = getenv("PI_JOURNAL");
+  const char *size = getenv("PI_JOURNAL_SIZE");
+  size_t capacity = size ? strtoul(size, NULL, 10) : 0;
+
+  if (path == NULL || *path == '\0') return;
+  pi__journal_env = pi_journal_new(capacity ? capacity : ENV_CAPACITY);
+  if (pi__journal_env == NULL) return;
+  dump_path = path;
+  atexit(pi__journal_atexit);
+}
@@ -0,0 +1,128 @@
+/*
+ * libpi - Shared peripheral mappings
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "peripheral", ##args)
+
+/*
+ * Distinct peripheral blocks mapped at once.
+ */
+
+#define MAX_MAPPINGS 8
+
+/*
+ * One mapping per (device, base); closures that set up
+ * the same block share it and the last to tear down
+ * unmaps it.
+ */
+
+typedef struct {
+  const char *dev;
+  off_t base;
+  size_t size;
+  volatile uint32_t *map;
+  unsigned int refs;
+} pi__mapping_t;
+
+static pi__mapping_t mappings[MAX_MAPPINGS];
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Map `size` bytes of `dev` at `base`, or take another
+ * reference to an existing mapping. The fd is closed
+ * once mapped. Returns NULL on failure.
+ */
+
+volatile uint32_t*
+pi__peripheral_map(const char *dev, off_t base, size_t size) {
+  pi__mapping_t *free_slot = NULL;
+  volatile uint32_t *map = NULL;
+  void *addr;
+  int fd, i;
+
+  pthread_mutex_lock(&mappings_lock);
+
+  for (i = 0; i < MAX_MAPPINGS; i++) {
+    pi__mapping_t *m = &mappings[i];
+    if (m->refs == 0) {
+      if (free_slot == NULL) free_slot = m;
+    } else if (m->base == base && m->size == size && strcmp(m->dev, dev) == 0) {
+      m->refs++;
+      map = m->map;
+      debug("%s@%lx: %u refs", dev, (unsigned long) base, m->refs);
+      goto done;
+    }
+  }
+
+  if (free_slot == NULL) {
+    debug("error: too many mappings");
+    goto done;
+  }
+
+  fd = open(dev, O_RDWR | O_SYNC | O_CLOEXEC);
+  if (fd < 0) {
+    debug("error: cannot open %s", dev);
+    goto done;
+  }
+
+  addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, base);
+  close(fd);
+
+  if (addr == MAP_FAILED) {
+    debug("error: mmap %s@%lx failed", dev, (unsigned long) base);
+    goto done;
+  }
+
+  free_slot->dev = dev;
+  free_slot->base = base;
+  free_slot->size = size;
+  free_slot->map = map = (volatile uint32_t*) addr;
+  free_slot->refs = 1;
+  debug("%s@%lx: mapped", dev, (unsigned long) base);
+
+done:
+  pthread_mutex_unlock(&mappings_lock);
+  return map;
+}
+
+/*
+ * Drop a reference taken by pi__peripheral_map,
+ * unmapping with the last one.
+ */
+
+void
+pi__peripheral_unmap(volatile uint32_t *map) {
+  int i;
+
+  pthread_mutex_lock(&mappings_lock);
+
+  for (i = 0; i < MAX_MAPPINGS; i++) {
+    pi__mapping_t *m = &mappings[i];
+    if (m->refs == 0 || m->map != map) continue;
+    if (--m->refs == 0) {
+      munmap((void*) m->map, m->size);
+      m->map = NULL;
+      debug("%s@%lx: unmapped", m->dev, (unsigned long) m->base);
+    }
+    break;
+  }
+
+  pthread_mutex_unlock(&mappings_lock);
+}
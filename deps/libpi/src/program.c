@@ -0,0 +1,390 @@
+/*
+ * libpi - Bytecode program runner
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "program", ##args)
+
+/*
+ * Below this much time to a deadline the runner spins
+ * instead of sleeping, as in the sampler.
+ */
+
+#define SPIN_NS 50000
+
+/*
+ * Longest single sleep, so a stop request is seen
+ * within this long during a long delay.
+ */
+
+#define SLICE_NS 10000000
+
+/*
+ * Registers per program, and the highest gpio pin.
+ */
+
+#define PROG_REGS 8
+#define PROG_PINS 54
+
+struct pi_program_s {
+  pi_closure_t *closure;
+  pi_prog_insn_t *code;
+  size_t len;
+
+  uint64_t *records;
+  size_t max_records;
+  size_t nrecords;
+
+  volatile uint32_t outputs[2];   /* pins a store may drive, per bank */
+  volatile int stopped;
+};
+
+/*
+ * Check one instruction's operands.
+ */
+
+static int
+program_check(const pi_prog_insn_t *insn, size_t len) {
+  switch (insn->op) {
+    case PI_PROG_END:
+    case PI_PROG_DELAY:
+    case PI_PROG_MARK:
+    case PI_PROG_DELAY_UNTIL:
+      return 0;
+    case PI_PROG_SET:
+    case PI_PROG_CLR:
+      return insn->b < 2 ? 0 : -1;
+    case PI_PROG_WRITE:
+      return insn->a < PROG_PINS ? 0 : -1;
+    case PI_PROG_READ:
+      return insn->a < PROG_REGS && insn->b < 2 ? 0 : -1;
+    case PI_PROG_WAIT_EDGE:
+      return insn->a < PROG_PINS && insn->b >= PI_GPIO_EDGE_RISING
+        && insn->b <= PI_GPIO_EDGE_BOTH ? 0 : -1;
+    case PI_PROG_WAIT_LEVEL:
+      return insn->a < PROG_PINS && insn->b < 2 ? 0 : -1;
+    case PI_PROG_RECORD:
+      return insn->b < PI_PROG_SOURCE_MAX && insn->a < PROG_REGS ? 0 : -1;
+    case PI_PROG_LOAD:
+      return insn->a < PROG_REGS ? 0 : -1;
+    case PI_PROG_LOOP:
+      return insn->a < PROG_REGS && insn->arg <= len ? 0 : -1;
+    case PI_PROG_JUMP:
+    case PI_PROG_JUMP_TIMEOUT:
+      return insn->arg <= len ? 0 : -1;
+    case PI_PROG_JUMP_HIGH:
+    case PI_PROG_JUMP_LOW:
+      return insn->a < PROG_PINS && insn->arg <= len ? 0 : -1;
+    default:
+      return -1;
+  }
+}
+
+/*
+ * Validate and copy a program with room for `max_records`
+ * recorded values. Returns NULL with errno EINVAL if any
+ * instruction has a bad op, register, pin or target.
+ */
+
+pi_program_t*
+pi_program_new(pi_closure_t *closure, const pi_prog_insn_t *code, size_t len,
+    size_t max_records) {
+  pi_program_t *program;
+  size_t i;
+
+  if (len == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  for (i = 0; i < len; i++) {
+    if (program_check(&code[i], len) < 0) {
+      debug("error: bad instruction %zu (op %u)", i, code[i].op);
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+
+  program = calloc(1, sizeof(pi_program_t));
+  if (program == NULL) return NULL;
+
+  program->code = malloc(len * sizeof(pi_prog_insn_t));
+  program->records = malloc((max_records ? max_records : 1) * sizeof(uint64_t));
+  if (program->code == NULL || program->records == NULL) {
+    pi_program_delete(program);
+    return NULL;
+  }
+
+  memcpy(program->code, code, len * sizeof(pi_prog_insn_t));
+  program->closure = closure;
+  program->len = len;
+  program->max_records = max_records;
+  program->outputs[0] = program->outputs[1] = ~0u;
+  return program;
+}
+
+static inline int
+program_level(volatile uint32_t *gpio_map, unsigned int pin) {
+  return (*(gpio_map + PINLEVEL_OFFSET + (pin / 32)) >> (pin % 32)) & 1;
+}
+
+/*
+ * Sleep in slices then spin to `deadline`. Returns -1 if
+ * stopped.
+ */
+
+static int
+program_wait_until(pi_program_t *program, uint64_t deadline) {
+  uint64_t now = pi_time_ns();
+
+  while (deadline > now && deadline - now > SPIN_NS) {
+    if (program->stopped) return -1;
+    if (deadline - now - SPIN_NS > SLICE_NS) {
+      pi_sleep_until_ns(now + SLICE_NS);
+    } else {
+      pi_sleep_until_ns(deadline - SPIN_NS);
+    }
+    now = pi_time_ns();
+  }
+
+  while (pi_time_ns() < deadline) {
+    if (program->stopped) return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Run the program to END on the calling thread. Returns
+ * 0, or -1 with errno ECANCELED when stopped and ENOBUFS
+ * when a RECORD found the buffer full. Records made
+ * before a failure are kept. A program may be run again
+ * until stopped; each run starts with empty records and
+ * registers.
+ */
+
+int
+pi_program_run(pi_program_t *program) {
+  volatile uint32_t *gpio_map = program->closure->gpio_map;
+  uint32_t r[PROG_REGS] = { 0 };
+  uint64_t mark = pi_time_ns();
+  uint64_t event = mark;
+  int timeout = 0;
+  size_t pc = 0;
+  size_t steps = 0;
+
+  if (gpio_map == NULL) {
+    debug("error: gpio not setup");
+    errno = EINVAL;
+    return -1;
+  }
+
+  program->nrecords = 0;
+  if (program->stopped) {
+    errno = ECANCELED;
+    return -1;
+  }
+
+  pi__trace(PI_TRACE_PROGRAM_RUN, 0, program->len, 0);
+
+  while (pc < program->len) {
+    const pi_prog_insn_t *insn = &program->code[pc++];
+
+    // a tight jump loop still sees stop requests
+    if ((++steps & 0xff) == 0 && program->stopped) {
+      errno = ECANCELED;
+      return -1;
+    }
+
+    switch (insn->op) {
+      case PI_PROG_END:
+        return 0;
+
+      case PI_PROG_SET: {
+        uint32_t bits = insn->arg & program->outputs[insn->b];
+        if (bits) *(gpio_map + SET_OFFSET + insn->b) = bits;
+        break;
+      }
+
+      case PI_PROG_CLR: {
+        uint32_t bits = insn->arg & program->outputs[insn->b];
+        if (bits) *(gpio_map + CLR_OFFSET + insn->b) = bits;
+        break;
+      }
+
+      case PI_PROG_WRITE: {
+        uint32_t bit = 1u << (insn->a % 32) & program->outputs[insn->a / 32];
+        if (bit) *(gpio_map + (insn->arg ? SET_OFFSET : CLR_OFFSET) + (insn->a / 32)) = bit;
+        break;
+      }
+
+      case PI_PROG_READ:
+        r[insn->a] = *(gpio_map + PINLEVEL_OFFSET + insn->b) & insn->arg;
+        break;
+
+      case PI_PROG_WAIT_EDGE:
+      case PI_PROG_WAIT_LEVEL: {
+        uint64_t start = pi_time_ns();
+        uint64_t limit = (uint64_t) insn->arg * 1000ULL;
+        int prev = program_level(gpio_map, insn->a);
+        int edge = insn->op == PI_PROG_WAIT_EDGE;
+        uint64_t now = start;
+
+        timeout = 0;
+        for (;;) {
+          int level = program_level(gpio_map, insn->a);
+          now = pi_time_ns();
+
+          if (edge && level != prev
+              && (insn->b & (level ? PI_GPIO_EDGE_RISING : PI_GPIO_EDGE_FALLING))) break;
+          if (!edge && level == insn->b) break;
+          if (limit && now - start >= limit) {
+            timeout = 1;
+            break;
+          }
+          if (program->stopped) {
+            errno = ECANCELED;
+            return -1;
+          }
+          prev = level;
+        }
+
+        event = now;
+        break;
+      }
+
+      case PI_PROG_DELAY:
+        if (program_wait_until(program, pi_time_ns() + insn->arg) < 0) {
+          errno = ECANCELED;
+          return -1;
+        }
+        break;
+
+      case PI_PROG_MARK:
+        mark = insn->b ? event : pi_time_ns();
+        break;
+
+      case PI_PROG_DELAY_UNTIL:
+        if (program_wait_until(program, mark + insn->arg) < 0) {
+          errno = ECANCELED;
+          return -1;
+        }
+        break;
+
+      case PI_PROG_RECORD: {
+        uint64_t value = 0;
+
+        if (program->nrecords == program->max_records) {
+          errno = ENOBUFS;
+          return -1;
+        }
+
+        switch (insn->b) {
+          case PI_PROG_SOURCE_ELAPSED:
+            value = pi_time_ns() - mark;
+            break;
+          case PI_PROG_SOURCE_EVENT:
+            value = event - mark;
+            break;
+          case PI_PROG_SOURCE_REG:
+            value = r[insn->a];
+            break;
+          case PI_PROG_SOURCE_LEVELS:
+            value = *(gpio_map + PINLEVEL_OFFSET);
+            break;
+        }
+
+        program->records[program->nrecords++] = value;
+        break;
+      }
+
+      case PI_PROG_LOAD:
+        r[insn->a] = insn->arg;
+        break;
+
+      case PI_PROG_LOOP:
+        // a register already at 0 falls through
+        if (r[insn->a] != 0 && --r[insn->a] != 0) pc = insn->arg;
+        break;
+
+      case PI_PROG_JUMP:
+        pc = insn->arg;
+        break;
+
+      case PI_PROG_JUMP_TIMEOUT:
+        if (timeout) pc = insn->arg;
+        break;
+
+      case PI_PROG_JUMP_HIGH:
+        if (program_level(gpio_map, insn->a)) pc = insn->arg;
+        break;
+
+      case PI_PROG_JUMP_LOW:
+        if (!program_level(gpio_map, insn->a)) pc = insn->arg;
+        break;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Values recorded by the last run.
+ */
+
+const uint64_t*
+pi_program_records(pi_program_t *program, size_t *count) {
+  *count = program->nrecords;
+  return program->records;
+}
+
+/*
+ * Limit the pins of `bank` that SET, CLR and WRITE may
+ * drive to `mask` (all of them by default). Takes effect
+ * at the next store, including in a run on another
+ * thread; writes to other pins are dropped.
+ */
+
+int
+pi_program_set_outputs(pi_program_t *program, uint8_t bank, uint32_t mask) {
+  if (bank > 1) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  program->outputs[bank] = mask;
+  __sync_synchronize();
+  return 0;
+}
+
+/*
+ * Make the current run, on another thread, stop at its
+ * next wait check or within 256 instructions, and any
+ * later run fail at once.
+ */
+
+void
+pi_program_stop(pi_program_t *program) {
+  program->stopped = 1;
+  __sync_synchronize();
+}
+
+void
+pi_program_delete(pi_program_t *program) {
+  free(program->code);
+  free(program->records);
+  free(program);
+}
@@ -0,0 +1,560 @@
+/*
+ * libpi - Hardware PWM
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "pwm", ##args)
+
+/*
+ * PWM and clock manager memory space
+ */
+
+#define PWM_OFFSET          0x20C000
+#define CLK_OFFSET          0x101000
+#define PWM_DEVICE          "/dev/mem"
+
+/*
+ * PWM registers (word offsets)
+ */
+
+#define PWM_CTL             0
+#define PWM_STA             1
+#define PWM_DMAC            2
+#define PWM_FIF1            6
+
+#define PWM_RNG(ch)         ((ch) == 0 ? 4 : 8)
+#define PWM_DAT(ch)         ((ch) == 0 ? 5 : 9)
+
+/*
+ * PWM_CTL holds one byte of flags per channel.
+ */
+
+#define CTL_SHIFT(ch)       ((ch) * 8)
+#define CTL_PWEN            0x01  /* channel enable */
+#define CTL_MODE            0x02  /* serializer mode */
+#define CTL_RPTL            0x04  /* repeat last fifo word */
+#define CTL_SBIT            0x08  /* silence bit */
+#define CTL_POLA            0x10  /* invert polarity */
+#define CTL_USEF            0x20  /* feed from fifo */
+#define CTL_MSEN            0x80  /* mark-space mode */
+#define CTL_CLRF            0x40  /* clear fifo, channel 1 byte only */
+#define CTL_CHANNEL         0xff
+
+#define STA_FULL            0x01
+
+#define DMAC_ENAB           0x80000000
+#define DMAC_PANIC          (7 << 8)
+#define DMAC_DREQ           7
+
+/*
+ * Clock manager registers for the PWM clock. Every write
+ * must carry the password in the top byte.
+ */
+
+#define CM_PWMCTL           40
+#define CM_PWMDIV           41
+
+#define CM_PASSWD           0x5A000000
+#define CM_SRC_OSC          0x01
+#define CM_ENAB             0x10
+#define CM_BUSY             0x80
+
+#define CM_DIVI_MAX         4095
+#define CM_DIVF_MAX         4095
+#define CM_BUSY_TIMEOUT     1000
+
+/*
+ * Divisor used when a frequency is requested before the
+ * clock was configured. Gives 9.6MHz ticks on the 19.2MHz
+ * oscillator: fine duty resolution for anything from
+ * servos to a few hundred kHz.
+ */
+
+#define DEFAULT_DIVI        2
+
+/*
+ * PWM_CTL is shared by both channels and updated
+ * read-modify-write. Process-wide because every closure
+ * maps the same hardware.
+ */
+
+static pi__spinlock_t ctl_lock = PI_SPINLOCK_INIT;
+
+/*
+ * Serializes clock changes, which wait for the clock
+ * manager without holding `ctl_lock`. While one runs the
+ * channels are paused and updates go to `ctl_paused`,
+ * written back when the clock is running again.
+ */
+
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ctl_pausing;
+static uint32_t ctl_paused;
+
+/*
+ * Serializes setup and teardown, so two first uses from
+ * different threads map the registers once.
+ */
+
+static pthread_mutex_t setup_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Claimed pins routed to each channel. Several pins share
+ * a channel; it is disabled when the last is released.
+ */
+
+static volatile int channel_users[PI_PWM_CHANNELS];
+
+/*
+ * Pins with a PWM function and the alternate function
+ * that routes the channel to them.
+ */
+
+typedef struct {
+  pi_gpio_pin_t pin;
+  int channel;
+  pi_gpio_mode_t mode;
+} pwm_pin_t;
+
+static const pwm_pin_t pwm_pins[] = {
+    { 12, 0, PI_GPIO_MODE_ALT0 }
+  , { 13, 1, PI_GPIO_MODE_ALT0 }
+  , { 18, 0, PI_GPIO_MODE_ALT5 }
+  , { 19, 1, PI_GPIO_MODE_ALT5 }
+  , { 40, 0, PI_GPIO_MODE_ALT0 }
+  , { 41, 1, PI_GPIO_MODE_ALT0 }
+  , { 45, 1, PI_GPIO_MODE_ALT0 }
+};
+
+#define PWM_PINS (sizeof(pwm_pins) / sizeof(pwm_pins[0]))
+
+static const pwm_pin_t*
+pwm_pin(pi_gpio_pin_t pin) {
+  size_t i;
+  for (i = 0; i < PWM_PINS; i++) {
+    if (pwm_pins[i].pin == pin) return &pwm_pins[i];
+  }
+  return NULL;
+}
+
+/*
+ * Oscillator feeding the clock manager.
+ */
+
+static double
+osc_hz(void) {
+  return pi_board()->soc == PI_SOC_BCM2711 ? 54000000.0 : 19200000.0;
+}
+
+static int
+pwm_ready(pi_closure_t *closure, unsigned int channel) {
+  if (closure->pwm_map == NULL) {
+    debug("error: not setup");
+    return 0;
+  }
+
+  if (channel >= PI_PWM_CHANNELS) {
+    debug("error: no channel %u", channel);
+    return 0;
+  }
+
+  return 1;
+}
+
+static void
+ctl_update(pi_closure_t *closure, unsigned int channel, uint32_t clear, uint32_t set) {
+  volatile uint32_t *pwm_map = closure->pwm_map;
+  int shift = CTL_SHIFT(channel);
+  pi__spin_lock(&ctl_lock);
+  if (ctl_pausing) {
+    ctl_paused = (ctl_paused & ~(clear << shift)) | (set << shift);
+  } else {
+    *(pwm_map + PWM_CTL) = (*(pwm_map + PWM_CTL) & ~(clear << shift)) | (set << shift);
+  }
+  pi__spin_unlock(&ctl_lock);
+}
+
+/*
+ * Map the PWM and clock manager registers. Requires the
+ * gpio registers to be set up so pins can be switched to
+ * their PWM function. Simulated closures get plain memory
+ * blocks.
+ */
+
+static int
+pwm_setup(pi_closure_t *closure) {
+  if (closure->pwm_map != NULL) {
+    debug("already setup");
+    return 0;
+  }
+
+  if (closure->gpio_map == NULL) {
+    debug("error: gpio not setup");
+    return -1;
+  }
+
+  if (closure->simulated) {
+    void *pwm, *clk;
+    if (posix_memalign(&pwm, PAGE_SIZE, BLOCK_SIZE) != 0) {
+      debug("error: cannot allocate registers");
+      return -1;
+    }
+
+    if (posix_memalign(&clk, PAGE_SIZE, BLOCK_SIZE) != 0) {
+      debug("error: cannot allocate registers");
+      free(pwm);
+      return -1;
+    }
+
+    memset(pwm, 0, BLOCK_SIZE);
+    memset(clk, 0, BLOCK_SIZE);
+    closure->pwm_map = (volatile uint32_t*)pwm;
+    closure->clk_map = (volatile uint32_t*)clk;
+    debug("success (sim)");
+    return 0;
+  }
+
+  const pi_board_t *board = pi_board();
+  if (board->peripheral_base == 0) {
+    debug("error: no pwm registers on %s", board->soc_name);
+    return -1;
+  }
+
+  volatile uint32_t *pwm = pi__peripheral_map(PWM_DEVICE
+    , (off_t) board->peripheral_base + PWM_OFFSET, BLOCK_SIZE);
+  if (pwm == NULL) {
+    debug("error: cannot map pwm registers");
+    return -1;
+  }
+
+  volatile uint32_t *clk = pi__peripheral_map(PWM_DEVICE
+    , (off_t) board->peripheral_base + CLK_OFFSET, BLOCK_SIZE);
+  if (clk == NULL) {
+    debug("error: cannot map clock registers");
+    pi__peripheral_unmap(pwm);
+    return -1;
+  }
+
+  closure->pwm_map = pwm;
+  closure->clk_map = clk;
+  debug("success");
+  return 0;
+}
+
+int
+pi_pwm_setup(pi_closure_t *closure) {
+  int res;
+  pthread_mutex_lock(&setup_lock);
+  res = pwm_setup(closure);
+  pthread_mutex_unlock(&setup_lock);
+  return res;
+}
+
+/*
+ * Release the PWM and clock mappings. Channels keep
+ * running; release their pins to stop them.
+ */
+
+int
+pi_pwm_teardown(pi_closure_t *closure) {
+  pthread_mutex_lock(&setup_lock);
+  if (closure->pwm_map == NULL) {
+    pthread_mutex_unlock(&setup_lock);
+    debug("not setup");
+    return 0;
+  }
+
+  if (closure->simulated) {
+    free((uint32_t*)closure->pwm_map);
+    free((uint32_t*)closure->clk_map);
+  } else {
+    pi__peripheral_unmap(closure->pwm_map);
+    pi__peripheral_unmap(closure->clk_map);
+  }
+
+  closure->pwm_map = NULL;
+  closure->clk_map = NULL;
+  pthread_mutex_unlock(&setup_lock);
+  debug("success");
+  return 0;
+}
+
+/*
+ * PWM channel routed to `pin`, or -1 if the pin has no
+ * PWM function.
+ */
+
+int
+pi_pwm_channel(pi_gpio_pin_t pin) {
+  const pwm_pin_t *p = pwm_pin(pin);
+  return p == NULL ? -1 : p->channel;
+}
+
+/*
+ * Claim a pin and switch it to its PWM function. Releasing
+ * the handle returns the pin to input, and disables the
+ * channel once no other claimed pin shares it.
+ */
+
+pi_gpio_handle_t*
+pi_pwm_claim(pi_closure_t *closure, pi_gpio_pin_t pin) {
+  const pwm_pin_t *p = pwm_pin(pin);
+  if (p == NULL) {
+    debug("error: (%i) has no pwm function", pin);
+    return NULL;
+  }
+
+  if (closure->pwm_map == NULL) {
+    debug("error: not setup");
+    return NULL;
+  }
+
+  pi_gpio_handle_t *handle = pi_gpio_claim_with_args(closure, pin, p->mode, PI_GPIO_PULL_NONE);
+  if (handle == NULL) return NULL;
+  handle->method = PI_GPIO_METHOD_PWM;
+  __sync_fetch_and_add(&channel_users[p->channel], 1);
+  return handle;
+}
+
+/*
+ * Called by pi_gpio_release() for a handle from
+ * pi_pwm_claim(): stop the channel unless another claimed
+ * pin still uses it.
+ */
+
+void
+pi__pwm_release(pi_closure_t *closure, pi_gpio_pin_t pin) {
+  int channel = pi_pwm_channel(pin);
+  if (channel < 0) return;
+  if (__sync_sub_and_fetch(&channel_users[channel], 1) > 0) {
+    debug("(%i) channel %i still in use", pin, channel);
+    return;
+  }
+
+  pi_pwm_enable(closure, channel, 0);
+}
+
+/*
+ * Set the PWM clock to oscillator / (divi + divf / 4096).
+ * Both channels are paused while the clock manager
+ * switches over, then resume with their previous flags
+ * and any changes made meanwhile.
+ */
+
+int
+pi_pwm_set_clock(pi_closure_t *closure, uint32_t divi, uint32_t divf) {
+  if (!pwm_ready(closure, 0)) return -1;
+
+  if (divi < 1 || divi > CM_DIVI_MAX || divf > CM_DIVF_MAX) {
+    debug("error: divisor %u.%u out of range", divi, divf);
+    return -1;
+  }
+
+  volatile uint32_t *pwm_map = closure->pwm_map;
+  volatile uint32_t *clk_map = closure->clk_map;
+  struct timespec wait = { 0, 1000 };
+  int res = 0;
+  int i;
+
+  debug("%u.%u", divi, divf);
+  pi__trace(PI_TRACE_PWM_CLOCK, 0, divi, divf);
+  pthread_mutex_lock(&clock_lock);
+
+  pi__spin_lock(&ctl_lock);
+  ctl_paused = *(pwm_map + PWM_CTL);
+  ctl_pausing = 1;
+  *(pwm_map + PWM_CTL) = 0;
+  pi__spin_unlock(&ctl_lock);
+
+  *(clk_map + CM_PWMCTL) = CM_PASSWD | CM_SRC_OSC;
+  for (i = 0; (*(clk_map + CM_PWMCTL) & CM_BUSY) && i < CM_BUSY_TIMEOUT; i++) {
+    nanosleep(&wait, NULL);
+  }
+
+  if (i == CM_BUSY_TIMEOUT) {
+    debug("error: clock did not stop");
+    res = -1;
+  } else {
+    *(clk_map + CM_PWMDIV) = CM_PASSWD | (divi << 12) | divf;
+    *(clk_map + CM_PWMCTL) = CM_PASSWD | CM_SRC_OSC | CM_ENAB;
+  }
+
+  pi__spin_lock(&ctl_lock);
+  *(pwm_map + PWM_CTL) = ctl_paused;
+  ctl_pausing = 0;
+  pi__spin_unlock(&ctl_lock);
+
+  pthread_mutex_unlock(&clock_lock);
+  return res;
+}
+
+/*
+ * Select how a channel shapes its output and whether it is
+ * fed from `range`/`data` or from the shared fifo. Switching
+ * to the fifo clears it.
+ */
+
+int
+pi_pwm_set_mode(pi_closure_t *closure, unsigned int channel, pi_pwm_mode_t mode, int use_fifo) {
+  if (!pwm_ready(closure, channel)) return -1;
+
+  uint32_t flags = 0;
+  switch (mode) {
+    case PI_PWM_MODE_BALANCED:
+      break;
+    case PI_PWM_MODE_MARK_SPACE:
+      flags |= CTL_MSEN;
+      break;
+    case PI_PWM_MODE_SERIALIZER:
+      flags |= CTL_MODE;
+      break;
+    default:
+      debug("error: unknown mode %i", mode);
+      return -1;
+  }
+
+  if (use_fifo) flags |= CTL_USEF;
+  debug("(%u) mode %i fifo %i", channel, mode, use_fifo);
+  ctl_update(closure, channel, CTL_MODE | CTL_MSEN | CTL_USEF, flags);
+  if (use_fifo) ctl_update(closure, 0, 0, CTL_CLRF);
+  return 0;
+}
+
+/*
+ * Ticks per period (pwm and mark-space) or bits per word
+ * (serializer).
+ */
+
+int
+pi_pwm_set_range(pi_closure_t *closure, unsigned int channel, uint32_t range) {
+  if (!pwm_ready(closure, channel)) return -1;
+  *(closure->pwm_map + PWM_RNG(channel)) = range;
+  return 0;
+}
+
+/*
+ * Ticks high per period, or the word to serialize when
+ * the channel is not fed from the fifo.
+ */
+
+int
+pi_pwm_set_data(pi_closure_t *closure, unsigned int channel, uint32_t data) {
+  if (!pwm_ready(closure, channel)) return -1;
+  *(closure->pwm_map + PWM_DAT(channel)) = data;
+  return 0;
+}
+
+int
+pi_pwm_enable(pi_closure_t *closure, unsigned int channel, int enabled) {
+  if (!pwm_ready(closure, channel)) return -1;
+  debug("(%u) %s", channel, enabled ? "on" : "off");
+  ctl_update(closure, channel, CTL_PWEN, enabled ? CTL_PWEN : 0);
+  return 0;
+}
+
+/*
+ * Queue words on the fifo shared by channels with
+ * `use_fifo` set. Stops when the fifo is full and returns
+ * the number of words queued; the caller retries the rest
+ * once the hardware has drained some.
+ */
+
+size_t
+pi_pwm_write_fifo(pi_closure_t *closure, const uint32_t *words, size_t len) {
+  if (!pwm_ready(closure, 0)) return 0;
+
+  volatile uint32_t *pwm_map = closure->pwm_map;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (*(pwm_map + PWM_STA) & STA_FULL) break;
+    *(pwm_map + PWM_FIF1) = words[i];
+  }
+
+  return i;
+}
+
+/*
+ * Current PWM clock rate, or 0 if the clock is stopped.
+ */
+
+double
+pi_pwm_clock_hz(pi_closure_t *closure) {
+  if (!pwm_ready(closure, 0)) return 0;
+
+  uint32_t div = *(closure->clk_map + CM_PWMDIV);
+  uint32_t divi = (div >> 12) & CM_DIVI_MAX;
+  uint32_t divf = div & CM_DIVF_MAX;
+
+  if (!(*(closure->clk_map + CM_PWMCTL) & CM_ENAB) || divi == 0) return 0;
+  return osc_hz() / (divi + divf / 4096.0);
+}
+
+/*
+ * Raise DMA requests while the fifo has room, so a DMA
+ * channel writing the fifo is paced by the PWM clock.
+ */
+
+int
+pi_pwm_set_dma(pi_closure_t *closure, int enabled) {
+  if (!pwm_ready(closure, 0)) return -1;
+  debug("%s", enabled ? "on" : "off");
+  *(closure->pwm_map + PWM_DMAC) = enabled ? DMAC_ENAB | DMAC_PANIC | DMAC_DREQ : 0;
+  return 0;
+}
+
+/*
+ * Drive a mark-space waveform at `frequency` Hz with
+ * `duty` (0 to 1) of each period high. Uses the clock as
+ * configured, starting it at the default divisor if it is
+ * not running yet.
+ */
+
+int
+pi_pwm_set_frequency(pi_closure_t *closure, unsigned int channel, double frequency, double duty) {
+  if (!pwm_ready(closure, channel)) return -1;
+
+  if (frequency <= 0 || duty < 0 || duty > 1) {
+    debug("error: invalid frequency %f duty %f", frequency, duty);
+    return -1;
+  }
+
+  double clock = pi_pwm_clock_hz(closure);
+
+  if (clock == 0) {
+    if (pi_pwm_set_clock(closure, DEFAULT_DIVI, 0) != 0) return -1;
+    clock = pi_pwm_clock_hz(closure);
+  }
+
+  double ticks = clock / frequency + 0.5;
+
+  if (ticks < 2 || ticks > UINT32_MAX) {
+    debug("error: %f Hz out of range for %f Hz clock", frequency, clock);
+    return -1;
+  }
+
+  uint32_t range = (uint32_t) ticks;
+  uint32_t data = (uint32_t) (range * duty + 0.5);
+
+  debug("(%u) %f Hz duty %f: range %u data %u", channel, frequency, duty, range, data);
+  pi__trace(PI_TRACE_PWM_SET, channel, range, data);
+  *(closure->pwm_map + PWM_RNG(channel)) = range;
+  *(closure->pwm_map + PWM_DAT(channel)) = data;
+  ctl_update(closure, channel, CTL_CHANNEL, CTL_MSEN | CTL_PWEN);
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * libpi - Realtime execution
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE
+
+#include "pi.h"
+#include "common.h"
+
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "realtime", ##args)
+
+/*
+ * Largest stack prefault honoured.
+ */
+
+#define MAX_PREFAULT_STACK (1024 * 1024)
+
+/*
+ * Store the realtime configuration used by threads that
+ * libpi starts on behalf of this closure.
+ */
+
+void
+pi_closure_set_rt(pi_closure_t *closure, const pi_rt_config_t *config) {
+  if (config == NULL) {
+    memset(&closure->rt, 0, sizeof(pi_rt_config_t));
+  } else {
+    closure->rt = *config;
+  }
+  closure->rt_status = PI_RT_OK;
+}
+
+/*
+ * Fault in `size` bytes of the calling thread's stack so
+ * later growth does not page fault.
+ */
+
+static void __attribute__((noinline))
+pi__rt_prefault_stack(size_t size) {
+  volatile unsigned char *stack = alloca(size);
+  size_t i;
+  for (i = 0; i < size; i += PAGE_SIZE) stack[i] = 0;
+}
+
+/*
+ * Apply `config` to the calling thread. Each step that
+ * fails (usually for lack of CAP_SYS_NICE or
+ * RLIMIT_MEMLOCK) is skipped and reported in the
+ * returned pi_rt_status_t bits; the thread keeps running
+ * under normal scheduling. Memory locking applies to the
+ * whole process.
+ */
+
+int
+pi_rt_apply(const pi_rt_config_t *config) {
+  int status = PI_RT_OK;
+
+  if (config->cpus) {
+    cpu_set_t set;
+    int cpu;
+    CPU_ZERO(&set);
+    for (cpu = 0; cpu < 32; cpu++) {
+      if (config->cpus & (1u << cpu)) CPU_SET(cpu, &set);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+      debug("error: affinity 0x%x", config->cpus);
+      status |= PI_RT_AFFINITY_FAILED;
+    }
+  }
+
+  if (config->lock_memory) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+      debug("error: mlockall");
+      status |= PI_RT_MLOCK_FAILED;
+    }
+  }
+
+  if (config->prefault_stack) {
+    size_t size = config->prefault_stack;
+    pi__rt_prefault_stack(size > MAX_PREFAULT_STACK ? MAX_PREFAULT_STACK : size);
+  }
+
+  if (config->priority > 0) {
+    struct sched_param param;
+    int max = sched_get_priority_max(SCHED_FIFO);
+    int min = sched_get_priority_min(SCHED_FIFO);
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config->priority;
+    if (param.sched_priority > max) param.sched_priority = max;
+    if (param.sched_priority < min) param.sched_priority = min;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+      debug("error: SCHED_FIFO %d", param.sched_priority);
+      status |= PI_RT_SCHED_FAILED;
+    }
+  }
+
+  debug("status 0x%x", status);
+  return status;
+}
+
+/*
+ * Apply the closure configuration to the calling thread,
+ * accumulating failures in `closure->rt_status`.
+ */
+
+int
+pi_closure_rt_apply(pi_closure_t *closure) {
+  int status = pi_rt_apply(&closure->rt);
+  if (status) __sync_fetch_and_or(&closure->rt_status, status);
+  return status;
+}
+
+/*
+ * Touch every page of a buffer so it is resident before
+ * timing-critical use. Contents are preserved.
+ */
+
+void
+pi_rt_prefault(void *buf, size_t len) {
+  volatile unsigned char *p = buf;
+  size_t i;
+
+  for (i = 0; i < len; i += PAGE_SIZE) p[i] = p[i];
+  if (len) p[len - 1] = p[len - 1];
+}
@@ -0,0 +1,297 @@
+/*
+ * libpi - Native pin routing
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "route", ##args)
+
+/*
+ * Below this much time to the next scan the thread spins
+ * instead of sleeping, as in the sampler.
+ */
+
+#define SPIN_NS 50000
+
+/*
+ * Route state. Everything but `running` belongs to
+ * whichever single thread evaluates: the route thread
+ * once started, the caller of pi_route_eval otherwise.
+ */
+
+struct pi_route_s {
+  pi_closure_t *closure;
+  pi_route_rule_t rules[32];
+  unsigned int count;
+  uint32_t inputs;        /* union of all rule inputs and resets */
+  uint32_t outputs;
+
+  int primed;
+  uint32_t prev;          /* last snapshot */
+  uint32_t driven;        /* output levels last written */
+  uint32_t state;         /* LATCH and TOGGLE outputs */
+
+  uint64_t period;
+  pi_route_stats_t stats;
+  volatile int running;
+  pthread_t thread;
+};
+
+static int
+route_popcount(uint32_t v) {
+  return __builtin_popcount(v);
+}
+
+/*
+ * Check and copy `count` rules. Each output is driven by
+ * exactly one rule; COPY and INVERT take one input. No
+ * output may feed a rule back as an input or reset, or
+ * the engine would chase its own writes. Returns NULL
+ * with errno EINVAL for a bad table.
+ */
+
+pi_route_t*
+pi_route_new(pi_closure_t *closure, const pi_route_rule_t *rules,
+    unsigned int count) {
+  pi_route_t *route;
+  uint32_t outputs = 0;
+  uint32_t inputs = 0;
+  unsigned int i;
+
+  if (count == 0 || count > 32) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  for (i = 0; i < count; i++) {
+    const pi_route_rule_t *rule = &rules[i];
+    uint32_t bit = 1u << rule->output;
+    int single = rule->op == PI_ROUTE_COPY || rule->op == PI_ROUTE_INVERT;
+
+    if (rule->op >= PI_ROUTE_OP_MAX || rule->output >= 32 || rule->inputs == 0
+        || (single && route_popcount(rule->inputs) != 1) || (outputs & bit)) {
+      debug("error: bad rule %u", i);
+      errno = EINVAL;
+      return NULL;
+    }
+
+    outputs |= bit;
+    inputs |= rule->inputs | rule->reset;
+  }
+
+  if (inputs & outputs) {
+    debug("error: outputs 0x%08x feed back", inputs & outputs);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  route = calloc(1, sizeof(pi_route_t));
+  if (route == NULL) return NULL;
+
+  route->closure = closure;
+  route->count = count;
+  route->inputs = inputs;
+  route->outputs = outputs;
+  for (i = 0; i < count; i++) route->rules[i] = rules[i];
+  return route;
+}
+
+/*
+ * Evaluate every rule against `levels` (bank 0) and the
+ * previous snapshot, then drive the outputs that change
+ * with at most one SET and one CLR store. The first call
+ * drives every output and starts LATCH and TOGGLE outputs
+ * from their current level. Returns the outputs written.
+ */
+
+uint32_t
+pi_route_eval(pi_route_t *route, uint32_t levels) {
+  volatile uint32_t *gpio_map = route->closure->gpio_map;
+  uint32_t rising, falling, high = 0;
+  uint32_t set, clr;
+  unsigned int i;
+
+  if (!route->primed) {
+    route->prev = levels;
+    route->state = levels & route->outputs;
+  }
+
+  rising = levels & ~route->prev;
+  falling = ~levels & route->prev;
+
+  for (i = 0; i < route->count; i++) {
+    const pi_route_rule_t *rule = &route->rules[i];
+    uint32_t bit = 1u << rule->output;
+    uint32_t in = levels & rule->inputs;
+    uint32_t edges = (rule->edge & PI_GPIO_EDGE_RISING ? rising : 0)
+      | (rule->edge & PI_GPIO_EDGE_FALLING ? falling : 0);
+    int value = 0;
+
+    switch (rule->op) {
+      case PI_ROUTE_COPY:
+      case PI_ROUTE_OR:
+        value = in != 0;
+        break;
+      case PI_ROUTE_INVERT:
+      case PI_ROUTE_NOR:
+        value = in == 0;
+        break;
+      case PI_ROUTE_AND:
+        value = in == rule->inputs;
+        break;
+      case PI_ROUTE_NAND:
+        value = in != rule->inputs;
+        break;
+      case PI_ROUTE_XOR:
+        value = route_popcount(in) & 1;
+        break;
+      case PI_ROUTE_LATCH:
+        if (edges & rule->inputs) route->state |= bit;
+        if (levels & rule->reset) route->state &= ~bit;
+        value = (route->state & bit) != 0;
+        break;
+      case PI_ROUTE_TOGGLE:
+        if (edges & rule->inputs) route->state ^= bit;
+        value = (route->state & bit) != 0;
+        break;
+      default:
+        break;
+    }
+
+    if (value) high |= bit;
+  }
+
+  set = high & ~route->driven;
+  clr = ~high & route->driven & route->outputs;
+  if (!route->primed) {
+    set = high;
+    clr = ~high & route->outputs;
+    route->primed = 1;
+  }
+
+  if (set) *(gpio_map + SET_OFFSET) = set;
+  if (clr) *(gpio_map + CLR_OFFSET) = clr;
+
+  route->driven = high;
+  route->prev = levels;
+  route->stats.writes += route_popcount(set | clr);
+  return set | clr;
+}
+
+/*
+ * Evaluate against the current levels.
+ */
+
+uint32_t
+pi_route_step(pi_route_t *route) {
+  return pi_route_eval(route, *(route->closure->gpio_map + PINLEVEL_OFFSET));
+}
+
+/*
+ * Route thread. Rules are only evaluated when an input
+ * changed; a zero period scans back to back.
+ */
+
+static void*
+route_run(void *arg) {
+  pi_route_t *route = arg;
+  volatile uint32_t *level = route->closure->gpio_map + PINLEVEL_OFFSET;
+  uint64_t deadline = pi_time_ns();
+
+  pi_closure_rt_apply(route->closure);
+  if (!route->primed) pi_route_eval(route, *level);
+
+  while (route->running) {
+    uint32_t levels = *level;
+    route->stats.scans++;
+
+    if ((levels ^ route->prev) & route->inputs) {
+      route->stats.changes++;
+      pi_route_eval(route, levels);
+    }
+
+    if (route->period == 0) continue;
+
+    uint64_t now = pi_time_ns();
+    deadline += route->period;
+
+    if (deadline <= now) {
+      deadline = now;
+    } else if (deadline - now > SPIN_NS) {
+      pi_sleep_until_ns(deadline - SPIN_NS);
+    }
+
+    while (pi_time_ns() < deadline);
+  }
+
+  return NULL;
+}
+
+/*
+ * Scan `rate` times a second on a thread of its own, or
+ * continuously with a rate of 0. The outputs must be
+ * claimed as outputs; nothing else may write them while
+ * the route runs.
+ */
+
+int
+pi_route_start(pi_route_t *route, uint32_t rate) {
+  if (route->running) return 0;
+  if (route->closure->gpio_map == NULL) {
+    debug("error: gpio not setup");
+    return -1;
+  }
+
+  route->period = rate ? 1000000000ULL / rate : 0;
+  route->running = 1;
+
+  if (pthread_create(&route->thread, NULL, route_run, route) != 0) {
+    debug("error: cannot start thread");
+    route->running = 0;
+    return -1;
+  }
+
+  pi__trace(PI_TRACE_ROUTE_START, 0, route->outputs, rate);
+  return 0;
+}
+
+/*
+ * Snapshot of the counters; they may be a scan behind
+ * while the thread runs.
+ */
+
+void
+pi_route_stats(pi_route_t *route, pi_route_stats_t *stats) {
+  __sync_synchronize();
+  *stats = route->stats;
+}
+
+/*
+ * Stop the thread. Outputs keep their last level.
+ */
+
+void
+pi_route_stop(pi_route_t *route) {
+  if (!route->running) return;
+  route->running = 0;
+  pthread_join(route->thread, NULL);
+  pi__trace(PI_TRACE_ROUTE_STOP, 0, route->outputs, 0);
+}
+
+void
+pi_route_delete(pi_route_t *route) {
+  pi_route_stop(route);
+  free(route);
+}
@@ -0,0 +1,245 @@
+/*
+ * libpi - Change-only GPIO sampler
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "sampler", ##args)
+
+/*
+ * Below this much time to the next deadline the sampler
+ * spins instead of sleeping; nanosleep overshoots by
+ * tens of microseconds.
+ */
+
+#define SPIN_NS 50000
+
+/*
+ * Sampler state. `head` is written by the sampler thread
+ * only and `tail` by the reader only.
+ */
+
+struct pi_sampler_s {
+  pi_closure_t *closure;
+  uint64_t period;
+  pi_sampler_notify_cb notify;
+  void *data;
+
+  pi_sample_t *ring;
+  uint32_t mask;
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t watch;
+  volatile uint32_t dropped;
+  volatile int pending;
+  volatile int running;
+  pthread_t thread;
+};
+
+/*
+ * Allocate a sampler polling `closure` `rate` times a
+ * second. `capacity` is rounded up to a power of two.
+ * `notify` is called from the sampler thread when records
+ * become available after a read emptied the ring.
+ */
+
+pi_sampler_t*
+pi_sampler_new(pi_closure_t *closure, uint32_t rate, size_t capacity,
+    pi_sampler_notify_cb notify, void *data) {
+  pi_sampler_t *sampler;
+  uint32_t size = 16;
+
+  if (rate == 0) return NULL;
+  while (size < capacity && size < (1u << 24)) size <<= 1;
+
+  sampler = calloc(1, sizeof(pi_sampler_t));
+  if (sampler == NULL) return NULL;
+
+  sampler->ring = malloc(sizeof(pi_sample_t) * size);
+  if (sampler->ring == NULL) {
+    free(sampler);
+    return NULL;
+  }
+
+  sampler->closure = closure;
+  sampler->period = 1000000000ULL / rate;
+  sampler->mask = size - 1;
+  sampler->notify = notify;
+  sampler->data = data;
+  return sampler;
+}
+
+/*
+ * Push a record, dropping it if the ring is full.
+ * Returns 0 on success.
+ */
+
+static int
+pi__sampler_push(pi_sampler_t *sampler, uint64_t time, uint32_t levels,
+    uint32_t changed) {
+  uint32_t head = sampler->head;
+  pi_sample_t *sample;
+
+  if (head - sampler->tail > sampler->mask) {
+    __sync_fetch_and_add(&sampler->dropped, 1);
+    return -1;
+  }
+
+  sample = &sampler->ring[head & sampler->mask];
+  sample->time = time;
+  sample->levels = levels;
+  sample->changed = changed;
+  __sync_synchronize();
+  sampler->head = head + 1;
+
+  if (sampler->notify && __sync_lock_test_and_set(&sampler->pending, 1) == 0) {
+    sampler->notify(sampler->data);
+  }
+
+  return 0;
+}
+
+/*
+ * Sampler thread. Deadlines are absolute; after an
+ * overrun the schedule restarts from now rather than
+ * bursting to catch up.
+ */
+
+static void*
+pi__sampler_run(void *arg) {
+  pi_sampler_t *sampler = arg;
+  volatile uint32_t *level = sampler->closure->gpio_map + PINLEVEL_OFFSET;
+  uint32_t prev = *level;
+  uint64_t deadline = pi_time_ns();
+
+  pi_closure_rt_apply(sampler->closure);
+  debug("running every %llu ns", (unsigned long long) sampler->period);
+
+  while (sampler->running) {
+    uint32_t levels = *level;
+    uint32_t changed = (levels ^ prev) & sampler->watch;
+    uint64_t now = pi_time_ns();
+
+    if (changed && pi__sampler_push(sampler, now, levels, changed) == 0) {
+      prev = levels;
+    }
+
+    deadline += sampler->period;
+    now = pi_time_ns();
+
+    if (deadline <= now) {
+      deadline = now;
+    } else if (deadline - now > SPIN_NS) {
+      pi_sleep_until_ns(deadline - SPIN_NS);
+    }
+
+    while (pi_time_ns() < deadline);
+  }
+
+  return NULL;
+}
+
+/*
+ * Start polling the pins in `mask` (bank 0).
+ */
+
+int
+pi_sampler_start(pi_sampler_t *sampler, uint32_t mask) {
+  if (sampler->running) return 0;
+  if (sampler->closure->gpio_map == NULL) {
+    debug("error: gpio not setup");
+    return -1;
+  }
+
+  sampler->watch = mask;
+  sampler->running = 1;
+
+  if (pthread_create(&sampler->thread, NULL, pi__sampler_run, sampler) != 0) {
+    debug("error: cannot start thread");
+    sampler->running = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Change the watched pins. A newly watched pin reports
+ * its level on the next sample if it differs from the
+ * last record.
+ */
+
+void
+pi_sampler_set_mask(pi_sampler_t *sampler, uint32_t mask) {
+  sampler->watch = mask;
+  __sync_synchronize();
+}
+
+/*
+ * Copy up to `max` records out of the ring. Re-arms
+ * notification first so a record pushed during the copy
+ * triggers another notify. Callers read until fewer than
+ * `max` records come back.
+ */
+
+size_t
+pi_sampler_read(pi_sampler_t *sampler, pi_sample_t *samples, size_t max) {
+  uint32_t tail = sampler->tail;
+  uint32_t head;
+  size_t n = 0;
+
+  __sync_lock_release(&sampler->pending);
+  __sync_synchronize();
+  head = sampler->head;
+
+  while (tail != head && n < max) {
+    samples[n++] = sampler->ring[tail & sampler->mask];
+    tail++;
+  }
+
+  __sync_synchronize();
+  sampler->tail = tail;
+  return n;
+}
+
+/*
+ * Records lost because the ring was full.
+ */
+
+uint32_t
+pi_sampler_dropped(pi_sampler_t *sampler) {
+  return sampler->dropped;
+}
+
+/*
+ * Stop the sampler thread and wait for it to exit.
+ */
+
+void
+pi_sampler_stop(pi_sampler_t *sampler) {
+  if (!sampler->running) return;
+  sampler->running = 0;
+  pthread_join(sampler->thread, NULL);
+}
+
+/*
+ * Stop and free.
+ */
+
+void
+pi_sampler_delete(pi_sampler_t *sampler) {
+  pi_sampler_stop(sampler);
+  free(sampler->ring);
+  free(sampler);
+}
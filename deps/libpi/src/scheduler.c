@@ -0,0 +1,626 @@
+/*
+ * libpi - Timer wheel write scheduler
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "scheduler", ##args)
+
+/*
+ * Below this much time to the next tick the thread spins
+ * instead of sleeping, as in the sampler.
+ */
+
+#define SPIN_NS 50000
+#define DEFAULT_TICK_NS 1000
+
+/*
+ * Wheel geometry. Level 0 has a slot per tick; each
+ * higher level has 64 slots of a whole lower level. At a
+ * 1us tick the wheel spans 67s; later entries park in the
+ * last level 3 slot and are placed again as it cascades.
+ */
+
+#define WHEEL_LEVELS 4
+#define WHEEL0_BITS 8
+#define WHEEL0_SIZE (1 << WHEEL0_BITS)
+#define WHEELN_BITS 6
+#define WHEELN_SIZE (1 << WHEELN_BITS)
+#define WHEEL_SLOTS (WHEEL0_SIZE + (WHEEL_LEVELS - 1) * WHEELN_SIZE)
+#define WHEEL_SPAN (1ULL << (WHEEL0_BITS + (WHEEL_LEVELS - 1) * WHEELN_BITS))
+
+#define WHEEL_SHIFT(level) (WHEEL0_BITS + ((level) - 1) * WHEELN_BITS)
+#define WHEEL_SLOT(level, idx) (WHEEL0_SIZE + ((level) - 1) * WHEELN_SIZE + (idx))
+
+/*
+ * Ids carry a generation above the entry index so a
+ * stale id cannot cancel a reused entry.
+ */
+
+#define ID_INDEX_BITS 24
+#define ID_GEN_MASK ((1u << 29) - 1)
+#define MAX_CAPACITY (1u << ID_INDEX_BITS)
+
+#define NIL 0xffffffffu
+
+typedef struct {
+  uint64_t expires;       /* tick */
+  uint64_t deadline;
+  uint32_t set;
+  uint32_t clr;
+  uint32_t gen;           /* 0 while free */
+  uint32_t next;
+  uint32_t prev;
+  uint16_t slot;
+  uint8_t bank;
+} sched_entry_t;
+
+/*
+ * Everything below `lock` is guarded by it.
+ */
+
+struct pi_sched_s {
+  pi_closure_t *closure;
+  uint64_t tick_ns;
+  sched_entry_t *entries;
+  uint32_t capacity;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  uint32_t free;
+  uint32_t gen;
+  uint32_t outputs[2];    /* pins a store may drive, per bank */
+  uint64_t cur;           /* next tick to process */
+  volatile uint64_t wake; /* tick the thread waits for */
+  uint32_t head[WHEEL_SLOTS];
+  uint32_t tail[WHEEL_SLOTS];
+  uint64_t occupied0[WHEEL0_SIZE / 64];
+  uint64_t occupied[WHEEL_LEVELS];
+  pi_sched_stats_t stats;
+
+  volatile int running;
+  pthread_t thread;
+};
+
+/*
+ * Create a scheduler for up to `capacity` pending entries
+ * with a `tick_ns` resolution (0 for 1us). Returns NULL
+ * with errno EINVAL for a bad size.
+ */
+
+pi_sched_t*
+pi_sched_new(pi_closure_t *closure, size_t capacity, uint32_t tick_ns) {
+  pthread_condattr_t attr;
+  pi_sched_t *sched;
+  uint32_t i;
+
+  if (capacity == 0 || capacity > MAX_CAPACITY) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  sched = calloc(1, sizeof(pi_sched_t));
+  if (sched == NULL) return NULL;
+
+  sched->entries = calloc(capacity, sizeof(sched_entry_t));
+  if (sched->entries == NULL) {
+    free(sched);
+    return NULL;
+  }
+
+  sched->closure = closure;
+  sched->tick_ns = tick_ns ? tick_ns : DEFAULT_TICK_NS;
+  sched->capacity = (uint32_t) capacity;
+  sched->cur = pi_time_ns() / sched->tick_ns;
+  sched->wake = ~0ULL;
+  sched->outputs[0] = sched->outputs[1] = ~0u;
+
+  for (i = 0; i < capacity; i++) sched->entries[i].next = i + 1 < capacity ? i + 1 : NIL;
+  for (i = 0; i < WHEEL_SLOTS; i++) sched->head[i] = sched->tail[i] = NIL;
+
+  pthread_mutex_init(&sched->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&sched->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  return sched;
+}
+
+/*
+ * The deadline clock.
+ */
+
+uint64_t
+pi_sched_now(void) {
+  return pi_time_ns();
+}
+
+/*
+ * Slot for an entry relative to the current tick.
+ */
+
+static uint16_t
+sched_slot(pi_sched_t *sched, uint64_t expires) {
+  uint64_t delta = expires - sched->cur;
+  int level;
+
+  if (delta < WHEEL0_SIZE) return expires & (WHEEL0_SIZE - 1);
+  if (delta >= WHEEL_SPAN) expires = sched->cur + WHEEL_SPAN - 1;
+
+  delta = expires - sched->cur;
+  for (level = 1; level < WHEEL_LEVELS - 1; level++) {
+    if (delta < 1ULL << WHEEL_SHIFT(level + 1)) break;
+  }
+
+  return WHEEL_SLOT(level, (expires >> WHEEL_SHIFT(level)) & (WHEELN_SIZE - 1));
+}
+
+static void
+sched_mark(pi_sched_t *sched, uint16_t slot, int occupied) {
+  uint64_t *word;
+  uint64_t bit;
+
+  if (slot < WHEEL0_SIZE) {
+    word = &sched->occupied0[slot / 64];
+    bit = 1ULL << (slot % 64);
+  } else {
+    word = &sched->occupied[1 + (slot - WHEEL0_SIZE) / WHEELN_SIZE];
+    bit = 1ULL << ((slot - WHEEL0_SIZE) % WHEELN_SIZE);
+  }
+
+  if (occupied) *word |= bit;
+  else *word &= ~bit;
+}
+
+/*
+ * Append to the tail so entries keep queue order within
+ * a slot, and through cascades.
+ */
+
+static void
+sched_link(pi_sched_t *sched, uint32_t i) {
+  sched_entry_t *entry = &sched->entries[i];
+  uint16_t slot = sched_slot(sched, entry->expires);
+
+  entry->slot = slot;
+  entry->next = NIL;
+  entry->prev = sched->tail[slot];
+
+  if (sched->tail[slot] == NIL) {
+    sched->head[slot] = i;
+    sched_mark(sched, slot, 1);
+  } else {
+    sched->entries[sched->tail[slot]].next = i;
+  }
+
+  sched->tail[slot] = i;
+}
+
+static void
+sched_unlink(pi_sched_t *sched, uint32_t i) {
+  sched_entry_t *entry = &sched->entries[i];
+  uint16_t slot = entry->slot;
+
+  if (entry->prev == NIL) sched->head[slot] = entry->next;
+  else sched->entries[entry->prev].next = entry->next;
+
+  if (entry->next == NIL) sched->tail[slot] = entry->prev;
+  else sched->entries[entry->next].prev = entry->prev;
+
+  if (sched->head[slot] == NIL) sched_mark(sched, slot, 0);
+}
+
+static void
+sched_free(pi_sched_t *sched, uint32_t i) {
+  sched->entries[i].gen = 0;
+  sched->entries[i].next = sched->free;
+  sched->free = i;
+  sched->stats.pending--;
+}
+
+/*
+ * First tick at or after the current one with a level 0
+ * entry or an occupied cascade, or ~0 when empty.
+ */
+
+static uint64_t
+sched_next(pi_sched_t *sched) {
+  uint64_t next = ~0ULL;
+  unsigned int pos = sched->cur & (WHEEL0_SIZE - 1);
+  unsigned int n;
+  int level;
+
+  for (n = 0; n <= WHEEL0_SIZE / 64; n++) {
+    unsigned int word = (pos / 64 + n) % (WHEEL0_SIZE / 64);
+    uint64_t bits = sched->occupied0[word];
+
+    if (n == 0) bits &= ~0ULL << (pos % 64);
+    if (n == WHEEL0_SIZE / 64) bits &= (1ULL << (pos % 64)) - 1;
+    if (bits) {
+      unsigned int slot = word * 64 + __builtin_ctzll(bits);
+      next = sched->cur + ((slot - pos) & (WHEEL0_SIZE - 1));
+      break;
+    }
+  }
+
+  for (level = 1; level < WHEEL_LEVELS; level++) {
+    uint64_t bits = sched->occupied[level];
+    unsigned int shift = WHEEL_SHIFT(level);
+    uint64_t first = (sched->cur + (1ULL << shift) - 1) >> shift;
+    unsigned int rot = first & (WHEELN_SIZE - 1);
+
+    if (bits == 0) continue;
+    if (rot) bits = (bits >> rot) | (bits << (WHEELN_SIZE - rot));
+
+    uint64_t tick = (first + __builtin_ctzll(bits)) << shift;
+    if (tick < next) next = tick;
+  }
+
+  return next;
+}
+
+/*
+ * Place a higher level slot's entries again, now that
+ * the current tick has reached it.
+ */
+
+static void
+sched_cascade(pi_sched_t *sched, int level, unsigned int idx) {
+  uint16_t slot = WHEEL_SLOT(level, idx);
+  uint32_t i = sched->head[slot];
+
+  sched->head[slot] = sched->tail[slot] = NIL;
+  sched_mark(sched, slot, 0);
+
+  while (i != NIL) {
+    uint32_t next = sched->entries[i].next;
+    sched_link(sched, i);
+    i = next;
+  }
+}
+
+/*
+ * Write every entry due at `tick` with one SET and one CLR
+ * store per bank, limited to the pins still allowed.
+ */
+
+static size_t
+sched_fire(pi_sched_t *sched, uint64_t tick, uint64_t now) {
+  volatile uint32_t *gpio_map = sched->closure->gpio_map;
+  uint16_t slot = tick & (WHEEL0_SIZE - 1);
+  uint32_t set[2] = { 0, 0 };
+  uint32_t clr[2] = { 0, 0 };
+  uint32_t i = sched->head[slot];
+  size_t fired = 0;
+  int bank;
+
+  sched->head[slot] = sched->tail[slot] = NIL;
+  sched_mark(sched, slot, 0);
+
+  while (i != NIL) {
+    sched_entry_t *entry = &sched->entries[i];
+    uint32_t next = entry->next;
+
+    set[entry->bank] = (set[entry->bank] & ~entry->clr) | entry->set;
+    clr[entry->bank] = (clr[entry->bank] & ~entry->set) | entry->clr;
+    if (now > entry->deadline && now - entry->deadline > sched->stats.max_late_ns) {
+      sched->stats.max_late_ns = now - entry->deadline;
+    }
+
+    sched_free(sched, i);
+    fired++;
+    i = next;
+  }
+
+  for (bank = 0; bank < 2; bank++) {
+    set[bank] &= sched->outputs[bank];
+    clr[bank] &= sched->outputs[bank];
+
+    if (set[bank]) {
+      *(gpio_map + SET_OFFSET + bank) = set[bank];
+      sched->stats.stores++;
+    }
+    if (clr[bank]) {
+      *(gpio_map + CLR_OFFSET + bank) = clr[bank];
+      sched->stats.stores++;
+    }
+    if (set[bank] | clr[bank]) pi__trace(PI_TRACE_SCHED_FIRE, bank, set[bank], clr[bank]);
+  }
+
+  sched->stats.fired += fired;
+  return fired;
+}
+
+/*
+ * Process every tick up to `now_tick`, jumping over empty
+ * ones. Called with the lock held.
+ */
+
+static size_t
+sched_advance(pi_sched_t *sched, uint64_t now_tick, uint64_t now) {
+  size_t fired = 0;
+  int level;
+
+  while (sched->stats.pending > 0) {
+    uint64_t tick = sched_next(sched);
+    if (tick > now_tick) break;
+
+    sched->cur = tick;
+    for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+      unsigned int shift = WHEEL_SHIFT(level);
+      if (tick & ((1ULL << shift) - 1)) continue;
+      sched_cascade(sched, level, (tick >> shift) & (WHEELN_SIZE - 1));
+    }
+
+    if (sched->head[tick & (WHEEL0_SIZE - 1)] != NIL) {
+      fired += sched_fire(sched, tick, now);
+    }
+
+    sched->cur = tick + 1;
+  }
+
+  if (sched->cur <= now_tick) sched->cur = now_tick + 1;
+  return fired;
+}
+
+/*
+ * Queue `count` entries, storing their ids in `ids` when
+ * given. Deadlines already passed fire on the next tick.
+ * Returns the number queued; fewer than `count` sets
+ * errno ENOSPC when the scheduler is full, or EINVAL at
+ * an entry with a bad bank or a pin both set and cleared.
+ */
+
+size_t
+pi_sched_add(pi_sched_t *sched, const pi_sched_entry_t *entries, size_t count,
+    uint64_t *ids) {
+  uint64_t earliest = ~0ULL;
+  size_t n;
+
+  pthread_mutex_lock(&sched->lock);
+
+  for (n = 0; n < count; n++) {
+    const pi_sched_entry_t *in = &entries[n];
+    uint64_t expires = (in->deadline + sched->tick_ns - 1) / sched->tick_ns;
+    uint32_t i = sched->free;
+    sched_entry_t *entry;
+
+    if (in->bank > 1 || (in->set & in->clr)) {
+      errno = EINVAL;
+      break;
+    }
+
+    if (i == NIL) {
+      errno = ENOSPC;
+      break;
+    }
+
+    entry = &sched->entries[i];
+    sched->free = entry->next;
+    sched->gen = (sched->gen + 1) & ID_GEN_MASK;
+    if (sched->gen == 0) sched->gen = 1;
+
+    entry->expires = expires < sched->cur ? sched->cur : expires;
+    entry->deadline = in->deadline;
+    entry->set = in->set;
+    entry->clr = in->clr;
+    entry->bank = in->bank;
+    entry->gen = sched->gen;
+    sched_link(sched, i);
+
+    if (entry->expires < earliest) earliest = entry->expires;
+    if (ids != NULL) ids[n] = ((uint64_t) entry->gen << ID_INDEX_BITS) | i;
+  }
+
+  sched->stats.queued += n;
+  sched->stats.pending += n;
+
+  // the thread sleeps toward `wake`; pull it in
+  if (earliest < sched->wake) {
+    sched->wake = earliest;
+    pthread_cond_signal(&sched->cond);
+  }
+
+  pthread_mutex_unlock(&sched->lock);
+  return n;
+}
+
+/*
+ * Queue a single pin write. Returns its id, or 0 with
+ * errno set.
+ */
+
+uint64_t
+pi_sched_write(pi_sched_t *sched, uint64_t deadline, pi_gpio_pin_t pin,
+    pi_gpio_value_t value) {
+  pi_sched_entry_t entry;
+  uint64_t id;
+
+  entry.deadline = deadline;
+  entry.bank = pin / 32;
+  entry.set = value ? 1u << (pin % 32) : 0;
+  entry.clr = value ? 0 : 1u << (pin % 32);
+
+  if (pi_sched_add(sched, &entry, 1, &id) != 1) return 0;
+  return id;
+}
+
+/*
+ * Drop a pending entry. Returns -1 if it already fired,
+ * was cancelled, or never existed.
+ */
+
+int
+pi_sched_cancel(pi_sched_t *sched, uint64_t id) {
+  uint32_t i = id & (MAX_CAPACITY - 1);
+  uint32_t gen = (uint32_t) (id >> ID_INDEX_BITS);
+  int res = -1;
+
+  if (i >= sched->capacity || gen == 0) return -1;
+
+  pthread_mutex_lock(&sched->lock);
+  if (sched->entries[i].gen == gen) {
+    sched_unlink(sched, i);
+    sched_free(sched, i);
+    sched->stats.cancelled++;
+    res = 0;
+  }
+  pthread_mutex_unlock(&sched->lock);
+
+  return res;
+}
+
+/*
+ * Limit the pins of `bank` any later store may drive to
+ * `mask` (all of them by default). Pending entries stay
+ * queued; their writes to other pins are dropped when
+ * they fire. Callers narrow it as pins are released.
+ */
+
+int
+pi_sched_set_outputs(pi_sched_t *sched, uint8_t bank, uint32_t mask) {
+  if (bank > 1) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&sched->lock);
+  sched->outputs[bank] = mask;
+  pthread_mutex_unlock(&sched->lock);
+
+  return 0;
+}
+
+/*
+ * Fire everything due by `now` on the calling thread, for
+ * a scheduler that is not started. Returns the entries
+ * written.
+ */
+
+size_t
+pi_sched_step(pi_sched_t *sched, uint64_t now) {
+  size_t fired;
+
+  pthread_mutex_lock(&sched->lock);
+  fired = sched_advance(sched, now / sched->tick_ns, now);
+  pthread_mutex_unlock(&sched->lock);
+
+  return fired;
+}
+
+/*
+ * Timing thread. Sleeps on the condition until the next
+ * occupied tick (or a new earlier entry), then releases
+ * the lock and spins the last stretch.
+ */
+
+static void*
+sched_run(void *arg) {
+  pi_sched_t *sched = arg;
+
+  pi_closure_rt_apply(sched->closure);
+  pthread_mutex_lock(&sched->lock);
+
+  while (sched->running) {
+    uint64_t now = pi_time_ns();
+    uint64_t next, deadline;
+
+    sched_advance(sched, now / sched->tick_ns, now);
+
+    next = sched_next(sched);
+    sched->wake = next;
+    if (next == ~0ULL) {
+      pthread_cond_wait(&sched->cond, &sched->lock);
+      continue;
+    }
+
+    deadline = next * sched->tick_ns;
+    now = pi_time_ns();
+
+    if (deadline > now && deadline - now > SPIN_NS) {
+      struct timespec until;
+      until.tv_sec = (deadline - SPIN_NS) / 1000000000ULL;
+      until.tv_nsec = (deadline - SPIN_NS) % 1000000000ULL;
+      pthread_cond_timedwait(&sched->cond, &sched->lock, &until);
+      continue;
+    }
+
+    pthread_mutex_unlock(&sched->lock);
+    while (sched->running && pi_time_ns() < sched->wake * sched->tick_ns);
+    pthread_mutex_lock(&sched->lock);
+  }
+
+  sched->wake = ~0ULL;
+  pthread_mutex_unlock(&sched->lock);
+  return NULL;
+}
+
+/*
+ * Fire entries from a thread of its own. Every pin
+ * written must be claimed as an output.
+ */
+
+int
+pi_sched_start(pi_sched_t *sched) {
+  if (sched->running) return 0;
+  if (sched->closure->gpio_map == NULL) {
+    debug("error: gpio not setup");
+    return -1;
+  }
+
+  sched->running = 1;
+  if (pthread_create(&sched->thread, NULL, sched_run, sched) != 0) {
+    debug("error: cannot start thread");
+    sched->running = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+void
+pi_sched_stats(pi_sched_t *sched, pi_sched_stats_t *stats) {
+  pthread_mutex_lock(&sched->lock);
+  *stats = sched->stats;
+  pthread_mutex_unlock(&sched->lock);
+}
+
+/*
+ * Stop the thread. Pending entries stay queued and fire,
+ * late, once started again.
+ */
+
+void
+pi_sched_stop(pi_sched_t *sched) {
+  if (!sched->running) return;
+
+  pthread_mutex_lock(&sched->lock);
+  sched->running = 0;
+  pthread_cond_signal(&sched->cond);
+  pthread_mutex_unlock(&sched->lock);
+
+  pthread_join(sched->thread, NULL);
+}
+
+void
+pi_sched_delete(pi_sched_t *sched) {
+  pi_sched_stop(sched);
+  pthread_cond_destroy(&sched->cond);
+  pthread_mutex_destroy(&sched->lock);
+  free(sched->entries);
+  free(sched);
+}
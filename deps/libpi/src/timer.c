@@ -7,8 +7,30 @@
 #include "pi.h"
 #include "common.h"
 
+#include <errno.h>
+#include <sched.h>
 #include <time.h>
 
+/*
+ * Monotonic time in nanoseconds.
+ */
+
+uint64_t
+pi_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Give up the cpu while spinning on a lock.
+ */
+
+void
+pi__spin_yield(void) {
+  sched_yield();
+}
+
 /*
  * Sleep for miliseconds.
  */
@@ -16,7 +38,8 @@
 void
 pi_sleep_ms(unsigned long ms) {
   struct timespec wait = {0};
-  wait.tv_nsec = ms * 1000000L;
+  wait.tv_sec = ms / 1000;
+  wait.tv_nsec = (ms % 1000) * 1000000L;
   nanosleep(&wait, NULL);
 }
 
@@ -27,6 +50,20 @@ pi_sleep_ms(unsigned long ms) {
 void
 pi_sleep_ns(unsigned long ns) {
   struct timespec wait = {0};
-  wait.tv_nsec = ns;
+  wait.tv_sec = ns / 1000000000L;
+  wait.tv_nsec = ns % 1000000000L;
   nanosleep(&wait, NULL);
 }
+
+/*
+ * Sleep until an absolute pi_time_ns() deadline. Returns
+ * at once if it has passed.
+ */
+
+void
+pi_sleep_until_ns(uint64_t deadline) {
+  struct timespec until = {0};
+  until.tv_sec = deadline / 1000000000ULL;
+  until.tv_nsec = deadline % 1000000000ULL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+}
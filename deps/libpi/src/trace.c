@@ -0,0 +1,305 @@
+/*
+ * libpi - Trace ring
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE
+
+#include "pi.h"
+#include "common.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "trace", ##args)
+
+/*
+ * Records per thread ring (power of two).
+ */
+
+#define RING_SIZE 4096
+#define RING_MASK (RING_SIZE - 1)
+
+/*
+ * Single-writer ring owned by one thread at a time.
+ * `head` counts every record ever written; the slot is
+ * `head & RING_MASK`. `seq` holds one more than the count
+ * of the record in each slot, or 0 while it is being
+ * written. Records before `tail` have been cleared. Rings
+ * of exited threads are kept on the list and reused by
+ * new threads.
+ */
+
+typedef struct pi__trace_ring_s {
+  struct pi__trace_ring_s *next;
+  volatile int owned;
+  uint32_t thread;
+  volatile uint64_t head;
+  volatile uint64_t tail;
+  volatile uint64_t seq[RING_SIZE];
+  pi_trace_record_t records[RING_SIZE];
+} pi__trace_ring_t;
+
+volatile int pi__trace_on = 0;
+
+static pi__trace_ring_t *volatile rings = NULL;
+static __thread pi__trace_ring_t *ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+static const char *op_names[PI_TRACE_OP_MAX] = {
+    "none"
+  , "gpio_setup"
+  , "gpio_teardown"
+  , "gpio_claim"
+  , "gpio_release"
+  , "gpio_set_mode"
+  , "gpio_set_pull"
+  , "gpio_read"
+  , "gpio_write"
+  , "gpio_read_mask"
+  , "gpio_write_mask"
+  , "gpio_listen"
+  , "gpio_write_sequence"
+  , "gpio_lines_get"
+  , "gpio_lines_set"
+  , "gpio_lines_events"
+  , "pwm_clock"
+  , "pwm_set"
+  , "wave_start"
+  , "wave_stop"
+  , "gpio_set_detect"
+  , "gpio_poll_events"
+  , "route_start"
+  , "route_stop"
+  , "program_run"
+  , "sched_fire"
+  , "daemon_connect"
+  , "daemon_disconnect"
+};
+
+/*
+ * Hand a ring back when its thread exits.
+ */
+
+static void
+pi__trace_ring_release(void *arg) {
+  pi__trace_ring_t *r = arg;
+  __sync_lock_release(&r->owned);
+}
+
+static void
+pi__trace_key_init(void) {
+  pthread_key_create(&ring_key, pi__trace_ring_release);
+}
+
+/*
+ * Find or create the ring for the calling thread.
+ */
+
+static pi__trace_ring_t*
+pi__trace_ring(void) {
+  pi__trace_ring_t *r;
+
+  pthread_once(&ring_once, pi__trace_key_init);
+
+  for (r = rings; r != NULL; r = r->next) {
+    if (__sync_lock_test_and_set(&r->owned, 1) == 0) break;
+  }
+
+  if (r == NULL) {
+    r = calloc(1, sizeof(pi__trace_ring_t));
+    if (r == NULL) return NULL;
+    r->owned = 1;
+    do {
+      r->next = rings;
+    } while (!__sync_bool_compare_and_swap(&rings, r->next, r));
+  }
+
+  r->thread = (uint32_t)syscall(SYS_gettid);
+  pthread_setspecific(ring_key, r);
+  return (ring = r);
+}
+
+/*
+ * Append a record to the calling thread's ring.
+ */
+
+void
+pi__trace_emit(uint16_t op, uint16_t pin, uint32_t value, uint32_t extra) {
+  pi__trace_ring_t *r = ring;
+  if (r == NULL && (r = pi__trace_ring()) == NULL) return;
+
+  uint64_t head = r->head;
+  pi_trace_record_t *rec = &r->records[head & RING_MASK];
+  r->seq[head & RING_MASK] = 0;
+  __sync_synchronize();
+  rec->time = pi_time_ns();
+  rec->thread = r->thread;
+  rec->op = op;
+  rec->pin = pin;
+  rec->value = value;
+  rec->extra = extra;
+  __sync_synchronize();
+  r->seq[head & RING_MASK] = head + 1;
+  r->head = head + 1;
+}
+
+/*
+ * Turn tracing on or off at runtime.
+ */
+
+void
+pi_trace_enable(int enabled) {
+  debug("%s", enabled ? "on" : "off");
+  pi__trace_on = enabled ? 1 : 0;
+  __sync_synchronize();
+}
+
+int
+pi_trace_enabled(void) {
+  return pi__trace_on;
+}
+
+/*
+ * Copy the records still held by one ring, dropping any
+ * that were overwritten while copying. The writer may be
+ * partway through slot `now`, so only records from
+ * `now + 1 - RING_SIZE` on can be intact, and a slot whose
+ * `seq` is not its own around the copy is torn.
+ */
+
+static size_t
+pi__trace_copy(pi__trace_ring_t *r, pi_trace_record_t *out, size_t max) {
+  uint64_t head = r->head;
+  uint64_t first = head > RING_SIZE ? head - RING_SIZE : 0;
+  uint64_t i, seq, now;
+  size_t n = 0;
+
+  if (first < r->tail) first = r->tail;
+
+  __sync_synchronize();
+  if (head - first > max) first = head - max;
+  for (i = first; i < head; i++) {
+    seq = r->seq[i & RING_MASK];
+    __sync_synchronize();
+    out[n] = r->records[i & RING_MASK];
+    __sync_synchronize();
+    now = r->head;
+    if (seq != i + 1 || r->seq[i & RING_MASK] != seq) continue;
+    if (now + 1 > RING_SIZE && i < now + 1 - RING_SIZE) continue;
+    n++;
+  }
+
+  return n;
+}
+
+static int
+pi__trace_cmp(const void *a, const void *b) {
+  uint64_t x = ((const pi_trace_record_t*)a)->time;
+  uint64_t y = ((const pi_trace_record_t*)b)->time;
+  return x < y ? -1 : x > y;
+}
+
+/*
+ * Copy up to `max` buffered records from all threads,
+ * ordered by time. Safe while other threads trace.
+ */
+
+size_t
+pi_trace_read(pi_trace_record_t *records, size_t max) {
+  pi__trace_ring_t *r;
+  size_t n = 0;
+
+  for (r = rings; r != NULL && n < max; r = r->next) {
+    n += pi__trace_copy(r, records + n, max - n);
+  }
+
+  qsort(records, n, sizeof(pi_trace_record_t), pi__trace_cmp);
+  return n;
+}
+
+/*
+ * Write a header and all buffered records to `fd`.
+ * Decode with `trace-decode`.
+ */
+
+int
+pi_trace_dump(int fd) {
+  pi_trace_header_t header;
+  pi__trace_ring_t *r;
+  size_t max = 0;
+
+  for (r = rings; r != NULL; r = r->next) max += RING_SIZE;
+
+  pi_trace_record_t *records = malloc(sizeof(pi_trace_record_t) * (max ? max : 1));
+  if (records == NULL) return -1;
+
+  size_t n = pi_trace_read(records, max);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PI_TRACE_MAGIC, sizeof(PI_TRACE_MAGIC));
+  header.version = PI_TRACE_VERSION;
+  header.record_size = sizeof(pi_trace_record_t);
+
+  int res = 0;
+  if (write(fd, &header, sizeof(header)) != sizeof(header)) res = -1;
+  else if (n && write(fd, records, n * sizeof(pi_trace_record_t))
+      != (ssize_t)(n * sizeof(pi_trace_record_t))) res = -1;
+
+  free(records);
+  debug("%lu records", (unsigned long)n);
+  return res;
+}
+
+/*
+ * Discard buffered records.
+ */
+
+void
+pi_trace_clear(void) {
+  pi__trace_ring_t *r;
+  for (r = rings; r != NULL; r = r->next) {
+    r->tail = r->head;
+  }
+  __sync_synchronize();
+}
+
+const char*
+pi_trace_op_name(uint16_t op) {
+  return op < PI_TRACE_OP_MAX ? op_names[op] : "unknown";
+}
+
+/*
+ * `PI_TRACE=<path>` in the environment enables tracing
+ * at load and dumps to `path` at exit.
+ */
+
+static const char *dump_path = NULL;
+
+static void
+pi__trace_atexit(void) {
+  int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return;
+  pi_trace_dump(fd);
+  close(fd);
+}
+
+__attribute__((constructor)) static void
+pi__trace_init(void) {
+  const char *path = getenv("PI_TRACE");
+  if (path == NULL || *path == '\0') return;
+  dump_path = path;
+  atexit(pi__trace_atexit);
+  pi_trace_enable(1);
+}
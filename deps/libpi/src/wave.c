@@ -0,0 +1,407 @@
+/*
+ * libpi - DMA waveforms
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "wave", ##args)
+
+/*
+ * DMA controller memory space. Channels 0-14 are 0x100
+ * apart; channel 15 lives elsewhere and is not used.
+ */
+
+#define DMA_OFFSET          0x007000
+#define DMA_DEVICE          "/dev/mem"
+#define DMA_CHANNELS        15
+#define DMA_CHANNEL_WORDS   (0x100 / 4)
+
+#define DMA_CS              0
+#define DMA_CONBLK_AD       1
+#define DMA_DEBUG           8
+
+#define DMA_CS_ACTIVE       (1 << 0)
+#define DMA_CS_END          (1 << 1)
+#define DMA_CS_INT          (1 << 2)
+#define DMA_CS_PRIORITY(p)  ((p) << 16)
+#define DMA_CS_PANIC(p)     ((p) << 20)
+#define DMA_CS_WAIT_WRITES  (1 << 28)
+#define DMA_CS_RESET        (1 << 31)
+
+#define DMA_DEBUG_CLEAR     7
+
+/*
+ * VideoCore mailbox, used to allocate physically
+ * contiguous memory the DMA engine can read.
+ */
+
+#define MBOX_DEVICE         "/dev/vcio"
+#define MBOX_PROPERTY       _IOWR(100, 0, char*)
+
+#define MBOX_TAG_ALLOC      0x3000c
+#define MBOX_TAG_LOCK       0x3000d
+#define MBOX_TAG_UNLOCK     0x3000e
+#define MBOX_TAG_RELEASE    0x3000f
+
+#define MBOX_MEM_DIRECT     0x04  /* uncached alias, 0xC0000000 */
+#define MBOX_MEM_L1_NONALLOC 0x0c /* L2 coherent alias, 0x40000000 */
+
+#define BUS_TO_PHYS(addr)   ((addr) & ~0xC0000000)
+
+/*
+ * Bus address given to simulated waveform memory. Never
+ * dereferenced by hardware; the interpreter translates it.
+ */
+
+#define SIM_BUS             0x40000000
+
+/*
+ * Control blocks per step at most: set, clear, delay.
+ */
+
+#define STEP_CBS            3
+
+/*
+ * Issue one property tag with up to three arguments and
+ * return the first response word, or 0 on failure.
+ */
+
+static uint32_t
+mbox_property(int fd, uint32_t tag, int nargs, uint32_t a0, uint32_t a1, uint32_t a2) {
+  uint32_t buf[16] __attribute__((aligned(16)));
+  uint32_t args[3] = { a0, a1, a2 };
+  int i = 0, j;
+
+  buf[i++] = 0;
+  buf[i++] = 0;
+  buf[i++] = tag;
+  buf[i++] = nargs * 4;
+  buf[i++] = nargs * 4;
+  for (j = 0; j < nargs; j++) buf[i++] = args[j];
+  buf[i++] = 0;
+  buf[0] = i * 4;
+
+  if (ioctl(fd, MBOX_PROPERTY, buf) < 0) {
+    debug("error: tag 0x%x failed", tag);
+    return 0;
+  }
+
+  return buf[5];
+}
+
+/*
+ * Release mailbox memory: unmap, unlock and free.
+ */
+
+static void
+mbox_free(pi_wave_t *wave) {
+  int fd = open(MBOX_DEVICE, 0);
+  if (wave->mem != NULL) munmap(wave->mem, wave->size);
+  if (fd < 0) return;
+  mbox_property(fd, MBOX_TAG_UNLOCK, 1, wave->mbox_handle, 0, 0);
+  mbox_property(fd, MBOX_TAG_RELEASE, 1, wave->mbox_handle, 0, 0);
+  close(fd);
+}
+
+/*
+ * Allocate `size` bytes (a page multiple) of DMA-able
+ * memory and map it. Simulated closures get heap memory
+ * at a fake bus address.
+ */
+
+static int
+wave_alloc(pi_wave_t *wave, size_t size) {
+  wave->size = size;
+
+  if (wave->closure->simulated) {
+    if (posix_memalign(&wave->mem, PAGE_SIZE, size) != 0) {
+      wave->mem = NULL;
+      return -1;
+    }
+    wave->bus = SIM_BUS;
+    return 0;
+  }
+
+  int fd = open(MBOX_DEVICE, 0);
+  if (fd < 0) {
+    debug("error: cannot open %s", MBOX_DEVICE);
+    return -1;
+  }
+
+  uint32_t flags = pi_board()->soc == PI_SOC_BCM2835
+    ? MBOX_MEM_L1_NONALLOC
+    : MBOX_MEM_DIRECT;
+
+  wave->mbox_handle = mbox_property(fd, MBOX_TAG_ALLOC, 3, size, PAGE_SIZE, flags);
+  if (wave->mbox_handle == 0) {
+    close(fd);
+    return -1;
+  }
+
+  wave->bus = mbox_property(fd, MBOX_TAG_LOCK, 1, wave->mbox_handle, 0, 0);
+  close(fd);
+  if (wave->bus == 0) {
+    mbox_free(wave);
+    return -1;
+  }
+
+  int mem = open(DMA_DEVICE, O_RDWR | O_SYNC);
+  if (mem < 0) {
+    debug("error: cannot open %s", DMA_DEVICE);
+    mbox_free(wave);
+    return -1;
+  }
+
+  wave->mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED
+    , mem, BUS_TO_PHYS(wave->bus));
+  close(mem);
+
+  if (wave->mem == MAP_FAILED) {
+    debug("error: cannot map 0x%x", wave->bus);
+    wave->mem = NULL;
+    mbox_free(wave);
+    return -1;
+  }
+
+  return 0;
+}
+
+static uint32_t
+wave_bus(pi_wave_t *wave, const void *addr) {
+  return wave->bus + (uint32_t) ((const char*) addr - (const char*) wave->mem);
+}
+
+/*
+ * Compile `steps` into a control block chain. `tick_ns`
+ * is the length of one delay tick; a looping chain jumps
+ * back to its first block instead of ending. Returns NULL
+ * with errno set on failure.
+ */
+
+pi_wave_t*
+pi_wave_new(pi_closure_t *closure, const pi_wave_step_t *steps, size_t len, uint32_t tick_ns, int loop) {
+  size_t ncbs = 0, i;
+
+  if (closure->gpio_map == NULL || tick_ns == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  for (i = 0; i < len; i++) {
+    ncbs += (steps[i].set != 0) + (steps[i].clr != 0) + (steps[i].delay != 0);
+  }
+
+  if (ncbs == 0) {
+    debug("error: empty waveform");
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pi_wave_t *wave = calloc(1, sizeof(pi_wave_t));
+  if (wave == NULL) return NULL;
+
+  // control blocks, a set and clear word per step, one pad word
+  size_t size = ncbs * sizeof(pi_dma_cb_t) + (len * 2 + 1) * sizeof(uint32_t);
+  size = (size + PAGE_SIZE - 1) & ~(size_t) (PAGE_SIZE - 1);
+
+  wave->closure = closure;
+  wave->tick_ns = tick_ns;
+  wave->loop = loop;
+  wave->channel = -1;
+
+  if (wave_alloc(wave, size) != 0) {
+    debug("error: cannot allocate %zu bytes", size);
+    free(wave);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  memset(wave->mem, 0, size);
+  wave->cbs = (pi_dma_cb_t*) wave->mem;
+  wave->ncbs = ncbs;
+
+  uint32_t *data = (uint32_t*) (wave->cbs + ncbs);
+  uint32_t *pad = data + len * 2;
+  pi_dma_cb_t *cb = wave->cbs;
+
+  for (i = 0; i < len; i++) {
+    data[i * 2] = steps[i].set;
+    data[i * 2 + 1] = steps[i].clr;
+
+    if (steps[i].set) {
+      cb->ti = PI_DMA_TI_NO_WIDE_BURSTS | PI_DMA_TI_WAIT_RESP;
+      cb->source_ad = wave_bus(wave, &data[i * 2]);
+      cb->dest_ad = PI_BUS_GPSET0;
+      cb->txfr_len = sizeof(uint32_t);
+      cb++;
+    }
+
+    if (steps[i].clr) {
+      cb->ti = PI_DMA_TI_NO_WIDE_BURSTS | PI_DMA_TI_WAIT_RESP;
+      cb->source_ad = wave_bus(wave, &data[i * 2 + 1]);
+      cb->dest_ad = PI_BUS_GPCLR0;
+      cb->txfr_len = sizeof(uint32_t);
+      cb++;
+    }
+
+    // one fifo word per tick; the write stalls until the
+    // PWM raises DREQ
+    if (steps[i].delay) {
+      cb->ti = PI_DMA_TI_NO_WIDE_BURSTS | PI_DMA_TI_WAIT_RESP
+        | PI_DMA_TI_DEST_DREQ | PI_DMA_TI_PERMAP(PI_DMA_PERMAP_PWM);
+      cb->source_ad = wave_bus(wave, pad);
+      cb->dest_ad = PI_BUS_PWM_FIF1;
+      cb->txfr_len = steps[i].delay * sizeof(uint32_t);
+      cb++;
+    }
+  }
+
+  for (i = 0; i < ncbs; i++) {
+    wave->cbs[i].nextconbk = i + 1 < ncbs
+      ? wave_bus(wave, &wave->cbs[i + 1])
+      : loop ? wave->bus : 0;
+  }
+
+  debug("%zu steps, %zu control blocks at 0x%x", len, ncbs, wave->bus);
+  return wave;
+}
+
+/*
+ * Compiled chain, for inspection.
+ */
+
+const pi_dma_cb_t*
+pi_wave_control_blocks(pi_wave_t *wave, size_t *count) {
+  if (count != NULL) *count = wave->ncbs;
+  return wave->cbs;
+}
+
+static volatile uint32_t*
+wave_channel(pi_wave_t *wave) {
+  return wave->dma_map + wave->channel * DMA_CHANNEL_WORDS;
+}
+
+/*
+ * Run the chain on DMA `channel`. The closure must have
+ * pwm set up; PWM channel 0 becomes the pacing clock and
+ * cannot drive a pin meanwhile. Pick a channel the
+ * firmware does not use.
+ */
+
+int
+pi_wave_start(pi_wave_t *wave, unsigned int channel) {
+  pi_closure_t *closure = wave->closure;
+
+  if (closure->simulated) {
+    debug("error: simulated closure, use pi_wave_interpret");
+    return -1;
+  }
+
+  if (channel >= DMA_CHANNELS || wave->channel >= 0) {
+    debug("error: channel %u unavailable", channel);
+    return -1;
+  }
+
+  double clock = pi_pwm_clock_hz(closure);
+  if (clock == 0) {
+    if (pi_pwm_set_clock(closure, 2, 0) != 0) return -1;
+    clock = pi_pwm_clock_hz(closure);
+  }
+
+  uint32_t range = (uint32_t) (wave->tick_ns * clock / 1e9 + 0.5);
+  if (range == 0) {
+    debug("error: %u ns tick below pwm clock resolution", wave->tick_ns);
+    return -1;
+  }
+
+  // map first, so a failure leaves the pwm untouched
+  if (wave->dma_map == NULL) {
+    wave->dma_map = pi__peripheral_map(DMA_DEVICE
+      , (off_t) pi_board()->peripheral_base + DMA_OFFSET, BLOCK_SIZE);
+    if (wave->dma_map == NULL) {
+      debug("error: cannot map dma registers");
+      return -1;
+    }
+  }
+
+  if (pi_pwm_set_mode(closure, 0, PI_PWM_MODE_SERIALIZER, 1) != 0) return -1;
+  pi_pwm_set_range(closure, 0, range);
+  pi_pwm_set_dma(closure, 1);
+  pi_pwm_enable(closure, 0, 1);
+
+  struct timespec wait = { 0, 10000 };
+  wave->channel = channel;
+  volatile uint32_t *dma = wave_channel(wave);
+
+  pi__trace(PI_TRACE_WAVE_START, channel, wave->ncbs, 0);
+  *(dma + DMA_CS) = DMA_CS_RESET;
+  nanosleep(&wait, NULL);
+  *(dma + DMA_CS) = DMA_CS_INT | DMA_CS_END;
+  *(dma + DMA_CONBLK_AD) = wave->bus;
+  *(dma + DMA_DEBUG) = DMA_DEBUG_CLEAR;
+  *(dma + DMA_CS) = DMA_CS_WAIT_WRITES | DMA_CS_PANIC(8)
+    | DMA_CS_PRIORITY(8) | DMA_CS_ACTIVE;
+
+  debug("channel %u", channel);
+  return 0;
+}
+
+/*
+ * Non-zero while the engine is still walking the chain.
+ * Looping chains stay busy until stopped.
+ */
+
+int
+pi_wave_busy(pi_wave_t *wave) {
+  if (wave->channel < 0) return 0;
+  return (*(wave_channel(wave) + DMA_CS) & DMA_CS_ACTIVE) != 0;
+}
+
+/*
+ * Abort the chain and stop the pacing clock. Pins keep
+ * the last level written.
+ */
+
+int
+pi_wave_stop(pi_wave_t *wave) {
+  if (wave->channel < 0) return 0;
+
+  pi__trace(PI_TRACE_WAVE_STOP, wave->channel, 0, 0);
+  *(wave_channel(wave) + DMA_CS) = DMA_CS_RESET;
+  pi_pwm_set_dma(wave->closure, 0);
+  pi_pwm_enable(wave->closure, 0, 0);
+  wave->channel = -1;
+  return 0;
+}
+
+void
+pi_wave_delete(pi_wave_t *wave) {
+  pi_wave_stop(wave);
+  if (wave->dma_map != NULL) pi__peripheral_unmap(wave->dma_map);
+
+  if (wave->mbox_handle != 0) {
+    mbox_free(wave);
+  } else {
+    free(wave->mem);
+  }
+
+  free(wave);
+}
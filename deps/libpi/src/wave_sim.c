@@ -0,0 +1,100 @@
+/*
+ * libpi - Software DMA interpreter
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+#include "common.h"
+
+#include <errno.h>
+#include <stdint.h>
+
+/*
+ * Debug macro
+ */
+
+#define debug(fmt, args...) \
+  pi__debug_print(fmt, "wave_sim", ##args)
+
+/*
+ * Translate a bus address inside the waveform block.
+ */
+
+static const uint32_t*
+wave_virt(pi_wave_t *wave, uint32_t addr, size_t len) {
+  if (addr < wave->bus || addr - wave->bus + len > wave->size) return NULL;
+  return (const uint32_t*) ((const char*) wave->mem + (addr - wave->bus));
+}
+
+/*
+ * Walk a compiled chain the way the DMA engine would,
+ * on a virtual clock: every fifo word written under PWM
+ * DREQ costs one tick, register writes are instant. Each
+ * SET/CLR write is recorded in `events`, and applied to
+ * the registers when the closure is simulated.
+ *
+ * Stops at the end of the chain, after `max` events, or
+ * once `duration_ns` has passed (required for looping
+ * chains). Returns the number of events, or -1 with errno
+ * EINVAL for a block the engine could not execute.
+ */
+
+int
+pi_wave_interpret(pi_wave_t *wave, pi_wave_event_t *events, size_t max, uint64_t duration_ns) {
+  volatile uint32_t *gpio_map = wave->closure->simulated ? wave->closure->gpio_map : NULL;
+  uint32_t addr = wave->bus;
+  uint64_t now = 0;
+  size_t n = 0;
+
+  if (wave->loop && duration_ns == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  while (addr != 0 && n < max && (duration_ns == 0 || now < duration_ns)) {
+    const pi_dma_cb_t *cb = (const pi_dma_cb_t*) wave_virt(wave, addr, sizeof(pi_dma_cb_t));
+    if (cb == NULL || (addr & 31) || (cb->ti & PI_DMA_TI_TDMODE)) {
+      debug("error: bad control block at 0x%x", addr);
+      errno = EINVAL;
+      return -1;
+    }
+
+    uint32_t words = cb->txfr_len / sizeof(uint32_t);
+    size_t span = cb->ti & PI_DMA_TI_SRC_INC ? cb->txfr_len : sizeof(uint32_t);
+    const uint32_t *src = wave_virt(wave, cb->source_ad, span);
+    uint32_t i;
+
+    if (src == NULL) {
+      debug("error: bad source 0x%x", cb->source_ad);
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (cb->dest_ad == PI_BUS_PWM_FIF1) {
+      int paced = (cb->ti & PI_DMA_TI_DEST_DREQ)
+        && (cb->ti & PI_DMA_TI_PERMAP_MASK) == PI_DMA_TI_PERMAP(PI_DMA_PERMAP_PWM);
+      if (paced) now += (uint64_t) words * wave->tick_ns;
+    } else if (cb->dest_ad == PI_BUS_GPSET0 || cb->dest_ad == PI_BUS_GPCLR0) {
+      int set = cb->dest_ad == PI_BUS_GPSET0;
+      for (i = 0; i < words && n < max; i++) {
+        uint32_t mask = src[cb->ti & PI_DMA_TI_SRC_INC ? i : 0];
+        events[n].time = now;
+        events[n].set = set ? mask : 0;
+        events[n].clr = set ? 0 : mask;
+        n++;
+        if (gpio_map != NULL) {
+          *(gpio_map + (set ? SET_OFFSET : CLR_OFFSET)) = mask;
+        }
+      }
+    } else {
+      debug("error: unsupported destination 0x%x", cb->dest_ad);
+      errno = EINVAL;
+      return -1;
+    }
+
+    addr = cb->nextconbk;
+  }
+
+  return (int) n;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# Run a command (default: the release test binary) with
+# PI_TEST_GPIOCHIP and PI_TEST_GPIOSIM pointing at a
+# temporary gpio-sim chip. Needs root and CONFIG_GPIO_SIM.
+#
+
+set -e
+
+CFG=/sys/kernel/config/gpio-sim/libpi-test
+
+cleanup() {
+  [ -d "$CFG" ] || return 0
+  echo 0 > "$CFG/live" 2>/dev/null || true
+  rmdir "$CFG/bank0" "$CFG" 2>/dev/null || true
+}
+
+trap cleanup EXIT
+
+modprobe gpio-sim
+mountpoint -q /sys/kernel/config || mount -t configfs none /sys/kernel/config
+
+mkdir -p "$CFG/bank0"
+echo 8 > "$CFG/bank0/num_lines"
+echo 1 > "$CFG/live"
+
+CHIP=$(cat "$CFG/bank0/chip_name")
+DEV=$(cat "$CFG/dev_name")
+
+export PI_TEST_GPIOCHIP="/dev/$CHIP"
+export PI_TEST_GPIOSIM="/sys/devices/platform/$DEV/$CHIP"
+
+if [ $# -eq 0 ]; then
+  set -- ./out/release/test
+fi
+
+"$@"
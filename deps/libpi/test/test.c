@@ -1,8 +1,19 @@
 
 #include "pi.h"
+#include "common.h"
+#include "pi_fast.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 #define PI_REVISION 2
 
@@ -15,6 +26,8 @@ void
 test_pi_revision(void) {
   int revision = pi_revision();
   assert(revision == PI_REVISION);
+  assert(pi_board() == pi_board());
+  assert(pi_board()->soc_name != NULL);
 }
 
 void
@@ -34,12 +47,978 @@ test_pi_closure_custom(void) {
   pi_closure_delete(c_closure);
 }
 
+void
+test_pi_trace(void) {
+  pi_trace_record_t records[16];
+  pi_closure_t *closure = pi_default_closure();
+  size_t i, n;
+  int found = 0;
+
+  assert(pi_gpio_setup_sim(closure) == 0);
+  pi_trace_enable(1);
+  pi_gpio_handle_t *handle = pi_gpio_claim_output(closure, 4, PI_GPIO_HIGH);
+  pi_gpio_write(handle, PI_GPIO_LOW);
+  pi_gpio_release(handle);
+  pi_trace_enable(0);
+
+  n = pi_trace_read(records, 16);
+  assert(n >= 3);
+  for (i = 0; i < n; i++) {
+    if (i > 0) assert(records[i].time >= records[i - 1].time);
+    if (records[i].op == PI_TRACE_GPIO_WRITE && records[i].pin == 4) found++;
+  }
+  assert(found == 2);
+
+  pi_trace_clear();
+  assert(pi_trace_read(records, 16) == 0);
+
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+static void*
+claim_neighbour(void *arg) {
+  pi_gpio_pin_t pin = *(pi_gpio_pin_t*)arg;
+  pi_closure_t *closure = pi_default_closure();
+  int i;
+
+  for (i = 0; i < 2000; i++) {
+    pi_gpio_mode_t mode = i & 1 ? PI_GPIO_MODE_OUTPUT : PI_GPIO_MODE_INPUT;
+    pi_gpio_handle_t *handle = pi_gpio_claim_with_args(closure, pin, mode, PI_GPIO_PULL_NONE);
+    assert(handle != NULL);
+    assert(pi_gpio_get_mode(handle) == mode);
+    pi_gpio_release(handle);
+  }
+
+  return NULL;
+}
+
+void
+test_pi_gpio_concurrent_claim(void) {
+  pi_gpio_pin_t pins[] = { 20, 21, 22, 23 };
+  pthread_t threads[4];
+  int i;
+
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+
+  for (i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, claim_neighbour, &pins[i]);
+  }
+
+  for (i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  assert(closure->gpio_map[2] == 0);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_gpio_write_sequence(void) {
+  uint8_t values[] = { 1, 0, 1, 1 };
+  struct timespec start, end;
+  uint64_t elapsed;
+
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  pi_gpio_handle_t *handle = pi_gpio_claim_output(closure, 36, PI_GPIO_LOW);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  assert(pi_gpio_write_sequence(handle, values, 4, 1000000) == 0);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  elapsed = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+  assert(elapsed >= 3000000);
+  assert(closure->gpio_map[7 + 1] == (1 << 4));
+  assert(closure->gpio_map[10 + 1] == (1 << 4));
+
+  pi_gpio_release(handle);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_gpio_poll_events(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  pi_gpio_handle_t *edge = pi_gpio_claim_input(closure, 5, PI_GPIO_PULL_NONE);
+  pi_gpio_handle_t *level = pi_gpio_claim_input(closure, 6, PI_GPIO_PULL_NONE);
+
+  pi_gpio_set_edge_detect(edge, PI_GPIO_DETECT_RISING);
+  pi_gpio_set_edge_detect(level, PI_GPIO_DETECT_HIGH);
+  assert(pi_gpio_get_edge_detect(edge) == PI_GPIO_DETECT_RISING);
+  assert(pi_gpio_poll_events(closure) == 0);
+
+  // pulses between polls stay latched until read
+  pi_gpio_sim_set_level(closure, 5, PI_GPIO_HIGH);
+  pi_gpio_sim_set_level(closure, 5, PI_GPIO_LOW);
+  assert(pi_gpio_poll_events(closure) == 1 << 5);
+  assert(pi_gpio_poll_events(closure) == 0);
+
+  // level detect latches again while the level holds
+  pi_gpio_sim_set_level(closure, 6, PI_GPIO_HIGH);
+  assert(pi_gpio_poll_events(closure) == 1 << 6);
+  assert(pi_gpio_poll_events(closure) == 1 << 6);
+  pi_gpio_sim_set_level(closure, 6, PI_GPIO_LOW);
+  assert(pi_gpio_poll_events(closure) == 1 << 6);
+  assert(pi_gpio_poll_events(closure) == 0);
+
+  pi_gpio_release(edge);
+  pi_gpio_release(level);
+  assert(closure->gpio_map[19] == 0 && closure->gpio_map[25] == 0);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_fast(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  volatile uint32_t *map = pi_fast_map(closure);
+
+  // same registers and masks as the handle api
+  pi_fast_write(map, 17, 1);
+  assert(map[SET_OFFSET] == 1 << 17);
+  pi_fast_clr(map, 40);
+  assert(map[CLR_OFFSET + 1] == 1 << 8);
+  pi_fast_set_mask(map, 0x30);
+  assert(map[SET_OFFSET] == 0x30);
+
+  pi_gpio_sim_set_level(closure, 4, PI_GPIO_HIGH);
+  assert(pi_fast_read(map, 4) == 1 && pi_fast_read(map, 5) == 0);
+  assert(pi_fast_read_mask(map) == 1 << 4);
+
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_route(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  volatile uint32_t *set = closure->gpio_map + SET_OFFSET;
+  volatile uint32_t *clr = closure->gpio_map + CLR_OFFSET;
+  pi_route_stats_t stats;
+  struct timespec wait = { 0, 5000000 };
+
+  pi_route_rule_t rules[] = {
+      { PI_ROUTE_INVERT, 1 << 4, 0, 20, PI_GPIO_EDGE_NONE }
+    , { PI_ROUTE_AND, 1 << 4 | 1 << 5, 0, 21, PI_GPIO_EDGE_NONE }
+    , { PI_ROUTE_LATCH, 1 << 6, 1 << 7, 22, PI_GPIO_EDGE_RISING }
+    , { PI_ROUTE_TOGGLE, 1 << 6, 0, 23, PI_GPIO_EDGE_FALLING }
+  };
+
+  // one output per rule, single input for invert
+  pi_route_rule_t dup[] = { rules[0], rules[0] };
+  assert(pi_route_new(closure, dup, 2) == NULL && errno == EINVAL);
+  rules[0].inputs |= 1 << 5;
+  assert(pi_route_new(closure, rules, 4) == NULL && errno == EINVAL);
+  rules[0].inputs = 1 << 4;
+
+  // no output may feed a rule
+  rules[1].inputs = 1 << 4 | 1 << 20;
+  assert(pi_route_new(closure, rules, 4) == NULL && errno == EINVAL);
+  rules[1].inputs = 1 << 4 | 1 << 5;
+  rules[2].reset = 1 << 23;
+  assert(pi_route_new(closure, rules, 4) == NULL && errno == EINVAL);
+  rules[2].reset = 1 << 7;
+
+  pi_route_t *route = pi_route_new(closure, rules, 4);
+  assert(route != NULL);
+
+  // first step drives every output
+  assert(pi_route_step(route) == (0xf << 20));
+  assert(*set == 1 << 20 && *clr == (0xe << 20));
+  assert(pi_route_step(route) == 0);
+
+  pi_gpio_sim_set_level(closure, 4, PI_GPIO_HIGH);
+  pi_gpio_sim_set_level(closure, 5, PI_GPIO_HIGH);
+  assert(pi_route_step(route) == (1 << 20 | 1 << 21));
+  assert(*set == 1 << 21 && *clr == 1 << 20);
+
+  // rising edge latches, falling edge toggles
+  pi_gpio_sim_set_level(closure, 6, PI_GPIO_HIGH);
+  assert(pi_route_step(route) == 1 << 22 && *set == 1 << 22);
+  pi_gpio_sim_set_level(closure, 6, PI_GPIO_LOW);
+  assert(pi_route_step(route) == 1 << 23 && *set == 1 << 23);
+  pi_gpio_sim_set_level(closure, 7, PI_GPIO_HIGH);
+  assert(pi_route_step(route) == 1 << 22 && *clr == 1 << 22);
+
+  // the thread reacts without being stepped
+  assert(pi_route_start(route, 0) == 0);
+  pi_gpio_sim_set_level(closure, 4, PI_GPIO_LOW);
+  while (*set != 1 << 20) nanosleep(&wait, NULL);
+  pi_route_stop(route);
+  pi_route_stats(route, &stats);
+  assert(stats.changes >= 1 && stats.scans >= stats.changes);
+
+  pi_route_delete(route);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+static void*
+program_stop(void *arg) {
+  struct timespec wait = { 0, 20000000 };
+  nanosleep(&wait, NULL);
+  pi_program_stop(arg);
+  return NULL;
+}
+
+static void*
+program_pulse(void *arg) {
+  struct timespec wait = { 0, 2000000 };
+  nanosleep(&wait, NULL);
+  pi_gpio_sim_set_level(arg, 5, PI_GPIO_HIGH);
+  return NULL;
+}
+
+void
+test_pi_program(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  const uint64_t *records;
+  size_t count;
+  pthread_t pulse;
+
+  pi_prog_insn_t code[] = {
+      { PI_PROG_SET, 0, 0, 1 << 17 }
+    , { PI_PROG_LOAD, 1, 0, 3 }
+    , { PI_PROG_RECORD, 1, PI_PROG_SOURCE_REG, 0 }              // 2
+    , { PI_PROG_LOOP, 1, 0, 2 }
+    , { PI_PROG_WAIT_LEVEL, 5, 1, 100 }
+    , { PI_PROG_JUMP_TIMEOUT, 0, 0, 7 }
+    , { PI_PROG_END, 0, 0, 0 }
+    , { PI_PROG_MARK, 0, 0, 0 }                                 // 7
+    , { PI_PROG_WAIT_EDGE, 5, PI_GPIO_EDGE_RISING, 1000000 }
+    , { PI_PROG_RECORD, 0, PI_PROG_SOURCE_EVENT, 0 }
+    , { PI_PROG_CLR, 0, 0, 1 << 17 }
+  };
+
+  // targets and operands are checked up front
+  pi_prog_insn_t bad = { PI_PROG_JUMP, 0, 0, 2 };
+  assert(pi_program_new(closure, &bad, 1, 0) == NULL && errno == EINVAL);
+
+  pi_program_t *program = pi_program_new(closure, code, 11, 8);
+  assert(program != NULL);
+
+  // loop records 3, 2, 1; the level wait times out and
+  // the edge wait sees the pulse from another thread
+  pthread_create(&pulse, NULL, program_pulse, closure);
+  assert(pi_program_run(program) == 0);
+  pthread_join(pulse, NULL);
+
+  records = pi_program_records(program, &count);
+  assert(count == 4);
+  assert(records[0] == 3 && records[1] == 2 && records[2] == 1);
+  assert(records[3] > 0 && records[3] < 1000000000ULL);
+  assert(closure->gpio_map[SET_OFFSET] == 1 << 17);
+  assert(closure->gpio_map[CLR_OFFSET] == 1 << 17);
+
+  // the level now holds, so the first wait ends the run
+  assert(pi_program_run(program) == 0);
+  assert(pi_program_records(program, &count) && count == 3);
+
+  // stores are held to the pins still allowed
+  assert(pi_program_set_outputs(program, 2, 0) == -1 && errno == EINVAL);
+  assert(pi_program_set_outputs(program, 0, ~(1u << 17)) == 0);
+  closure->gpio_map[SET_OFFSET] = 0;
+  assert(pi_program_run(program) == 0);
+  assert(closure->gpio_map[SET_OFFSET] == 0);
+  assert(pi_program_set_outputs(program, 0, ~0u) == 0);
+
+  pi_program_stop(program);
+  assert(pi_program_run(program) == -1 && errno == ECANCELED);
+
+  pi_program_delete(program);
+
+  // a loop on a zero register falls through, and a stop
+  // ends a long delay early
+  pi_prog_insn_t idle[] = {
+      { PI_PROG_RECORD, 0, PI_PROG_SOURCE_REG, 0 }              // 0
+    , { PI_PROG_LOOP, 0, 0, 0 }
+    , { PI_PROG_DELAY, 0, 0, 4000000000U }
+  };
+
+  program = pi_program_new(closure, idle, 3, 2);
+  assert(program != NULL);
+  uint64_t start = pi_time_ns();
+  pthread_create(&pulse, NULL, program_stop, program);
+  assert(pi_program_run(program) == -1 && errno == ECANCELED);
+  pthread_join(pulse, NULL);
+  assert(pi_time_ns() - start < 1000000000ULL);
+  assert(pi_program_records(program, &count) && count == 1);
+
+  pi_program_delete(program);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_sched(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  volatile uint32_t *set = closure->gpio_map + SET_OFFSET;
+  volatile uint32_t *clr = closure->gpio_map + CLR_OFFSET;
+  struct timespec wait = { 0, 1000000 };
+  pi_sched_stats_t stats;
+  uint64_t ids[5];
+
+  pi_sched_t *sched = pi_sched_new(closure, 4, 1000);
+  assert(sched != NULL);
+  uint64_t t = (pi_sched_now() + 10000000ULL) / 1000 * 1000;
+
+  // same tick merges, the later entry wins pin 18
+  pi_sched_entry_t entries[] = {
+      { t, 1 << 17, 0, 0 }
+    , { t, 1 << 18, 0, 0 }
+    , { t, 0, 1 << 18, 0 }
+    , { t + 100000000000ULL, 1 << 19, 0, 0 }
+    , { t, 1 << 20, 0, 0 }
+  };
+
+  pi_sched_entry_t bad = { t, 1 << 4, 1 << 4, 0 };
+  assert(pi_sched_add(sched, &bad, 1, NULL) == 0 && errno == EINVAL);
+  assert(pi_sched_add(sched, entries, 5, ids) == 4 && errno == ENOSPC);
+
+  assert(pi_sched_cancel(sched, ids[3]) == 0);
+  assert(pi_sched_cancel(sched, ids[3]) == -1);
+
+  assert(pi_sched_step(sched, t - 1000) == 0);
+  assert(pi_sched_step(sched, t) == 3);
+  assert(*set == 1 << 17 && *clr == 1 << 18);
+  pi_sched_stats(sched, &stats);
+  assert(stats.fired == 3 && stats.stores == 2 && stats.cancelled == 1);
+  assert(stats.pending == 0);
+  assert(pi_sched_cancel(sched, ids[0]) == -1);
+
+  // entries on each wheel level cascade down in order
+  assert(pi_sched_write(sched, t + 300000, 5, PI_GPIO_HIGH) != 0);
+  assert(pi_sched_write(sched, t + 20000000, 6, PI_GPIO_HIGH) != 0);
+  assert(pi_sched_write(sched, t + 2000000000ULL, 7, PI_GPIO_HIGH) != 0);
+  assert(pi_sched_step(sched, t + 299000) == 0);
+  assert(pi_sched_step(sched, t + 19999000) == 1 && *set == 1 << 5);
+  assert(pi_sched_step(sched, t + 1999999000ULL) == 1 && *set == 1 << 6);
+  assert(pi_sched_step(sched, t + 2000000000ULL) == 1 && *set == 1 << 7);
+
+  // stores are held to the pins still allowed
+  assert(pi_sched_set_outputs(sched, 2, 0) == -1 && errno == EINVAL);
+  assert(pi_sched_write(sched, t + 3000000000ULL, 8, PI_GPIO_HIGH) != 0);
+  assert(pi_sched_write(sched, t + 3000000000ULL, 9, PI_GPIO_LOW) != 0);
+  assert(pi_sched_set_outputs(sched, 0, ~(1u << 8)) == 0);
+  *set = 0;
+  assert(pi_sched_step(sched, t + 3000000000ULL) == 2);
+  assert(*set == 0 && *clr == 1 << 9);
+  assert(pi_sched_set_outputs(sched, 0, ~0u) == 0);
+
+  // the thread fires without being stepped
+  assert(pi_sched_start(sched) == 0);
+  assert(pi_sched_write(sched, pi_sched_now() + 2000000, 21, PI_GPIO_HIGH) != 0);
+  while (*set != 1 << 21) nanosleep(&wait, NULL);
+  pi_sched_stop(sched);
+  pi_sched_stats(sched, &stats);
+  assert(stats.fired == 9 && stats.queued == 10);
+
+  pi_sched_delete(sched);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_daemon(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  volatile uint32_t *set = closure->gpio_map + SET_OFFSET;
+  struct timespec wait = { 0, 1000000 };
+  pi_daemon_config_t config = { 2, 0, 0 };
+  pi_daemon_stats_t stats;
+  char name[32];
+  pid_t child;
+  int status;
+
+  snprintf(name, sizeof(name), "/libpi-test-%d", (int) getpid());
+  assert(pi_client_connect(name) == NULL && errno == ENOENT);
+
+  pi_daemon_t *daemon = pi_daemon_new(closure, name, &config);
+  assert(daemon != NULL);
+  assert(pi_daemon_new(closure, name, &config) == NULL && errno == EEXIST);
+  assert(pi_daemon_start(daemon) == 0);
+
+  pi_client_t *a = pi_client_connect(name);
+  pi_client_t *b = pi_client_connect(name);
+  assert(a != NULL && b != NULL);
+  assert(pi_client_connect(name) == NULL && errno == EBUSY);
+
+  // ownership is enforced across clients
+  assert(pi_client_claim(a, 17, PI_GPIO_MODE_OUTPUT, PI_GPIO_PULL_NONE, PI_GPIO_LOW) == 0);
+  assert(pi_client_claim(b, 17, PI_GPIO_MODE_INPUT, PI_GPIO_PULL_NONE, PI_GPIO_LOW) == -1);
+  assert(errno == EBUSY);
+  assert(pi_client_write(a, 17, PI_GPIO_HIGH) == 0);
+  assert(pi_client_flush(a, 0) == 0 && *set == 1 << 17);
+  assert(pi_client_write_mask(b, 0, 1 << 17, 0) == 0);
+  assert(pi_client_flush(b, 0) == -1 && errno == EPERM);
+  assert(pi_client_flush(b, 0) == 0);
+
+  // from the daemon's own tables, not the shared copies: a
+  // forged owner byte (header offset 48) gains nothing and a
+  // head far past the tail (slot 0 at 128, head at +64,
+  // tail at +128) resets the ring
+  int fd = shm_open(name, O_RDWR, 0);
+  volatile uint8_t *shm = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(fd >= 0 && shm != MAP_FAILED && shm[48 + 17] == 1);
+  close(fd);
+  shm[48 + 17] = 2;
+  assert(pi_client_write(b, 17, PI_GPIO_LOW) == 0);
+  assert(pi_client_flush(b, 0) == -1 && errno == EPERM);
+  assert(pi_client_errors(b, &status) == 3 && status == -EPERM);
+  volatile uint32_t *head = (volatile uint32_t*) (shm + 128 + 64);
+  *head += 100000;
+  while (head[16] != *head) nanosleep(&wait, NULL);
+  assert(pi_client_flush(a, 0) == -1 && errno == EOVERFLOW);
+  assert(pi_client_flush(a, 0) == 0);
+  munmap((void*) shm, 4096);
+
+  // levels arrive through the snapshot page
+  pi_gpio_sim_set_level(closure, 5, PI_GPIO_HIGH);
+  while (pi_client_read(b, 5) != PI_GPIO_HIGH) nanosleep(&wait, NULL);
+
+  // disconnecting frees the slot and the pins
+  pi_client_disconnect(a);
+  while (pi_client_claim(b, 17, PI_GPIO_MODE_INPUT, PI_GPIO_PULL_NONE, PI_GPIO_LOW) != 0) {
+    assert(errno == EBUSY);
+    nanosleep(&wait, NULL);
+  }
+  assert(pi_client_release(b, 17) == 0);
+
+  // so does exiting without disconnecting
+  child = fork();
+  if (child == 0) {
+    pi_client_t *c = pi_client_connect(name);
+    _exit(c == NULL || pi_client_claim(c, 18, PI_GPIO_MODE_OUTPUT
+      , PI_GPIO_PULL_NONE, PI_GPIO_LOW) != 0);
+  }
+  assert(waitpid(child, &status, 0) == child && WEXITSTATUS(status) == 0);
+  while (pi_client_claim(b, 18, PI_GPIO_MODE_INPUT, PI_GPIO_PULL_NONE, PI_GPIO_LOW) != 0) {
+    nanosleep(&wait, NULL);
+  }
+
+  pi_daemon_stats(daemon, &stats);
+  assert(stats.reaped == 1 && stats.rejected >= 3);
+
+  pi_client_disconnect(b);
+  pi_daemon_delete(daemon);
+  assert(pi_client_connect(name) == NULL && errno == ENOENT);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_journal(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  pi_journal_t *journal = pi_journal_new(8);
+  const pi_journal_record_t *records;
+  pi_journal_replay_stats_t stats;
+  uint64_t dropped;
+  size_t count;
+
+  pi_journal_attach(closure, journal);
+  pi_gpio_handle_t *out = pi_gpio_claim_output(closure, 17, PI_GPIO_HIGH);
+  pi_gpio_handle_t *in = pi_gpio_claim_input(closure, 4, PI_GPIO_PULL_UP);
+  pi_gpio_sim_set_level(closure, 4, PI_GPIO_HIGH);
+  assert(pi_gpio_read(in) == PI_GPIO_HIGH);
+  pi_gpio_write_mask(closure, 1 << 3, 1 << 17);
+  assert(pi_gpio_read_mask(closure) == 1 << 4);
+  pi_gpio_release(out);
+  pi_gpio_release(in);
+  pi_gpio_write_mask(closure, 1 << 5, 0);
+  pi_journal_detach(closure);
+  pi_gpio_write_mask(closure, 1 << 6, 0);
+
+  // claims journal as one op; the last op did not fit
+  records = pi_journal_records(journal, &count, &dropped);
+  assert(count == 8 && dropped == 1);
+  assert(PI_JOURNAL_OP(&records[0]) == PI_TRACE_GPIO_CLAIM && PI_JOURNAL_PIN(&records[0]) == 17);
+  assert(PI_JOURNAL_OP(&records[1]) == PI_TRACE_GPIO_WRITE && records[1].value == 1);
+  assert(PI_JOURNAL_OP(&records[2]) == PI_TRACE_GPIO_CLAIM && records[2].extra == PI_GPIO_PULL_UP);
+  assert(PI_JOURNAL_OP(&records[3]) == PI_TRACE_GPIO_READ && records[3].value == 1);
+  assert(PI_JOURNAL_OP(&records[5]) == PI_TRACE_GPIO_READ_MASK && records[5].value == 1 << 4);
+  assert(PI_JOURNAL_OP(&records[7]) == PI_TRACE_GPIO_RELEASE && PI_JOURNAL_PIN(&records[7]) == 4);
+  assert(PI_JOURNAL_TIME(&records[7]) >= PI_JOURNAL_TIME(&records[0]));
+
+  // dump and load round trip
+  FILE *file = tmpfile();
+  int fd = fileno(file);
+  assert(pi_journal_dump(journal, fd) == 0);
+  lseek(fd, 0, SEEK_SET);
+  pi_journal_t *loaded = pi_journal_load(fd);
+  assert(loaded != NULL);
+  assert(pi_journal_records(loaded, &count, &dropped) && count == 8 && dropped == 1);
+  assert(memcmp(pi_journal_records(loaded, &count, NULL), records, 8 * sizeof(*records)) == 0);
+  lseek(fd, 4, SEEK_SET);
+  assert(pi_journal_load(fd) == NULL && errno == EPROTO);
+  fclose(file);
+
+  // replay on fresh registers; recorded inputs are fed in
+  pi_closure_t *replay = pi_closure_new();
+  assert(pi_gpio_setup_sim(replay) == 0);
+  assert(pi_journal_replay(replay, loaded, 0, &stats) == 0);
+  assert(stats.records == 8 && stats.skipped == 0 && stats.mismatches == 0);
+  assert(replay->gpio_map[SET_OFFSET] == 1 << 3);
+  assert(replay->gpio_map[CLR_OFFSET] == 1 << 17);
+  assert(replay->gpio_map[PINLEVEL_OFFSET] == 1 << 4);
+
+  assert(pi_journal_replay(replay, loaded, PI_JOURNAL_REPLAY_TIMED, &stats) == 0);
+  assert(stats.elapsed_ns >= stats.recorded_ns);
+  assert(stats.max_late_ns >= stats.mean_late_ns);
+
+  pi_journal_delete(loaded);
+  pi_journal_delete(journal);
+  pi_closure_delete(replay);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_capture(void) {
+  pi_capture_config_t config = { 1000, 4096, 64 };
+  char path[] = "/tmp/pi-capture-XXXXXX";
+  uint32_t mask = (1 << 4) | (1 << 17);
+  uint64_t start = 1000000;
+  pi_sample_t expect[4000];
+  pi_capture_info_t info;
+  pi_sample_t sample;
+  uint32_t levels = 0;
+  size_t n = 0, i;
+  uint64_t t = start;
+
+  close(mkstemp(path));
+  pi_capture_t *capture = pi_capture_new(path, mask, 0, start, &config);
+  assert(capture != NULL);
+
+  // a 10us clock on pin 4 collapses into one repeat; data
+  // on pin 17 with uneven gaps spans several windows, each
+  // sample 400ns late
+  for (i = 0; i < 1000; i++) {
+    t += 10000;
+    levels ^= 1 << 4;
+    pi_sample_t s = { t + 400, levels | (1 << 9), 1 << 4 };
+    expect[n++] = s;
+    assert(pi_capture_append(capture, &s, 1) == 0);
+  }
+  for (i = 0; i < 3000; i++) {
+    t += 1000 * (i * 131 % 4000 + 1);
+    levels ^= i % 3 ? 1 << 17 : (1 << 17) | (1 << 4);
+    pi_sample_t s = { t + 400, levels, 0 };
+    pi_sample_t same = { t + 500, levels, 0 };
+    expect[n++] = s;
+    assert(pi_capture_append(capture, &s, 1) == 0);
+    assert(pi_capture_append(capture, &same, 1) == 0);
+  }
+
+  pi_capture_info(capture, &info);
+  assert(info.transitions == 4000);
+  assert(info.bytes > 2 * 4096 && info.bytes < 3000 * 4);
+  assert(pi_capture_close(capture) == 0);
+
+  pi_capture_reader_t *reader = pi_capture_open(path);
+  assert(reader != NULL);
+  pi_capture_reader_info(reader, &info);
+  assert(info.transitions == 4000 && info.index_count > 100);
+  assert(info.levels == 0 && info.end == t);
+
+  // times come back on the tick; unwatched pins are gone
+  for (i = 0; i < n; i++) {
+    assert(pi_capture_next(reader, &sample) == 1);
+    assert(sample.time == expect[i].time - 400);
+    assert(sample.levels == (expect[i].levels & mask));
+  }
+  assert(pi_capture_next(reader, &sample) == 0);
+
+  // seek into the clock run and into the indexed data
+  pi_capture_seek(reader, expect[500].time - 900);
+  assert(pi_capture_levels(reader) == (expect[499].levels & mask));
+  assert(pi_capture_next(reader, &sample) && sample.time == expect[500].time - 400);
+  pi_capture_seek(reader, expect[3000].time - 400);
+  assert(pi_capture_next(reader, &sample) && sample.levels == (expect[3000].levels & mask));
+  pi_capture_seek(reader, t + 1);
+  assert(pi_capture_next(reader, &sample) == 0);
+  pi_capture_reader_close(reader);
+
+  // the index is aligned for in-place reads; a zero tick is corrupt
+  uint64_t index_offset;
+  uint32_t tick = 0;
+  int fd = open(path, O_RDWR);
+  assert(pread(fd, &index_offset, 8, 64) == 8 && index_offset % 8 == 0);
+  assert(pwrite(fd, &tick, 4, 12) == 4);
+  close(fd);
+  assert(pi_capture_open(path) == NULL && errno == EPROTO);
+  unlink(path);
+
+  // sampling the simulated registers
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  struct timespec wait = { 0, 2000000 };
+  capture = pi_capture_new(path, 1 << 4, pi_gpio_read_mask(closure), pi_time_ns(), NULL);
+  assert(pi_capture_start(capture, closure, 10000) == 0);
+  for (i = 0; i < 6; i++) {
+    nanosleep(&wait, NULL);
+    pi_gpio_sim_set_level(closure, 4, i & 1 ? PI_GPIO_LOW : PI_GPIO_HIGH);
+  }
+  nanosleep(&wait, NULL);
+  pi_capture_info(capture, &info);
+  assert(pi_capture_close(capture) == 0);
+  reader = pi_capture_open(path);
+  pi_capture_reader_info(reader, &info);
+  assert(info.transitions == 6 && info.dropped == 0);
+  pi_capture_reader_close(reader);
+  unlink(path);
+
+  // not a capture
+  assert(pi_capture_open("/dev/null") == NULL && errno == EPROTO);
+
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+static void
+sampler_notify(void *data) {
+  __sync_fetch_and_add((int*) data, 1);
+}
+
+void
+test_pi_sampler(void) {
+  pi_sample_t samples[8];
+  struct timespec wait = { 0, 5000000 };
+  int notified = 0;
+  size_t n;
+
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  pi_sampler_t *sampler = pi_sampler_new(closure, 10000, 8, sampler_notify, &notified);
+  assert(sampler != NULL);
+  assert(pi_sampler_start(sampler, 1 << 5) == 0);
+
+  // unwatched pins do not produce records
+  pi_gpio_sim_set_level(closure, 6, PI_GPIO_HIGH);
+  nanosleep(&wait, NULL);
+  assert(pi_sampler_read(sampler, samples, 8) == 0);
+
+  pi_gpio_sim_set_level(closure, 5, PI_GPIO_HIGH);
+  nanosleep(&wait, NULL);
+  n = pi_sampler_read(sampler, samples, 8);
+  assert(n == 1);
+  assert(notified == 1);
+  assert(samples[0].changed == (1 << 5));
+  assert(samples[0].levels & (1 << 5));
+
+  pi_gpio_sim_set_level(closure, 5, PI_GPIO_LOW);
+  nanosleep(&wait, NULL);
+  n = pi_sampler_read(sampler, samples, 8);
+  assert(n == 1 && notified == 2);
+  assert(!(samples[0].levels & (1 << 5)));
+
+  assert(pi_sampler_dropped(sampler) == 0);
+  pi_sampler_delete(sampler);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+/*
+ * Character device lines. Runs fully against a gpio-sim
+ * chip when PI_TEST_GPIOCHIP names its device node and
+ * PI_TEST_GPIOSIM its sysfs directory (see gpio-sim.sh).
+ */
+
+static void
+gpiosim_pull(const char *dir, int line, const char *pull) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/sim_gpio%d/pull", dir, line);
+  int fd = open(path, O_WRONLY);
+  assert(fd >= 0);
+  assert(write(fd, pull, strlen(pull)) == (ssize_t) strlen(pull));
+  close(fd);
+}
+
+void
+test_pi_gpio_lines(void) {
+  pi_gpio_pin_t outs[] = { 0, 1 };
+  pi_gpio_pin_t ins[] = { 2 };
+  pi_gpio_lines_config_t config = { 0 };
+  pi_gpio_lines_event_t events[4];
+  const char *chip = getenv("PI_TEST_GPIOCHIP");
+  const char *sim = getenv("PI_TEST_GPIOSIM");
+  uint64_t values;
+
+  assert(pi_gpio_lines_request("/dev/nonexistent", outs, 2, &config) == NULL);
+  assert(pi_gpio_lines_request("/dev/null", outs, 0, &config) == NULL);
+  assert(errno == EINVAL);
+  if (chip == NULL) return;
+
+  config.mode = PI_GPIO_MODE_OUTPUT;
+  config.values = 0x2;
+  pi_gpio_lines_t *out = pi_gpio_lines_request(chip, outs, 2, &config);
+  assert(out != NULL);
+  assert(out->method == PI_GPIO_METHOD_CHARDEV);
+  assert(pi_gpio_lines_get(out, &values) == 0 && values == 0x2);
+  assert(pi_gpio_lines_set(out, 0x1, 0x3) == 0);
+  assert(pi_gpio_lines_get(out, &values) == 0 && values == 0x1);
+  pi_gpio_lines_release(out);
+
+  if (sim == NULL) return;
+
+  memset(&config, 0, sizeof(config));
+  config.mode = PI_GPIO_MODE_INPUT;
+  config.edge = PI_GPIO_EDGE_BOTH;
+  gpiosim_pull(sim, 2, "pull-down");
+  pi_gpio_lines_t *in = pi_gpio_lines_request(chip, ins, 1, &config);
+  assert(in != NULL);
+  assert(pi_gpio_lines_read_events(in, events, 4, 0) == 0);
+
+  gpiosim_pull(sim, 2, "pull-up");
+  gpiosim_pull(sim, 2, "pull-down");
+  assert(pi_gpio_lines_read_events(in, events, 4, 1000) == 2);
+  assert(events[0].pin == 2 && events[0].edge == PI_GPIO_EDGE_RISING);
+  assert(events[1].edge == PI_GPIO_EDGE_FALLING);
+  assert(events[1].time >= events[0].time && events[0].time > 0);
+
+  // quiet lines queue nothing until edges are back on
+  assert(pi_gpio_lines_set_edge_enabled(in, 0x1, 0) == 0);
+  gpiosim_pull(sim, 2, "pull-up");
+  assert(pi_gpio_lines_read_events(in, events, 4, 50) == 0);
+  assert(pi_gpio_lines_set_edge_enabled(in, 0x1, 1) == 0);
+  gpiosim_pull(sim, 2, "pull-down");
+  assert(pi_gpio_lines_read_events(in, events, 4, 1000) == 1);
+  pi_gpio_lines_release(in);
+}
+
+static void
+watch_count(const pi_gpio_watch_event_t *events, size_t count, void *data) {
+  (void) events;
+  __sync_fetch_and_add((int*) data, (int) count);
+}
+
+void
+test_pi_gpio_watcher(void) {
+  pi_gpio_watch_config_t config = { 50, 10, 10, 500, PI_GPIO_EDGE_BOTH };
+  pi_gpio_pin_t pins[] = { 5, 40 };
+  struct timespec toggle = { 0, 2000000 };
+  struct timespec quiet = { 0, 80000000 };
+  pi_gpio_watch_stats_t stats;
+  int events = 0;
+  int i;
+
+  // hysteresis: switch up at poll_rate, down below irq_rate
+  assert(pi__watch_decide(0, 49, 50, 10) == 0);
+  assert(pi__watch_decide(0, 50, 50, 10) == 1);
+  assert(pi__watch_decide(1, 10, 50, 10) == 1);
+  assert(pi__watch_decide(1, 9, 50, 10) == 0);
+
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  assert(pi_gpio_watcher_new(closure, NULL, pins, 2, &config, NULL, NULL) == NULL);
+
+  pi_gpio_watcher_t *watcher = pi_gpio_watcher_new(closure, NULL, pins, 2
+    , &config, watch_count, &events);
+  assert(watcher != NULL);
+  assert(pi_gpio_watcher_start(watcher) == 0);
+  assert(pi_gpio_watcher_stats(watcher, 7, &stats) == -1);
+
+  // a busy pin switches to polling
+  for (i = 0; i < 100; i++) {
+    pi_gpio_sim_set_level(closure, 5, i & 1 ? PI_GPIO_LOW : PI_GPIO_HIGH);
+    nanosleep(&toggle, NULL);
+  }
+
+  assert(pi_gpio_watcher_stats(watcher, 5, &stats) == 0);
+  assert(stats.to_poll >= 1);
+  assert(stats.edges > 0 && events > 0);
+
+  // and back to interrupts once quiet
+  nanosleep(&quiet, NULL);
+  assert(pi_gpio_watcher_stats(watcher, 5, &stats) == 0);
+  assert(stats.polling == 0 && stats.to_irq >= 1);
+  assert(pi_gpio_watcher_stats(watcher, 40, &stats) == 0);
+  assert(stats.to_poll == 0);
+
+  pi_gpio_watcher_delete(watcher);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_peripheral_map(void) {
+  volatile uint32_t *a = pi__peripheral_map("/dev/zero", 0, BLOCK_SIZE);
+  volatile uint32_t *b = pi__peripheral_map("/dev/zero", 0, BLOCK_SIZE);
+  volatile uint32_t *c = pi__peripheral_map("/dev/zero", PAGE_SIZE, BLOCK_SIZE);
+
+  assert(a != NULL && a == b);
+  assert(c != NULL && c != a);
+  assert(pi__peripheral_map("/dev/nonexistent", 0, BLOCK_SIZE) == NULL);
+
+  // shared until the last reference goes
+  pi__peripheral_unmap(a);
+  b[1] = 42;
+  assert(b[1] == 42);
+  pi__peripheral_unmap(b);
+  pi__peripheral_unmap(c);
+
+  a = pi__peripheral_map("/dev/zero", 0, BLOCK_SIZE);
+  assert(a != NULL && a[1] == 0);
+  pi__peripheral_unmap(a);
+}
+
+void
+test_pi_pwm(void) {
+  uint32_t words[] = { 0xf0f0f0f0, 0x0f0f0f0f };
+
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_pwm_setup(closure) == -1);
+  assert(pi_gpio_setup_sim(closure) == 0);
+  assert(pi_pwm_setup(closure) == 0);
+
+  assert(pi_pwm_channel(18) == 0);
+  assert(pi_pwm_channel(13) == 1);
+  assert(pi_pwm_channel(17) == -1);
+  assert(pi_pwm_claim(closure, 17) == NULL);
+
+  pi_gpio_handle_t *handle = pi_pwm_claim(closure, 18);
+  assert(handle != NULL);
+  assert(pi_gpio_get_mode(handle) == PI_GPIO_MODE_ALT5);
+
+  // clock starts at the default divisor on first use
+  assert(pi_pwm_set_frequency(closure, 0, 50, 0.075) == 0);
+  assert(closure->clk_map[41] == (0x5A000000 | (2 << 12)));
+  assert(closure->clk_map[40] & 0x10);
+  assert(closure->pwm_map[4] > 0);
+  assert(closure->pwm_map[5] * 1000 == closure->pwm_map[4] * 75);
+  assert(closure->pwm_map[0] == 0x81);
+  assert(pi_pwm_set_frequency(closure, 0, 50, 1.5) == -1);
+  assert(pi_pwm_set_frequency(closure, 2, 50, 0.5) == -1);
+
+  assert(pi_pwm_set_mode(closure, 1, PI_PWM_MODE_SERIALIZER, 1) == 0);
+  assert(pi_pwm_set_range(closure, 1, 32) == 0);
+  assert(pi_pwm_write_fifo(closure, words, 2) == 2);
+  assert(closure->pwm_map[6] == words[1]);
+  assert(pi_pwm_enable(closure, 1, 1) == 0);
+  assert(closure->pwm_map[0] == (0x81 | 0x40 | (0x23 << 8)));
+
+  // the channel keeps running while another pin shares it
+  pi_gpio_handle_t *shared = pi_pwm_claim(closure, 12);
+  assert(shared != NULL);
+  pi_gpio_release(shared);
+  assert(closure->pwm_map[0] & 0x01);
+
+  // releasing the last stops the channel and returns the pin to input
+  pi_gpio_release(handle);
+  assert((closure->pwm_map[0] & 0x01) == 0);
+  assert(((closure->gpio_map[1] >> 24) & 7) == 0);
+
+  pi_gpio_teardown(closure);
+  assert(closure->pwm_map == NULL);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_wave(void) {
+  pi_wave_step_t steps[] = {
+      { 1 << 4, 0, 10 }
+    , { 0, 1 << 4, 5 }
+    , { 1 << 5, 1 << 6, 0 }
+  };
+  pi_wave_event_t events[8];
+  size_t ncbs;
+
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_wave_new(closure, steps, 3, 1000, 0) == NULL);
+  assert(pi_gpio_setup_sim(closure) == 0);
+
+  pi_wave_t *wave = pi_wave_new(closure, steps, 3, 1000, 0);
+  assert(wave != NULL);
+
+  const pi_dma_cb_t *cbs = pi_wave_control_blocks(wave, &ncbs);
+  assert(ncbs == 6);
+  assert(cbs[0].dest_ad == 0x7E20001C && cbs[0].txfr_len == 4);
+  assert(cbs[1].dest_ad == 0x7E20C018 && cbs[1].txfr_len == 40);
+  assert(cbs[1].ti & (1 << 6));
+  assert(cbs[3].dest_ad == 0x7E20C018 && cbs[3].txfr_len == 20);
+  assert(cbs[5].nextconbk == 0);
+  assert(pi_wave_start(wave, 5) == -1);
+
+  assert(pi_wave_interpret(wave, events, 8, 0) == 4);
+  assert(events[0].time == 0 && events[0].set == 1 << 4);
+  assert(events[1].time == 10000 && events[1].clr == 1 << 4);
+  assert(events[2].time == 15000 && events[2].set == 1 << 5);
+  assert(events[3].time == 15000 && events[3].clr == 1 << 6);
+  assert(closure->gpio_map[7] == 1 << 5);
+  assert(closure->gpio_map[10] == 1 << 6);
+  assert(pi_wave_interpret(wave, events, 2, 0) == 2);
+  pi_wave_delete(wave);
+
+  // loops need a bound and wrap to the first block
+  wave = pi_wave_new(closure, steps, 2, 1000, 1);
+  assert(wave != NULL);
+  assert(pi_wave_interpret(wave, events, 8, 0) == -1);
+  assert(pi_wave_interpret(wave, events, 8, 30000) == 4);
+  assert(events[2].time == 15000 && events[2].set == 1 << 4);
+  assert(events[3].time == 25000 && events[3].clr == 1 << 4);
+  pi_wave_delete(wave);
+
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_rt(void) {
+  pi_rt_config_t config = { 0 };
+  char buf[3 * 4096];
+  int status;
+
+  assert(pi_rt_apply(&config) == PI_RT_OK);
+
+  buf[0] = 1;
+  buf[sizeof(buf) - 1] = 2;
+  pi_rt_prefault(buf, sizeof(buf));
+  assert(buf[0] == 1 && buf[sizeof(buf) - 1] == 2);
+
+  // may be refused without privileges, but must not fail otherwise
+  config.priority = 10;
+  config.cpus = 1;
+  config.prefault_stack = 16 * 1024;
+  status = pi_rt_apply(&config);
+  assert((status & ~(PI_RT_SCHED_FAILED | PI_RT_AFFINITY_FAILED)) == 0);
+
+  config.priority = 0;
+  config.cpus = 0;
+  pi_rt_apply(&config);
+}
+
 int
 main() {
   fprintf(stdout, "\n");
   RUN_TEST(pi_revision)
   RUN_TEST(pi_closure_default)
   RUN_TEST(pi_closure_custom)
+  RUN_TEST(pi_trace)
+  RUN_TEST(pi_gpio_concurrent_claim)
+  RUN_TEST(pi_gpio_write_sequence)
+  RUN_TEST(pi_gpio_poll_events)
+  RUN_TEST(pi_fast)
+  RUN_TEST(pi_route)
+  RUN_TEST(pi_program)
+  RUN_TEST(pi_sched)
+  RUN_TEST(pi_daemon)
+  RUN_TEST(pi_journal)
+  RUN_TEST(pi_capture)
+  RUN_TEST(pi_sampler)
+  RUN_TEST(pi_gpio_lines)
+  RUN_TEST(pi_gpio_watcher)
+  RUN_TEST(pi_peripheral_map)
+  RUN_TEST(pi_rt)
+  RUN_TEST(pi_pwm)
+  RUN_TEST(pi_wave)
   fprintf(stdout, "\n");
   return 0;
 }
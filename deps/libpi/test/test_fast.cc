@@ -0,0 +1,83 @@
+
+#include "pi.h"
+#include "pi_fast.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#define RUN_TEST(func) \
+  test_##func(); \
+  fprintf(stdout, "  (y) test_" #func "()\n");
+
+typedef pi::Pin<17> Led;
+typedef pi::Pin<40> High;
+typedef pi::PinGroup<4, 5, 6> Bus;
+
+static_assert(Led::mask == 1 << 17 && Led::set_offset == PI_FAST_SET_OFFSET, "pin 17");
+static_assert(High::mask == 1 << 8 && High::clr_offset == PI_FAST_CLR_OFFSET + 1, "pin 40");
+static_assert(Bus::mask == 0x70 && Bus::size == 3, "group mask");
+
+void
+test_pi_fast_pin(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  volatile uint32_t *map = pi_fast_map(closure);
+
+  Led::set(map);
+  assert(map[PI_FAST_SET_OFFSET] == 1 << 17);
+  Led::write(map, false);
+  assert(map[PI_FAST_CLR_OFFSET] == 1 << 17);
+  High::write(map, true);
+  assert(map[PI_FAST_SET_OFFSET + 1] == 1 << 8);
+  High::clr(map);
+  assert(map[PI_FAST_CLR_OFFSET + 1] == 1 << 8);
+
+  pi_gpio_sim_set_level(closure, 17, PI_GPIO_HIGH);
+  assert(Led::read(map));
+  pi_gpio_sim_set_level(closure, 17, PI_GPIO_LOW);
+  assert(!Led::read(map));
+
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+void
+test_pi_fast_group(void) {
+  pi_closure_t *closure = pi_default_closure();
+  assert(pi_gpio_setup_sim(closure) == 0);
+  volatile uint32_t *map = pi_fast_map(closure);
+
+  Bus::set(map);
+  assert(map[PI_FAST_SET_OFFSET] == 0x70);
+  Bus::clr(map);
+  assert(map[PI_FAST_CLR_OFFSET] == 0x70);
+
+  // bit i drives the i-th pin listed, the rest are cleared
+  map[PI_FAST_SET_OFFSET] = 0;
+  map[PI_FAST_CLR_OFFSET] = 0;
+  Bus::write(map, 0x5);
+  assert(map[PI_FAST_SET_OFFSET] == (1 << 4 | 1 << 6));
+  assert(map[PI_FAST_CLR_OFFSET] == 1 << 5);
+
+  // nothing to clear leaves the clear register alone
+  map[PI_FAST_CLR_OFFSET] = 0;
+  Bus::write(map, 0x7);
+  assert(map[PI_FAST_SET_OFFSET] == 0x70);
+  assert(map[PI_FAST_CLR_OFFSET] == 0);
+
+  pi_gpio_sim_set_level(closure, 5, PI_GPIO_HIGH);
+  pi_gpio_sim_set_level(closure, 9, PI_GPIO_HIGH);
+  assert(Bus::read(map) == 1 << 5);
+
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+}
+
+int
+main() {
+  fprintf(stdout, "\n");
+  RUN_TEST(pi_fast_pin)
+  RUN_TEST(pi_fast_group)
+  fprintf(stdout, "\n");
+  return 0;
+}
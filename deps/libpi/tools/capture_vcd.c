@@ -0,0 +1,137 @@
+/*
+ * libpi - Capture to VCD converter
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void
+usage(const char *prog) {
+  fprintf(stderr,
+      "usage: %s [options] <capture> [out.vcd]\n"
+      "\n"
+      "  -f <ns>   start this long after the capture began\n"
+      "  -t <ns>   stop this long after the capture began\n"
+      "  -i        print capture info and exit\n"
+    , prog);
+}
+
+/*
+ * One VCD identifier per watched pin, from '!'.
+ */
+
+static char
+vcd_id(uint32_t mask, unsigned int pin) {
+  return '!' + __builtin_popcount(mask & ((1u << pin) - 1));
+}
+
+static void
+vcd_levels(FILE *out, uint32_t mask, uint32_t bits, uint32_t levels) {
+  unsigned int pin;
+
+  for (pin = 0; pin < 32; pin++) {
+    if (!(mask & bits & (1u << pin))) continue;
+    fprintf(out, "%c%c\n", levels & (1u << pin) ? '1' : '0', vcd_id(mask, pin));
+  }
+}
+
+/*
+ * Write a capture made with pi_capture_new() as a Value
+ * Change Dump with 1ns timescale and one wire per watched
+ * pin, times relative to the capture start.
+ */
+
+int
+main(int argc, char **argv) {
+  pi_capture_reader_t *reader;
+  pi_capture_info_t info;
+  pi_sample_t sample;
+  uint64_t from = 0, to = UINT64_MAX, last;
+  unsigned long n = 0;
+  int show_info = 0;
+  unsigned int pin;
+  FILE *out = stdout;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:t:ih")) != -1) {
+    switch (opt) {
+      case 'f': from = strtoull(optarg, NULL, 10); break;
+      case 't': to = strtoull(optarg, NULL, 10); break;
+      case 'i': show_info = 1; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  reader = pi_capture_open(argv[optind]);
+  if (reader == NULL) {
+    fprintf(stderr, "error: cannot open %s: %s\n", argv[optind], strerror(errno));
+    return 1;
+  }
+
+  pi_capture_reader_info(reader, &info);
+
+  if (show_info) {
+    printf("pins         0x%08x\n", info.mask);
+    printf("tick         %u ns\n", info.tick_ns);
+    printf("span         %.6f s\n", (info.end - info.start) / 1e9);
+    printf("transitions  %llu in %llu records\n"
+      , (unsigned long long) info.transitions
+      , (unsigned long long) info.records);
+    printf("data         %llu bytes (%.2f per transition)\n"
+      , (unsigned long long) info.bytes
+      , info.transitions ? (double) info.bytes / info.transitions : 0.0);
+    printf("index        %llu entries\n", (unsigned long long) info.index_count);
+    printf("dropped      %llu samples\n", (unsigned long long) info.dropped);
+    pi_capture_reader_close(reader);
+    return 0;
+  }
+
+  if (optind + 1 < argc && (out = fopen(argv[optind + 1], "w")) == NULL) {
+    fprintf(stderr, "error: cannot open %s\n", argv[optind + 1]);
+    return 1;
+  }
+
+  fprintf(out, "$version libpi capture-vcd $end\n");
+  fprintf(out, "$timescale 1ns $end\n");
+  fprintf(out, "$scope module gpio $end\n");
+  for (pin = 0; pin < 32; pin++) {
+    if (info.mask & (1u << pin)) {
+      fprintf(out, "$var wire 1 %c gpio%u $end\n", vcd_id(info.mask, pin), pin);
+    }
+  }
+  fprintf(out, "$upscope $end\n$enddefinitions $end\n");
+
+  pi_capture_seek(reader, info.start + from);
+  fprintf(out, "#%llu\n$dumpvars\n", (unsigned long long) from);
+  vcd_levels(out, info.mask, info.mask, pi_capture_levels(reader));
+  fprintf(out, "$end\n");
+  last = from;
+
+  while (pi_capture_next(reader, &sample)) {
+    uint64_t time = sample.time - info.start;
+    if (time > to) break;
+    if (time != last) fprintf(out, "#%llu\n", (unsigned long long) time);
+    vcd_levels(out, info.mask, sample.changed, sample.levels);
+    last = time;
+    n++;
+  }
+
+  if (out != stdout) fclose(out);
+  pi_capture_reader_close(reader);
+  fprintf(stderr, "%lu transitions\n", n);
+  return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * libpi - GPIO daemon
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void
+usage(const char *prog) {
+  fprintf(stderr,
+      "usage: %s [options]\n"
+      "\n"
+      "  -n <name>   shared memory name (default: %s)\n"
+      "  -c <count>  client slots (default: 8)\n"
+      "  -r <rate>   ring scans per second, 0 to spin (default: 10000)\n"
+      "  -p <prio>   run the scan thread under SCHED_FIFO at prio\n"
+      "  -s          use simulated registers\n"
+    , prog, PI_DAEMON_NAME);
+}
+
+/*
+ * Own the gpio registers and serve pi_client_* callers
+ * until SIGINT or SIGTERM; pins still claimed by clients
+ * are released on the way out.
+ */
+
+int
+main(int argc, char **argv) {
+  pi_daemon_config_t config = { 0, 10000, 0 };
+  pi_daemon_stats_t stats;
+  const char *name = PI_DAEMON_NAME;
+  pi_closure_t *closure = pi_default_closure();
+  pi_daemon_t *daemon;
+  int simulate = 0;
+  sigset_t signals;
+  int opt, sig;
+
+  while ((opt = getopt(argc, argv, "n:c:r:p:sh")) != -1) {
+    switch (opt) {
+      case 'n': name = optarg; break;
+      case 'c': config.clients = strtoul(optarg, NULL, 10); break;
+      case 'r': config.rate = strtoul(optarg, NULL, 10); break;
+      case 'p': closure->rt.priority = strtol(optarg, NULL, 10); break;
+      case 's': simulate = 1; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if ((simulate ? pi_gpio_setup_sim(closure) : pi_gpio_setup(closure)) != 0) {
+    fprintf(stderr, "error: gpio setup failed\n");
+    return 1;
+  }
+
+  // the scan thread inherits the mask; signals come here
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  daemon = pi_daemon_new(closure, name, &config);
+  if (daemon == NULL || pi_daemon_start(daemon) != 0) {
+    perror("error: cannot start daemon");
+    pi_gpio_teardown(closure);
+    return 1;
+  }
+
+  fprintf(stderr, "serving %s\n", name);
+  sigwait(&signals, &sig);
+
+  pi_daemon_stats(daemon, &stats);
+  pi_daemon_delete(daemon);
+  pi_gpio_teardown(closure);
+  pi_closure_delete(closure);
+
+  fprintf(stderr, "%llu commands, %llu rejected, %u reaped\n"
+    , (unsigned long long) stats.commands
+    , (unsigned long long) stats.rejected
+    , stats.reaped);
+  return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * libpi - Journal replay
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+static void
+usage(const char *prog) {
+  fprintf(stderr,
+      "usage: %s [options] <journal>\n"
+      "\n"
+      "  -t          keep the recorded timing (default: as fast as possible)\n"
+      "  -n <count>  replay count times (default: 1)\n"
+      "  -g          replay on the gpio registers instead of simulated ones\n"
+      "  -l          list the records instead of replaying\n"
+    , prog);
+}
+
+/*
+ * Print a journal, one record per line, with times
+ * relative to the first record:
+ *
+ *     <ns> <op> <pin> <value> <extra>
+ */
+
+static void
+list(pi_journal_t *journal) {
+  size_t count, i;
+  const pi_journal_record_t *records = pi_journal_records(journal, &count, NULL);
+  uint64_t first = count ? PI_JOURNAL_TIME(&records[0]) : 0;
+
+  for (i = 0; i < count; i++) {
+    const pi_journal_record_t *rec = &records[i];
+    printf("%12lld %-16s %3u 0x%08x 0x%08x\n"
+      , (long long)(PI_JOURNAL_TIME(rec) - first)
+      , pi_trace_op_name(PI_JOURNAL_OP(rec))
+      , (unsigned int) PI_JOURNAL_PIN(rec)
+      , rec->value
+      , rec->extra);
+  }
+}
+
+/*
+ * Re-run a journal written through `PI_JOURNAL=<path>`
+ * or pi_journal_dump() and report throughput and, with
+ * -t, how far each op ran behind its recorded time.
+ */
+
+int
+main(int argc, char **argv) {
+  pi_journal_replay_stats_t stats;
+  pi_closure_t *closure = pi_default_closure();
+  pi_journal_t *journal;
+  uint64_t dropped, ops = 0, elapsed = 0, late_sum = 0, max_late = 0;
+  unsigned long loops = 1, n;
+  int flags = 0, hardware = 0, listing = 0;
+  size_t count;
+  int opt, fd;
+
+  while ((opt = getopt(argc, argv, "tn:glh")) != -1) {
+    switch (opt) {
+      case 't': flags |= PI_JOURNAL_REPLAY_TIMED; break;
+      case 'n': loops = strtoul(optarg, NULL, 10); break;
+      case 'g': hardware = 1; break;
+      case 'l': listing = 1; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind >= argc || loops == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  fd = open(argv[optind], O_RDONLY);
+  if (fd < 0 || (journal = pi_journal_load(fd)) == NULL) {
+    fprintf(stderr, "error: cannot load %s: %s\n", argv[optind], strerror(errno));
+    return 1;
+  }
+
+  close(fd);
+  pi_journal_records(journal, &count, &dropped);
+  if (dropped) fprintf(stderr, "warning: %llu ops were not journaled\n", (unsigned long long) dropped);
+
+  if (listing) {
+    list(journal);
+    fprintf(stderr, "%lu records\n", (unsigned long) count);
+    pi_journal_delete(journal);
+    return 0;
+  }
+
+  if ((hardware ? pi_gpio_setup(closure) : pi_gpio_setup_sim(closure)) != 0) {
+    fprintf(stderr, "error: gpio setup failed\n");
+    return 1;
+  }
+
+  for (n = 0; n < loops; n++) {
+    if (pi_journal_replay(closure, journal, flags, &stats) != 0) {
+      fprintf(stderr, "error: replay failed: %s\n", strerror(errno));
+      return 1;
+    }
+
+    ops += stats.records;
+    elapsed += stats.elapsed_ns;
+    late_sum += stats.mean_late_ns;
+    if (stats.max_late_ns > max_late) max_late = stats.max_late_ns;
+  }
+
+  printf("records     %lu (%llu skipped, %llu mismatched reads)\n"
+    , (unsigned long) count
+    , (unsigned long long) stats.skipped
+    , (unsigned long long) stats.mismatches);
+  printf("recorded    %.3f ms\n", stats.recorded_ns / 1e6);
+  printf("replayed    %lu x in %.3f ms\n", loops, elapsed / 1e6);
+  printf("throughput  %.0f ops/s\n", elapsed ? ops * 1e9 / elapsed : 0.0);
+
+  if (flags & PI_JOURNAL_REPLAY_TIMED) {
+    printf("deviation   mean %llu ns, max %llu ns\n"
+      , (unsigned long long)(late_sum / loops)
+      , (unsigned long long) max_late);
+  }
+
+  pi_closure_delete(closure);
+  pi_journal_delete(journal);
+  return 0;
+}
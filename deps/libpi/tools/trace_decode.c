@@ -0,0 +1,57 @@
+/*
+ * libpi - Trace dump decoder
+ * Copyright(c) 2013 Jake Luer <jake@alogicalparadox.com>
+ * MIT Licensed
+ */
+
+#include "pi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Print a `pi_trace_dump` file as text, one record per
+ * line, with times relative to the first record:
+ *
+ *     <ns> <thread> <op> <pin> <value> <extra>
+ */
+
+int
+main(int argc, char **argv) {
+  pi_trace_header_t header;
+  pi_trace_record_t rec;
+  uint64_t start = 0;
+  unsigned long n = 0;
+
+  FILE *in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+  if (in == NULL) {
+    fprintf(stderr, "error: cannot open %s\n", argv[1]);
+    return 1;
+  }
+
+  if (fread(&header, sizeof(header), 1, in) != 1
+      || memcmp(header.magic, PI_TRACE_MAGIC, sizeof(PI_TRACE_MAGIC)) != 0) {
+    fprintf(stderr, "error: not a libpi trace\n");
+    return 1;
+  }
+
+  if (header.version != PI_TRACE_VERSION || header.record_size != sizeof(rec)) {
+    fprintf(stderr, "error: unsupported trace version %u\n", header.version);
+    return 1;
+  }
+
+  while (fread(&rec, sizeof(rec), 1, in) == 1) {
+    if (n++ == 0) start = rec.time;
+    printf("%12llu %6u %-16s %3u 0x%08x 0x%08x\n"
+      , (unsigned long long)(rec.time - start)
+      , rec.thread
+      , pi_trace_op_name(rec.op)
+      , rec.pin
+      , rec.value
+      , rec.extra);
+  }
+
+  if (in != stdin) fclose(in);
+  fprintf(stderr, "%lu records\n", n);
+  return 0;
+}
@@ -1,17 +1,20 @@
 
 exports.GPIO = require('./pidaeus/gpio');
+exports.Program = require('./pidaeus/gpio/program');
+exports.Client = require('./pidaeus/gpio/client');
 
 exports.types = {
   'gpio': exports.GPIO
 };
 
-exports.bind = function(type, ready) {
+exports.bind = function(type, opts, ready) {
+  if ('function' === typeof opts) ready = opts, opts = {};
   if (!exports.types[type]) {
     throw new Error('invalid interface type "' + type + '"');
   }
 
   var fn = exports.types[type];
-  var iface = new fn();
+  var iface = new fn(opts);
 
   if (ready) iface.on('ready', ready);
   setImmediate(iface.setup.bind(iface));
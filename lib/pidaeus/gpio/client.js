@@ -0,0 +1,164 @@
+/*!
+ * External dependencies
+ */
+
+var debug = require('sherlock')('pidaeus:client');
+
+/*!
+ * Native connect
+ */
+
+var connect = require('bindings')('pidaeus.node').connect;
+
+/*!
+ * Primary export
+ */
+
+module.exports = Client;
+
+/**
+ * ### Client([name])
+ *
+ * A connection to a running `pi-daemon`, which owns the
+ * gpio registers so that several processes can share
+ * them. Pins are claimed per client; the daemon refuses
+ * writes to pins another client holds and releases a
+ * client's pins when it disconnects or exits.
+ *
+ * Writes are posted to shared memory and return at once;
+ * refused writes are reported by the next `.flush()`.
+ * Reads come from the daemon's last scan. Throws when no
+ * daemon serves `name` or it has no free client slot.
+ *
+ *     var client = new Client();
+ *     client.claim(17, { direction: 1 }, function(err) {
+ *       client.write(17, 1);
+ *       client.flush(done);
+ *     });
+ *
+ * @param {String} shared memory name (default: `/libpi`)
+ * @return {Client}
+ * @api public
+ */
+
+function Client(name) {
+  this.name = name || '/libpi';
+  this._handle = connect(this.name);
+  debug('(connect) %s', this.name);
+}
+
+/**
+ * #### .claim(pin, [opts], callback)
+ *
+ * Options as `gpio.claim()`: `direction`, `pull` and, for
+ * outputs, the initial `value`. Throws for a pin outside
+ * 0-53 or a direction outside 0-7, as do the other pin
+ * methods for a bad pin.
+ *
+ * @param {Number} pin
+ * @param {Object} options
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+Client.prototype.claim = function(pin, opts, cb) {
+  if ('function' === typeof opts) cb = opts, opts = {};
+  this._handle.claim(pin, opts || {}, cb);
+};
+
+/**
+ * #### .release(pin, callback)
+ *
+ * @param {Number} pin
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+Client.prototype.release = function(pin, cb) {
+  this._handle.release(pin, cb);
+};
+
+/**
+ * #### .write(pin, value)
+ *
+ * Queue a write. Returns `false` when the command ring
+ * is full; `.flush()` and try again.
+ *
+ * @param {Number} pin
+ * @param {Number} value
+ * @return {Boolean} queued
+ * @api public
+ */
+
+Client.prototype.write = function(pin, value) {
+  return this._handle.write(pin, value ? 1 : 0);
+};
+
+/**
+ * #### .writeMask(set, [clear])
+ *
+ * Queue a write of pins 0-31 as bit masks, applied by
+ * the daemon with one store per register.
+ *
+ * @param {Number} pins driven high
+ * @param {Number} pins driven low
+ * @return {Boolean} queued
+ * @api public
+ */
+
+Client.prototype.writeMask = function(set, clr) {
+  return this._handle.writeMask(set >>> 0, (clr || 0) >>> 0);
+};
+
+/**
+ * #### .read(pin)
+ *
+ * @param {Number} pin
+ * @return {Number} value at the daemon's last scan
+ * @api public
+ */
+
+Client.prototype.read = function(pin) {
+  return this._handle.read(pin);
+};
+
+/**
+ * #### .readMask()
+ *
+ * @return {Number} levels of pins 0-31 at the last scan
+ * @api public
+ */
+
+Client.prototype.readMask = function() {
+  return this._handle.readMask();
+};
+
+/**
+ * #### .flush(callback)
+ *
+ * Wait for every queued write.
+ *
+ * @param {Function} callback
+ * @cb {Error|null} if the daemon refused a write
+ * @api public
+ */
+
+Client.prototype.flush = function(cb) {
+  this._handle.flush(cb);
+};
+
+/**
+ * #### .close()
+ *
+ * Disconnect once pending callbacks have run. The daemon
+ * releases this client's pins.
+ *
+ * @api public
+ */
+
+Client.prototype.close = function() {
+  debug('(close) %s', this.name);
+  this._handle.close();
+};
@@ -0,0 +1,128 @@
+/*!
+ * Primary export
+ */
+
+module.exports = EventBatch;
+
+/*!
+ * Record layout written by the native event pump:
+ * pin (uint8), value (uint8), flags (uint16), reserved
+ * (uint32), time in ns (low then high uint32), little
+ * endian.
+ */
+
+var RECORD = 16;
+var POLLED = 0x1;
+var NS = 1e9;
+
+/**
+ * ### EventBatch(buf)
+ *
+ * View over one batch of native edge events. Nothing is
+ * decoded until asked for, so a handler that only looks
+ * at the last value or the count does no per-event work.
+ *
+ * @param {Buffer} packed records
+ * @api public
+ */
+
+function EventBatch(buf) {
+  this.buffer = buf;
+  this.length = Math.floor(buf.length / RECORD);
+}
+
+/**
+ * #### .pin(i)
+ *
+ * @param {Number} index
+ * @return {Number} pin
+ * @api public
+ */
+
+EventBatch.prototype.pin = function(i) {
+  return this.buffer[i * RECORD];
+};
+
+/**
+ * #### .value(i)
+ *
+ * @param {Number} index
+ * @return {Number} level after the edge
+ * @api public
+ */
+
+EventBatch.prototype.value = function(i) {
+  return this.buffer[i * RECORD + 1];
+};
+
+/**
+ * #### .time(i)
+ *
+ * Rounded once past 2^53 ns (about 104 days of uptime);
+ * use `.hrtime(i)` where every nanosecond counts.
+ *
+ * @param {Number} index
+ * @return {Number} monotonic time in ns
+ * @api public
+ */
+
+EventBatch.prototype.time = function(i) {
+  var off = i * RECORD + 8;
+  return this.buffer.readUInt32LE(off + 4) * 0x100000000 + this.buffer.readUInt32LE(off);
+};
+
+/**
+ * #### .hrtime(i)
+ *
+ * The exact time, split as `process.hrtime()` does.
+ *
+ * @param {Number} index
+ * @return {Array} `[seconds, nanoseconds]`
+ * @api public
+ */
+
+EventBatch.prototype.hrtime = function(i) {
+  var off = i * RECORD + 8;
+  var hi = this.buffer.readUInt32LE(off + 4);
+  var lo = this.buffer.readUInt32LE(off);
+
+  // long division by 1e9, 16 bits at a time, so no
+  // intermediate passes 2^53
+  var mid = (hi % NS) * 0x10000 + (lo >>> 16);
+  var low = (mid % NS) * 0x10000 + (lo & 0xffff);
+  var sec = Math.floor(hi / NS) * 0x100000000
+    + Math.floor(mid / NS) * 0x10000
+    + Math.floor(low / NS);
+
+  return [ sec, low % NS ];
+};
+
+/**
+ * #### .polled(i)
+ *
+ * @param {Number} index
+ * @return {Boolean} seen by busy-polling rather than
+ *   a kernel interrupt
+ * @api public
+ */
+
+EventBatch.prototype.polled = function(i) {
+  return !!(this.buffer.readUInt16LE(i * RECORD + 2) & POLLED);
+};
+
+/**
+ * #### .forEach(fn, [ctx])
+ *
+ * Call `fn(pin, value, time, polled)` for each event in
+ * order.
+ *
+ * @param {Function} iterator
+ * @param {Object} context
+ * @api public
+ */
+
+EventBatch.prototype.forEach = function(fn, ctx) {
+  for (var i = 0; i < this.length; i++) {
+    fn.call(ctx, this.pin(i), this.value(i), this.time(i), this.polled(i));
+  }
+};
@@ -9,6 +9,9 @@ var sherlock = require('sherlock');
  * State handle
  */
 
+var EventBatch = require('./event-batch');
+var Pin = require('./pin');
+var Program = require('./program');
 var State = require('./state');
 
 /*!
@@ -16,6 +19,7 @@ var State = require('./state');
  */
 
 var ReadableStream = require('./readable-stream');
+var SampleStream = require('./sample-stream');
 var WritableStream = require('./writable-stream');
 
 /*!
@@ -25,16 +29,36 @@ var WritableStream = require('./writable-stream');
 module.exports = GPIO;
 
 /**
- * ### GPIO
+ * ### GPIO([options])
  *
+ * Options:
+ *
+ * - `simulate` {Boolean} use simulated registers (default: `false`)
+ * - `stats` {Boolean} collect operation stats (default: `false`)
+ * - `thread` {Boolean} run operations in order on a dedicated
+ *   thread instead of the libuv threadpool (default: `false`)
+ * - `queueSize` {Number} max outstanding operations when using
+ *   `thread`; further calls throw (default: `1024`)
+ * - `realtime` {Object} timing options for the `thread`
+ *   and native libpi threads: `priority` (SCHED_FIFO 1-99),
+ *   `cpus` (array of cpu numbers), `lockMemory` {Boolean}
+ *   and `prefaultStack` (bytes). Refused settings fall back
+ *   to normal scheduling; see `.getRealtimeStatus()`.
+ * - `sampleRate` {Number} polls per second of the native
+ *   sampler behind `.createSampleStream()` (default: `1000`)
+ *
+ * @param {Object} options
  * @return {GPIO}
  * @api public
  */
 
-function GPIO() {
+function GPIO(opts) {
   State.call(this, '_state');
   this._state.debug = sherlock('pidaeus:gpio-state');
   this._handle = null;
+  this._options = opts || {};
+  this._sampler = null;
+  this._edges = false;
 }
 
 /*!
@@ -70,6 +94,36 @@ GPIO.prototype.claim = function(pin, opts, cb) {
   wrap(this, claim, cb);
 };
 
+/**
+ * #### .pin(pin, [opts], callback)
+ *
+ * Claim `pin` (options as `.claim()`) and hand back a
+ * `Pin` bound to the native handle. Its `read`,
+ * `write` and `toggle` calls, and their sync forms,
+ * skip the per-call checks of the methods here. Only
+ * pins claimed through registers (not the chardev or
+ * PWM) can be bound.
+ *
+ * @param {Number} pin
+ * @param {Object} options
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @cb {Pin} bound pin
+ * @api public
+ */
+
+GPIO.prototype.pin = function(pin, opts, cb) {
+  if ('function' === typeof opts) cb = opts, opts = {};
+  var self = this;
+
+  this.claim(pin, opts, function(err) {
+    if (err) return cb(err);
+    var native = self._handle && self._handle.bindPin(pin);
+    if (!native) return cb(new Error('pin ' + pin + ' cannot be bound'));
+    cb(null, new Pin(self, pin, native));
+  });
+};
+
 /**
  * #### .release(pin, [callback])
  *
@@ -145,6 +199,490 @@ GPIO.prototype.write = function(pin, value, cb) {
   wrap(this, write, cb);
 };
 
+/**
+ * #### .writeBuffer(pin, buffer, [period], [callback])
+ *
+ * Write a sequence of values to a pin in one native
+ * call. Each byte of `buffer` is a value (non-zero is
+ * high). `period` is the spacing between values in
+ * nanoseconds measured from the first write; omit it
+ * to write back to back.
+ *
+ * @param {Number} pin
+ * @param {Buffer} buffer
+ * @param {Number} period in ns
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+GPIO.prototype.writeBuffer = function(pin, buf, period, cb) {
+  var handle = this._handle;
+
+  if ('function' === typeof period) cb = period, period = 0;
+
+  function write(next) {
+    handle.writeBuffer(pin, buf, period || 0, function(err) {
+      if (err) return next(err);
+      debug('(writeBuffer) [%d] %d values', pin, buf.length);
+      next();
+    });
+  }
+
+  wrap(this, write, cb);
+};
+
+/**
+ * #### .pwm(pin, frequency, duty, [callback])
+ *
+ * Drive `pin` from the hardware PWM at `frequency` Hz
+ * with `duty` (0 to 1) of each period high. The first
+ * call claims the pin; call again to retune and use
+ * `.release(pin)` to stop. Only pins 12, 13, 18 and 19
+ * have a PWM function, and 12/18 and 13/19 share a
+ * channel. Both channels share one clock.
+ *
+ * @param {Number} pin
+ * @param {Number} frequency in Hz
+ * @param {Number} duty cycle 0-1
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+GPIO.prototype.pwm = function(pin, frequency, duty, cb) {
+  var handle = this._handle;
+
+  function pwm(next) {
+    handle.pwm(pin, frequency, duty, function(err) {
+      if (err) return next(err);
+      debug('(pwm) [%d] %dHz %d', pin, frequency, duty);
+      next();
+    });
+  }
+
+  wrap(this, pwm, cb);
+};
+
+/**
+ * #### .runProgram(program, [opts], [callback])
+ *
+ * Run a `Program` (or its encoded Buffer) natively in
+ * one dispatch, so waits and delays are timed in
+ * microseconds instead of event loop turns. The result
+ * is a Buffer of the recorded values as doubles
+ * (`buf.readDoubleLE(i * 8)`). One program runs at a
+ * time; teardown stops it. Every pin it sets, clears or
+ * writes must be claimed as an output; once a pin is
+ * released or routed the running program's writes to it
+ * are dropped.
+ *
+ * Options:
+ *
+ * - `maxRecords` {Number} result capacity (default: `1024`)
+ *
+ * @param {Program|Buffer} program
+ * @param {Object} options
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @cb {Buffer} recorded values
+ * @api public
+ */
+
+GPIO.prototype.runProgram = function(program, opts, cb) {
+  if ('function' === typeof opts) cb = opts, opts = {};
+  var handle = this._handle;
+  var code = program instanceof Program ? program.toBuffer() : program;
+
+  function run(next) {
+    handle.runProgram(code, opts || {}, function(err, records) {
+      if (err) return next(err);
+      debug('(program) %d records', records.length / 8);
+      next(null, records);
+    });
+  }
+
+  wrap(this, run, cb);
+};
+
+/**
+ * #### .getStats()
+ *
+ * Snapshot of per-operation counts, errors and
+ * queue/execute latency percentiles (ns), plus per-pin
+ * read, write and edge counts. Returns `null` if the
+ * interface has not been setup.
+ *
+ * @return {Object|null}
+ * @api public
+ */
+
+GPIO.prototype.getStats = function() {
+  return this._handle ? this._handle.getStats() : null;
+};
+
+/**
+ * #### .setStatsEnabled(enabled)
+ *
+ * Turn stats collection on or off at runtime.
+ *
+ * @param {Boolean} enabled
+ * @api public
+ */
+
+GPIO.prototype.setStatsEnabled = function(enabled) {
+  this._options.stats = !!enabled;
+  if (this._handle) this._handle.setStatsEnabled(!!enabled);
+};
+
+/**
+ * #### .resetStats()
+ *
+ * @api public
+ */
+
+GPIO.prototype.resetStats = function() {
+  if (this._handle) this._handle.resetStats();
+};
+
+/**
+ * #### .getRealtimeStatus()
+ *
+ * Which parts of the `realtime` option took effect. Each
+ * of `priority`, `cpus` and `lockMemory` is `true` when
+ * applied, `false` when refused (usually permissions) and
+ * `null` when not requested. Returns `null` if the
+ * interface has not been setup.
+ *
+ * @return {Object|null}
+ * @api public
+ */
+
+GPIO.prototype.getRealtimeStatus = function() {
+  return this._handle ? this._handle.getRealtimeStatus() : null;
+};
+
+/**
+ * #### .getBoard()
+ *
+ * Board detected during setup: `soc` (e.g. `'BCM2711'`),
+ * header `revision`, raw `revisionCode` and the
+ * `peripheralBase` the registers were mapped from.
+ * Returns `null` if the interface has not been setup.
+ *
+ * @return {Object|null}
+ * @api public
+ */
+
+GPIO.prototype.getBoard = function() {
+  return this._handle ? this._handle.getBoard() : null;
+};
+
+/**
+ * #### .createSampleStream(pin, [pull])
+ *
+ * Readable stream of a pin's value that pushes only
+ * changes, as seen by one native thread polling every
+ * sampled pin at the `sampleRate` option. Pins 0-31.
+ *
+ * @param {Number} pin
+ * @param {Number} pull option (default: `0`)
+ * @return {SampleStream}
+ * @api public
+ */
+
+GPIO.prototype.createSampleStream = function(pin, pull) {
+  return new SampleStream(this, pin, pull);
+};
+
+/*!
+ * Route changes of `pin` from the native sampler to
+ * `fn(value, time)`, starting the sampler on first use.
+ *
+ * @param {Number} pin
+ * @param {Function} handler
+ * @api private
+ */
+
+GPIO.prototype._sampleWatch = function(pin, fn) {
+  var sampler = this._sampler;
+  var rate = this._options.sampleRate || 1000;
+
+  if (!this._handle) throw new Error('interface not ready');
+  if (pin < 0 || pin > 31) throw new RangeError('sampled pins must be 0-31');
+
+  if (!sampler) {
+    sampler = this._sampler = { mask: 0, watchers: {} };
+    sampler.watchers[pin] = fn;
+    sampler.mask = (1 << pin) >>> 0;
+    this._handle.sampleStart(rate, sampler.mask, sampleDispatch.bind(this));
+  } else {
+    sampler.watchers[pin] = fn;
+    sampler.mask = (sampler.mask | (1 << pin)) >>> 0;
+    this._handle.sampleMask(sampler.mask);
+  }
+
+  debug('(sample) [%d] mask %d', pin, sampler.mask);
+};
+
+/*!
+ * Stop routing changes of `pin`; the sampler thread
+ * stops with its last pin.
+ *
+ * @param {Number} pin
+ * @api private
+ */
+
+GPIO.prototype._sampleUnwatch = function(pin) {
+  var sampler = this._sampler;
+  if (!sampler || !sampler.watchers[pin]) return;
+
+  delete sampler.watchers[pin];
+  sampler.mask = (sampler.mask & ~(1 << pin)) >>> 0;
+
+  if (sampler.mask) {
+    this._handle.sampleMask(sampler.mask);
+  } else {
+    this._handle.sampleStop();
+    this._sampler = null;
+  }
+};
+
+/**
+ * #### .watchEdges(pins, [options], fn)
+ *
+ * Deliver edges on `pins` (0-30) from a native watcher
+ * that switches busy pins from interrupts to polling.
+ * `fn` receives an `EventBatch` per wakeup rather than
+ * a call per edge.
+ *
+ * Options:
+ *
+ * - `backlog` {Number} pending events that wake the
+ *   loop (default: `64`)
+ * - `maxDelay` {Number} ms an event may wait for its
+ *   batch (default: `10`)
+ * - `pollRate` {Number} edges/s that switch a pin to
+ *   polling (default: `5000`)
+ * - `irqRate` {Number} edges/s that switch it back
+ *   (default: `1000`)
+ * - `window` {Number} ms between rate checks (default: `10`)
+ * - `chip` {String} gpiochip whose edge interrupts wake
+ *   idle pins, e.g. `'/dev/gpiochip0'`; without it idle
+ *   pins are checked once per window
+ * - `pull` {Number} pull applied when requesting `chip`
+ *   lines (default: `0`)
+ *
+ * @param {Array} pins
+ * @param {Object} options
+ * @param {Function} handler
+ * @api public
+ */
+
+GPIO.prototype.watchEdges = function(pins, opts, fn) {
+  if ('function' === typeof opts) fn = opts, opts = {};
+  if (!this._handle) throw new Error('interface not ready');
+  if (this._edges) throw new Error('edges already watched');
+
+  this._handle.eventStart(pins, opts || {}, function(buf) {
+    fn(new EventBatch(buf));
+  });
+
+  this._edges = true;
+  debug('(edges) %j', pins);
+};
+
+/**
+ * #### .unwatchEdges()
+ *
+ * Stop the watcher started by `.watchEdges()`. Edges
+ * not yet delivered are dropped.
+ *
+ * @api public
+ */
+
+GPIO.prototype.unwatchEdges = function() {
+  if (!this._edges) return;
+  if (this._handle) this._handle.eventStop();
+  this._edges = false;
+};
+
+/**
+ * #### .route(rules, [options])
+ *
+ * Forward inputs to outputs natively: a thread in the
+ * binding scans the bank 0 levels and re-evaluates the
+ * rules whenever an input changes, without a trip
+ * through the event loop. Each rule drives one output,
+ * which must already be claimed as an output and cannot
+ * be an input or reset of any rule:
+ *
+ * - `op` {String} `copy`, `invert`, `and`, `or`, `nand`,
+ *   `nor`, `xor`, `latch` (set on `edge` of any input,
+ *   cleared while a `reset` pin is high) or `toggle`
+ *   (flip on `edge` of any input)
+ * - `inputs` {Array|Number} pins 0-31 (one for `copy`
+ *   and `invert`)
+ * - `output` {Number} pin
+ * - `edge` {String} `rising`, `falling` or `both`
+ *   (default: `rising`)
+ * - `reset` {Array|Number} pins, `latch` only
+ *
+ * Options:
+ *
+ * - `rate` {Number} scans per second (default: `1000`).
+ *   `0` scans continuously and keeps a core busy for as
+ *   long as the route runs.
+ *
+ * Until `.unroute()`, the routed outputs refuse
+ * `.write()`, `.writeBuffer()`, `.release()` and
+ * `.bindPin()`, and schedules and programs may not drive
+ * them.
+ *
+ * @param {Array} rules
+ * @param {Object} options
+ * @api public
+ */
+
+GPIO.prototype.route = function(rules, opts) {
+  if (!this._handle) throw new Error('interface not ready');
+  opts = opts || {};
+  var rate = null == opts.rate ? 1000 : opts.rate;
+  this._handle.routeStart(rules.map(routeRule), rate);
+  debug('(route) %d rules', rules.length);
+};
+
+/**
+ * #### .unroute()
+ *
+ * Stop the route engine. Outputs keep their levels.
+ *
+ * @api public
+ */
+
+GPIO.prototype.unroute = function() {
+  if (this._handle) this._handle.routeStop();
+};
+
+/**
+ * #### .getRouteStats()
+ *
+ * Counters of the running route engine: `scans`,
+ * `changes` (scans that saw an input change) and
+ * `writes` (output transitions driven). Returns `null`
+ * when no route is running.
+ *
+ * @return {Object|null}
+ * @api public
+ */
+
+GPIO.prototype.getRouteStats = function() {
+  return this._handle ? this._handle.routeStats() : null;
+};
+
+/**
+ * #### .now()
+ *
+ * Current time on the scheduler's clock, in ns, for
+ * computing `.schedule()` deadlines.
+ *
+ * @return {Number} ns
+ * @api public
+ */
+
+GPIO.prototype.now = function() {
+  if (!this._handle) throw new Error('interface not ready');
+  return this._handle.schedNow();
+};
+
+/**
+ * #### .schedule(writes, [options])
+ *
+ * Queue writes for absolute deadlines on the `.now()`
+ * clock. A native thread fires them from a timer wheel;
+ * writes due in the same microsecond go out as one
+ * register store, the one listed last winning a pin they
+ * disagree on. Pins must already be claimed as outputs;
+ * once a pin is released or routed, the writes still
+ * queued for it are dropped when they fire. Each write is
+ * one of:
+ *
+ * - `{ at, pin, value }`
+ * - `{ at, set, clr }` with `set` and `clr` {Array|Number}
+ *   pins 0-31
+ *
+ * `writes` may also be a Buffer of packed 16 byte records
+ * (double `at`, uint32 set mask, uint32 clear mask, little
+ * endian) to skip the conversion for large batches.
+ *
+ * Options:
+ *
+ * - `capacity` {Number} pending writes the scheduler
+ *   holds, fixed when it first starts (default: `16384`)
+ *
+ * @param {Array|Buffer} writes
+ * @param {Object} options
+ * @return {Array} ids for `.cancel()`
+ * @api public
+ */
+
+GPIO.prototype.schedule = function(writes, opts) {
+  if (!this._handle) throw new Error('interface not ready');
+  opts = opts || {};
+
+  var buf = Buffer.isBuffer(writes) ? writes : packWrites(writes);
+  var ids = this._handle.schedule(buf, opts.capacity);
+  var res = new Array(ids.length / 8);
+
+  for (var i = 0; i < res.length; i++) {
+    res[i] = ids.readDoubleLE(i * 8);
+  }
+
+  return res;
+};
+
+/**
+ * #### .cancel(id)
+ *
+ * Drop a write queued by `.schedule()`.
+ *
+ * @param {Number} id
+ * @return {Boolean} false if it already fired
+ * @api public
+ */
+
+GPIO.prototype.cancel = function(id) {
+  return this._handle ? this._handle.schedCancel(id) : false;
+};
+
+/**
+ * #### .unschedule()
+ *
+ * Stop the scheduler and drop every queued write.
+ *
+ * @api public
+ */
+
+GPIO.prototype.unschedule = function() {
+  if (this._handle) this._handle.schedStop();
+};
+
+/**
+ * #### .getScheduleStats()
+ *
+ * Scheduler counters: `queued`, `fired`, `cancelled`,
+ * `stores` (register writes after merging), `maxLate`
+ * (worst deadline miss in ns) and `pending`. Returns
+ * `null` before the first `.schedule()`.
+ *
+ * @return {Object|null}
+ * @api public
+ */
+
+GPIO.prototype.getScheduleStats = function() {
+  return this._handle ? this._handle.schedStats() : null;
+};
+
 /**
  * #### .createWriteStream(pin)
  *
@@ -158,17 +696,116 @@ GPIO.prototype.createReadStream = function(pin, interval, pull) {
 };
 
 /**
- * #### .createWriteStream(pin)
+ * #### .createWriteStream(pin, [options])
+ *
+ * Options:
+ *
+ * - `period` {Number} ns between values written from a
+ *   Buffer chunk or a buffered batch (default: `0`)
  *
  * @param {Number} pin
+ * @param {Object} options
  * @return {WritableStream}
  * @api public
  */
 
-GPIO.prototype.createWriteStream = function(pin) {
-  return new WritableStream(this, pin);
+GPIO.prototype.createWriteStream = function(pin, opts) {
+  return new WritableStream(this, pin, opts);
 };
 
+/*!
+ * Route ops and edges, in native order.
+ */
+
+var ROUTE_OPS = [ 'copy', 'invert', 'and', 'or', 'nand', 'nor', 'xor', 'latch', 'toggle' ];
+var ROUTE_EDGES = { rising: 1, falling: 2, both: 3 };
+
+/*!
+ * Convert a route rule to its native form, with pin
+ * lists as bank 0 masks.
+ *
+ * @param {Object} rule
+ * @return {Object} native rule
+ * @api private
+ */
+
+function routeRule(rule) {
+  var op = ROUTE_OPS.indexOf(rule.op);
+  if (op === -1) throw new TypeError('unknown route op ' + rule.op);
+
+  return {
+      op: op
+    , inputs: pinMask(rule.inputs)
+    , reset: pinMask(rule.reset)
+    , output: rule.output
+    , edge: ROUTE_EDGES[rule.edge || 'rising'] || 0
+  };
+}
+
+function pinMask(pins) {
+  if (null == pins) return 0;
+  if (!Array.isArray(pins)) pins = [ pins ];
+  return pins.reduce(function(mask, pin) {
+    if (pin < 0 || pin > 31) throw new RangeError('pins must be 0-31');
+    return (mask | (1 << pin)) >>> 0;
+  }, 0);
+}
+
+/*!
+ * Pack scheduled writes into native 16 byte records.
+ *
+ * @param {Array} writes
+ * @return {Buffer}
+ * @api private
+ */
+
+function packWrites(writes) {
+  var buf = new Buffer(writes.length * 16);
+
+  writes.forEach(function(write, i) {
+    var set = pinMask(write.set);
+    var clr = pinMask(write.clr);
+
+    if (null != write.pin) {
+      if (write.value) set = (set | pinMask(write.pin)) >>> 0;
+      else clr = (clr | pinMask(write.pin)) >>> 0;
+    }
+
+    buf.writeDoubleLE(write.at, i * 16);
+    buf.writeUInt32LE(set, i * 16 + 8);
+    buf.writeUInt32LE(clr, i * 16 + 12);
+  });
+
+  return buf;
+}
+
+/*!
+ * Decode a batch of native sampler records (16 bytes:
+ * time ns as low and high uint32, uint32 levels, uint32
+ * changed) and hand each change to its pin's watcher.
+ *
+ * @param {Buffer} batch
+ * @api private
+ */
+
+function sampleDispatch(buf) {
+  var off, time, levels, changed, watchers, pin;
+
+  for (off = 0; off + 16 <= buf.length; off += 16) {
+    // a watcher may stop the sampler mid-batch
+    if (!this._sampler) return;
+    watchers = this._sampler.watchers;
+    time = buf.readUInt32LE(off + 4) * 0x100000000 + buf.readUInt32LE(off);
+    levels = buf.readUInt32LE(off + 8);
+    changed = buf.readUInt32LE(off + 12);
+    for (pin in watchers) {
+      if (changed & (1 << pin) && watchers[pin]) {
+        watchers[pin]((levels >>> pin) & 1, time);
+      }
+    }
+  }
+}
+
 /*!
  * Wrap non-state functions to error if
  * gpio interface not ready.
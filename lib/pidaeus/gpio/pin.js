@@ -0,0 +1,124 @@
+/*!
+ * Primary export
+ */
+
+module.exports = Pin;
+
+/**
+ * ### Pin(gpio, pin, native)
+ *
+ * A claimed pin bound to its native handle, created by
+ * `gpio.pin()`. Calls go straight to the binding: no
+ * interface state check, closures or debug output per
+ * call. The sync methods throw once the pin has been
+ * released; the async ones report errors to `cb`, or
+ * emit `error` on the gpio without one.
+ *
+ * @param {GPIO} gpio
+ * @param {Number} gpio pin
+ * @param {Object} native GPIOPin
+ * @api public
+ */
+
+function Pin(gpio, pin, native) {
+  this.pin = pin;
+  this._gpio = gpio;
+  this._native = native;
+  this._done = done.bind(this);
+}
+
+/**
+ * #### .readSync()
+ *
+ * @return {Number} value
+ * @api public
+ */
+
+Pin.prototype.readSync = function() {
+  return this._native.readSync();
+};
+
+/**
+ * #### .writeSync(value)
+ *
+ * @param {Number} value
+ * @api public
+ */
+
+Pin.prototype.writeSync = function(value) {
+  this._native.writeSync(value);
+};
+
+/**
+ * #### .toggleSync()
+ *
+ * Invert the level last written through this pin.
+ *
+ * @return {Number} new value
+ * @api public
+ */
+
+Pin.prototype.toggleSync = function() {
+  return this._native.toggleSync();
+};
+
+/**
+ * #### .read([callback])
+ *
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @cb {Number} value
+ * @api public
+ */
+
+Pin.prototype.read = function(cb) {
+  this._native.read(cb || this._done);
+};
+
+/**
+ * #### .write(value, [callback])
+ *
+ * @param {Number} value
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+Pin.prototype.write = function(value, cb) {
+  this._native.write(value, cb || this._done);
+};
+
+/**
+ * #### .toggle([callback])
+ *
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+Pin.prototype.toggle = function(cb) {
+  this._native.toggle(cb || this._done);
+};
+
+/**
+ * #### .release([callback])
+ *
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+Pin.prototype.release = function(cb) {
+  this._gpio.release(this.pin, cb);
+};
+
+/*!
+ * Shared callback for async calls made without one.
+ *
+ * @param {Error|null} err
+ * @api private
+ */
+
+function done(err) {
+  if (err) this._gpio.emit('error', err);
+}
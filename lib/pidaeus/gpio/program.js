@@ -0,0 +1,203 @@
+/*!
+ * Primary export
+ */
+
+module.exports = Program;
+
+/*!
+ * Opcodes and record sources, in native order.
+ */
+
+var OPS = Program.OPS = {
+    end: 0
+  , set: 1
+  , clr: 2
+  , write: 3
+  , read: 4
+  , waitEdge: 5
+  , waitLevel: 6
+  , delay: 7
+  , mark: 8
+  , delayUntil: 9
+  , record: 10
+  , load: 11
+  , loop: 12
+  , jump: 13
+  , jumpTimeout: 14
+  , jumpHigh: 15
+  , jumpLow: 16
+};
+
+var SOURCES = { elapsed: 0, event: 1, reg: 2, levels: 3 };
+var EDGES = { rising: 1, falling: 2, both: 3 };
+
+/**
+ * ### Program()
+ *
+ * Assembler for `gpio.runProgram()`. Each method appends
+ * one instruction and returns the program; jump targets
+ * are label names resolved by `.toBuffer()`. Times are
+ * ns except wait timeouts, which are us (0 waits
+ * forever). Pins 0-31 only for `set`, `clr`, `read`.
+ *
+ *     var echo = new Program()
+ *       .write(23, 1).delay(10000).write(23, 0)
+ *       .waitEdge(24, 'rising', 30000).jumpTimeout('done')
+ *       .mark(true)
+ *       .waitEdge(24, 'falling', 30000).record('event')
+ *       .label('done');
+ *
+ * @api public
+ */
+
+function Program() {
+  this._code = [];
+  this._labels = {};
+}
+
+Program.prototype._op = function(op, a, b, arg) {
+  this._code.push([ OPS[op], a || 0, b || 0, arg || 0 ]);
+  return this;
+};
+
+Program.prototype.label = function(name) {
+  this._labels[name] = this._code.length;
+  return this;
+};
+
+Program.prototype.end = function() {
+  return this._op('end');
+};
+
+Program.prototype.set = function(mask) {
+  return this._op('set', 0, 0, mask);
+};
+
+Program.prototype.clr = function(mask) {
+  return this._op('clr', 0, 0, mask);
+};
+
+Program.prototype.write = function(pin, value) {
+  return this._op('write', pin, 0, value ? 1 : 0);
+};
+
+Program.prototype.read = function(reg, mask) {
+  return this._op('read', reg, 0, mask);
+};
+
+Program.prototype.waitEdge = function(pin, edge, timeout) {
+  edge = edge || 'both';
+  if (!EDGES.hasOwnProperty(edge)) throw new Error('unknown edge ' + edge);
+  return this._op('waitEdge', pin, EDGES[edge], timeout);
+};
+
+Program.prototype.waitLevel = function(pin, value, timeout) {
+  return this._op('waitLevel', pin, value ? 1 : 0, timeout);
+};
+
+Program.prototype.delay = function(ns) {
+  return this._op('delay', 0, 0, ns);
+};
+
+/**
+ * #### .mark([event])
+ *
+ * Restart the clock used by `delayUntil` and `record`,
+ * at now or at the last wait's event.
+ *
+ * @param {Boolean} from the last event
+ * @api public
+ */
+
+Program.prototype.mark = function(event) {
+  return this._op('mark', 0, event ? 1 : 0);
+};
+
+Program.prototype.delayUntil = function(ns) {
+  return this._op('delayUntil', 0, 0, ns);
+};
+
+/**
+ * #### .record(source, [reg])
+ *
+ * Append a value to the results: `elapsed` (ns since
+ * mark), `event` (ns from mark to the last wait's
+ * event), `reg` (register `reg`) or `levels` (bank 0).
+ *
+ * @param {String} source
+ * @param {Number} register
+ * @api public
+ */
+
+Program.prototype.record = function(source, reg) {
+  if (!SOURCES.hasOwnProperty(source)) throw new Error('unknown record source ' + source);
+  return this._op('record', reg, SOURCES[source]);
+};
+
+Program.prototype.load = function(reg, value) {
+  return this._op('load', reg, 0, value);
+};
+
+/**
+ * #### .loop(reg, label)
+ *
+ * Decrement register `reg` and jump to `label` unless
+ * it reached zero. A register already at zero does not
+ * jump.
+ *
+ * @param {Number} register
+ * @param {String} label
+ * @api public
+ */
+
+Program.prototype.loop = function(reg, label) {
+  return this._op('loop', reg, 0, label);
+};
+
+Program.prototype.jump = function(label) {
+  return this._op('jump', 0, 0, label);
+};
+
+Program.prototype.jumpTimeout = function(label) {
+  return this._op('jumpTimeout', 0, 0, label);
+};
+
+Program.prototype.jumpHigh = function(pin, label) {
+  return this._op('jumpHigh', pin, 0, label);
+};
+
+Program.prototype.jumpLow = function(pin, label) {
+  return this._op('jumpLow', pin, 0, label);
+};
+
+/**
+ * #### .toBuffer()
+ *
+ * Encode as 8 byte instructions (op, a, b as uint16,
+ * arg as uint32, little endian), resolving labels.
+ *
+ * @return {Buffer}
+ * @api public
+ */
+
+Program.prototype.toBuffer = function() {
+  var code = this._code;
+  var buf = new Buffer(Math.max(code.length, 1) * 8);
+  var labels = this._labels;
+
+  buf.fill(0);
+  code.forEach(function(insn, i) {
+    var arg = insn[3];
+    if ('string' === typeof arg) {
+      if (!(arg in labels)) throw new Error('unknown label ' + arg);
+      arg = labels[arg];
+    }
+
+    buf.writeUInt8(insn[0], i * 8);
+    buf.writeUInt8(insn[1], i * 8 + 1);
+    buf.writeUInt16LE(insn[2], i * 8 + 2);
+    buf.writeUInt32LE(arg >>> 0, i * 8 + 4);
+  });
+
+  return buf;
+};
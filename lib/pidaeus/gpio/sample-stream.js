@@ -0,0 +1,193 @@
+/*!
+ * External dependencies
+ */
+
+var debug = require('sherlock')('pidaeus:gpio:sample');
+var inherits = require('util').inherits;
+var ReadableStream = require('stream').Readable;
+
+/*!
+ * Primary export
+ */
+
+module.exports = Sample;
+
+/**
+ * ### Sample(gpio, pin, pull)
+ *
+ * Create a readable stream that emits the
+ * pin's current value once claimed, then each
+ * change seen by the native sampler. No JS timer
+ * runs per stream.
+ *
+ * @param {GPIO} gpio
+ * @param {Number} gpio pin
+ * @param {Number} pull option (default: `0`)
+ * @api public
+ */
+
+function Sample(gpio, pin, pull) {
+  ReadableStream.call(this, { objectMode: true });
+  this._claimed = false;
+  this._claiming = false;
+  this._finished = false;
+  this._gpio = gpio;
+  this._options = { direction: 0 , pull: pull || 0 };
+  this._pin = pin;
+  this._value = null;
+
+  if ('ready' !== gpio._state.state) {
+    gpio.once('ready', this._claim.bind(this));
+  } else {
+    this._claim();
+  }
+}
+
+/*!
+ * Inherits ReadableStream
+ */
+
+inherits(Sample, ReadableStream);
+
+/**
+ * #### .close([cb])
+ *
+ * Stop sampling and release the pin.
+ *
+ * @param {Function} callback
+ * @cb {Error|null} if error
+ * @api public
+ */
+
+Sample.prototype.close = function(cb) {
+  var self = this;
+
+  function success() {
+    self.removeListener('error', error);
+    cb();
+  }
+
+  function error(err) {
+    self.removeListener('close', success);
+    cb(err);
+  }
+
+  if (cb && 'function' === typeof cb) {
+    self.once('close', success);
+    self.once('error', error);
+  }
+
+  this._finish();
+};
+
+/*!
+ * ReadableStream `._read()` implementation. Values
+ * are pushed as the sampler reports them.
+ *
+ * @api private
+ */
+
+Sample.prototype._read = function() {};
+
+/*!
+ * Push a value unless it repeats the last one.
+ *
+ * @param {Number} value
+ * @api private
+ */
+
+Sample.prototype._change = function(value) {
+  if (this._finished || value === this._value) return;
+  debug('(change) [%d] %d', this._pin, value);
+  this._value = value;
+  this.push(value);
+};
+
+/*!
+ * Claim the pin, push its current value and start
+ * receiving changes.
+ *
+ * @api private
+ */
+
+Sample.prototype._claim = function() {
+  var self = this;
+  var gpio = this._gpio;
+  var pin = this._pin;
+
+  if (this._finished) return;
+
+  debug('(claim) [%d]', pin);
+  this._claiming = true;
+  gpio.claim(pin, this._options, function(err) {
+    self._claiming = false;
+    if (err) return self.emit('error', err);
+
+    // closed while the claim was in flight
+    if (self._finished) return self._release();
+
+    try {
+      gpio._sampleWatch(pin, self._change.bind(self));
+    } catch (ex) {
+      return self._release(ex);
+    }
+
+    self._claimed = true;
+    gpio.once('close', self._onclose = function() {
+      self._claimed = false;
+      self._finish();
+    });
+
+    self.emit('claim');
+    gpio.read(pin, function(err, value) {
+      if (err) return self.emit('error', err);
+      self._change(value);
+    });
+  });
+};
+
+/*!
+ * End the stream, releasing the pin if it is held.
+ *
+ * @api private
+ */
+
+Sample.prototype._finish = function() {
+  var self = this;
+
+  if (this._finished) return;
+  this._finished = true;
+  this.push(null);
+
+  if (this._onclose) this._gpio.removeListener('close', this._onclose);
+
+  if (this._claimed) {
+    this._claimed = false;
+    this._gpio._sampleUnwatch(this._pin);
+    this._release();
+  } else if (!this._claiming) {
+    setImmediate(function() {
+      self.emit('close');
+    });
+  }
+};
+
+/*!
+ * Release the pin then emit `release` and `close`,
+ * or `error` if `err` is given or the release fails.
+ *
+ * @param {Error} error to report after release
+ * @api private
+ */
+
+Sample.prototype._release = function(err) {
+  var self = this;
+  var pin = this._pin;
+
+  debug('(release) [%d]', pin);
+  this._gpio.release(pin, function(rerr) {
+    if (err || rerr) return self.emit('error', err || rerr);
+    self.emit('release');
+    self.emit('close');
+  });
+};
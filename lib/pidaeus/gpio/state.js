@@ -44,8 +44,10 @@ State.method('setup', {
 function setup(ev, cb) {
   var self = this;
   var handle = new Binding;
-  handle.setup(function(err) {
+  var opts = this._options || {};
+  handle.setup(opts, function(err) {
     if (err) return cb(err);
+    if (opts.stats) handle.setStatsEnabled(true);
     self._handle = handle;
     cb();
   });
@@ -81,6 +83,8 @@ function teardown(ev, cb) {
   handle.teardown(function(err) {
     delete self._handle;
     self._handle = null;
+    self._sampler = null;
+    self._edges = false;
     if (err) return cb(err);
     cb();
   });
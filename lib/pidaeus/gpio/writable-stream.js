@@ -13,21 +13,32 @@ var WritableStream = require('stream').Writable;
 module.exports = Writable;
 
 /**
- * ### Writable(gpio, pin)
+ * ### Writable(gpio, pin, [options])
  *
  * Create a writable stream that writes
- * data to pin.
+ * data to pin. Number chunks are single values;
+ * a Buffer chunk is a sequence of values, one per
+ * byte. Chunks that queue up while a write is in
+ * flight are sent together in one native call.
+ *
+ * Options:
+ *
+ * - `period` {Number} ns between values of a
+ *   Buffer chunk or batch (default: `0`)
  *
  * @param {GPIO} gpio
  * @param {Number} gpio pin
+ * @param {Object} options
  * @api public
  */
 
-function Writable(gpio, pin) {
+function Writable(gpio, pin, opts) {
+  opts = opts || {};
   WritableStream.call(this, { objectMode: true });
   this._claimed = false;
   this._gpio = gpio;
   this._pin = pin;
+  this._period = opts.period || 0;
 }
 
 /*!
@@ -46,23 +57,83 @@ inherits(Writable, WritableStream);
  */
 
 Writable.prototype._write = function(chunk, enc, cb) {
-  var self = this;
   var gpio = this._gpio;
   var pin = this._pin;
+  var period = this._period;
+
+  this._ready(function write(err) {
+    if (err) return cb(err);
+    if (Buffer.isBuffer(chunk)) {
+      debug('(write) [%d] %d values', pin, chunk.length);
+      gpio.writeBuffer(pin, chunk, period, cb);
+    } else {
+      debug('(write) [%d] %d', pin, chunk);
+      gpio.write(pin, value(chunk), cb);
+    }
+  });
+};
 
-  function write() {
-    debug('(write) [%d] %d', pin, chunk);
-    gpio.write(pin, chunk, cb);
+/*!
+ * WritableStream `._writev()` implementation. Flattens
+ * the buffered chunks into one value Buffer, converting
+ * each as `._write()` would.
+ *
+ * @param {Array} chunks `{ chunk, encoding }`
+ * @param {Function} callback
+ * @api private
+ */
+
+Writable.prototype._writev = function(chunks, cb) {
+  var gpio = this._gpio;
+  var pin = this._pin;
+  var period = this._period;
+  var len = 0;
+  var buf, chunk, i, pos;
+
+  for (i = 0; i < chunks.length; i++) {
+    chunk = chunks[i].chunk;
+    len += Buffer.isBuffer(chunk) ? chunk.length : 1;
   }
 
+  buf = new Buffer(len);
+  for (i = 0, pos = 0; i < chunks.length; i++) {
+    chunk = chunks[i].chunk;
+    if (Buffer.isBuffer(chunk)) {
+      chunk.copy(buf, pos);
+      pos += chunk.length;
+    } else {
+      buf[pos++] = value(chunk);
+    }
+  }
+
+  this._ready(function write(err) {
+    if (err) return cb(err);
+    debug('(writev) [%d] %d values', pin, len);
+    gpio.writeBuffer(pin, buf, period, cb);
+  });
+};
+
+/*!
+ * Invoke `fn` once the interface is ready and
+ * the pin is claimed for output.
+ *
+ * @param {Function} callback
+ * @api private
+ */
+
+Writable.prototype._ready = function(fn) {
+  var self = this;
+  var gpio = this._gpio;
+  var pin = this._pin;
+
   function claim() {
     debug('(claim) [%d]', pin);
     gpio.claim(pin, { direction: 1 }, function(err) {
-      if (err) return cb(err);
+      if (err) return fn(err);
       self._claimed = true;
       self.once('finish', self.onfinish.bind(self));
       self.emit('claim');
-      write();
+      fn();
     });
   }
 
@@ -72,7 +143,7 @@ Writable.prototype._write = function(chunk, enc, cb) {
   } else if (!this._claimed) {
     claim();
   } else {
-    write();
+    fn();
   }
 };
 
@@ -96,3 +167,17 @@ Writable.prototype.onfinish = function() {
     self.emit('release');
   });
 };
+
+/*!
+ * Level of a non-Buffer chunk, converted as the native
+ * write converts its value (to int32, non-zero is high)
+ * so batched and single writes agree.
+ *
+ * @param {Mixed} chunk
+ * @return {Number} 0 or 1
+ * @api private
+ */
+
+function value(chunk) {
+  return (chunk | 0) !== 0 ? 1 : 0;
+}
@@ -3,10 +3,14 @@
  * External Includes
  */
 
+#include <errno.h>
+#include <sched.h>
 #include <v8.h>
 #include <node.h>
+#include <node_buffer.h>
 #include <string.h>
 #include <sstream>
+#include <vector>
 
 /*!
  * Source controlled includes
@@ -20,6 +24,7 @@
  */
 
 #include "gpio_async.h"
+#include "gpio_pin.h"
 
 /*!
  * Start namespace
@@ -52,6 +57,7 @@ GPIO::Init() {
   NanAssignPersistent(v8::FunctionTemplate, constructor, tpl);
   tpl->InstanceTemplate()->SetInternalFieldCount(1);
   tpl->SetClassName(NanSymbol("GPIO"));
+  GPIOPin::Init();
 
   // Prototype (Methods)
   NODE_SET_PROTOTYPE_METHOD(tpl, "setup", GPIO::Setup);
@@ -60,6 +66,28 @@ GPIO::Init() {
   NODE_SET_PROTOTYPE_METHOD(tpl, "release", GPIO::PinRelease);
   NODE_SET_PROTOTYPE_METHOD(tpl, "read", GPIO::PinRead);
   NODE_SET_PROTOTYPE_METHOD(tpl, "write", GPIO::PinWrite);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "writeBuffer", GPIO::PinWriteBuffer);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "pwm", GPIO::PinPwm);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "bindPin", GPIO::BindPin);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "runProgram", GPIO::RunProgram);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getStats", GPIO::GetStats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setStatsEnabled", GPIO::SetStatsEnabled);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "resetStats", GPIO::ResetStats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getRealtimeStatus", GPIO::GetRealtimeStatus);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getBoard", GPIO::GetBoard);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "sampleStart", GPIO::SampleStart);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "sampleMask", GPIO::SampleMask);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "sampleStop", GPIO::SampleStop);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "eventStart", GPIO::EventStart);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "eventStop", GPIO::EventStop);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "routeStart", GPIO::RouteStart);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "routeStop", GPIO::RouteStop);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "routeStats", GPIO::RouteStats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "schedNow", GPIO::SchedNow);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "schedule", GPIO::Schedule);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "schedCancel", GPIO::SchedCancel);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "schedStop", GPIO::SchedStop);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "schedStats", GPIO::SchedStats);
 }
 
 /**
@@ -85,15 +113,79 @@ NAN_METHOD(GPIO::New) {
   NanReturnValue(args.This());
 }
 
+/*!
+ * Read the `realtime` setup option into a libpi config.
+ * `cpus` is an array of cpu numbers.
+ */
+
+static void
+RealtimeOption(v8::Local<v8::Object> optionsObj, pi_rt_config_t *rt) {
+  memset(rt, 0, sizeof(pi_rt_config_t));
+  if (optionsObj.IsEmpty() || !optionsObj->Has(NanSymbol("realtime"))) return;
+
+  v8::Local<v8::Value> value = optionsObj->Get(NanSymbol("realtime"));
+  if (!value->IsObject()) return;
+  v8::Local<v8::Object> rtObj = value.As<v8::Object>();
+
+  rt->priority = NanUInt32OptionValue(rtObj, NanSymbol("priority"), 0);
+  rt->lock_memory = NanBooleanOptionValue(rtObj, NanSymbol("lockMemory"), false);
+  rt->prefault_stack = NanUInt32OptionValue(rtObj, NanSymbol("prefaultStack"), 0);
+
+  v8::Local<v8::Value> cpus = rtObj->Get(NanSymbol("cpus"));
+  if (cpus->IsArray()) {
+    v8::Local<v8::Array> list = cpus.As<v8::Array>();
+    for (uint32_t i = 0; i < list->Length(); i++) {
+      uint32_t cpu = list->Get(i)->Uint32Value();
+      if (cpu < 32) rt->cpus |= 1u << cpu;
+    }
+  }
+}
+
 /**
  * Initialize the GPIO interface asyncronously.
  */
 
 NAN_METHOD(GPIO::Setup) {
   NanScope();
-  PI_GPIO_SETUP_COMMON(setup, -1, 0)
-  SetupWorker* worker = new SetupWorker(gpio, new NanCallback(callback));
-  NanAsyncQueueWorker(worker);
+  PI_GPIO_SETUP_COMMON(setup, 0, 1)
+
+  bool simulate = NanBooleanOptionValue(
+      optionsObj
+    , NanSymbol("simulate")
+    , false
+  );
+
+  bool thread = NanBooleanOptionValue(
+      optionsObj
+    , NanSymbol("thread")
+    , false
+  );
+
+  uint32_t queueSize = NanUInt32OptionValue(
+      optionsObj
+    , NanSymbol("queueSize")
+    , PI_GPIO_QUEUE_SIZE
+  );
+
+  pi_rt_config_t rt;
+  RealtimeOption(optionsObj, &rt);
+
+  if (thread && gpio->queue == NULL) {
+    gpio->queue = new GPIOQueue(queueSize);
+    if (gpio->queue->Start() < 0) {
+      gpio->queue = NULL;
+      return NanThrowError("setup() could not start gpio thread");
+    }
+  }
+
+  SetupWorker* worker = new SetupWorker(
+      gpio
+    , new NanCallback(callback)
+    , simulate
+    , rt
+  );
+
+  PI_GPIO_DISPATCH(setup, worker)
   NanReturnUndefined();
 }
 
@@ -102,16 +194,34 @@ NAN_METHOD(GPIO::Setup) {
  */
 
 GPIOStatus*
-GPIO::NativeSetup() {
+GPIO::NativeSetup(bool simulate, const pi_rt_config_t &rt) {
   GPIOStatus *status = new GPIOStatus();
   status->success = true;
 
   if (active == false) {
-    if (0 > pi_gpio_setup(closure)) {
+    int res = simulate
+      ? pi_gpio_setup_sim(closure)
+      : pi_gpio_setup(closure);
+
+    if (0 > res) {
       status->success = false;
       status->msg = "gpio setup failed: do you have permissions";
     } else {
       active = true;
+      pi_closure_set_rt(closure, &rt);
+
+      // scheduling applies to the dedicated I/O thread we are
+      // running on; threadpool threads are shared so only the
+      // process-wide memory lock is taken without one
+      if (queue != NULL) {
+        pi_closure_rt_apply(closure);
+      } else if (rt.lock_memory) {
+        pi_rt_config_t lock;
+        memset(&lock, 0, sizeof(lock));
+        lock.lock_memory = 1;
+        int res = pi_rt_apply(&lock);
+        if (res) __sync_fetch_and_or(&closure->rt_status, res);
+      }
     }
   }
 
@@ -125,8 +235,22 @@ GPIO::NativeSetup() {
 NAN_METHOD(GPIO::Teardown) {
   NanScope();
   PI_GPIO_SETUP_COMMON(teardown, -1, 0)
+  gpio->StopSampler();
+  gpio->StopPump();
+  gpio->StopRoute();
+  gpio->StopScheduler();
+  gpio->StopProgram();
   TeardownWorker* worker = new TeardownWorker(gpio, new NanCallback(callback));
-  NanAsyncQueueWorker(worker);
+
+  // a program on the threadpool may still be between its
+  // stop checks; unmap only once its worker is done
+  if (gpio->queue == NULL && gpio->program != NULL) {
+    gpio->teardowns.push_back(worker);
+    NanReturnUndefined();
+  }
+
+  PI_GPIO_DISPATCH(teardown, worker)
+  gpio->StopQueue();
   NanReturnUndefined();
 }
 
@@ -141,10 +265,9 @@ GPIO::NativeTeardown() {
 
   if (active != false) {
     for (int i = 0; i < PI_MAX_PINS; i++) {
-      if (pins[i] != NULL) {
-        pi_gpio_release(pins[i]);
-        pins[i] = NULL;
-      }
+      pi_gpio_handle_t *handle = pins[i];
+      if (handle == NULL || handle == PI_GPIO_PIN_CLAIMING) continue;
+      ReleaseHandle(i, handle);
     }
 
     pi_gpio_teardown(closure);
@@ -180,11 +303,11 @@ NAN_METHOD(GPIO::PinClaim) {
       gpio
     , new NanCallback(callback)
     , gpioPin
-    , static_cast<pi_gpio_direction_t>(gpioDirection)
+    , static_cast<pi_gpio_mode_t>(gpioDirection)
     , static_cast<pi_gpio_pull_t>(gpioPull)
   );
 
-  NanAsyncQueueWorker(worker);
+  PI_GPIO_DISPATCH(claim, worker)
   NanReturnUndefined();
 }
 
@@ -195,11 +318,30 @@ NAN_METHOD(GPIO::PinClaim) {
 GPIOStatus*
 GPIO::NativePinClaim(
     pi_gpio_pin_t pin
-  , pi_gpio_direction_t direction
+  , pi_gpio_mode_t direction
   , pi_gpio_pull_t pull)
 {
   PI_GPIO_SETUP_NATIVE(claim)
 
+  if (pin >= PI_MAX_PINS) {
+    std::stringstream msg;
+    msg << "pin " << pin << " is out of range";
+    status->success = false;
+    status->msg = msg.str();
+    return status;
+  }
+
+  // reserve the slot before touching registers
+  if (!__sync_bool_compare_and_swap(&pins[pin], NULL, PI_GPIO_PIN_CLAIMING)) {
+    std::stringstream msg;
+    msg << "pin " << pin << " is already claimed";
+    status->success = false;
+    status->msg = msg.str();
+    return status;
+  }
+
+  __sync_fetch_and_add(&generations[pin], 1);
+
   pi_gpio_handle_t *handle = pi_gpio_claim_with_args(
       closure
     , pin
@@ -207,7 +349,16 @@ GPIO::NativePinClaim(
     , pull
   );
 
+  __sync_synchronize();
   pins[pin] = handle;
+
+  if (handle == NULL) {
+    std::stringstream msg;
+    msg << "pin " << pin << " could not be claimed";
+    status->success = false;
+    status->msg = msg.str();
+  }
+
   return status;
 }
 
@@ -220,6 +371,7 @@ NAN_METHOD(GPIO::PinRelease) {
   PI_GPIO_SETUP_COMMON(release, -1, 1)
 
   pi_gpio_pin_t gpioPin = args[0]->Int32Value();
+  PI_GPIO_UNROUTED(release, gpioPin)
 
   PinReleaseWorker* worker = new PinReleaseWorker(
       gpio
@@ -227,7 +379,7 @@ NAN_METHOD(GPIO::PinRelease) {
     , gpioPin
   );
 
-  NanAsyncQueueWorker(worker);
+  PI_GPIO_DISPATCH(release, worker)
   NanReturnUndefined();
 }
 
@@ -238,11 +390,18 @@ NAN_METHOD(GPIO::PinRelease) {
 GPIOStatus*
 GPIO::NativePinRelease(pi_gpio_pin_t pin) {
   PI_GPIO_SETUP_NATIVE(release)
-  PI_GPIO_PIN_HANDLE_NATIVE(pin)
 
-  pi_gpio_release(handle);
-  pins[pin] = NULL;
+  // not a use: release waits for those to end
+  pi_gpio_handle_t *handle = pin < PI_MAX_PINS ? pins[pin] : NULL;
+  if (handle == NULL || handle == PI_GPIO_PIN_CLAIMING) {
+    std::stringstream msg;
+    msg << "pin " << pin << " has not been claimed";
+    status->success = false;
+    status->msg = msg.str();
+    return status;
+  }
 
+  ReleaseHandle(pin, handle);
   return status;
 }
 
@@ -262,7 +421,7 @@ NAN_METHOD(GPIO::PinRead) {
     , pin
   );
 
-  NanAsyncQueueWorker(worker);
+  PI_GPIO_DISPATCH(read, worker)
   NanReturnUndefined();
 }
 
@@ -271,13 +430,19 @@ NAN_METHOD(GPIO::PinRead) {
  */
 
 GPIOStatus*
-GPIO::NativePinRead(pi_gpio_pin_t pin, pi_gpio_value_t& value) {
-  PI_GPIO_SETUP_NATIVE(write)
+GPIO::NativePinRead(
+    pi_gpio_pin_t pin
+  , pi_gpio_value_t& value
+  , pi_gpio_handle_t *bound
+  , uint32_t generation
+) {
+  PI_GPIO_SETUP_NATIVE(read)
   PI_GPIO_PIN_HANDLE_NATIVE(pin)
+  PI_GPIO_PIN_BOUND_NATIVE(pin, bound, generation)
 
-  pi_gpio_direction_t direction = pi_gpio_get_direction(handle);
+  pi_gpio_mode_t direction = pi_gpio_get_mode(handle);
 
-  if (direction != PI_DIR_IN) {
+  if (direction != PI_GPIO_MODE_INPUT) {
     std::stringstream msg;
     msg << "pin " << pin << " is not readable";
     status->success = false;
@@ -299,6 +464,7 @@ NAN_METHOD(GPIO::PinWrite) {
   PI_GPIO_SETUP_COMMON(write, -1, 2)
 
   pi_gpio_pin_t pin = args[0]->Int32Value();
+  PI_GPIO_UNROUTED(write, pin)
   pi_gpio_value_t value;
 
   // TODO: error if not 0 or 1
@@ -318,7 +484,7 @@ NAN_METHOD(GPIO::PinWrite) {
     , value
   );
 
-  NanAsyncQueueWorker(worker);
+  PI_GPIO_DISPATCH(write, worker)
   NanReturnUndefined();
 }
 
@@ -327,13 +493,19 @@ NAN_METHOD(GPIO::PinWrite) {
  */
 
 GPIOStatus*
-GPIO::NativePinWrite(pi_gpio_pin_t pin, pi_gpio_value_t value) {
+GPIO::NativePinWrite(
+    pi_gpio_pin_t pin
+  , pi_gpio_value_t value
+  , pi_gpio_handle_t *bound
+  , uint32_t generation
+) {
   PI_GPIO_SETUP_NATIVE(write)
   PI_GPIO_PIN_HANDLE_NATIVE(pin)
+  PI_GPIO_PIN_BOUND_NATIVE(pin, bound, generation)
 
-  pi_gpio_direction_t direction = pi_gpio_get_direction(handle);
+  pi_gpio_mode_t direction = pi_gpio_get_mode(handle);
 
-  if (direction != PI_DIR_OUT) {
+  if (direction != PI_GPIO_MODE_OUTPUT) {
     std::stringstream msg;
     msg << "pin " << pin << " is not writable";
     status->success = false;
@@ -346,16 +518,916 @@ GPIO::NativePinWrite(pi_gpio_pin_t pin, pi_gpio_value_t value) {
   return status;
 }
 
+/**
+ * Write a Buffer of pin values asyncronously in a single
+ * native call. Each byte is a value (non-zero is high);
+ * `period` is the spacing between them in nanoseconds.
+ */
+
+NAN_METHOD(GPIO::PinWriteBuffer) {
+  NanScope();
+  PI_GPIO_SETUP_COMMON(writeBuffer, -1, 3)
+
+  pi_gpio_pin_t pin = args[0]->Int32Value();
+  PI_GPIO_UNROUTED(writeBuffer, pin)
+
+  if (!node::Buffer::HasInstance(args[1])) {
+    return NanThrowError("writeBuffer() requires a buffer argument");
+  }
+
+  v8::Local<v8::Object> buffer = args[1]->ToObject();
+  double period = args[2]->NumberValue();
+
+  PinWriteBufferWorker* worker = new PinWriteBufferWorker(
+      gpio
+    , new NanCallback(callback)
+    , pin
+    , (const uint8_t*) node::Buffer::Data(buffer)
+    , node::Buffer::Length(buffer)
+    , period > 0 ? (uint64_t) period : 0
+  );
+
+  PI_GPIO_DISPATCH(writeBuffer, worker)
+  NanReturnUndefined();
+}
+
+/**
+ * Worker handle for write pin buffer.
+ */
+
+GPIOStatus*
+GPIO::NativePinWriteBuffer(
+    pi_gpio_pin_t pin
+  , const uint8_t *values
+  , size_t length
+  , uint64_t period
+) {
+  PI_GPIO_SETUP_NATIVE(writeBuffer)
+  PI_GPIO_PIN_HANDLE_NATIVE(pin)
+
+  if (pi_gpio_get_mode(handle) != PI_GPIO_MODE_OUTPUT) {
+    std::stringstream msg;
+    msg << "pin " << pin << " is not writable";
+    status->success = false;
+    status->msg = msg.str();
+    return status;
+  }
+
+  if (length) pi_gpio_write_sequence(handle, values, length, period);
+
+  return status;
+}
+
+/**
+ * Drive a pin from the hardware pwm asyncronously.
+ */
+
+NAN_METHOD(GPIO::PinPwm) {
+  NanScope();
+  PI_GPIO_SETUP_COMMON(pwm, -1, 3)
+
+  PinPwmWorker* worker = new PinPwmWorker(
+      gpio
+    , new NanCallback(callback)
+    , args[0]->Int32Value()
+    , args[1]->NumberValue()
+    , args[2]->NumberValue()
+  );
+
+  PI_GPIO_DISPATCH(pwm, worker)
+  NanReturnUndefined();
+}
+
+/**
+ * Worker handle for pwm. The first call for a pin maps
+ * the pwm registers and claims the pin for its pwm
+ * function; later calls only retune the channel.
+ */
+
+GPIOStatus*
+GPIO::NativePinPwm(pi_gpio_pin_t pin, double frequency, double duty) {
+  PI_GPIO_SETUP_NATIVE(pwm)
+
+  if (pin >= PI_MAX_PINS || pi_pwm_channel(pin) < 0) {
+    std::stringstream msg;
+    msg << "pin " << pin << " has no pwm function";
+    status->success = false;
+    status->msg = msg.str();
+    return status;
+  }
+
+  if (pi_pwm_setup(closure) != 0) {
+    status->success = false;
+    status->msg = "pwm registers could not be mapped";
+    return status;
+  }
+
+  if (__sync_bool_compare_and_swap(&pins[pin], NULL, PI_GPIO_PIN_CLAIMING)) {
+    __sync_fetch_and_add(&generations[pin], 1);
+    pi_gpio_handle_t *claimed = pi_pwm_claim(closure, pin);
+    __sync_synchronize();
+    pins[pin] = claimed;
+  }
+
+  GPIOPinUse use(this, pin);
+  pi_gpio_handle_t *handle = use.handle;
+
+  if (handle == NULL) {
+    std::stringstream msg;
+    msg << "pin " << pin << " could not be claimed";
+    status->success = false;
+    status->msg = msg.str();
+    return status;
+  }
+
+  if (handle->method != PI_GPIO_METHOD_PWM) {
+    std::stringstream msg;
+    msg << "pin " << pin << " is claimed as gpio";
+    status->success = false;
+    status->msg = msg.str();
+    return status;
+  }
+
+  if (pi_pwm_set_frequency(closure, pi_pwm_channel(pin), frequency, duty) != 0) {
+    std::stringstream msg;
+    msg << "pin " << pin << " cannot run at " << frequency
+        << "Hz with duty " << duty;
+    status->success = false;
+    status->msg = msg.str();
+  }
+
+  return status;
+}
+
+/**
+ * Run a bytecode program (a Buffer of 8 byte
+ * instructions: op, a, b as uint16, arg as uint32, little
+ * endian) on the I/O thread. Every pin it sets, clears
+ * or writes must be claimed as an output. The callback
+ * receives a Buffer of the recorded values as doubles.
+ * One program runs at a time per instance.
+ */
+
+NAN_METHOD(GPIO::RunProgram) {
+  NanScope();
+  PI_GPIO_SETUP_COMMON(runProgram, 1, 2)
+
+  if (!node::Buffer::HasInstance(args[0])) {
+    return NanThrowError("runProgram() requires a Buffer of instructions");
+  }
+
+  const char *data = node::Buffer::Data(args[0]);
+  size_t length = node::Buffer::Length(args[0]);
+
+  if (length == 0 || length % 8 != 0) {
+    return NanThrowError("runProgram() instructions must be 8 bytes each");
+  }
+
+  uint32_t maxRecords = NanUInt32OptionValue(
+      optionsObj
+    , NanSymbol("maxRecords")
+    , 1024
+  );
+
+  uint32_t outputs = gpio->OutputMask();
+  std::vector<pi_prog_insn_t> code(length / 8);
+  for (size_t i = 0; i < code.size(); i++) {
+    const uint8_t *insn = reinterpret_cast<const uint8_t*>(data) + i * 8;
+    code[i].op = insn[0];
+    code[i].a = insn[1];
+    code[i].b = insn[2] | insn[3] << 8;
+    code[i].arg = insn[4] | insn[5] << 8 | insn[6] << 16 | (uint32_t) insn[7] << 24;
+
+    // writes are held to claimed outputs, as for routes
+    bool denied = false;
+    switch (code[i].op) {
+      case PI_PROG_SET:
+      case PI_PROG_CLR:
+        denied = code[i].b != 0 ? code[i].arg != 0 : (code[i].arg & ~outputs) != 0;
+        break;
+      case PI_PROG_WRITE:
+        denied = code[i].a >= 32 || !(outputs & (1u << code[i].a));
+        break;
+    }
+
+    if (denied) {
+      std::stringstream msg;
+      msg << "runProgram() instruction " << i << " writes pins not claimed as outputs";
+      return NanThrowError(msg.str().c_str());
+    }
+  }
+
+  pi_program_t *program = pi_program_new(gpio->closure, &code[0], code.size(), maxRecords);
+  if (program == NULL) {
+    return NanThrowError("runProgram() invalid program");
+  }
+
+  if (!__sync_bool_compare_and_swap(&gpio->program, NULL, program)) {
+    pi_program_delete(program);
+    return NanThrowError("runProgram() a program is already running");
+  }
+
+  // and held there while it runs, see SchedOutputs()
+  pi_program_set_outputs(program, 0, outputs);
+  pi_program_set_outputs(program, 1, 0);
+
+  ProgramWorker* worker = new ProgramWorker(
+      gpio
+    , new NanCallback(callback)
+    , program
+  );
+
+  PI_GPIO_DISPATCH(runProgram, worker)
+  NanReturnUndefined();
+}
+
+/**
+ * Worker handle for program runs.
+ */
+
+GPIOStatus*
+GPIO::NativeRunProgram(pi_program_t *program) {
+  PI_GPIO_SETUP_NATIVE(runProgram)
+
+  if (pi_program_run(program) < 0) {
+    status->success = false;
+    status->msg = errno == ECANCELED
+      ? "runProgram() stopped"
+      : errno == ENOBUFS
+        ? "runProgram() record buffer full"
+        : "runProgram() could not run";
+  }
+
+  return status;
+}
+
+/**
+ * Snapshot of operation counters and latency
+ * histograms. Synchronous.
+ */
+
+NAN_METHOD(GPIO::GetStats) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  NanReturnValue(gpio->stats.ToObject());
+}
+
+/**
+ * Turn stats collection on or off. Synchronous.
+ */
+
+NAN_METHOD(GPIO::SetStatsEnabled) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  gpio->stats.enabled = args[0]->BooleanValue();
+  NanReturnUndefined();
+}
+
+/**
+ * Report which parts of the `realtime` setup option took
+ * effect. Each field is `true` when applied, `false` when
+ * refused and `null` when not requested. Synchronous.
+ */
+
+static v8::Local<v8::Value>
+RealtimeField(bool requested, int status, int flag) {
+  if (!requested) return v8::Local<v8::Value>::New(v8::Null());
+  return v8::Local<v8::Value>::New(v8::Boolean::New(!(status & flag)));
+}
+
+NAN_METHOD(GPIO::GetRealtimeStatus) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  pi_rt_config_t *rt = &gpio->closure->rt;
+  int status = gpio->closure->rt_status;
+  bool scheduled = gpio->queue != NULL;
+
+  v8::Local<v8::Object> obj = v8::Object::New();
+  obj->Set(NanSymbol("priority"), RealtimeField(
+      scheduled && rt->priority > 0, status, PI_RT_SCHED_FAILED));
+  obj->Set(NanSymbol("cpus"), RealtimeField(
+      scheduled && rt->cpus != 0, status, PI_RT_AFFINITY_FAILED));
+  obj->Set(NanSymbol("lockMemory"), RealtimeField(
+      rt->lock_memory != 0, status, PI_RT_MLOCK_FAILED));
+  NanReturnValue(obj);
+}
+
+/**
+ * Board detected during setup. Returns `null` before
+ * setup so detection never runs on the JS thread.
+ * Synchronous.
+ */
+
+NAN_METHOD(GPIO::GetBoard) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  if (!gpio->active) NanReturnValue(v8::Null());
+
+  const pi_board_t *board = pi_board();
+  v8::Local<v8::Object> obj = v8::Object::New();
+  obj->Set(NanSymbol("soc"), v8::String::New(board->soc_name));
+  obj->Set(NanSymbol("revision"), v8::Integer::New(board->revision));
+  obj->Set(NanSymbol("revisionCode"), v8::Integer::NewFromUnsigned(board->revision_code));
+  obj->Set(NanSymbol("peripheralBase"), v8::Integer::NewFromUnsigned(board->peripheral_base));
+  NanReturnValue(obj);
+}
+
+/**
+ * Start the native sampler polling the pins in `mask`
+ * (bank 0) `rate` times a second. `callback` receives a
+ * Buffer of packed change records per batch. Synchronous.
+ */
+
+NAN_METHOD(GPIO::SampleStart) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+
+  if (!gpio->active) {
+    return NanThrowError("sampleStart() requires gpio to be setup");
+  }
+
+  if (gpio->sampler != NULL) {
+    return NanThrowError("sampleStart() sampler already running");
+  }
+
+  if (!args[2]->IsFunction()) {
+    return NanThrowError("sampleStart() requires a callback argument");
+  }
+
+  uint32_t rate = args[0]->Uint32Value();
+  uint32_t mask = args[1]->Uint32Value();
+
+  if (rate == 0) {
+    return NanThrowError("sampleStart() requires a positive rate");
+  }
+
+  GPIOSampler *sampler = new GPIOSampler(gpio, args[2].As<v8::Function>());
+  if (sampler->Start(rate, mask) < 0) {
+    return NanThrowError("sampleStart() could not start sampler thread");
+  }
+
+  gpio->sampler = sampler;
+  NanReturnUndefined();
+}
+
+/**
+ * Change the pins watched by the sampler. Synchronous.
+ */
+
+NAN_METHOD(GPIO::SampleMask) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  if (gpio->sampler != NULL) gpio->sampler->SetMask(args[0]->Uint32Value());
+  NanReturnUndefined();
+}
+
+/**
+ * Stop the sampler. Synchronous.
+ */
+
+NAN_METHOD(GPIO::SampleStop) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  gpio->StopSampler();
+  NanReturnUndefined();
+}
+
+/**
+ * Start delivering edges on `pins` to `callback` in
+ * batches: one Buffer of packed event records once
+ * `backlog` events are pending or the oldest has waited
+ * `maxDelay` ms. Options also take the watcher's
+ * `pollRate`, `irqRate` and `window`, and a `chip` whose
+ * edge interrupts wake idle pins (requesting the lines
+ * applies `pull`). Synchronous.
+ */
+
+NAN_METHOD(GPIO::EventStart) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+
+  if (!gpio->active) {
+    return NanThrowError("eventStart() requires gpio to be setup");
+  }
+
+  if (gpio->pump != NULL) {
+    return NanThrowError("eventStart() events already running");
+  }
+
+  if (!args[0]->IsArray() || !args[1]->IsObject() || !args[2]->IsFunction()) {
+    return NanThrowError("eventStart() requires pins, options and callback arguments");
+  }
+
+  v8::Local<v8::Array> list = v8::Local<v8::Array>::Cast(args[0]);
+  v8::Local<v8::Object> opts = args[1].As<v8::Object>();
+  pi_gpio_pin_t pins[PI_MAX_PINS];
+  unsigned int count = list->Length();
+
+  if (count == 0 || count > PI_MAX_PINS) {
+    return NanThrowError("eventStart() requires 1 to 31 pins");
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    pins[i] = list->Get(i)->Uint32Value();
+    if (pins[i] >= PI_MAX_PINS) {
+      return NanThrowError("eventStart() pin out of range");
+    }
+  }
+
+  pi_gpio_watch_config_t config;
+  config.poll_rate = NanUInt32OptionValue(opts, NanSymbol("pollRate"), 5000);
+  config.irq_rate = NanUInt32OptionValue(opts, NanSymbol("irqRate"), 1000);
+  config.window_ms = NanUInt32OptionValue(opts, NanSymbol("window"), 10);
+  config.burst_us = 1000;
+  config.edge = PI_GPIO_EDGE_BOTH;
+
+  uint32_t backlog = NanUInt32OptionValue(opts, NanSymbol("backlog"), 64);
+  uint32_t maxDelay = NanUInt32OptionValue(opts, NanSymbol("maxDelay"), 10);
+  pi_gpio_pull_t pull = (pi_gpio_pull_t) NanUInt32OptionValue(opts, NanSymbol("pull"), PI_GPIO_PULL_NONE);
+  v8::Local<v8::Value> chip = opts->Get(NanSymbol("chip"));
+  v8::String::Utf8Value chipPath(chip);
+
+  GPIOEventPump *pump = new GPIOEventPump(gpio, args[2].As<v8::Function>(), backlog, maxDelay);
+  if (pump->Start(pins, count, &config, chip->IsString() ? *chipPath : NULL, pull) < 0) {
+    return NanThrowError("eventStart() could not start watcher");
+  }
+
+  gpio->pump = pump;
+  NanReturnUndefined();
+}
+
+/**
+ * Stop edge delivery. Synchronous.
+ */
+
+NAN_METHOD(GPIO::EventStop) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  gpio->StopPump();
+  NanReturnUndefined();
+}
+
+/**
+ * Start the native route engine on a table of rules,
+ * each `{ op, inputs, reset, output, edge }` with bank 0
+ * masks for `inputs` and `reset`. Every output must be
+ * claimed as an output and feed no rule. `rate` scans
+ * per second, 0 to scan continuously on a busy core.
+ * Routed outputs refuse writes and release until
+ * routeStop(). Synchronous.
+ */
+
+NAN_METHOD(GPIO::RouteStart) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+
+  if (!gpio->active) {
+    return NanThrowError("routeStart() requires gpio to be setup");
+  }
+
+  if (gpio->route != NULL) {
+    return NanThrowError("routeStart() route already running");
+  }
+
+  if (!args[0]->IsArray()) {
+    return NanThrowError("routeStart() requires an array of rules");
+  }
+
+  v8::Local<v8::Array> list = v8::Local<v8::Array>::Cast(args[0]);
+  uint32_t rate = args[1]->Uint32Value();
+  unsigned int count = list->Length();
+  pi_route_rule_t rules[32];
+  uint32_t outputs = gpio->OutputMask();
+  uint32_t driven = 0;
+  uint32_t sources = 0;
+
+  if (count == 0 || count > 32) {
+    return NanThrowError("routeStart() requires 1 to 32 rules");
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    if (!list->Get(i)->IsObject()) {
+      return NanThrowError("routeStart() rules must be objects");
+    }
+
+    v8::Local<v8::Object> rule = list->Get(i).As<v8::Object>();
+    rules[i].op = static_cast<pi_route_op_t>(NanUInt32OptionValue(rule, NanSymbol("op"), 0));
+    rules[i].inputs = NanUInt32OptionValue(rule, NanSymbol("inputs"), 0);
+    rules[i].reset = NanUInt32OptionValue(rule, NanSymbol("reset"), 0);
+    rules[i].output = NanUInt32OptionValue(rule, NanSymbol("output"), 0);
+    rules[i].edge = static_cast<pi_gpio_edge_t>(NanUInt32OptionValue(rule, NanSymbol("edge"), 0));
+
+    pi_gpio_pin_t out = rules[i].output;
+    if (out >= 32 || !(outputs & (1u << out))) {
+      std::stringstream msg;
+      msg << "routeStart() pin " << out << " is not claimed as an output";
+      return NanThrowError(msg.str().c_str());
+    }
+
+    driven |= 1u << out;
+    sources |= rules[i].inputs | rules[i].reset;
+  }
+
+  if (driven & sources) {
+    return NanThrowError("routeStart() a routed output cannot be a rule input");
+  }
+
+  pi_route_t *route = pi_route_new(gpio->closure, rules, count);
+  if (route == NULL) {
+    return NanThrowError("routeStart() invalid rules");
+  }
+
+  if (pi_route_start(route, rate) < 0) {
+    pi_route_delete(route);
+    return NanThrowError("routeStart() could not start route thread");
+  }
+
+  gpio->route = route;
+  gpio->routed = driven;
+  gpio->SchedOutputs();
+  NanReturnUndefined();
+}
+
+/**
+ * Stop the route engine; outputs keep their levels.
+ * Synchronous.
+ */
+
+NAN_METHOD(GPIO::RouteStop) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  gpio->StopRoute();
+  gpio->SchedOutputs();
+  NanReturnUndefined();
+}
+
+/**
+ * Route engine counters, or `null` when it is not
+ * running. Synchronous.
+ */
+
+NAN_METHOD(GPIO::RouteStats) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+
+  if (gpio->route == NULL) {
+    NanReturnValue(v8::Null());
+  }
+
+  pi_route_stats_t stats;
+  pi_route_stats(gpio->route, &stats);
+
+  v8::Local<v8::Object> obj = v8::Object::New();
+  obj->Set(NanSymbol("scans"), v8::Number::New((double) stats.scans));
+  obj->Set(NanSymbol("changes"), v8::Number::New((double) stats.changes));
+  obj->Set(NanSymbol("writes"), v8::Number::New((double) stats.writes));
+  NanReturnValue(obj);
+}
+
+/**
+ * Current time on the scheduler's clock, in ns.
+ * Synchronous.
+ */
+
+NAN_METHOD(GPIO::SchedNow) {
+  NanScope();
+  NanReturnValue(v8::Number::New((double) pi_sched_now()));
+}
+
+/**
+ * Queue future-dated writes from a Buffer of 16 byte
+ * records (double deadline ns, uint32 set mask, uint32
+ * clear mask; bank 0). The scheduler thread starts on
+ * first use with room for `capacity` pending writes.
+ * Every pin written must be claimed as an output.
+ * Returns a Buffer of ids as doubles. Synchronous.
+ */
+
+NAN_METHOD(GPIO::Schedule) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+
+  if (!gpio->active) {
+    return NanThrowError("schedule() requires gpio to be setup");
+  }
+
+  if (!node::Buffer::HasInstance(args[0])) {
+    return NanThrowError("schedule() requires a Buffer of writes");
+  }
+
+  const char *data = node::Buffer::Data(args[0]);
+  size_t length = node::Buffer::Length(args[0]);
+
+  if (length % 16 != 0) {
+    return NanThrowError("schedule() writes must be 16 bytes each");
+  }
+
+  uint32_t outputs = gpio->OutputMask();
+  std::vector<pi_sched_entry_t> entries(length / 16);
+  for (size_t i = 0; i < entries.size(); i++) {
+    double deadline;
+    memcpy(&deadline, data + i * 16, sizeof(double));
+    memcpy(&entries[i].set, data + i * 16 + 8, sizeof(uint32_t));
+    memcpy(&entries[i].clr, data + i * 16 + 12, sizeof(uint32_t));
+    entries[i].deadline = deadline > 0 ? (uint64_t) deadline : 0;
+    entries[i].bank = 0;
+
+    if ((entries[i].set | entries[i].clr) & ~outputs) {
+      return NanThrowError("schedule() writes pins not claimed as outputs");
+    }
+  }
+
+  if (gpio->sched == NULL) {
+    uint32_t capacity = args[1]->IsUndefined() ? 16384 : args[1]->Uint32Value();
+    pi_sched_t *sched = pi_sched_new(gpio->closure, capacity, 0);
+    if (sched == NULL) {
+      return NanThrowError("schedule() invalid capacity");
+    }
+
+    if (pi_sched_start(sched) < 0) {
+      pi_sched_delete(sched);
+      return NanThrowError("schedule() could not start scheduler thread");
+    }
+
+    gpio->sched = sched;
+  }
+
+  gpio->SchedOutputs();
+
+  std::vector<uint64_t> ids(entries.size());
+  size_t queued = entries.empty() ? 0
+    : pi_sched_add(gpio->sched, &entries[0], entries.size(), &ids[0]);
+
+  if (queued < entries.size()) {
+    // all or nothing, so ids line up with the writes
+    for (size_t i = 0; i < queued; i++) pi_sched_cancel(gpio->sched, ids[i]);
+    return NanThrowError(errno == ENOSPC
+      ? "schedule() scheduler is full"
+      : "schedule() invalid write");
+  }
+
+  std::vector<double> packed(ids.begin(), ids.end());
+  NanReturnValue(NanNewBufferHandle(
+      reinterpret_cast<char*>(packed.empty() ? NULL : &packed[0])
+    , (uint32_t) (packed.size() * sizeof(double))
+  ));
+}
+
+/**
+ * Drop a queued write by id. Returns false if it already
+ * fired or was cancelled. Synchronous.
+ */
+
+NAN_METHOD(GPIO::SchedCancel) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+
+  if (gpio->sched == NULL) {
+    NanReturnValue(v8::False());
+  }
+
+  uint64_t id = (uint64_t) args[0]->NumberValue();
+  NanReturnValue(v8::Boolean::New(pi_sched_cancel(gpio->sched, id) == 0));
+}
+
+/**
+ * Stop the scheduler and drop every queued write.
+ * Synchronous.
+ */
+
+NAN_METHOD(GPIO::SchedStop) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  gpio->StopScheduler();
+  NanReturnUndefined();
+}
+
+/**
+ * Scheduler counters, or `null` when it is not running.
+ * Synchronous.
+ */
+
+NAN_METHOD(GPIO::SchedStats) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+
+  if (gpio->sched == NULL) {
+    NanReturnValue(v8::Null());
+  }
+
+  pi_sched_stats_t stats;
+  pi_sched_stats(gpio->sched, &stats);
+
+  v8::Local<v8::Object> obj = v8::Object::New();
+  obj->Set(NanSymbol("queued"), v8::Number::New((double) stats.queued));
+  obj->Set(NanSymbol("fired"), v8::Number::New((double) stats.fired));
+  obj->Set(NanSymbol("cancelled"), v8::Number::New((double) stats.cancelled));
+  obj->Set(NanSymbol("stores"), v8::Number::New((double) stats.stores));
+  obj->Set(NanSymbol("maxLate"), v8::Number::New((double) stats.max_late_ns));
+  obj->Set(NanSymbol("pending"), v8::Number::New(stats.pending));
+  NanReturnValue(obj);
+}
+
+/**
+ * Bind a claimed mmap pin to a GPIOPin object whose
+ * calls skip the per-call pin lookup. Returns undefined
+ * if the pin is not claimed through the mmap method.
+ * Synchronous.
+ */
+
+NAN_METHOD(GPIO::BindPin) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  pi_gpio_pin_t pin = args[0]->Uint32Value();
+  PI_GPIO_UNROUTED(bindPin, pin)
+  NanReturnValue(GPIOPin::NewInstance(args.This(), gpio, pin));
+}
+
+/**
+ * Zero all counters and histograms. Synchronous.
+ */
+
+NAN_METHOD(GPIO::ResetStats) {
+  NanScope();
+  GPIO* gpio = node::ObjectWrap::Unwrap<GPIO>(args.This());
+  gpio->stats.Reset();
+  NanReturnUndefined();
+}
+
+/**
+ * Bank 0 pins claimed as mmap outputs, not driven by the
+ * route engine and not being released: the pins other
+ * native engines may drive. Main thread only.
+ */
+
+uint32_t
+GPIO::OutputMask() {
+  uint32_t outputs = 0;
+
+  for (pi_gpio_pin_t pin = 0; pin < 32 && pin < PI_MAX_PINS; pin++) {
+    GPIOPinUse use(this, pin);
+    if (use.handle != NULL
+        && use.handle->method == PI_GPIO_METHOD_MMAP
+        && pi_gpio_get_mode(use.handle) == PI_GPIO_MODE_OUTPUT) {
+      outputs |= 1u << pin;
+    }
+  }
+
+  return outputs & ~routed & ~releasing;
+}
+
+/**
+ * Hold the scheduler's and the running program's stores
+ * to OutputMask(), so writes queued for a pin, or made by
+ * a program, stop once it is released or routed. Main
+ * thread only, where a finished program is freed.
+ */
+
+void
+GPIO::SchedOutputs() {
+  uint32_t outputs = OutputMask();
+  if (sched != NULL) pi_sched_set_outputs(sched, 0, outputs);
+  if (program != NULL) pi_program_set_outputs(program, 0, outputs);
+}
+
+/**
+ * Take `handle` out of the pin table and free it once no
+ * read or write is using it. Only one concurrent release
+ * wins the handle. Worker threads only; the caller must
+ * not hold a use of the pin.
+ */
+
+void
+GPIO::ReleaseHandle(pi_gpio_pin_t pin, pi_gpio_handle_t *handle) {
+  if (!__sync_bool_compare_and_swap(&pins[pin], handle, NULL)) return;
+  __sync_fetch_and_add(&generations[pin], 1);
+  while (users[pin] != 0) sched_yield();
+  pi_gpio_release(handle);
+}
+
+/**
+ * Run a worker on the instance I/O thread when there is
+ * one, otherwise on the libuv threadpool. Returns false
+ * (and frees the worker) if the I/O queue is full.
+ */
+
+bool
+GPIO::Dispatch(NanAsyncWorker *worker) {
+  if (queue == NULL) {
+    NanAsyncQueueWorker(worker);
+    return true;
+  }
+
+  if (queue->Push(worker)) return true;
+  delete worker;
+  return false;
+}
+
+/**
+ * Stop the I/O thread once queued work has finished.
+ * Later work goes to the threadpool.
+ */
+
+void
+GPIO::StopQueue() {
+  if (queue == NULL) return;
+  queue->Stop();
+  queue = NULL;
+}
+
+/**
+ * Stop the sampler thread, if any. Must happen before
+ * the registers are unmapped.
+ */
+
+void
+GPIO::StopSampler() {
+  if (sampler == NULL) return;
+  sampler->Stop();
+  sampler = NULL;
+}
+
+/**
+ * Stop the event pump, if any. Must happen before the
+ * registers are unmapped.
+ */
+
+void
+GPIO::StopPump() {
+  if (pump == NULL) return;
+  pump->Stop();
+  pump = NULL;
+}
+
+/**
+ * Stop a running program, if any. The worker still owns
+ * it and fails with a "stopped" error; teardown waits
+ * for it in ProgramDone().
+ */
+
+void
+GPIO::StopProgram() {
+  pi_program_t *running = program;
+  if (running != NULL) pi_program_stop(running);
+}
+
+/**
+ * The program worker finished; start any teardown that
+ * waited for it.
+ */
+
+void
+GPIO::ProgramDone() {
+  std::vector<NanAsyncWorker*> waiting;
+  waiting.swap(teardowns);
+  for (size_t i = 0; i < waiting.size(); i++) NanAsyncQueueWorker(waiting[i]);
+}
+
+/**
+ * Stop the route engine, if any. Must happen before the
+ * registers are unmapped.
+ */
+
+void
+GPIO::StopRoute() {
+  if (route == NULL) return;
+  pi_route_delete(route);
+  route = NULL;
+  routed = 0;
+}
+
+/**
+ * Stop the scheduler, if any, dropping queued writes.
+ * Must happen before the registers are unmapped.
+ */
+
+void
+GPIO::StopScheduler() {
+  if (sched == NULL) return;
+  pi_sched_delete(sched);
+  sched = NULL;
+}
+
 /**
  * Class constructor
  */
 
 GPIO::GPIO () {
   active = false;
+  queue = NULL;
+  sampler = NULL;
+  pump = NULL;
+  route = NULL;
+  routed = 0;
+  releasing = 0;
+  sched = NULL;
+  program = NULL;
   closure = pi_closure_new();
 
   for (int i = 0; i < PI_MAX_PINS; i++) {
     pins[i] = NULL;
+    users[i] = 0;
+    generations[i] = 0;
   }
 };
 
@@ -364,6 +1436,10 @@ GPIO::GPIO () {
  */
 
 GPIO::~GPIO() {
+  StopSampler();
+  StopPump();
+  StopRoute();
+  StopScheduler();
   pi_closure_delete(closure);
   closure = NULL;
 };
@@ -12,6 +12,7 @@
 #include <node.h>
 #include <string>
 #include <v8.h>
+#include <vector>
 
 /*!
  * Source controlled includes
@@ -20,12 +21,29 @@
 #include <pi.h>
 #include "nan.h"
 
+/*!
+ * Local includes
+ */
+
+#include "gpio_event_pump.h"
+#include "gpio_queue.h"
+#include "gpio_sampler.h"
+#include "gpio_stats.h"
+
 /*!
  * Max pins
  */
 
 #define PI_MAX_PINS 31
 
+/*!
+ * Placeholder held in the pin table while a claim is
+ * configuring the pin, so concurrent claims of the same
+ * pin fail instead of both reconfiguring it.
+ */
+
+#define PI_GPIO_PIN_CLAIMING ((pi_gpio_handle_t*) 1)
+
 /*!
  * Setup ensures callback for async methods and constructs
  * options object.
@@ -50,6 +68,24 @@
     return NanThrowError(#name "() requires a callback argument");            \
   }
 
+/*!
+ * Refuse a pin the route engine drives until unroute().
+ */
+
+#define PI_GPIO_UNROUTED(name, pin)                                           \
+  if ((pin) < 32 && (gpio->routed & (1u << (pin))))                           \
+    return NanThrowError(#name "() pin is routed, call unroute() first");
+
+/*!
+ * Hand a worker to the threadpool or I/O queue, throwing
+ * if the queue is full.
+ */
+
+#define PI_GPIO_DISPATCH(name, worker)                                        \
+  if (!gpio->Dispatch(worker)) {                                              \
+    return NanThrowError(#name "() gpio queue is full");                      \
+  }
+
 /*!
  * Setup native status bacon.
  */
@@ -68,14 +104,31 @@
  */
 
 #define PI_GPIO_PIN_HANDLE_NATIVE(pin)                                        \
-  if (pins[pin] == NULL) {                                                    \
+  GPIOPinUse use(this, pin);                                                  \
+  pi_gpio_handle_t *handle = use.handle;                                      \
+  if (handle == NULL) {                                                       \
     std::stringstream msg;                                                    \
     msg << "pin " << pin << " has not been claimed";                          \
     status->success = false;                                                  \
     status->msg = msg.str();                                                  \
     return status;                                                            \
   }                                                                           \
-  pi_gpio_handle_t *handle = pins[pin];                                       \
+
+/*!
+ * Fail a pin action bound to an earlier claim once that
+ * claim has been released, even if the pin was claimed
+ * again since. A NULL `bound` accepts any claim.
+ */
+
+#define PI_GPIO_PIN_BOUND_NATIVE(pin, bound, generation)                      \
+  if ((bound) != NULL                                                         \
+      && (handle != (bound) || generations[pin] != (generation))) {           \
+    std::stringstream msg;                                                    \
+    msg << "pin " << pin << " has been released";                             \
+    status->success = false;                                                  \
+    status->msg = msg.str();                                                  \
+    return status;                                                            \
+  }                                                                           \
 
 /*!
  * Start namespace
@@ -115,23 +168,69 @@ class GPIO: public node::ObjectWrap {
     static v8::Handle<v8::Value> NewInstance();
 
     // native bridges
-    GPIOStatus* NativeSetup();
+    GPIOStatus* NativeSetup(bool simulate, const pi_rt_config_t &rt);
     GPIOStatus* NativeTeardown();
 
     GPIOStatus* NativePinClaim(
         pi_gpio_pin_t pin
-      , pi_gpio_direction_t direction
+      , pi_gpio_mode_t direction
       , pi_gpio_pull_t pull
     );
 
     GPIOStatus* NativePinRelease(pi_gpio_pin_t pin);
-    GPIOStatus* NativePinRead(pi_gpio_pin_t pin, pi_gpio_value_t& value);
-    GPIOStatus* NativePinWrite(pi_gpio_pin_t pin, pi_gpio_value_t value);
+    GPIOStatus* NativePinRead(
+        pi_gpio_pin_t pin
+      , pi_gpio_value_t& value
+      , pi_gpio_handle_t *bound = NULL
+      , uint32_t generation = 0
+    );
+
+    GPIOStatus* NativePinWrite(
+        pi_gpio_pin_t pin
+      , pi_gpio_value_t value
+      , pi_gpio_handle_t *bound = NULL
+      , uint32_t generation = 0
+    );
+
+    GPIOStatus* NativePinWriteBuffer(
+        pi_gpio_pin_t pin
+      , const uint8_t *values
+      , size_t length
+      , uint64_t period
+    );
+    GPIOStatus* NativePinPwm(pi_gpio_pin_t pin, double frequency, double duty);
+    GPIOStatus* NativeRunProgram(pi_program_t *program);
+
+    uint32_t OutputMask();
+    void SchedOutputs();
+    void ReleaseHandle(pi_gpio_pin_t pin, pi_gpio_handle_t *handle);
+
+    // dispatch
+    bool Dispatch(NanAsyncWorker *worker);
+    void StopQueue();
+    void StopSampler();
+    void StopPump();
+    void StopRoute();
+    void StopScheduler();
+    void StopProgram();
+    void ProgramDone();
 
     // bridge variables
     pi_closure_t *closure;
-    pi_gpio_handle_t *pins[PI_MAX_PINS];
+    pi_gpio_handle_t *volatile pins[PI_MAX_PINS];
+    volatile int users[PI_MAX_PINS];
+    volatile uint32_t generations[PI_MAX_PINS];
     bool active;
+    GPIOStats stats;
+    GPIOQueue *queue;
+    GPIOSampler *sampler;
+    GPIOEventPump *pump;
+    pi_route_t *route;
+    uint32_t routed;
+    uint32_t releasing;
+    pi_sched_t *sched;
+    pi_program_t *volatile program;
+    std::vector<NanAsyncWorker*> teardowns;
 
     // cpp (de)construct methods
     GPIO ();
@@ -147,12 +246,62 @@ class GPIO: public node::ObjectWrap {
     static NAN_METHOD(PinRelease);
     static NAN_METHOD(PinRead);
     static NAN_METHOD(PinWrite);
+    static NAN_METHOD(PinWriteBuffer);
+    static NAN_METHOD(PinPwm);
+    static NAN_METHOD(BindPin);
+    static NAN_METHOD(RunProgram);
+    static NAN_METHOD(GetStats);
+    static NAN_METHOD(SetStatsEnabled);
+    static NAN_METHOD(ResetStats);
+    static NAN_METHOD(GetRealtimeStatus);
+    static NAN_METHOD(GetBoard);
+    static NAN_METHOD(SampleStart);
+    static NAN_METHOD(SampleMask);
+    static NAN_METHOD(SampleStop);
+    static NAN_METHOD(EventStart);
+    static NAN_METHOD(EventStop);
+    static NAN_METHOD(RouteStart);
+    static NAN_METHOD(RouteStop);
+    static NAN_METHOD(RouteStats);
+    static NAN_METHOD(SchedNow);
+    static NAN_METHOD(Schedule);
+    static NAN_METHOD(SchedCancel);
+    static NAN_METHOD(SchedStop);
+    static NAN_METHOD(SchedStats);
 
     /*
     static NAN_METHOD(PinStat);
     */
 };
 
+/*!
+ * Holds the handle of a claimed pin for the length of a
+ * scope. Release swaps the handle out of the pin table,
+ * then waits for every use to end before freeing it.
+ * `handle` is NULL when the pin is not claimed.
+ */
+
+class GPIOPinUse {
+  public:
+    GPIOPinUse(GPIO *gpio, pi_gpio_pin_t pin) : gpio(gpio), pin(pin) {
+      handle = NULL;
+      if (pin >= PI_MAX_PINS) return;
+      __sync_fetch_and_add(&gpio->users[pin], 1);
+      pi_gpio_handle_t *claimed = gpio->pins[pin];
+      if (claimed != PI_GPIO_PIN_CLAIMING) handle = claimed;
+    };
+
+    ~GPIOPinUse() {
+      if (pin < PI_MAX_PINS) __sync_fetch_and_sub(&gpio->users[pin], 1);
+    };
+
+    pi_gpio_handle_t *handle;
+
+  private:
+    GPIO *gpio;
+    pi_gpio_pin_t pin;
+};
+
 } // end namespace
 
 #endif
@@ -16,6 +16,18 @@
 
 namespace pidaeus {
 
+/*!
+ * Run the native operation, recording queue and
+ * execute time when stats are enabled.
+ */
+
+void GPIOWorker::Execute() {
+  uint64_t started = queued ? GPIOStats::Now() : 0;
+  GPIOStatus *status = Run();
+  gpio->stats.Record(op, StatsPin(), queued, started, status->success);
+  SetStatus(status);
+}
+
 /*!
  * Setup Worker
  */
@@ -23,13 +35,23 @@ namespace pidaeus {
 SetupWorker::SetupWorker(
     GPIO *gpio
   , NanCallback *callback
-) : GPIOWorker(gpio, callback)
+  , bool simulate
+  , const pi_rt_config_t &rt
+) : GPIOWorker(gpio, callback, GPIO_STATS_SETUP)
+  , simulate(simulate)
+  , rt(rt)
 {};
 
 SetupWorker::~SetupWorker() {};
 
-void SetupWorker::Execute() {
-  SetStatus(gpio->NativeSetup());
+GPIOStatus* SetupWorker::Run() {
+  return gpio->NativeSetup(simulate, rt);
+}
+
+void SetupWorker::HandleErrorCallback() {
+  // a failed setup will never be torn down
+  gpio->StopQueue();
+  GPIOWorker::HandleErrorCallback();
 }
 
 /*!
@@ -39,13 +61,13 @@ void SetupWorker::Execute() {
 TeardownWorker::TeardownWorker(
     GPIO *gpio
   , NanCallback *callback
-) : GPIOWorker(gpio, callback)
+) : GPIOWorker(gpio, callback, GPIO_STATS_TEARDOWN)
 {};
 
 TeardownWorker::~TeardownWorker() {};
 
-void TeardownWorker::Execute() {
-  SetStatus(gpio->NativeTeardown());
+GPIOStatus* TeardownWorker::Run() {
+  return gpio->NativeTeardown();
 }
 
 /*!
@@ -55,8 +77,9 @@ void TeardownWorker::Execute() {
 PinWorker::PinWorker(
     GPIO *gpio
   , NanCallback *callback
+  , GPIOStatsOp op
   , pi_gpio_pin_t pin
-) : GPIOWorker(gpio, callback)
+) : GPIOWorker(gpio, callback, op)
   , pin(pin)
 {};
 
@@ -70,34 +93,41 @@ PinClaimWorker::PinClaimWorker(
     GPIO *gpio
   , NanCallback *callback
   , pi_gpio_pin_t pin
-  , pi_gpio_direction_t direction
+  , pi_gpio_mode_t direction
   , pi_gpio_pull_t pull
-) : PinWorker(gpio, callback, pin)
+) : PinWorker(gpio, callback, GPIO_STATS_CLAIM, pin)
   , direction(direction)
   , pull(pull)
 {};
 
 PinClaimWorker::~PinClaimWorker() {};
 
-void PinClaimWorker::Execute() {
-  SetStatus(gpio->NativePinClaim(pin, direction, pull));
+GPIOStatus* PinClaimWorker::Run() {
+  return gpio->NativePinClaim(pin, direction, pull);
 }
 
 /*!
- * Release pin worker
+ * Release pin worker. From creation until it is done the
+ * pin is out of the outputs native engines may drive, so
+ * scheduled writes stop before the handle goes.
  */
 
 PinReleaseWorker::PinReleaseWorker(
     GPIO *gpio
   , NanCallback *callback
   , pi_gpio_pin_t pin
-) : PinWorker(gpio, callback, pin)
-{};
-
-PinReleaseWorker::~PinReleaseWorker() {};
-
-void PinReleaseWorker::Execute() {
-  SetStatus(gpio->NativePinRelease(pin));
+) : PinWorker(gpio, callback, GPIO_STATS_RELEASE, pin)
+{
+  if (pin < 32) gpio->releasing |= 1u << pin;
+  gpio->SchedOutputs();
+};
+
+PinReleaseWorker::~PinReleaseWorker() {
+  if (pin < 32) gpio->releasing &= ~(1u << pin);
+};
+
+GPIOStatus* PinReleaseWorker::Run() {
+  return gpio->NativePinRelease(pin);
 }
 
 /*!
@@ -108,13 +138,17 @@ PinReadWorker::PinReadWorker(
     GPIO *gpio
   , NanCallback *callback
   , pi_gpio_pin_t pin
-) : PinWorker(gpio, callback, pin)
+  , pi_gpio_handle_t *bound
+  , uint32_t generation
+) : PinWorker(gpio, callback, GPIO_STATS_READ, pin)
+  , bound(bound)
+  , generation(generation)
 {};
 
 PinReadWorker::~PinReadWorker() {};
 
-void PinReadWorker::Execute() {
-  SetStatus(gpio->NativePinRead(pin, value));
+GPIOStatus* PinReadWorker::Run() {
+  return gpio->NativePinRead(pin, value, bound, generation);
 }
 
 void PinReadWorker::HandleOKCallback() {
@@ -137,14 +171,101 @@ PinWriteWorker::PinWriteWorker(
   , NanCallback *callback
   , pi_gpio_pin_t pin
   , pi_gpio_value_t value
-) : PinWorker(gpio, callback, pin)
+  , pi_gpio_handle_t *bound
+  , uint32_t generation
+) : PinWorker(gpio, callback, GPIO_STATS_WRITE, pin)
   , value(value)
+  , bound(bound)
+  , generation(generation)
 {};
 
 PinWriteWorker::~PinWriteWorker() {};
 
-void PinWriteWorker::Execute() {
-  SetStatus(gpio->NativePinWrite(pin, value));
+GPIOStatus* PinWriteWorker::Run() {
+  return gpio->NativePinWrite(pin, value, bound, generation);
+}
+
+/*!
+ * Pin Write Buffer Worker
+ */
+
+PinWriteBufferWorker::PinWriteBufferWorker(
+    GPIO *gpio
+  , NanCallback *callback
+  , pi_gpio_pin_t pin
+  , const uint8_t *values
+  , size_t length
+  , uint64_t period
+) : PinWorker(gpio, callback, GPIO_STATS_WRITE_BUFFER, pin)
+  , values(values, values + length)
+  , period(period)
+{};
+
+PinWriteBufferWorker::~PinWriteBufferWorker() {};
+
+GPIOStatus* PinWriteBufferWorker::Run() {
+  const uint8_t *data = values.empty() ? NULL : &values[0];
+  return gpio->NativePinWriteBuffer(pin, data, values.size(), period);
+}
+
+/*!
+ * Pin Pwm Worker
+ */
+
+PinPwmWorker::PinPwmWorker(
+    GPIO *gpio
+  , NanCallback *callback
+  , pi_gpio_pin_t pin
+  , double frequency
+  , double duty
+) : PinWorker(gpio, callback, GPIO_STATS_PWM, pin)
+  , frequency(frequency)
+  , duty(duty)
+{};
+
+PinPwmWorker::~PinPwmWorker() {};
+
+GPIOStatus* PinPwmWorker::Run() {
+  return gpio->NativePinPwm(pin, frequency, duty);
+}
+
+/*!
+ * Program Worker
+ */
+
+ProgramWorker::ProgramWorker(
+    GPIO *gpio
+  , NanCallback *callback
+  , pi_program_t *program
+) : GPIOWorker(gpio, callback, GPIO_STATS_PROGRAM)
+  , program(program)
+{};
+
+ProgramWorker::~ProgramWorker() {
+  __sync_bool_compare_and_swap(&gpio->program, program, NULL);
+  pi_program_delete(program);
+  gpio->ProgramDone();
+};
+
+GPIOStatus* ProgramWorker::Run() {
+  return gpio->NativeRunProgram(program);
+}
+
+void ProgramWorker::HandleOKCallback() {
+  NanScope();
+
+  size_t count;
+  const uint64_t *records = pi_program_records(program, &count);
+  std::vector<double> values(records, records + count);
+
+  v8::Local<v8::Value> argv[] = {
+      v8::Local<v8::Value>::New(v8::Null())
+    , NanNewBufferHandle(
+          reinterpret_cast<char*>(values.empty() ? NULL : &values[0])
+        , (uint32_t) (count * sizeof(double)))
+  };
+
+  callback->Call(2, argv);
 }
 
 } // end namespace
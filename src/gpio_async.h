@@ -10,6 +10,7 @@
  */
 
 #include <node.h>
+#include <vector>
 
 /*!
  * Source controlled includes
@@ -23,6 +24,7 @@
  */
 
 #include "gpio.h"
+#include "gpio_stats.h"
 
 /**
  * Start namespace
@@ -31,7 +33,9 @@
 namespace pidaeus {
 
 /*!
- * Abstract worker that wraps up GPIO and callback
+ * Abstract worker that wraps up GPIO and callback.
+ * Subclasses implement Run(); Execute() times it for
+ * the instance stats.
  */
 
 class GPIOWorker : public NanAsyncWorker {
@@ -39,14 +43,22 @@ class GPIOWorker : public NanAsyncWorker {
     GPIOWorker(
         pidaeus::GPIO* gpio
       , NanCallback *callback
-    ) : NanAsyncWorker(callback), gpio(gpio) {
+      , GPIOStatsOp op
+    ) : NanAsyncWorker(callback), gpio(gpio), op(op) {
       NanScope();
       v8::Local<v8::Object> obj = v8::Object::New();
       NanAssignPersistent(v8::Object, persistentHandle, obj);
+      queued = gpio->stats.Begin();
     };
 
+    virtual void Execute();
+
   protected:
     GPIO* gpio;
+    GPIOStatsOp op;
+    uint64_t queued;
+    virtual GPIOStatus* Run() = 0;
+    virtual pi_gpio_pin_t StatsPin() { return PI_STATS_PINS; };
     void SetStatus(GPIOStatus *status) {
       if (!status->success) this->errmsg = strdup(status->msg.c_str());
       delete status;
@@ -64,10 +76,17 @@ class SetupWorker : public GPIOWorker {
     SetupWorker(
         GPIO *gpio
       , NanCallback *callback
+      , bool simulate
+      , const pi_rt_config_t &rt
     );
 
     virtual ~SetupWorker();
-    virtual void Execute();
+    virtual GPIOStatus* Run();
+    virtual void HandleErrorCallback();
+
+  private:
+    bool simulate;
+    pi_rt_config_t rt;
 };
 
 /**
@@ -84,7 +103,7 @@ class TeardownWorker : public GPIOWorker {
     );
 
     virtual ~TeardownWorker();
-    virtual void Execute();
+    virtual GPIOStatus* Run();
 };
 
 /**
@@ -98,6 +117,7 @@ class PinWorker : public GPIOWorker {
     PinWorker(
         GPIO *gpio
       , NanCallback *callback
+      , GPIOStatsOp op
       , pi_gpio_pin_t pin
     );
 
@@ -105,6 +125,7 @@ class PinWorker : public GPIOWorker {
 
   protected:
     pi_gpio_pin_t pin;
+    virtual pi_gpio_pin_t StatsPin() { return pin; };
 };
 
 /**
@@ -119,15 +140,15 @@ class PinClaimWorker : public PinWorker {
         GPIO *gpio
       , NanCallback *callback
       , pi_gpio_pin_t pin
-      , pi_gpio_direction_t direction
+      , pi_gpio_mode_t direction
       , pi_gpio_pull_t pull
     );
 
     virtual ~PinClaimWorker();
-    virtual void Execute();
+    virtual GPIOStatus* Run();
 
   private:
-    pi_gpio_direction_t direction;
+    pi_gpio_mode_t direction;
     pi_gpio_pull_t pull;
 };
 
@@ -146,11 +167,12 @@ class PinReleaseWorker : public PinWorker {
     );
 
     virtual ~PinReleaseWorker();
-    virtual void Execute();
+    virtual GPIOStatus* Run();
 };
 
 /**
- * Async GPIO pin read worker.
+ * Async GPIO pin read worker. With `bound` set it only
+ * reads while that claim is still the pin's.
  *
  * @inherits {PinWorker}
  */
@@ -161,18 +183,23 @@ class PinReadWorker : public PinWorker {
         GPIO *gpio
       , NanCallback *callback
       , pi_gpio_pin_t pin
+      , pi_gpio_handle_t *bound = NULL
+      , uint32_t generation = 0
     );
 
     virtual ~PinReadWorker();
-    virtual void Execute();
+    virtual GPIOStatus* Run();
     virtual void HandleOKCallback();
 
   private:
     pi_gpio_value_t value;
+    pi_gpio_handle_t *bound;
+    uint32_t generation;
 };
 
 /**
- * Async GPIO pin write worker.
+ * Async GPIO pin write worker. With `bound` set it only
+ * writes while that claim is still the pin's.
  *
  * @inherits {PinWorker}
  */
@@ -184,13 +211,90 @@ class PinWriteWorker : public PinWorker {
       , NanCallback *callback
       , pi_gpio_pin_t pin
       , pi_gpio_value_t value
+      , pi_gpio_handle_t *bound = NULL
+      , uint32_t generation = 0
     );
 
     virtual ~PinWriteWorker();
-    virtual void Execute();
+    virtual GPIOStatus* Run();
 
   private:
     pi_gpio_value_t value;
+    pi_gpio_handle_t *bound;
+    uint32_t generation;
+};
+
+/**
+ * Async GPIO pin write of a value sequence. The values
+ * are copied so the source Buffer may be reused.
+ *
+ * @inherits {PinWorker}
+ */
+
+class PinWriteBufferWorker : public PinWorker {
+  public:
+    PinWriteBufferWorker(
+        GPIO *gpio
+      , NanCallback *callback
+      , pi_gpio_pin_t pin
+      , const uint8_t *values
+      , size_t length
+      , uint64_t period
+    );
+
+    virtual ~PinWriteBufferWorker();
+    virtual GPIOStatus* Run();
+
+  private:
+    std::vector<uint8_t> values;
+    uint64_t period;
+};
+
+/**
+ * Async GPIO hardware pwm worker.
+ *
+ * @inherits {PinWorker}
+ */
+
+class PinPwmWorker : public PinWorker {
+  public:
+    PinPwmWorker(
+        GPIO *gpio
+      , NanCallback *callback
+      , pi_gpio_pin_t pin
+      , double frequency
+      , double duty
+    );
+
+    virtual ~PinPwmWorker();
+    virtual GPIOStatus* Run();
+
+  private:
+    double frequency;
+    double duty;
+};
+
+/**
+ * Async program run worker. Owns the program; results
+ * are handed back as one Buffer of doubles.
+ *
+ * @inherits {GPIOWorker}
+ */
+
+class ProgramWorker : public GPIOWorker {
+  public:
+    ProgramWorker(
+        GPIO *gpio
+      , NanCallback *callback
+      , pi_program_t *program
+    );
+
+    virtual ~ProgramWorker();
+    virtual GPIOStatus* Run();
+    virtual void HandleOKCallback();
+
+  private:
+    pi_program_t *program;
 };
 
 } // end namespace
@@ -0,0 +1,373 @@
+/*!
+ * External includes
+ */
+
+#include <errno.h>
+#include <node.h>
+#include <string.h>
+#include <string>
+
+/*!
+ * Source controlled includes
+ */
+
+#include <pi.h>
+
+/*!
+ * Local includes
+ */
+
+#include "gpio_client.h"
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+/*!
+ * v8 Function Template
+ */
+
+static v8::Persistent<v8::FunctionTemplate> constructor;
+
+/*!
+ * Connection made for the constructor, only valid while
+ * NewInstance runs.
+ */
+
+static pi_client_t *pending_client = NULL;
+
+/*!
+ * How long claims, releases and flushes wait for the
+ * daemon.
+ */
+
+#define CLIENT_TIMEOUT_NS 1000000000ULL
+
+/*!
+ * Wait on the threadpool for command `seq`, queued on
+ * the loop thread. A flush also fails if the daemon
+ * refused any command since the count of `errors`.
+ */
+
+class ClientWaitWorker : public NanAsyncWorker {
+  public:
+    ClientWaitWorker(
+        NanCallback *callback
+      , GPIOClient *owner
+      , pi_client_t *client
+      , uint32_t seq
+      , bool flush
+      , uint32_t errors
+    ) : NanAsyncWorker(callback)
+      , owner(owner)
+      , client(client)
+      , seq(seq)
+      , flush(flush)
+      , errors(errors) {};
+
+    ~ClientWaitWorker() {
+      owner->Done(errors);
+    };
+
+    void Execute() {
+      int res = pi_client_wait(client, seq, CLIENT_TIMEOUT_NS);
+      int last = 0;
+
+      if (res == 0 && flush) {
+        uint32_t now = pi_client_errors(client, &last);
+        if (now != errors) res = last;
+        errors = now;
+      }
+
+      if (res < 0) this->errmsg = strdup(strerror(-res));
+    };
+
+  private:
+    GPIOClient *owner;
+    pi_client_t *client;
+    uint32_t seq;
+    bool flush;
+    uint32_t errors;
+};
+
+/**
+ * Construct a new client from javascript.
+ */
+
+NAN_METHOD(GPIOClientConnect) {
+  NanScope();
+  NanReturnValue(GPIOClient::NewInstance(args[0]));
+}
+
+/**
+ * Initialize a new function template.
+ */
+
+void
+GPIOClient::Init() {
+  v8::Local<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New(New);
+  NanAssignPersistent(v8::FunctionTemplate, constructor, tpl);
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(NanSymbol("GPIOClient"));
+
+  // Prototype (Methods)
+  NODE_SET_PROTOTYPE_METHOD(tpl, "claim", GPIOClient::Claim);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "release", GPIOClient::Release);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "write", GPIOClient::Write);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "writeMask", GPIOClient::WriteMask);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "read", GPIOClient::Read);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "readMask", GPIOClient::ReadMask);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "flush", GPIOClient::Flush);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "close", GPIOClient::Close);
+}
+
+/**
+ * Connect to the daemon serving shared memory `name`
+ * (the libpi default when not a string). Throws when
+ * there is no daemon or no free client slot.
+ */
+
+v8::Handle<v8::Value>
+GPIOClient::NewInstance(v8::Handle<v8::Value> name) {
+  NanScope();
+  std::string path = name->IsString() ? *v8::String::Utf8Value(name) : PI_DAEMON_NAME;
+  pi_client_t *client = pi_client_connect(path.c_str());
+
+  if (client == NULL) {
+    std::string msg = "connect() " + path + ": " + strerror(errno);
+    return NanThrowError(msg.c_str());
+  }
+
+  pending_client = client;
+  v8::Local<v8::FunctionTemplate> tpl = NanPersistentToLocal(constructor);
+  v8::Local<v8::Object> instance = tpl->GetFunction()->NewInstance(0, NULL);
+  pending_client = NULL;
+  return instance;
+}
+
+/**
+ * Constructor, only reachable through NewInstance.
+ */
+
+NAN_METHOD(GPIOClient::New) {
+  NanScope();
+
+  if (pending_client == NULL) {
+    return NanThrowError("GPIOClient is created by connect()");
+  }
+
+  GPIOClient *self = new GPIOClient(pending_client);
+  self->Wrap(args.This());
+  NanReturnValue(args.This());
+}
+
+GPIOClient::GPIOClient(pi_client_t *client)
+  : client(client)
+  , pending(0)
+  , closing(false)
+  , errors(pi_client_errors(client, NULL))
+{};
+
+GPIOClient::~GPIOClient() {
+  Disconnect();
+};
+
+/*!
+ * Start a wait worker. The object stays referenced, and
+ * connected, until the worker is done.
+ */
+
+void
+GPIOClient::Wait(int64_t seq, bool flush, v8::Local<v8::Value> callback) {
+  pending++;
+  Ref();
+  NanAsyncQueueWorker(new ClientWaitWorker(
+      new NanCallback(callback.As<v8::Function>())
+    , this
+    , client
+    , (uint32_t) seq
+    , flush
+    , errors
+  ));
+}
+
+/*!
+ * A wait worker finished, having seen `seen` refusals.
+ */
+
+void
+GPIOClient::Done(uint32_t seen) {
+  if ((int32_t) (seen - errors) > 0) errors = seen;
+  pending--;
+  if (closing && pending == 0) Disconnect();
+  Unref();
+}
+
+void
+GPIOClient::Disconnect() {
+  if (client == NULL) return;
+  pi_client_disconnect(client);
+  client = NULL;
+}
+
+#define PI_CLIENT_OPEN(name)                                                    \
+  GPIOClient* self = node::ObjectWrap::Unwrap<GPIOClient>(args.This());         \
+  if (self->client == NULL || self->closing) {                                  \
+    return NanThrowError(#name "() client is closed");                          \
+  }
+
+/*!
+ * Pins the daemon serves. Commands carry the pin and
+ * mode in a byte each, so both are checked here rather
+ * than truncated.
+ */
+
+#define PI_CLIENT_PINS 54
+
+#define PI_CLIENT_PIN(name, pin, arg)                                           \
+  if (!(arg)->IsUint32() || (arg)->Uint32Value() >= PI_CLIENT_PINS) {           \
+    return NanThrowError(#name "() pin must be 0-53");                          \
+  }                                                                             \
+  pi_gpio_pin_t pin = (arg)->Uint32Value();
+
+/**
+ * Claim a pin through the daemon with options
+ * `{ direction, pull, value }` as for gpio.claim().
+ * Fails if another client holds it.
+ */
+
+NAN_METHOD(GPIOClient::Claim) {
+  NanScope();
+  PI_CLIENT_OPEN(claim)
+
+  v8::Local<v8::Object> opts = args[1]->IsObject()
+    ? args[1].As<v8::Object>()
+    : v8::Object::New();
+
+  PI_CLIENT_PIN(claim, pin, args[0])
+  uint32_t mode = NanUInt32OptionValue(opts, NanSymbol("direction"), 0);
+  if (mode > PI_GPIO_MODE_ALT3) return NanThrowError("claim() direction must be 0-7");
+
+  pi_daemon_cmd_t cmd;
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.op = PI_DAEMON_CLAIM;
+  cmd.pin = pin;
+  cmd.mode = mode;
+  cmd.arg = NanUInt32OptionValue(opts, NanSymbol("pull"), 0);
+  cmd.set = NanUInt32OptionValue(opts, NanSymbol("value"), 0) != 0;
+
+  if (!args[2]->IsFunction()) return NanThrowError("claim() requires a callback argument");
+  int64_t seq = pi_client_submit(self->client, &cmd);
+  if (seq < 0) return NanThrowError("claim() command ring is full");
+  self->Wait(seq, false, args[2]);
+  NanReturnUndefined();
+}
+
+/**
+ * Release a pin claimed by this client.
+ */
+
+NAN_METHOD(GPIOClient::Release) {
+  NanScope();
+  PI_CLIENT_OPEN(release)
+
+  PI_CLIENT_PIN(release, pin, args[0])
+
+  pi_daemon_cmd_t cmd;
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.op = PI_DAEMON_RELEASE;
+  cmd.pin = pin;
+
+  if (!args[1]->IsFunction()) return NanThrowError("release() requires a callback argument");
+  int64_t seq = pi_client_submit(self->client, &cmd);
+  if (seq < 0) return NanThrowError("release() command ring is full");
+  self->Wait(seq, false, args[1]);
+  NanReturnUndefined();
+}
+
+/**
+ * Queue a pin write. Returns false when the ring is
+ * full. Synchronous.
+ */
+
+NAN_METHOD(GPIOClient::Write) {
+  NanScope();
+  PI_CLIENT_OPEN(write)
+
+  PI_CLIENT_PIN(write, pin, args[0])
+  pi_gpio_value_t value = args[1]->Int32Value() ? PI_GPIO_HIGH : PI_GPIO_LOW;
+  NanReturnValue(v8::Boolean::New(pi_client_write(self->client, pin, value) == 0));
+}
+
+/**
+ * Queue a bank 0 mask write. Returns false when the ring
+ * is full. Synchronous.
+ */
+
+NAN_METHOD(GPIOClient::WriteMask) {
+  NanScope();
+  PI_CLIENT_OPEN(writeMask)
+
+  uint32_t set = args[0]->Uint32Value();
+  uint32_t clr = args[1]->Uint32Value();
+  NanReturnValue(v8::Boolean::New(pi_client_write_mask(self->client, 0, set, clr) == 0));
+}
+
+/**
+ * Level of a pin at the daemon's last scan. Synchronous.
+ */
+
+NAN_METHOD(GPIOClient::Read) {
+  NanScope();
+  PI_CLIENT_OPEN(read)
+  PI_CLIENT_PIN(read, pin, args[0])
+  NanReturnValue(v8::Integer::New(pi_client_read(self->client, pin)));
+}
+
+/**
+ * Bank 0 levels at the daemon's last scan. Synchronous.
+ */
+
+NAN_METHOD(GPIOClient::ReadMask) {
+  NanScope();
+  PI_CLIENT_OPEN(readMask)
+  NanReturnValue(v8::Integer::NewFromUnsigned(pi_client_read_mask(self->client, 0)));
+}
+
+/**
+ * Wait for every queued write; fails if the daemon
+ * refused any since the last flush.
+ */
+
+NAN_METHOD(GPIOClient::Flush) {
+  NanScope();
+  PI_CLIENT_OPEN(flush)
+  if (!args[0]->IsFunction()) return NanThrowError("flush() requires a callback argument");
+
+  pi_daemon_cmd_t cmd;
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.op = PI_DAEMON_PING;
+
+  int64_t seq = pi_client_submit(self->client, &cmd);
+  if (seq < 0) return NanThrowError("flush() command ring is full");
+  self->Wait(seq, true, args[0]);
+  NanReturnUndefined();
+}
+
+/**
+ * Disconnect once pending waits finish; the daemon
+ * releases every pin this client holds. Synchronous.
+ */
+
+NAN_METHOD(GPIOClient::Close) {
+  NanScope();
+  GPIOClient* self = node::ObjectWrap::Unwrap<GPIOClient>(args.This());
+
+  self->closing = true;
+  if (self->pending == 0) self->Disconnect();
+  NanReturnUndefined();
+}
+
+} // end namespace
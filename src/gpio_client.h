@@ -0,0 +1,86 @@
+/*!
+ * Only once
+ */
+
+#ifndef __PI_GPIO_CLIENT_H_
+#define __PI_GPIO_CLIENT_H_
+
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <stdint.h>
+
+/*!
+ * Source controlled includes
+ */
+
+#include <pi.h>
+#include "nan.h"
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+/*!
+ * Construct a new GPIOClient connected to a libpi daemon.
+ */
+
+NAN_METHOD(GPIOClientConnect);
+
+/**
+ * Class GPIOClient
+ *
+ * A connection to a libpi daemon that owns the gpio
+ * registers for several processes. Writes are posted to
+ * the client's shared memory ring and reads come from
+ * the daemon's snapshot page, so both are synchronous
+ * and make no syscalls. Claims, releases and flushes
+ * queue their command on the loop thread, the only
+ * producer of the ring, and wait for the daemon on the
+ * threadpool. The connection closes once every pending
+ * wait has finished.
+ *
+ * @type Class
+ * @name GPIOClient
+ * @inherit {ObjectWrap}
+ */
+
+class GPIOClient: public node::ObjectWrap {
+  public:
+    static void Init();
+    static v8::Handle<v8::Value> NewInstance(v8::Handle<v8::Value> name);
+
+    void Done(uint32_t errors);
+
+  private:
+    GPIOClient(pi_client_t *client);
+    ~GPIOClient();
+
+    static NAN_METHOD(New);
+    static NAN_METHOD(Claim);
+    static NAN_METHOD(Release);
+    static NAN_METHOD(Write);
+    static NAN_METHOD(WriteMask);
+    static NAN_METHOD(Read);
+    static NAN_METHOD(ReadMask);
+    static NAN_METHOD(Flush);
+    static NAN_METHOD(Close);
+
+    void Wait(int64_t seq, bool flush, v8::Local<v8::Value> callback);
+    void Disconnect();
+
+    pi_client_t *client;
+    unsigned int pending;
+    bool closing;
+
+    // refusals already reported by a flush
+    uint32_t errors;
+};
+
+} // end namespace
+
+#endif
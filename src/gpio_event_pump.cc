@@ -0,0 +1,236 @@
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <node_buffer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include <vector>
+
+/*!
+ * Local includes
+ */
+
+#include "gpio.h"
+#include "gpio_event_pump.h"
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+GPIOEventPump::GPIOEventPump(
+    GPIO *gpio
+  , v8::Local<v8::Function> callback
+  , uint32_t backlog
+  , uint32_t maxDelay
+) : gpio(gpio)
+  , callback(new NanCallback(callback))
+  , watcher(NULL)
+  , lines(NULL)
+  , ring(NULL)
+  , mask(PI_GPIO_PUMP_SIZE - 1)
+  , head(0)
+  , tail(0)
+  , dropped(0)
+  , backlog(backlog ? backlog : 1)
+  , maxDelay((uint64_t) maxDelay * 1000000ULL)
+  , signalled(0)
+  , oldest(0)
+  , open(0)
+{}
+
+GPIOEventPump::~GPIOEventPump() {
+  if (watcher != NULL) pi_gpio_watcher_delete(watcher);
+  if (lines != NULL) pi_gpio_lines_release(lines);
+  free(ring);
+  delete callback;
+}
+
+/**
+ * Register the wakeup handles and start watching `pins`.
+ * With a `chip`, idle pins wait on kernel edge interrupts
+ * (requesting the lines applies `pull`); otherwise their
+ * levels are checked once per watch window. JS thread
+ * only. On failure the pump frees itself and must not be
+ * used.
+ */
+
+int
+GPIOEventPump::Start(
+    const pi_gpio_pin_t *pins
+  , unsigned int count
+  , const pi_gpio_watch_config_t *config
+  , const char *chip
+  , pi_gpio_pull_t pull
+) {
+  uv_async_init(uv_default_loop(), &async, AsyncDrain);
+  async.data = this;
+  uv_timer_init(uv_default_loop(), &timer);
+  timer.data = this;
+  open = 2;
+
+  ring = (char*) malloc(PI_GPIO_PUMP_SIZE * PI_GPIO_EVENT_BYTES);
+  if (ring == NULL) {
+    Close();
+    return -1;
+  }
+
+  if (chip != NULL) {
+    pi_gpio_lines_config_t lc;
+    memset(&lc, 0, sizeof(lc));
+    lc.mode = PI_GPIO_MODE_INPUT;
+    lc.pull = pull;
+    lc.edge = PI_GPIO_EDGE_BOTH;
+    lc.consumer = "pidaeus";
+    lines = pi_gpio_lines_request(chip, pins, count, &lc);
+    if (lines == NULL) {
+      Close();
+      return -1;
+    }
+  }
+
+  watcher = pi_gpio_watcher_new(
+      gpio->closure
+    , lines
+    , pins
+    , count
+    , config
+    , Push
+    , this
+  );
+
+  if (watcher == NULL || pi_gpio_watcher_start(watcher) < 0) {
+    Close();
+    return -1;
+  }
+
+  uint64_t sweep = maxDelay / 1000000ULL;
+  if (sweep == 0) sweep = 1;
+  uv_timer_start(&timer, TimerDrain, sweep, sweep);
+  uv_unref((uv_handle_t*) &timer);
+  return 0;
+}
+
+/**
+ * Stop the watcher thread before the registers go away.
+ * Records not yet delivered are dropped; the pump frees
+ * itself once its handles close. JS thread only.
+ */
+
+void
+GPIOEventPump::Stop() {
+  pi_gpio_watcher_stop(watcher);
+  Close();
+}
+
+void
+GPIOEventPump::Close() {
+  uv_timer_stop(&timer);
+  uv_close((uv_handle_t*) &async, HandleClose);
+  uv_close((uv_handle_t*) &timer, HandleClose);
+}
+
+/*!
+ * Watcher thread: pack a batch of events, dropping what
+ * does not fit, and wake the loop per the backlog policy.
+ */
+
+void
+GPIOEventPump::Push(const pi_gpio_watch_event_t *events, size_t count, void *data) {
+  GPIOEventPump *self = static_cast<GPIOEventPump*>(data);
+  uint32_t h = self->head;
+
+  for (size_t i = 0; i < count; i++) {
+    if (h - self->tail > self->mask) {
+      __sync_fetch_and_add(&self->dropped, 1);
+      continue;
+    }
+
+    char *record = self->ring + (h & self->mask) * PI_GPIO_EVENT_BYTES;
+    uint32_t time[2] = {
+        (uint32_t) events[i].time
+      , (uint32_t) (events[i].time >> 32)
+    };
+    uint16_t flags = events[i].polled ? PI_GPIO_EVENT_POLLED : 0;
+    memset(record, 0, 8);
+    record[0] = (char) events[i].pin;
+    record[1] = events[i].edge == PI_GPIO_EDGE_RISING ? 1 : 0;
+    memcpy(record + 2, &flags, 2);
+    memcpy(record + 8, time, 8);
+    h++;
+  }
+
+  __sync_synchronize();
+  self->head = h;
+
+  // the timer drained records that were never signalled,
+  // so the next batch starts its delay afresh
+  uint32_t t = self->tail;
+  if ((int32_t) (t - self->signalled) > 0) {
+    self->signalled = t;
+    self->oldest = 0;
+  }
+
+  uint64_t now = uv_hrtime();
+  if (h == self->signalled) return;
+  if (self->oldest == 0) self->oldest = now;
+
+  if (h - self->signalled >= self->backlog || now - self->oldest >= self->maxDelay) {
+    self->signalled = h;
+    self->oldest = 0;
+    uv_async_send(&self->async);
+  }
+}
+
+/*!
+ * Hand every pending record to the callback as one
+ * Buffer, counting an edge per record.
+ */
+
+void
+GPIOEventPump::Drain() {
+  NanScope();
+  uint32_t h = head;
+  uint32_t t = tail;
+
+  __sync_synchronize();
+  if (h == t) return;
+
+  std::vector<char> packed((size_t) (h - t) * PI_GPIO_EVENT_BYTES);
+  for (uint32_t i = 0; t != h; t++, i++) {
+    const char *record = ring + (t & mask) * PI_GPIO_EVENT_BYTES;
+    memcpy(&packed[(size_t) i * PI_GPIO_EVENT_BYTES], record, PI_GPIO_EVENT_BYTES);
+    gpio->stats.RecordEdge((uint8_t) record[0]);
+  }
+
+  __sync_synchronize();
+  tail = h;
+
+  v8::Local<v8::Value> argv[] = {
+    NanNewBufferHandle(&packed[0], (uint32_t) packed.size())
+  };
+
+  callback->Call(1, argv);
+}
+
+void
+GPIOEventPump::AsyncDrain(uv_async_t *handle, int status) {
+  static_cast<GPIOEventPump*>(handle->data)->Drain();
+}
+
+void
+GPIOEventPump::TimerDrain(uv_timer_t *handle, int status) {
+  static_cast<GPIOEventPump*>(handle->data)->Drain();
+}
+
+void
+GPIOEventPump::HandleClose(uv_handle_t *handle) {
+  GPIOEventPump *self = static_cast<GPIOEventPump*>(handle->data);
+  if (--self->open == 0) delete self;
+}
+
+} // end namespace
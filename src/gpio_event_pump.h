@@ -0,0 +1,120 @@
+/*!
+ * Only once
+ */
+
+#ifndef __PI_GPIO_EVENT_PUMP_H_
+#define __PI_GPIO_EVENT_PUMP_H_
+
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <stdint.h>
+#include <uv.h>
+
+/*!
+ * Source controlled includes
+ */
+
+#include <pi.h>
+#include "nan.h"
+
+/*!
+ * Edge records buffered between drains of the loop.
+ */
+
+#define PI_GPIO_PUMP_SIZE 8192
+
+/*!
+ * Bytes per record handed to javascript: pin (uint8),
+ * value (uint8), flags (uint16), reserved (uint32), time
+ * (ns, low then high uint32, exact where a double is
+ * not past 2^53), all little endian.
+ */
+
+#define PI_GPIO_EVENT_BYTES 16
+
+/*!
+ * Record flags.
+ */
+
+#define PI_GPIO_EVENT_POLLED 0x1
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+class GPIO;
+
+/**
+ * Batched delivery of edge events into javascript.
+ *
+ * Wraps a libpi adaptive watcher. The watcher thread packs
+ * events into a ring and wakes the loop once `backlog`
+ * records are waiting or the oldest has waited
+ * `maxDelay` ms; a timer on the loop sweeps up stragglers
+ * at the same interval. Each wakeup hands every pending
+ * record to the callback as one Buffer, so the cost of
+ * entering V8 is paid per batch rather than per edge.
+ */
+
+class GPIOEventPump {
+  public:
+    GPIOEventPump(
+        GPIO *gpio
+      , v8::Local<v8::Function> callback
+      , uint32_t backlog
+      , uint32_t maxDelay
+    );
+
+    int Start(
+        const pi_gpio_pin_t *pins
+      , unsigned int count
+      , const pi_gpio_watch_config_t *config
+      , const char *chip
+      , pi_gpio_pull_t pull
+    );
+
+    void Stop();
+
+  private:
+    ~GPIOEventPump();
+
+    static void Push(const pi_gpio_watch_event_t *events, size_t count, void *data);
+    static void AsyncDrain(uv_async_t *handle, int status);
+    static void TimerDrain(uv_timer_t *handle, int status);
+    static void HandleClose(uv_handle_t *handle);
+
+    void Drain();
+    void Close();
+
+    GPIO *gpio;
+    NanCallback *callback;
+    pi_gpio_watcher_t *watcher;
+    pi_gpio_lines_t *lines;
+
+    // ring, `head` written by the watcher thread only and
+    // `tail` by the loop only
+    char *ring;
+    uint32_t mask;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+
+    // wakeup policy, watcher thread only
+    uint32_t backlog;
+    uint64_t maxDelay;
+    uint32_t signalled;
+    uint64_t oldest;
+
+    uv_async_t async;
+    uv_timer_t timer;
+    int open;
+};
+
+} // end namespace
+
+#endif
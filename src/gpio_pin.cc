@@ -0,0 +1,319 @@
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <sstream>
+
+/*!
+ * Source controlled includes
+ */
+
+#include <pi.h>
+#include <pi_fast.h>
+
+/*!
+ * Local includes
+ */
+
+#include "gpio.h"
+#include "gpio_async.h"
+#include "gpio_pin.h"
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+/*!
+ * v8 Function Template
+ */
+
+static v8::Persistent<v8::FunctionTemplate> constructor;
+
+/*!
+ * Bind arguments, only valid while NewInstance runs.
+ */
+
+static GPIO *pending_gpio = NULL;
+static pi_gpio_pin_t pending_pin = 0;
+static pi_gpio_handle_t *pending_handle = NULL;
+static uint32_t pending_generation = 0;
+
+/**
+ * Initialize a new function template.
+ */
+
+void
+GPIOPin::Init() {
+  v8::Local<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New(New);
+  NanAssignPersistent(v8::FunctionTemplate, constructor, tpl);
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(NanSymbol("GPIOPin"));
+
+  // Prototype (Methods)
+  NODE_SET_PROTOTYPE_METHOD(tpl, "readSync", GPIOPin::ReadSync);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "writeSync", GPIOPin::WriteSync);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "toggleSync", GPIOPin::ToggleSync);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "read", GPIOPin::Read);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "write", GPIOPin::Write);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "toggle", GPIOPin::Toggle);
+}
+
+/**
+ * Create a javascript object for `pin` of `gpio`, which
+ * must be claimed through the mmap method. `owner` is
+ * the GPIO object, kept alive as long as the pin is.
+ * Returns undefined when the pin cannot be bound.
+ */
+
+v8::Handle<v8::Value>
+GPIOPin::NewInstance(
+    v8::Handle<v8::Object> owner
+  , GPIO *gpio
+  , pi_gpio_pin_t pin
+) {
+  NanScope();
+
+  // read before the handle: a claim in between only makes
+  // the new object stale, never the old handle current
+  uint32_t generation = pin < PI_MAX_PINS ? gpio->generations[pin] : 0;
+  GPIOPinUse use(gpio, pin);
+
+  if (!gpio->active || use.handle == NULL || use.handle->method != PI_GPIO_METHOD_MMAP) {
+    return v8::Undefined();
+  }
+
+  pending_gpio = gpio;
+  pending_pin = pin;
+  pending_handle = use.handle;
+  pending_generation = generation;
+  v8::Local<v8::FunctionTemplate> tpl = NanPersistentToLocal(constructor);
+  v8::Local<v8::Object> instance = tpl->GetFunction()->NewInstance(0, NULL);
+  pending_gpio = NULL;
+
+  GPIOPin *self = node::ObjectWrap::Unwrap<GPIOPin>(instance);
+  NanAssignPersistent(v8::Object, self->owner, owner);
+  return instance;
+}
+
+/**
+ * Constructor, only reachable through NewInstance.
+ */
+
+NAN_METHOD(GPIOPin::New) {
+  NanScope();
+
+  if (pending_gpio == NULL) {
+    return NanThrowError("GPIOPin is created by gpio.bindPin()");
+  }
+
+  GPIO *gpio = pending_gpio;
+  GPIOPin *self = new GPIOPin(gpio, pending_pin, pending_handle, pending_generation);
+  self->Wrap(args.This());
+  NanReturnValue(args.This());
+}
+
+GPIOPin::GPIOPin(
+    GPIO *gpio
+  , pi_gpio_pin_t pin
+  , pi_gpio_handle_t *handle
+  , uint32_t generation
+)
+  : gpio(gpio)
+  , pin(pin)
+  , handle(handle)
+  , generation(generation)
+  , mode(pi_gpio_get_mode(handle))
+  , map(gpio->closure->gpio_map)
+{
+  level = pi_fast_read(map, pin);
+}
+
+GPIOPin::~GPIOPin() {
+  NanDispose(owner);
+}
+
+/*!
+ * Still the claim this object was bound to, checked
+ * under `use` so a release cannot free the handle or
+ * unmap the registers until the access is done. The
+ * handle alone is not enough: a release and reclaim can
+ * hand back the same address, so the claim generation
+ * must match too, and the register block must not have
+ * been remapped by a teardown and setup.
+ */
+
+bool
+GPIOPin::Valid(const GPIOPinUse &use) const {
+  return gpio->active
+    && use.handle == handle
+    && gpio->generations[pin] == generation
+    && gpio->closure->gpio_map == map;
+}
+
+/**
+ * Read an input pin. Synchronous.
+ */
+
+NAN_METHOD(GPIOPin::ReadSync) {
+  NanScope();
+  GPIOPin *self = node::ObjectWrap::Unwrap<GPIOPin>(args.This());
+  GPIOPinUse use(self->gpio, self->pin);
+
+  if (!self->Valid(use)) return NanThrowError("readSync() pin has been released");
+  if (self->mode != PI_GPIO_MODE_INPUT) return NanThrowError("readSync() pin is not readable");
+
+  NanReturnValue(v8::Integer::New(pi_fast_read(self->map, self->pin)));
+}
+
+/**
+ * Drive an output pin, non-zero meaning high.
+ * Synchronous.
+ */
+
+NAN_METHOD(GPIOPin::WriteSync) {
+  NanScope();
+  GPIOPin *self = node::ObjectWrap::Unwrap<GPIOPin>(args.This());
+  GPIO *gpio = self->gpio;
+  GPIOPinUse use(gpio, self->pin);
+
+  if (!self->Valid(use)) return NanThrowError("writeSync() pin has been released");
+  if (self->mode != PI_GPIO_MODE_OUTPUT) return NanThrowError("writeSync() pin is not writable");
+  PI_GPIO_UNROUTED(writeSync, self->pin)
+
+  self->level = args[0]->Int32Value() != 0;
+  pi_fast_write(self->map, self->pin, self->level);
+  NanReturnUndefined();
+}
+
+/**
+ * Invert the level last driven through this object and
+ * return the new one. Synchronous.
+ */
+
+NAN_METHOD(GPIOPin::ToggleSync) {
+  NanScope();
+  GPIOPin *self = node::ObjectWrap::Unwrap<GPIOPin>(args.This());
+  GPIO *gpio = self->gpio;
+  GPIOPinUse use(gpio, self->pin);
+
+  if (!self->Valid(use)) return NanThrowError("toggleSync() pin has been released");
+  if (self->mode != PI_GPIO_MODE_OUTPUT) return NanThrowError("toggleSync() pin is not writable");
+  PI_GPIO_UNROUTED(toggleSync, self->pin)
+
+  self->level = !self->level;
+  pi_fast_write(self->map, self->pin, self->level);
+  NanReturnValue(v8::Integer::New(self->level));
+}
+
+/**
+ * Read pin async, through the instance dispatch. The
+ * worker only touches the pin while the claim is still
+ * the bound one.
+ */
+
+NAN_METHOD(GPIOPin::Read) {
+  NanScope();
+  GPIOPin *self = node::ObjectWrap::Unwrap<GPIOPin>(args.This());
+  GPIO *gpio = self->gpio;
+
+  if (!args[0]->IsFunction()) {
+    return NanThrowError("read() requires a callback argument");
+  }
+
+  {
+    GPIOPinUse use(gpio, self->pin);
+    if (!self->Valid(use)) return NanThrowError("read() pin has been released");
+  }
+
+  PinReadWorker *worker = new PinReadWorker(
+      gpio
+    , new NanCallback(args[0].As<v8::Function>())
+    , self->pin
+    , self->handle
+    , self->generation
+  );
+
+  PI_GPIO_DISPATCH(read, worker)
+  NanReturnUndefined();
+}
+
+/**
+ * Write pin async, through the instance dispatch.
+ */
+
+NAN_METHOD(GPIOPin::Write) {
+  NanScope();
+  GPIOPin *self = node::ObjectWrap::Unwrap<GPIOPin>(args.This());
+  GPIO *gpio = self->gpio;
+
+  if (!args[1]->IsFunction()) {
+    return NanThrowError("write() requires a callback argument");
+  }
+
+  {
+    GPIOPinUse use(gpio, self->pin);
+    if (!self->Valid(use)) return NanThrowError("write() pin has been released");
+  }
+
+  PI_GPIO_UNROUTED(write, self->pin)
+
+  self->level = args[0]->Int32Value() != 0;
+  if (!self->DispatchWrite(args[1].As<v8::Function>())) {
+    return NanThrowError("write() gpio queue is full");
+  }
+
+  NanReturnUndefined();
+}
+
+/**
+ * Invert the level last driven through this object,
+ * async.
+ */
+
+NAN_METHOD(GPIOPin::Toggle) {
+  NanScope();
+  GPIOPin *self = node::ObjectWrap::Unwrap<GPIOPin>(args.This());
+  GPIO *gpio = self->gpio;
+
+  if (!args[0]->IsFunction()) {
+    return NanThrowError("toggle() requires a callback argument");
+  }
+
+  {
+    GPIOPinUse use(gpio, self->pin);
+    if (!self->Valid(use)) return NanThrowError("toggle() pin has been released");
+  }
+
+  PI_GPIO_UNROUTED(toggle, self->pin)
+
+  self->level = !self->level;
+  if (!self->DispatchWrite(args[0].As<v8::Function>())) {
+    return NanThrowError("toggle() gpio queue is full");
+  }
+
+  NanReturnUndefined();
+}
+
+/*!
+ * Queue a write of the current level to the bound
+ * claim.
+ */
+
+bool
+GPIOPin::DispatchWrite(v8::Local<v8::Function> callback) {
+  PinWriteWorker *worker = new PinWriteWorker(
+      gpio
+    , new NanCallback(callback)
+    , pin
+    , level ? PI_GPIO_HIGH : PI_GPIO_LOW
+    , handle
+    , generation
+  );
+
+  return gpio->Dispatch(worker);
+}
+
+} // end namespace
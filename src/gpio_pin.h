@@ -0,0 +1,90 @@
+/*!
+ * Only once
+ */
+
+#ifndef __PI_GPIO_PIN_H_
+#define __PI_GPIO_PIN_H_
+
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <stdint.h>
+
+/*!
+ * Source controlled includes
+ */
+
+#include <pi.h>
+#include "nan.h"
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+class GPIO;
+class GPIOPinUse;
+
+/**
+ * Class GPIOPin
+ *
+ * A claimed mmap pin bound to javascript. The register
+ * block, bank and mask are resolved once at bind time so
+ * the synchronous calls are a few compares and one
+ * register access: no state checks, pin table lookup,
+ * handle dereference or worker allocation. The compare
+ * against the instance claim generation makes a pin
+ * released or reclaimed behind its back fail instead of
+ * touching another claim. Synchronous calls are not
+ * counted in the instance stats.
+ *
+ * @type Class
+ * @name GPIOPin
+ * @inherit {ObjectWrap}
+ */
+
+class GPIOPin: public node::ObjectWrap {
+  public:
+    static void Init();
+    static v8::Handle<v8::Value> NewInstance(
+        v8::Handle<v8::Object> owner
+      , GPIO *gpio
+      , pi_gpio_pin_t pin
+    );
+
+  private:
+    GPIOPin(
+        GPIO *gpio
+      , pi_gpio_pin_t pin
+      , pi_gpio_handle_t *handle
+      , uint32_t generation
+    );
+    ~GPIOPin();
+
+    static NAN_METHOD(New);
+    static NAN_METHOD(ReadSync);
+    static NAN_METHOD(WriteSync);
+    static NAN_METHOD(ToggleSync);
+    static NAN_METHOD(Read);
+    static NAN_METHOD(Write);
+    static NAN_METHOD(Toggle);
+
+    bool Valid(const GPIOPinUse &use) const;
+    bool DispatchWrite(v8::Local<v8::Function> callback);
+
+    GPIO *gpio;
+    pi_gpio_pin_t pin;
+    pi_gpio_handle_t *handle;
+    uint32_t generation;
+    pi_gpio_mode_t mode;
+    volatile uint32_t *map;
+    int level;
+    v8::Persistent<v8::Object> owner;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,235 @@
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <uv.h>
+
+/*!
+ * Local includes
+ */
+
+#include "gpio_queue.h"
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+/*!
+ * Queue with room for `size` outstanding workers,
+ * rounded up to a power of two.
+ */
+
+GPIOQueue::GPIOQueue(uint32_t size) {
+  capacity = 1;
+  while (capacity < size) capacity <<= 1;
+  mask = capacity - 1;
+
+  submit = new NanAsyncWorker*[capacity];
+  complete = new NanAsyncWorker*[capacity];
+
+  submitHead = 0;
+  submitTail = 0;
+  completeHead = 0;
+  completeTail = 0;
+  outstanding = 0;
+
+  signalled = 0;
+  sleeping = 0;
+  stopping = 0;
+  exited = 0;
+}
+
+GPIOQueue::~GPIOQueue() {
+  uv_cond_destroy(&cond);
+  uv_mutex_destroy(&mutex);
+  delete[] submit;
+  delete[] complete;
+}
+
+/**
+ * Register the completion handle and start the I/O
+ * thread. JS thread only. On failure the queue frees
+ * itself and must not be used.
+ */
+
+int
+GPIOQueue::Start() {
+  uv_mutex_init(&mutex);
+  uv_cond_init(&cond);
+  uv_async_init(uv_default_loop(), &async, AsyncDrain);
+  async.data = this;
+
+  // only keep the loop alive while work is outstanding
+  uv_unref((uv_handle_t*) &async);
+
+  if (uv_thread_create(&thread, Run, this) != 0) {
+    uv_close((uv_handle_t*) &async, AsyncClose);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Submit a worker. JS thread only. Returns false if
+ * `capacity` workers are already outstanding.
+ */
+
+bool
+GPIOQueue::Push(NanAsyncWorker *worker) {
+  if (outstanding == capacity || stopping) return false;
+  if (outstanding++ == 0) uv_ref((uv_handle_t*) &async);
+
+  submit[submitHead & mask] = worker;
+  __sync_synchronize();
+  submitHead = submitHead + 1;
+  __sync_synchronize();
+
+  if (sleeping) {
+    uv_mutex_lock(&mutex);
+    uv_cond_signal(&cond);
+    uv_mutex_unlock(&mutex);
+  }
+
+  return true;
+}
+
+/**
+ * Let the I/O thread finish queued work and exit; the
+ * queue frees itself once the last completion has been
+ * delivered. JS thread only.
+ */
+
+void
+GPIOQueue::Stop() {
+  uv_ref((uv_handle_t*) &async);
+  uv_mutex_lock(&mutex);
+  stopping = 1;
+  uv_cond_signal(&cond);
+  uv_mutex_unlock(&mutex);
+}
+
+/*!
+ * I/O thread main loop.
+ */
+
+void
+GPIOQueue::Run(void *arg) {
+  GPIOQueue *queue = static_cast<GPIOQueue*>(arg);
+  NanAsyncWorker *worker;
+
+  for (;;) {
+    if (queue->Next(&worker)) {
+      worker->Execute();
+      queue->Complete(worker);
+    } else if (queue->stopping) {
+      break;
+    } else {
+      queue->Wait();
+    }
+  }
+
+  queue->exited = 1;
+  __sync_synchronize();
+  uv_async_send(&queue->async);
+}
+
+/*!
+ * Pop the next submitted worker. I/O thread only.
+ */
+
+bool
+GPIOQueue::Next(NanAsyncWorker **worker) {
+  uint32_t tail = submitTail;
+  if (tail == submitHead) return false;
+  __sync_synchronize();
+  *worker = submit[tail & mask];
+  __sync_synchronize();
+  submitTail = tail + 1;
+  return true;
+}
+
+/*!
+ * Block until work arrives or the queue is stopped.
+ * `sleeping` is published before the final emptiness
+ * check so Push cannot miss the wakeup.
+ */
+
+void
+GPIOQueue::Wait() {
+  uv_mutex_lock(&mutex);
+  sleeping = 1;
+  __sync_synchronize();
+
+  while (submitTail == submitHead && !stopping) {
+    uv_cond_wait(&cond, &mutex);
+  }
+
+  sleeping = 0;
+  uv_mutex_unlock(&mutex);
+}
+
+/*!
+ * Hand a finished worker back to the JS thread and wake
+ * the loop before the next worker starts, which may
+ * block for a long time. The send is skipped while an
+ * earlier one is still undrained, so a burst of quick
+ * workers still costs one wakeup. I/O thread only.
+ */
+
+void
+GPIOQueue::Complete(NanAsyncWorker *worker) {
+  complete[completeHead & mask] = worker;
+  __sync_synchronize();
+  completeHead = completeHead + 1;
+
+  if (__sync_lock_test_and_set(&signalled, 1) == 0) {
+    uv_async_send(&async);
+  }
+}
+
+/*!
+ * Deliver every completed worker. JS thread only.
+ */
+
+void
+GPIOQueue::Drain() {
+  __sync_lock_release(&signalled);
+  __sync_synchronize();
+
+  uint32_t head = completeHead;
+  __sync_synchronize();
+
+  while (completeTail != head) {
+    NanAsyncWorker *worker = complete[completeTail & mask];
+    completeTail = completeTail + 1;
+    outstanding--;
+    worker->WorkComplete();
+    delete worker;
+  }
+
+  if (outstanding == 0 && !stopping) {
+    uv_unref((uv_handle_t*) &async);
+  }
+
+  if (exited && completeTail == completeHead) {
+    exited = 0;
+    uv_thread_join(&thread);
+    uv_close((uv_handle_t*) &async, AsyncClose);
+  }
+}
+
+void
+GPIOQueue::AsyncDrain(uv_async_t *handle, int status) {
+  static_cast<GPIOQueue*>(handle->data)->Drain();
+}
+
+void
+GPIOQueue::AsyncClose(uv_handle_t *handle) {
+  delete static_cast<GPIOQueue*>(handle->data);
+}
+
+} // end namespace
@@ -0,0 +1,97 @@
+/*!
+ * Only once
+ */
+
+#ifndef __PI_GPIO_QUEUE_H_
+#define __PI_GPIO_QUEUE_H_
+
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <stdint.h>
+#include <uv.h>
+
+/*!
+ * Source controlled includes
+ */
+
+#include "nan.h"
+
+/*!
+ * Default ring capacity (power of two).
+ */
+
+#define PI_GPIO_QUEUE_SIZE 1024
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+/**
+ * Dedicated I/O thread for one GPIO instance.
+ *
+ * Workers are submitted from the JS thread into a
+ * single-producer/single-consumer ring and executed in
+ * order by the I/O thread, which pushes them into a
+ * second SPSC ring. Each completion is signalled before
+ * the next worker starts, so a callback never waits on
+ * a later worker; one `uv_async_t` wakeup covers every
+ * completion until the loop drains. Both rings hold at
+ * most `capacity` workers in total, so the completion
+ * ring can never fill while the I/O thread holds a
+ * worker.
+ */
+
+class GPIOQueue {
+  public:
+    GPIOQueue(uint32_t capacity);
+
+    int Start();
+    bool Push(NanAsyncWorker *worker);
+    void Stop();
+
+    uv_thread_t thread;
+
+  private:
+    ~GPIOQueue();
+
+    static void Run(void *arg);
+    static void AsyncDrain(uv_async_t *handle, int status);
+    static void AsyncClose(uv_handle_t *handle);
+
+    bool Next(NanAsyncWorker **worker);
+    void Complete(NanAsyncWorker *worker);
+    void Drain();
+    void Wait();
+
+    uint32_t capacity;
+    uint32_t mask;
+    NanAsyncWorker **submit;
+    NanAsyncWorker **complete;
+
+    // written by the JS thread
+    volatile uint32_t submitHead;
+    volatile uint32_t completeTail;
+    uint32_t outstanding;
+
+    // written by the I/O thread
+    volatile uint32_t submitTail;
+    volatile uint32_t completeHead;
+
+    volatile int signalled;
+    volatile int sleeping;
+    volatile int stopping;
+    volatile int exited;
+
+    uv_async_t async;
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+};
+
+} // end namespace
+
+#endif
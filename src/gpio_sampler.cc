@@ -0,0 +1,150 @@
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <node_buffer.h>
+#include <string.h>
+#include <uv.h>
+#include <vector>
+
+/*!
+ * Local includes
+ */
+
+#include "gpio.h"
+#include "gpio_sampler.h"
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+/*!
+ * Records copied out of libpi per read.
+ */
+
+#define SAMPLER_READ 256
+
+GPIOSampler::GPIOSampler(GPIO *gpio, v8::Local<v8::Function> callback)
+  : gpio(gpio)
+  , callback(new NanCallback(callback))
+  , sampler(NULL)
+{}
+
+GPIOSampler::~GPIOSampler() {
+  if (sampler != NULL) pi_sampler_delete(sampler);
+  delete callback;
+}
+
+/**
+ * Register the wakeup handle and start polling `mask`
+ * `rate` times a second. JS thread only. On failure the
+ * sampler frees itself and must not be used.
+ */
+
+int
+GPIOSampler::Start(uint32_t rate, uint32_t mask) {
+  uv_async_init(uv_default_loop(), &async, AsyncDrain);
+  async.data = this;
+
+  sampler = pi_sampler_new(
+      gpio->closure
+    , rate
+    , PI_GPIO_SAMPLER_SIZE
+    , Notify
+    , this
+  );
+
+  if (sampler == NULL || pi_sampler_start(sampler, mask) < 0) {
+    uv_close((uv_handle_t*) &async, AsyncClose);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Change the watched pins. JS thread only.
+ */
+
+void
+GPIOSampler::SetMask(uint32_t mask) {
+  pi_sampler_set_mask(sampler, mask);
+}
+
+/**
+ * Stop the sampler thread before the registers go
+ * away. Records not yet delivered are dropped; the
+ * sampler frees itself once the handle closes. JS
+ * thread only.
+ */
+
+void
+GPIOSampler::Stop() {
+  pi_sampler_stop(sampler);
+  uv_close((uv_handle_t*) &async, AsyncClose);
+}
+
+/*!
+ * Sampler thread: records are waiting.
+ */
+
+void
+GPIOSampler::Notify(void *data) {
+  GPIOSampler *self = static_cast<GPIOSampler*>(data);
+  uv_async_send(&self->async);
+}
+
+/*!
+ * Pack every pending record into one Buffer for the
+ * callback, counting an edge per changed pin.
+ */
+
+void
+GPIOSampler::Drain() {
+  NanScope();
+  pi_sample_t samples[SAMPLER_READ];
+  std::vector<char> packed;
+  size_t n;
+
+  do {
+    n = pi_sampler_read(sampler, samples, SAMPLER_READ);
+    for (size_t i = 0; i < n; i++) {
+      char record[PI_GPIO_SAMPLE_BYTES];
+      uint32_t time[2] = {
+          (uint32_t) samples[i].time
+        , (uint32_t) (samples[i].time >> 32)
+      };
+      memcpy(record, time, 8);
+      memcpy(record + 8, &samples[i].levels, 4);
+      memcpy(record + 12, &samples[i].changed, 4);
+      packed.insert(packed.end(), record, record + PI_GPIO_SAMPLE_BYTES);
+
+      for (uint32_t changed = samples[i].changed; changed; changed &= changed - 1) {
+        gpio->stats.RecordEdge(__builtin_ctz(changed));
+      }
+    }
+  } while (n == SAMPLER_READ);
+
+  if (packed.empty()) return;
+
+  v8::Local<v8::Value> argv[] = {
+    NanNewBufferHandle(&packed[0], (uint32_t) packed.size())
+  };
+
+  callback->Call(1, argv);
+}
+
+void
+GPIOSampler::AsyncDrain(uv_async_t *handle, int status) {
+  static_cast<GPIOSampler*>(handle->data)->Drain();
+}
+
+void
+GPIOSampler::AsyncClose(uv_handle_t *handle) {
+  delete static_cast<GPIOSampler*>(handle->data);
+}
+
+} // end namespace
@@ -0,0 +1,79 @@
+/*!
+ * Only once
+ */
+
+#ifndef __PI_GPIO_SAMPLER_H_
+#define __PI_GPIO_SAMPLER_H_
+
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <stdint.h>
+#include <uv.h>
+
+/*!
+ * Source controlled includes
+ */
+
+#include <pi.h>
+#include "nan.h"
+
+/*!
+ * Change records buffered between wakeups of the loop.
+ */
+
+#define PI_GPIO_SAMPLER_SIZE 4096
+
+/*!
+ * Bytes per record handed to javascript: time (ns, low
+ * then high uint32), levels (uint32), changed (uint32),
+ * all little endian.
+ */
+
+#define PI_GPIO_SAMPLE_BYTES 16
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+class GPIO;
+
+/**
+ * Native change-only sampler for one GPIO instance.
+ *
+ * Wraps a libpi sampler thread polling bank 0 at a fixed
+ * rate. The thread signals one `uv_async_t` when records
+ * arrive after a drain; the loop then passes every
+ * pending record to the callback as a single Buffer.
+ */
+
+class GPIOSampler {
+  public:
+    GPIOSampler(GPIO *gpio, v8::Local<v8::Function> callback);
+
+    int Start(uint32_t rate, uint32_t mask);
+    void SetMask(uint32_t mask);
+    void Stop();
+
+  private:
+    ~GPIOSampler();
+
+    static void Notify(void *data);
+    static void AsyncDrain(uv_async_t *handle, int status);
+    static void AsyncClose(uv_handle_t *handle);
+
+    void Drain();
+
+    GPIO *gpio;
+    NanCallback *callback;
+    pi_sampler_t *sampler;
+    uv_async_t async;
+};
+
+} // end namespace
+
+#endif
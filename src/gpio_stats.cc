@@ -0,0 +1,247 @@
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <string.h>
+#include <uv.h>
+#include <v8.h>
+
+/*!
+ * Source controlled includes
+ */
+
+#include "nan.h"
+
+/*!
+ * Local includes
+ */
+
+#include "gpio_stats.h"
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+/*!
+ * Names for GPIOStatsOp, in order.
+ */
+
+static const char *op_names[GPIO_STATS_OPS] = {
+    "setup"
+  , "teardown"
+  , "claim"
+  , "release"
+  , "read"
+  , "write"
+  , "writeBuffer"
+  , "pwm"
+  , "program"
+};
+
+/*!
+ * Map a value to its histogram bucket.
+ */
+
+static inline int
+bucket_index(uint64_t v) {
+  if (v < PI_STATS_SUB_COUNT) return (int) v;
+  int msb = 63 - __builtin_clzll(v);
+  int shift = msb - PI_STATS_SUB_BITS;
+  int idx = ((shift + 1) << PI_STATS_SUB_BITS)
+    + (int) ((v >> shift) - PI_STATS_SUB_COUNT);
+  return idx < PI_STATS_BUCKETS ? idx : PI_STATS_BUCKETS - 1;
+}
+
+/*!
+ * Highest value that maps to a bucket.
+ */
+
+static inline uint64_t
+bucket_value(int idx) {
+  if (idx < PI_STATS_SUB_COUNT) return idx;
+  int shift = (idx >> PI_STATS_SUB_BITS) - 1;
+  uint64_t lower = (uint64_t) (PI_STATS_SUB_COUNT + (idx & (PI_STATS_SUB_COUNT - 1))) << shift;
+  return lower + (1ULL << shift) - 1;
+}
+
+/*!
+ * Histogram
+ */
+
+void
+GPIOHistogram::Record(uint64_t ns) {
+  __sync_fetch_and_add(&counts[bucket_index(ns)], 1);
+}
+
+void
+GPIOHistogram::Reset() {
+  memset((void*) counts, 0, sizeof(counts));
+}
+
+/**
+ * Snapshot as `{ count, min, p50, p90, p99, max }` in
+ * nanoseconds.
+ */
+
+v8::Local<v8::Object>
+GPIOHistogram::ToObject() const {
+  uint32_t snap[PI_STATS_BUCKETS];
+  uint64_t total = 0;
+  int first = -1;
+  int last = -1;
+
+  for (int i = 0; i < PI_STATS_BUCKETS; i++) {
+    snap[i] = counts[i];
+    if (snap[i] == 0) continue;
+    if (first < 0) first = i;
+    last = i;
+    total += snap[i];
+  }
+
+  static const double quantiles[] = { 0.5, 0.9, 0.99 };
+  static const char *names[] = { "p50", "p90", "p99" };
+  uint64_t values[3] = { 0, 0, 0 };
+
+  for (int q = 0, i = 0; q < 3 && total > 0; q++) {
+    uint64_t rank = (uint64_t) (quantiles[q] * total);
+    uint64_t seen = 0;
+    for (i = 0; i < PI_STATS_BUCKETS; i++) {
+      seen += snap[i];
+      if (seen > rank) break;
+    }
+    values[q] = bucket_value(i < PI_STATS_BUCKETS ? i : last);
+  }
+
+  v8::Local<v8::Object> obj = v8::Object::New();
+  obj->Set(NanSymbol("count"), v8::Number::New(total));
+  obj->Set(NanSymbol("min"), v8::Number::New(first < 0 ? 0 : bucket_value(first)));
+
+  for (int q = 0; q < 3; q++) {
+    obj->Set(NanSymbol(names[q]), v8::Number::New(values[q]));
+  }
+
+  obj->Set(NanSymbol("max"), v8::Number::New(last < 0 ? 0 : bucket_value(last)));
+  return obj;
+}
+
+/*!
+ * Stats
+ */
+
+GPIOStats::GPIOStats() {
+  enabled = false;
+  Reset();
+}
+
+uint64_t
+GPIOStats::Now() {
+  return uv_hrtime();
+}
+
+/**
+ * Record a finished operation. `queued` is when it was
+ * submitted on the JS thread, `started` when Execute()
+ * picked it up; both come from Begin().
+ */
+
+void
+GPIOStats::Record(
+    GPIOStatsOp op
+  , pi_gpio_pin_t pin
+  , uint64_t queued
+  , uint64_t started
+  , bool success)
+{
+  if (!enabled || queued == 0 || started == 0) return;
+
+  uint64_t now = Now();
+  Op *o = &ops[op];
+  __sync_fetch_and_add(&o->count, 1);
+  if (!success) __sync_fetch_and_add(&o->errors, 1);
+  o->queue.Record(started - queued);
+  o->execute.Record(now - started);
+
+  if (!success || pin >= PI_STATS_PINS) return;
+
+  switch (op) {
+    case GPIO_STATS_READ:
+      __sync_fetch_and_add(&pins[pin].reads, 1);
+      break;
+    case GPIO_STATS_WRITE:
+    case GPIO_STATS_WRITE_BUFFER:
+    case GPIO_STATS_PWM:
+      __sync_fetch_and_add(&pins[pin].writes, 1);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Count an edge delivered for a pin.
+ */
+
+void
+GPIOStats::RecordEdge(pi_gpio_pin_t pin) {
+  if (!enabled || pin >= PI_STATS_PINS) return;
+  __sync_fetch_and_add(&pins[pin].edges, 1);
+}
+
+void
+GPIOStats::Reset() {
+  for (int i = 0; i < GPIO_STATS_OPS; i++) {
+    ops[i].count = 0;
+    ops[i].errors = 0;
+    ops[i].queue.Reset();
+    ops[i].execute.Reset();
+  }
+
+  memset((void*) pins, 0, sizeof(pins));
+}
+
+/**
+ * Snapshot as a plain object:
+ *
+ *     { enabled: Boolean
+ *     , ops: { <name>: { count, errors, queue, execute } }
+ *     , pins: { <pin>: { reads, writes, edges } } }
+ *
+ * Only pins with activity are included.
+ */
+
+v8::Local<v8::Object>
+GPIOStats::ToObject() const {
+  v8::Local<v8::Object> obj = v8::Object::New();
+  v8::Local<v8::Object> opsObj = v8::Object::New();
+  v8::Local<v8::Object> pinsObj = v8::Object::New();
+
+  for (int i = 0; i < GPIO_STATS_OPS; i++) {
+    const Op *o = &ops[i];
+    v8::Local<v8::Object> opObj = v8::Object::New();
+    opObj->Set(NanSymbol("count"), v8::Number::New(o->count));
+    opObj->Set(NanSymbol("errors"), v8::Number::New(o->errors));
+    opObj->Set(NanSymbol("queue"), o->queue.ToObject());
+    opObj->Set(NanSymbol("execute"), o->execute.ToObject());
+    opsObj->Set(NanSymbol(op_names[i]), opObj);
+  }
+
+  for (uint32_t i = 0; i < PI_STATS_PINS; i++) {
+    const Pin *p = &pins[i];
+    if (!p->reads && !p->writes && !p->edges) continue;
+    v8::Local<v8::Object> pinObj = v8::Object::New();
+    pinObj->Set(NanSymbol("reads"), v8::Number::New(p->reads));
+    pinObj->Set(NanSymbol("writes"), v8::Number::New(p->writes));
+    pinObj->Set(NanSymbol("edges"), v8::Number::New(p->edges));
+    pinsObj->Set(i, pinObj);
+  }
+
+  obj->Set(NanSymbol("enabled"), v8::Boolean::New(enabled));
+  obj->Set(NanSymbol("ops"), opsObj);
+  obj->Set(NanSymbol("pins"), pinsObj);
+  return obj;
+}
+
+} // end namespace
@@ -0,0 +1,132 @@
+/*!
+ * Only once
+ */
+
+#ifndef __PI_GPIO_STATS_H_
+#define __PI_GPIO_STATS_H_
+
+/*!
+ * External includes
+ */
+
+#include <node.h>
+#include <stdint.h>
+#include <v8.h>
+
+/*!
+ * Source controlled includes
+ */
+
+#include <pi.h>
+
+/*!
+ * Histogram precision: 2^PI_STATS_SUB_BITS buckets per
+ * power of two (~12% relative error) up to 2^47 ns.
+ */
+
+#define PI_STATS_SUB_BITS 3
+#define PI_STATS_SUB_COUNT (1 << PI_STATS_SUB_BITS)
+#define PI_STATS_MAX_BITS 48
+#define PI_STATS_BUCKETS ((PI_STATS_MAX_BITS - PI_STATS_SUB_BITS + 1) << PI_STATS_SUB_BITS)
+
+/*!
+ * Stat pins (mirrors PI_MAX_PINS)
+ */
+
+#define PI_STATS_PINS 31
+
+/*!
+ * Start namespace
+ */
+
+namespace pidaeus {
+
+/*!
+ * Operation types tracked by GPIOStats.
+ */
+
+enum GPIOStatsOp {
+    GPIO_STATS_SETUP = 0
+  , GPIO_STATS_TEARDOWN
+  , GPIO_STATS_CLAIM
+  , GPIO_STATS_RELEASE
+  , GPIO_STATS_READ
+  , GPIO_STATS_WRITE
+  , GPIO_STATS_WRITE_BUFFER
+  , GPIO_STATS_PWM
+  , GPIO_STATS_PROGRAM
+  , GPIO_STATS_OPS
+};
+
+/**
+ * Log-linear latency histogram. Recording is a single
+ * atomic increment and safe from any thread.
+ */
+
+class GPIOHistogram {
+  public:
+    void Record(uint64_t ns);
+    void Reset();
+    v8::Local<v8::Object> ToObject() const;
+
+  private:
+    volatile uint32_t counts[PI_STATS_BUCKETS];
+};
+
+/**
+ * Per-operation and per-pin counters for a GPIO
+ * instance. Every field is updated with atomic adds so
+ * threadpool workers never take a lock; snapshots are
+ * read without stopping writers.
+ */
+
+class GPIOStats {
+  public:
+    GPIOStats();
+
+    static uint64_t Now();
+
+    /*!
+     * Returns a timestamp to pass to Record, or 0 when
+     * collection is disabled.
+     */
+
+    uint64_t Begin() const {
+      return enabled ? Now() : 0;
+    };
+
+    void Record(
+        GPIOStatsOp op
+      , pi_gpio_pin_t pin
+      , uint64_t queued
+      , uint64_t started
+      , bool success
+    );
+
+    void RecordEdge(pi_gpio_pin_t pin);
+    void Reset();
+    v8::Local<v8::Object> ToObject() const;
+
+    volatile bool enabled;
+
+  private:
+    struct Op {
+      volatile uint32_t count;
+      volatile uint32_t errors;
+      GPIOHistogram queue;
+      GPIOHistogram execute;
+    };
+
+    struct Pin {
+      volatile uint32_t reads;
+      volatile uint32_t writes;
+      volatile uint32_t edges;
+    };
+
+    Op ops[GPIO_STATS_OPS];
+    Pin pins[PI_STATS_PINS];
+};
+
+} // end namespace
+
+#endif
@@ -15,6 +15,7 @@
  */
 
 #include "gpio.h"
+#include "gpio_client.h"
 
 /*!
  * Start namespace
@@ -28,9 +29,13 @@ namespace pidaeus {
 
 void Init (v8::Handle<v8::Object> target) {
   GPIO::Init();
+  GPIOClient::Init();
 
   v8::Local<v8::Function> gpioc = v8::FunctionTemplate::New(GPIOConstruct)->GetFunction();
   target->Set(NanSymbol("GPIO"), gpioc);
+
+  v8::Local<v8::Function> connect = v8::FunctionTemplate::New(GPIOClientConnect)->GetFunction();
+  target->Set(NanSymbol("connect"), connect);
 }
 
 /*!
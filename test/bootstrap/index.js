@@ -33,3 +33,36 @@ function req (name) {
  */
 
 global.__pidaeus = {};
+global.__pidaeus.EventBatch = req('gpio/event-batch');
+global.__pidaeus.Pin = req('gpio/pin');
+
+/**
+ * Stand-in for a native handle, for specs of the packing
+ * and argument handling in front of the binding. Each of
+ * `names` records `[ name, args... ]` in `handle.calls`
+ * (callbacks left out), calls back with `err` when given
+ * a callback, and returns `returns[name](args...)` when
+ * that is given.
+ *
+ * @param {Array} method names
+ * @param {Object} options `err`, `returns`
+ * @return {Object} handle
+ */
+
+global.stubHandle = function (names, opts) {
+  opts = opts || {};
+  var returns = opts.returns || {};
+  var handle = { calls: [] };
+
+  names.forEach(function (name) {
+    handle[name] = function () {
+      var args = [].slice.call(arguments);
+      var cb = 'function' === typeof args[args.length - 1] ? args.pop() : null;
+      handle.calls.push([ name ].concat(args));
+      if (cb) cb(opts.err ? new Error(name + ' failed') : null);
+      return returns[name] ? returns[name].apply(null, args) : undefined;
+    };
+  });
+
+  return handle;
+};
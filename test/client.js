@@ -0,0 +1,73 @@
+describe('Client', function () {
+  var Client = pidaeus.Client;
+
+  // a client over a stand-in daemon connection
+  function fake() {
+    var client = Object.create(Client.prototype);
+    client.name = '/fake';
+    client._handle = stubHandle(
+        [ 'claim', 'release', 'write', 'writeMask', 'read', 'readMask', 'flush', 'close' ]
+      , { returns: { write: queued } }
+    );
+    return client;
+  }
+
+  function queued() {
+    return true;
+  }
+
+  it('should throw when no daemon serves the name', function () {
+    (function () {
+      new Client('/pidaeus-test-no-daemon');
+    }).should.throw();
+  });
+
+  describe('.claim()', function () {
+    it('should default options', function (done) {
+      var client = fake();
+      client.claim(17, function (err) {
+        should.not.exist(err);
+        client._handle.calls.should.eql([ [ 'claim', 17, {} ] ]);
+        done();
+      });
+    });
+  });
+
+  describe('.write()', function () {
+    it('should send levels as 0 or 1', function () {
+      var client = fake();
+      client.write(17, 5).should.equal(true);
+      client.write(17, 0);
+      client.write(17, null);
+      client._handle.calls.should.eql([
+          [ 'write', 17, 1 ]
+        , [ 'write', 17, 0 ]
+        , [ 'write', 17, 0 ]
+      ]);
+    });
+  });
+
+  describe('.writeMask()', function () {
+    it('should send unsigned masks, clearing nothing by default', function () {
+      var client = fake();
+      client.writeMask(1 << 31);
+      client.writeMask(-1, 1 << 4);
+      client._handle.calls.should.eql([
+          [ 'writeMask', 0x80000000, 0 ]
+        , [ 'writeMask', 0xffffffff, 0x10 ]
+      ]);
+    });
+  });
+
+  describe('.flush()', function () {
+    it('should hand the callback to the handle', function (done) {
+      var client = fake();
+      client.write(17, 1);
+      client.flush(function (err) {
+        should.not.exist(err);
+        client._handle.calls.should.eql([ [ 'write', 17, 1 ], [ 'flush' ] ]);
+        done();
+      });
+    });
+  });
+});
@@ -0,0 +1,55 @@
+describe('EventBatch', function () {
+  var EventBatch = __pidaeus.EventBatch;
+
+  // records as the native event pump packs them
+  function pack(events) {
+    var buf = new Buffer(events.length * 16);
+    buf.fill(0);
+    events.forEach(function (ev, i) {
+      buf.writeUInt8(ev.pin, i * 16);
+      buf.writeUInt8(ev.value, i * 16 + 1);
+      buf.writeUInt16LE(ev.polled ? 1 : 0, i * 16 + 2);
+      buf.writeUInt32LE(ev.time % 0x100000000, i * 16 + 8);
+      buf.writeUInt32LE(Math.floor(ev.time / 0x100000000), i * 16 + 12);
+    });
+    return buf;
+  }
+
+  var events = [
+      { pin: 4, value: 1, time: 1000, polled: false }
+    , { pin: 30, value: 0, time: 2500, polled: true }
+    , { pin: 4, value: 0, time: 9007199254740000, polled: false }
+  ];
+
+  it('should count whole records only', function () {
+    new EventBatch(pack(events)).length.should.equal(3);
+    new EventBatch(pack(events).slice(0, 40)).length.should.equal(2);
+    new EventBatch(new Buffer(0)).length.should.equal(0);
+  });
+
+  it('should decode each field by index', function () {
+    var batch = new EventBatch(pack(events));
+    batch.pin(1).should.equal(30);
+    batch.value(0).should.equal(1);
+    batch.time(2).should.equal(9007199254740000);
+    batch.polled(1).should.equal(true);
+    batch.polled(2).should.equal(false);
+  });
+
+  it('should keep every nanosecond past 2^53', function () {
+    var buf = new Buffer(16);
+    buf.fill(0);
+    // 2^53 + 1 ns, which a double cannot hold
+    buf.writeUInt32LE(1, 8);
+    buf.writeUInt32LE(0x200000, 12);
+    new EventBatch(buf).hrtime(0).should.eql([ 9007199, 254740993 ]);
+  });
+
+  it('should iterate in order with a context', function () {
+    var ctx = { seen: [] };
+    new EventBatch(pack(events)).forEach(function (pin, value, time, polled) {
+      this.seen.push({ pin: pin, value: value, time: time, polled: polled });
+    }, ctx);
+    ctx.seen.should.eql(events);
+  });
+});
@@ -3,12 +3,13 @@ var GPIO_PIN = 4;
 describe('GPIO', function () {
   var GPIO = pidaeus.GPIO;
 
-  function setup(cb) {
-    var gpio = new GPIO;
+  function setup(opts, cb) {
+    if ('function' === typeof opts) cb = opts, opts = {};
+    var gpio = new GPIO({ simulate: true, thread: opts.thread });
     gpio.setup(function (err) {
       should.not.exist(err);
       cb(gpio, function (done) {
-        gpio.destroy(function (err) {
+        gpio.teardown(function (err) {
           should.not.exist(err);
           done();
         });
@@ -16,169 +17,203 @@ describe('GPIO', function () {
     });
   }
 
-  describe('(setup/destroy)', function () {
+  describe('(setup/teardown)', function () {
     it('should invoke callbacks', function (done) {
-      var gpio = new GPIO;
-
-      gpio.setup(function (err) {
-        should.not.exist(err);
-        gpio.destroy(function (err) {
-          should.not.exist(err);
-          done();
-        });
+      setup(function (gpio, teardown) {
+        teardown(done);
       });
     });
 
-    it('should emit proper events', function (done) {
-      var gpio = new GPIO
-        , errSpy = chai.spy('error')
-        , readySpy = chai.spy('ready', function () {
-            gpio.destroy();
-          });
+    it('should emit ready', function (done) {
+      var gpio = new GPIO({ simulate: true })
+        , readySpy = chai.spy('ready');
 
       gpio.on('ready', readySpy);
-      gpio.on('close', function () {
-        errSpy.should.not.have.been.called;
+      gpio.setup(function (err) {
+        should.not.exist(err);
         readySpy.should.have.been.called.once;
-        done();
+        gpio.teardown(done);
       });
+    });
 
-      gpio.setup();
+    it('should report calls made before setup', function (done) {
+      var gpio = new GPIO;
+      gpio.claim(GPIO_PIN, function (err) {
+        should.exist(err);
+        err.message.should.match(/not ready/);
+        done();
+      });
     });
   });
 
   describe('(pin management)', function () {
-    describe('.claimSync()', function () {
-      it('should claimSync a pin with default options', function (done) {
-        setup(function (gpio, destroy) {
-          (function () {
-            gpio.claimSync(GPIO_PIN);
-          }).should.not.throw();
-          destroy(done);
-        });
-      });
-
-      it('should claimSync a pin with direction = "in"', function (done) {
-        setup(function (gpio, destroy) {
-          (function () {
-            gpio.claimSync(GPIO_PIN, 'in');
-          }).should.not.throw();
-          destroy(done);
+    describe('.claim()', function () {
+      it('should claim a pin with default options', function (done) {
+        setup(function (gpio, teardown) {
+          gpio.claim(GPIO_PIN, function (err) {
+            should.not.exist(err);
+            teardown(done);
+          });
         });
       });
 
-      it('should claimSync a pin with direction = "out"', function (done) {
-        setup(function (gpio, destroy) {
-          (function () {
-            gpio.claimSync(GPIO_PIN, 'out');
-          }).should.not.throw();
-          destroy(done);
+      it('should claim a pin as an output', function (done) {
+        setup(function (gpio, teardown) {
+          gpio.claim(GPIO_PIN, { direction: 1 }, function (err) {
+            should.not.exist(err);
+            teardown(done);
+          });
         });
       });
 
-      it('should throw error if already claimed', function (done) {
-        setup(function (gpio, destroy) {
-          (function () {
-            gpio.claimSync(GPIO_PIN);
-          }).should.not.throw();
-          (function () {
-            gpio.claimSync(GPIO_PIN);
-          }).should.throw(/already claimed/);
-          destroy(done);
+      it('should error if already claimed', function (done) {
+        setup(function (gpio, teardown) {
+          gpio.claim(GPIO_PIN, function (err) {
+            should.not.exist(err);
+            gpio.claim(GPIO_PIN, function (err) {
+              should.exist(err);
+              err.message.should.match(/already claimed/);
+              teardown(done);
+            });
+          });
         });
       });
     });
 
-    describe('.releaseSync()', function () {
+    describe('.release()', function () {
       it('should release a pin', function (done) {
-        setup(function (gpio, destroy) {
-          gpio.claimSync(GPIO_PIN);
-          (function () {
-            gpio.releaseSync(GPIO_PIN);
-          }).should.not.throw();
-          destroy(done);
+        setup(function (gpio, teardown) {
+          gpio.claim(GPIO_PIN, function (err) {
+            should.not.exist(err);
+            gpio.release(GPIO_PIN, function (err) {
+              should.not.exist(err);
+              teardown(done);
+            });
+          });
         });
       });
 
-      it('should throw if not claimed', function (done) {
-        setup(function (gpio, destroy) {
-          (function () {
-            gpio.releaseSync(GPIO_PIN);
-          }).should.throw(/not been claimed/);
-          destroy(done);
+      it('should error if not claimed', function (done) {
+        setup(function (gpio, teardown) {
+          gpio.release(GPIO_PIN, function (err) {
+            should.exist(err);
+            err.message.should.match(/not been claimed/);
+            teardown(done);
+          });
         });
       });
     });
   });
 
   describe('(io)', function () {
-    describe.only('.stat()', function () {
-      it('should return an object', function (done) {
-        setup(function (gpio, destroy) {
-          gpio.claimSync(GPIO_PIN);
-          stat = gpio.stat(GPIO_PIN, function (err, stat) {
+    describe('.read()', function () {
+      it('should read an input', function (done) {
+        setup(function (gpio, teardown) {
+          gpio.claim(GPIO_PIN, function (err) {
+            should.not.exist(err);
+            gpio.read(GPIO_PIN, function (err, value) {
+              should.not.exist(err);
+              value.should.be.a('number');
+              teardown(done);
+            });
+          });
+        });
+      });
+
+      it('should refuse an output', function (done) {
+        setup(function (gpio, teardown) {
+          gpio.claim(GPIO_PIN, { direction: 1 }, function (err) {
             should.not.exist(err);
-            gpio.releaseSync(GPIO_PIN);
-            should.exist(stat);
-            stat.should
-              .have.property('pin')
-              .a('number').equal(GPIO_PIN);
-            stat.should
-              .have.property('claimSynced')
-              .a('boolean').equal(true);
-            stat.should
-              .have.property('direction')
-              .a('string').equal('in');
-            destroy(done);
+            gpio.read(GPIO_PIN, function (err) {
+              should.exist(err);
+              err.message.should.match(/not readable/);
+              teardown(done);
+            });
           });
         });
       });
     });
 
-    describe('.setDirection()', function () {
-      it('should set direction of pin', function (done) {
-        var gpio = new GPIO
-          , stat;
-
-        gpio.setup(function () {
-          gpio.claimSync(GPIO_PIN);
-          stat = gpio.stat(GPIO_PIN);
-          stat.should.have.property('direction', 'in');
-          gpio.setDirection(GPIO_PIN, "out");
-          stat = gpio.stat(GPIO_PIN);
-          gpio.releaseSync(GPIO_PIN);
-          stat.should.have.property('direction', 'out');
-          gpio.destroy(done);
+    describe('.write()', function () {
+      it('should write an output', function (done) {
+        setup(function (gpio, teardown) {
+          gpio.claim(GPIO_PIN, { direction: 1 }, function (err) {
+            should.not.exist(err);
+            gpio.write(GPIO_PIN, 1, function (err) {
+              should.not.exist(err);
+              teardown(done);
+            });
+          });
+        });
+      });
+
+      it('should refuse an input', function (done) {
+        setup(function (gpio, teardown) {
+          gpio.claim(GPIO_PIN, function (err) {
+            should.not.exist(err);
+            gpio.write(GPIO_PIN, 1, function (err) {
+              should.exist(err);
+              err.message.should.match(/not writable/);
+              teardown(done);
+            });
+          });
         });
       });
     });
+  });
 
-    describe('.read()', function () {
-      it('should read a pin\'s value', function (done) {
-        var gpio = new GPIO
-          , val;
-
-        gpio.setup(function () {
-          gpio.claimSync(GPIO_PIN, 'in', "up");
-          (function () {
-            val = gpio.read(GPIO_PIN);
-          }).should.not.throw();
-          val.should.be.a('number').equal(1);
-          gpio.destroy(done);
+  describe('(thread)', function () {
+    it('should complete operations in order', function (done) {
+      setup({ thread: true }, function (gpio, teardown) {
+        var seen = [];
+
+        gpio.claim(GPIO_PIN, { direction: 1 }, function (err) {
+          should.not.exist(err);
+          seen.push('claim');
+        });
+
+        gpio.write(GPIO_PIN, 1, function (err) {
+          should.not.exist(err);
+          seen.push('write');
+        });
+
+        gpio.writeBuffer(GPIO_PIN, new Buffer([ 0, 1, 0 ]), function (err) {
+          should.not.exist(err);
+          seen.push('writeBuffer');
+        });
+
+        gpio.release(GPIO_PIN, function (err) {
+          should.not.exist(err);
+          seen.push('release');
+          seen.should.eql([ 'claim', 'write', 'writeBuffer', 'release' ]);
+          teardown(done);
         });
       });
     });
 
-    describe('.write()', function () {
-      it('should write a value to a pin', function (done) {
-        var gpio = new GPIO;
-
-        gpio.setup(function () {
-          gpio.claimSync(GPIO_PIN, 'out');
-          (function () {
-            gpio.write(GPIO_PIN, 1);
-          }).should.not.throw();
-          gpio.destroy(done);
+    it('should deliver a completion while a later operation runs', function (done) {
+      setup({ thread: true }, function (gpio, teardown) {
+        gpio.claim(GPIO_PIN, { direction: 1 }, function (err) {
+          should.not.exist(err);
+
+          var values = new Buffer(50)
+            , start = Date.now()
+            , delivered = null;
+
+          values.fill(1);
+
+          gpio.write(GPIO_PIN, 0, function (err) {
+            should.not.exist(err);
+            delivered = Date.now() - start;
+          });
+
+          // 50 values 10ms apart keeps the thread busy ~0.5s
+          gpio.writeBuffer(GPIO_PIN, values, 10000000, function (err) {
+            should.not.exist(err);
+            should.exist(delivered);
+            delivered.should.be.below(250);
+            teardown(done);
+          });
         });
       });
     });
@@ -0,0 +1,119 @@
+describe('Pin', function () {
+  var GPIO = pidaeus.GPIO;
+  var Pin = __pidaeus.Pin;
+
+  function fake() {
+    var native = stubHandle(
+        [ 'readSync', 'writeSync', 'toggleSync', 'read', 'write', 'toggle' ]
+      , { err: true, returns: { readSync: one, toggleSync: one } }
+    );
+    var gpio = stubHandle([ 'emit', 'release' ]);
+    return { pin: new Pin(gpio, 17, native), gpio: gpio, native: native };
+  }
+
+  function one() {
+    return 1;
+  }
+
+  describe('(bound)', function () {
+    it('should call straight through to the native pin', function () {
+      var f = fake();
+      f.pin.readSync().should.equal(1);
+      f.pin.writeSync(0);
+      f.pin.toggleSync().should.equal(1);
+      f.native.calls.should.eql([ [ 'readSync' ], [ 'writeSync', 0 ], [ 'toggleSync' ] ]);
+    });
+
+    it('should hand async errors to the callback', function (done) {
+      var f = fake();
+      f.pin.write(1, function (err) {
+        err.message.should.equal('write failed');
+        f.gpio.calls.should.have.length(0);
+        done();
+      });
+    });
+
+    it('should emit async errors on the gpio without a callback', function () {
+      var f = fake();
+      f.pin.read();
+      f.pin.toggle();
+      f.gpio.calls.should.have.length(2);
+      f.gpio.calls[1][0].should.equal('emit');
+      f.gpio.calls[1][2].message.should.equal('toggle failed');
+    });
+
+    it('should release through the gpio', function (done) {
+      var f = fake();
+      f.pin.release(function () {
+        f.gpio.calls.should.eql([ [ 'release', 17 ] ]);
+        done();
+      });
+    });
+  });
+
+  describe('GPIO .pin()', function () {
+    it('should report a pin the binding cannot bind', function (done) {
+      var gpio = new GPIO;
+      gpio.claim = function (pin, opts, cb) { cb(); };
+      gpio._handle = stubHandle([ 'bindPin' ]);
+      gpio.pin(17, function (err, pin) {
+        should.exist(err);
+        err.message.should.match(/cannot be bound/);
+        should.not.exist(pin);
+        done();
+      });
+    });
+
+    it('should report a failed claim', function (done) {
+      var gpio = new GPIO;
+      gpio.pin(17, { direction: 1 }, function (err) {
+        should.exist(err);
+        err.message.should.match(/not ready/);
+        done();
+      });
+    });
+
+    describe('(simulated)', function () {
+      function setup(cb) {
+        var gpio = new GPIO({ simulate: true });
+        gpio.setup(function (err) {
+          should.not.exist(err);
+          gpio.pin(17, { direction: 1 }, function (err, pin) {
+            should.not.exist(err);
+            cb(gpio, pin, function (done) {
+              gpio.teardown(done);
+            });
+          });
+        });
+      }
+
+      it('should drive a claimed output', function (done) {
+        setup(function (gpio, pin, teardown) {
+          pin.pin.should.equal(17);
+          pin.writeSync(0);
+          pin.toggleSync().should.equal(1);
+          pin.toggleSync().should.equal(0);
+          (function () { pin.readSync(); }).should.throw(/not readable/);
+          teardown(done);
+        });
+      });
+
+      it('should fail once released, even if reclaimed', function (done) {
+        setup(function (gpio, pin, teardown) {
+          pin.release(function (err) {
+            should.not.exist(err);
+            (function () { pin.writeSync(1); }).should.throw(/released/);
+
+            gpio.claim(17, { direction: 1 }, function (err) {
+              should.not.exist(err);
+              (function () { pin.writeSync(1); }).should.throw(/released/);
+              (function () { pin.write(1, done); }).should.throw(/released/);
+              (function () { pin.read(done); }).should.throw(/released/);
+              teardown(done);
+            });
+          });
+        });
+      });
+    });
+  });
+});
@@ -0,0 +1,145 @@
+describe('Program', function () {
+  var GPIO = pidaeus.GPIO;
+  var Program = pidaeus.Program;
+
+  function insn(buf, i) {
+    return [
+        buf.readUInt8(i * 8)
+      , buf.readUInt8(i * 8 + 1)
+      , buf.readUInt16LE(i * 8 + 2)
+      , buf.readUInt32LE(i * 8 + 4)
+    ];
+  }
+
+  describe('.toBuffer()', function () {
+    it('should encode 8 byte instructions', function () {
+      var buf = new Program()
+        .write(23, 1)
+        .delay(10000)
+        .set(0x80000000)
+        .waitEdge(24, 'falling', 30000)
+        .record('event')
+        .end()
+        .toBuffer();
+
+      buf.length.should.equal(48);
+      insn(buf, 0).should.eql([ Program.OPS.write, 23, 0, 1 ]);
+      insn(buf, 1).should.eql([ Program.OPS.delay, 0, 0, 10000 ]);
+      insn(buf, 2).should.eql([ Program.OPS.set, 0, 0, 0x80000000 ]);
+      insn(buf, 3).should.eql([ Program.OPS.waitEdge, 24, 2, 30000 ]);
+      insn(buf, 4).should.eql([ Program.OPS.record, 0, 1, 0 ]);
+      insn(buf, 5).should.eql([ Program.OPS.end, 0, 0, 0 ]);
+    });
+
+    it('should resolve labels, forward and back', function () {
+      var buf = new Program()
+        .load(1, 3)
+        .label('top')
+        .jumpTimeout('done')
+        .loop(1, 'top')
+        .label('done')
+        .toBuffer();
+
+      insn(buf, 1).should.eql([ Program.OPS.jumpTimeout, 0, 0, 3 ]);
+      insn(buf, 2).should.eql([ Program.OPS.loop, 1, 0, 1 ]);
+    });
+
+    it('should encode an empty program as one end', function () {
+      insn(new Program().toBuffer(), 0).should.eql([ 0, 0, 0, 0 ]);
+    });
+
+    it('should throw on an unknown label', function () {
+      (function () {
+        new Program().jump('nowhere').toBuffer();
+      }).should.throw(/unknown label nowhere/);
+    });
+  });
+
+  describe('names', function () {
+    it('should map record sources', function () {
+      var buf = new Program()
+        .record('elapsed')
+        .record('reg', 2)
+        .record('levels')
+        .toBuffer();
+
+      insn(buf, 0).should.eql([ Program.OPS.record, 0, 0, 0 ]);
+      insn(buf, 1).should.eql([ Program.OPS.record, 2, 2, 0 ]);
+      insn(buf, 2).should.eql([ Program.OPS.record, 0, 3, 0 ]);
+    });
+
+    it('should throw on an unknown record source', function () {
+      (function () {
+        new Program().record('elapse');
+      }).should.throw(/unknown record source/);
+      (function () {
+        new Program().record('toString');
+      }).should.throw(/unknown record source/);
+    });
+
+    it('should throw on an unknown edge', function () {
+      (function () {
+        new Program().waitEdge(4, 'up');
+      }).should.throw(/unknown edge/);
+    });
+
+    it('should wait for both edges by default', function () {
+      insn(new Program().waitEdge(4).toBuffer(), 0)[2].should.equal(3);
+    });
+  });
+
+  describe('GPIO .runProgram()', function () {
+    it('should report an interface that is not ready', function (done) {
+      var gpio = new GPIO;
+      gpio.runProgram(new Program().end(), function (err) {
+        should.exist(err);
+        err.message.should.match(/not ready/);
+        done();
+      });
+    });
+
+    describe('(simulated)', function () {
+      function setup(cb) {
+        var gpio = new GPIO({ simulate: true });
+        gpio.setup(function (err) {
+          should.not.exist(err);
+          gpio.claim(17, { direction: 1 }, function (err) {
+            should.not.exist(err);
+            cb(gpio, function (done) {
+              gpio.teardown(done);
+            });
+          });
+        });
+      }
+
+      it('should refuse writes to pins not claimed as outputs', function (done) {
+        setup(function (gpio, teardown) {
+          (function () {
+            gpio.runProgram(new Program().write(18, 1), function () {});
+          }).should.throw(/not claimed as outputs/);
+          (function () {
+            gpio.runProgram(new Program().set(1 << 17 | 1 << 18), function () {});
+          }).should.throw(/not claimed as outputs/);
+          teardown(done);
+        });
+      });
+
+      it('should run a program on claimed outputs', function (done) {
+        setup(function (gpio, teardown) {
+          var program = new Program()
+            .mark()
+            .set(1 << 17)
+            .clr(1 << 17)
+            .record('elapsed');
+
+          gpio.runProgram(program, function (err, records) {
+            should.not.exist(err);
+            records.length.should.equal(8);
+            records.readDoubleLE(0).should.be.at.least(0);
+            teardown(done);
+          });
+        });
+      });
+    });
+  });
+});
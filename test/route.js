@@ -0,0 +1,130 @@
+describe('GPIO (route)', function () {
+  var GPIO = pidaeus.GPIO;
+
+  function stub(gpio) {
+    gpio._handle = stubHandle([ 'routeStart', 'routeStop', 'routeStats' ]);
+    return gpio;
+  }
+
+  function started(gpio, i) {
+    var call = gpio._handle.calls[i];
+    call[0].should.equal('routeStart');
+    return { rules: call[1], rate: call[2] };
+  }
+
+  describe('before setup', function () {
+    it('should throw from .route()', function () {
+      var gpio = new GPIO;
+      (function () {
+        gpio.route([ { op: 'copy', inputs: 4, output: 17 } ]);
+      }).should.throw(/not ready/);
+    });
+
+    it('should make .unroute() a no-op', function () {
+      var gpio = new GPIO;
+      (function () { gpio.unroute(); }).should.not.throw();
+      should.equal(gpio.getRouteStats(), null);
+    });
+  });
+
+  describe('.route()', function () {
+    it('should convert rules to native ops and masks', function () {
+      var gpio = stub(new GPIO);
+      gpio.route([
+          { op: 'copy', inputs: 4, output: 17 }
+        , { op: 'and', inputs: [ 5, 6 ], output: 18 }
+        , { op: 'latch', inputs: 7, reset: [ 8 ], output: 19, edge: 'falling' }
+        , { op: 'toggle', inputs: 9, output: 20, edge: 'both' }
+      ]);
+
+      started(gpio, 0).rules.should.eql([
+          { op: 0, inputs: 1 << 4, reset: 0, output: 17, edge: 1 }
+        , { op: 2, inputs: 1 << 5 | 1 << 6, reset: 0, output: 18, edge: 1 }
+        , { op: 7, inputs: 1 << 7, reset: 1 << 8, output: 19, edge: 2 }
+        , { op: 8, inputs: 1 << 9, reset: 0, output: 20, edge: 3 }
+      ]);
+    });
+
+    it('should default to a rate that does not spin', function () {
+      var gpio = stub(new GPIO);
+      gpio.route([ { op: 'copy', inputs: 4, output: 17 } ]);
+      started(gpio, 0).rate.should.equal(1000);
+    });
+
+    it('should pass an explicit rate, including 0', function () {
+      var gpio = stub(new GPIO);
+      gpio.route([ { op: 'copy', inputs: 4, output: 17 } ], { rate: 0 });
+      gpio.route([ { op: 'copy', inputs: 4, output: 17 } ], { rate: 250 });
+      started(gpio, 0).rate.should.equal(0);
+      started(gpio, 1).rate.should.equal(250);
+    });
+
+    it('should reject unknown ops and input pins outside bank 0', function () {
+      var gpio = stub(new GPIO);
+      (function () {
+        gpio.route([ { op: 'nope', inputs: 4, output: 17 } ]);
+      }).should.throw(TypeError);
+      (function () {
+        gpio.route([ { op: 'or', inputs: [ 4, 32 ], output: 17 } ]);
+      }).should.throw(RangeError);
+      gpio._handle.calls.should.have.length(0);
+    });
+  });
+
+  describe('(simulated)', function () {
+    function setup(cb) {
+      var gpio = new GPIO({ simulate: true });
+      gpio.setup(function (err) {
+        should.not.exist(err);
+        gpio.claim(17, { direction: 1 }, function (err) {
+          should.not.exist(err);
+          gpio.claim(18, { direction: 1 }, function (err) {
+            should.not.exist(err);
+            cb(gpio, function (done) {
+              gpio.unroute();
+              gpio.teardown(done);
+            });
+          });
+        });
+      });
+    }
+
+    it('should refuse outputs that are not claimed', function (done) {
+      setup(function (gpio, teardown) {
+        (function () {
+          gpio.route([ { op: 'copy', inputs: 4, output: 19 } ]);
+        }).should.throw(/not claimed as an output/);
+        teardown(done);
+      });
+    });
+
+    it('should refuse an output feeding a rule', function (done) {
+      setup(function (gpio, teardown) {
+        (function () {
+          gpio.route([
+              { op: 'copy', inputs: 4, output: 17 }
+            , { op: 'invert', inputs: 17, output: 18 }
+          ]);
+        }).should.throw(/cannot be a rule input/);
+        teardown(done);
+      });
+    });
+
+    it('should refuse writes and release of routed outputs', function (done) {
+      setup(function (gpio, teardown) {
+        gpio.route([ { op: 'copy', inputs: 4, output: 17 } ]);
+        gpio.getRouteStats().should.have.property('scans');
+
+        (function () { gpio.write(17, 1); }).should.throw(/routed/);
+        (function () { gpio.release(17); }).should.throw(/routed/);
+        (function () { gpio._handle.bindPin(17); }).should.throw(/routed/);
+
+        gpio.unroute();
+        gpio.write(17, 1, function (err) {
+          should.not.exist(err);
+          teardown(done);
+        });
+      });
+    });
+  });
+});
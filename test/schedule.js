@@ -0,0 +1,166 @@
+describe('GPIO (schedule)', function () {
+  var GPIO = pidaeus.GPIO;
+
+  function stub(gpio) {
+    gpio._handle = stubHandle(
+        [ 'schedNow', 'schedule', 'schedCancel', 'schedStop' ]
+      , { returns: { schedNow: now, schedule: ids, schedCancel: first } }
+    );
+    return gpio;
+  }
+
+  function now() {
+    return 42;
+  }
+
+  function ids(buf) {
+    var res = new Buffer(buf.length / 2);
+    for (var i = 0; i < buf.length / 16; i++) res.writeDoubleLE(i + 1, i * 8);
+    return res;
+  }
+
+  function first(id) {
+    return id === 1;
+  }
+
+  // Buffer handed to the native schedule() by call `i`
+  function packed(gpio, i) {
+    return gpio._handle.calls[i || 0][1];
+  }
+
+  function record(buf, i) {
+    return {
+        at: buf.readDoubleLE(i * 16)
+      , set: buf.readUInt32LE(i * 16 + 8)
+      , clr: buf.readUInt32LE(i * 16 + 12)
+    };
+  }
+
+  describe('before setup', function () {
+    it('should throw from .now() and .schedule()', function () {
+      var gpio = new GPIO;
+      (function () { gpio.now(); }).should.throw(/not ready/);
+      (function () { gpio.schedule([]); }).should.throw(/not ready/);
+    });
+
+    it('should make .cancel() and .unschedule() no-ops', function () {
+      var gpio = new GPIO;
+      gpio.cancel(1).should.equal(false);
+      (function () { gpio.unschedule(); }).should.not.throw();
+      should.equal(gpio.getScheduleStats(), null);
+    });
+  });
+
+  describe('.schedule()', function () {
+    it('should pack pin writes into set and clear masks', function () {
+      var gpio = stub(new GPIO);
+      gpio.schedule([
+          { at: 1000, pin: 17, value: 1 }
+        , { at: 2000, pin: 17, value: 0 }
+      ]);
+
+      var buf = packed(gpio);
+      buf.length.should.equal(32);
+      record(buf, 0).should.eql({ at: 1000, set: 1 << 17, clr: 0 });
+      record(buf, 1).should.eql({ at: 2000, set: 0, clr: 1 << 17 });
+    });
+
+    it('should pack pin lists, including pin 31', function () {
+      var gpio = stub(new GPIO);
+      gpio.schedule([ { at: 5, set: [ 4, 31 ], clr: 5 } ]);
+      record(packed(gpio), 0).should.eql({ at: 5, set: 0x80000010, clr: 0x20 });
+    });
+
+    it('should merge a pin into its record masks', function () {
+      var gpio = stub(new GPIO);
+      gpio.schedule([ { at: 5, set: 4, pin: 6, value: true } ]);
+      record(packed(gpio), 0).set.should.equal(0x50);
+    });
+
+    it('should reject pins outside bank 0', function () {
+      var gpio = stub(new GPIO);
+      (function () {
+        gpio.schedule([ { at: 5, pin: 32, value: 1 } ]);
+      }).should.throw(RangeError);
+      (function () {
+        gpio.schedule([ { at: 5, set: [ -1 ] } ]);
+      }).should.throw(RangeError);
+      gpio._handle.calls.should.have.length(0);
+    });
+
+    it('should pass a packed Buffer and capacity through', function () {
+      var gpio = stub(new GPIO);
+      var buf = new Buffer(16);
+      buf.fill(0);
+      gpio.schedule(buf, { capacity: 64 });
+      gpio._handle.calls[0].should.eql([ 'schedule', buf, 64 ]);
+    });
+
+    it('should return one numeric id per write', function () {
+      var gpio = stub(new GPIO);
+      gpio.schedule([
+          { at: 1, pin: 4, value: 1 }
+        , { at: 2, pin: 4, value: 0 }
+      ]).should.eql([ 1, 2 ]);
+    });
+  });
+
+  describe('.now(), .cancel() and .unschedule()', function () {
+    it('should proxy to the handle', function () {
+      var gpio = stub(new GPIO);
+      gpio.now().should.equal(42);
+      gpio.cancel(1).should.equal(true);
+      gpio.cancel(2).should.equal(false);
+      gpio.unschedule();
+      gpio._handle.calls.pop().should.eql([ 'schedStop' ]);
+    });
+  });
+
+  describe('(simulated)', function () {
+    function setup(cb) {
+      var gpio = new GPIO({ simulate: true });
+      gpio.setup(function (err) {
+        should.not.exist(err);
+        cb(gpio, function (done) {
+          gpio.teardown(done);
+        });
+      });
+    }
+
+    it('should refuse pins not claimed as outputs', function (done) {
+      setup(function (gpio, teardown) {
+        (function () {
+          gpio.schedule([ { at: gpio.now(), pin: 17, value: 1 } ]);
+        }).should.throw(/not claimed as outputs/);
+        teardown(done);
+      });
+    });
+
+    it('should refuse a Buffer of partial records', function (done) {
+      setup(function (gpio, teardown) {
+        (function () {
+          gpio.schedule(new Buffer(8));
+        }).should.throw(/16 bytes/);
+        teardown(done);
+      });
+    });
+
+    it('should fire writes to a claimed output', function (done) {
+      setup(function (gpio, teardown) {
+        gpio.claim(17, { direction: 1 }, function (err) {
+          should.not.exist(err);
+          var ids = gpio.schedule([ { at: gpio.now(), pin: 17, value: 1 } ]);
+          ids.should.have.length(1);
+
+          setTimeout(function () {
+            var stats = gpio.getScheduleStats();
+            stats.should.have.property('fired', 1);
+            gpio.cancel(ids[0]).should.equal(false);
+            gpio.unschedule();
+            teardown(done);
+          }, 20);
+        });
+      });
+    });
+  });
+});